@@ -29,7 +29,11 @@ Copyright (c) 2015 Ryan Neve <Ryan@PlanktosInstruments.com>
 
 void Atlas::begin(HardwareSerial *serial,const uint32_t baud_rate) {
 	// Need to do this at least once
-	Serial_AS = serial;
+	_serial_transport.setSerial(serial);
+	begin(&_serial_transport,baud_rate);
+}
+void Atlas::begin(AtlasTransport *transport,const uint32_t baud_rate) {
+	Serial_AS = transport;
 	begin(baud_rate);
 }
 void Atlas::begin(const uint32_t baud_rate) {
@@ -39,7 +43,7 @@ void Atlas::begin(const uint32_t baud_rate) {
 }
 void Atlas::begin() {
 	// To re-establish communications
-	Serial_AS->begin(_baud_rate << CLKPR);
+	Serial_AS->begin(_clock->baudRate(_baud_rate));
 	flushSerial();
 }
 
@@ -48,11 +52,14 @@ uint16_t Atlas::flushSerial(){
 	uint16_t flushed = 0;
 	char flush_char;
 	if (debug()) Serial.print(F("Flushing:"));
+	_framer.setDataBuffer(NULL,0); // stale data lines are dropped, but events still get through
 	while (Serial_AS->available()) {
 		flush_char = Serial_AS->read();
 		if (debug()) Serial.print(flush_char);
+		_frameByte(flush_char);
 		flushed++;
 	}
+	_framer.setDataBuffer(_result,ATLAS_SERIAL_RESULT_LEN);
 	if (debug()) { Serial.print(F("\r\nFlushed:")); Serial.println(flushed);}
 	return flushed;
 }
@@ -73,39 +80,217 @@ void Atlas::setOffline() {
 	_online = false;
 }
 
-int16_t Atlas::_delayUntilSerialData(uint32_t delay_millis) const{
+void Atlas::service() {
+	if ( offline() ) return;
+	_listen();
+	if ( _health == ATLAS_HEALTH_OPEN && ATLAS_TIME_DIFF(_clock->millis(),_next_probe) >= 0 ) {
+		if ( debug() ) Serial.println(F("Probing unresponsive circuit"));
+		_probe(); // _failFast() moves us to half-open, so this will actually be sent.
+	}
+	if ( _needs_init ) {
+		_needs_init = false;
+		if ( debug() ) Serial.println(F("Circuit recovered, re-initializing"));
+		initialize();
+	}
+}
+
+void Atlas::resetHealth() {
+	_health = ATLAS_HEALTH_CLOSED;
+	_failures = 0;
+	_backoff = ATLAS_BACKOFF_MIN;
+}
+
+bool Atlas::_failFast() {
+	if ( _health != ATLAS_HEALTH_OPEN ) return false;
+	if ( ATLAS_TIME_DIFF(_clock->millis(),_next_probe) < 0 ) return true;
+	_health = ATLAS_HEALTH_HALF_OPEN; // Let this one through as the probe
+	return false;
+}
+
+bool Atlas::_beginCommand() {
+	if ( ! _command_open ) {
+		_command_open = true;
+		_command_sent = online() && ! _failFast(); // a probe that falls due part way through waits for the next command
+	}
+	return _command_sent;
+}
+
+bool Atlas::_commandSent() {
+	bool sent = _beginCommand(); // nothing was written: decide now
+	_command_open = false;
+	return sent;
+}
+
+void Atlas::_commandSucceeded() {
+	if ( _latency && _reply_seen ) _latency->add(_first_byte_millis - _request_millis);
+	if ( _health != ATLAS_HEALTH_CLOSED ) {
+		_needs_init = true; // it may have been power cycled while we weren't looking
+		if ( debug() ) Serial.println(F("Circuit responding again"));
+	}
+	resetHealth();
+}
+
+void Atlas::_commandFailed() {
+	_timeouts++;
+	if ( _health == ATLAS_HEALTH_HALF_OPEN ) {
+		// Probe failed. Wait twice as long before the next one.
+		_backoff = ( _backoff >= ATLAS_BACKOFF_MAX / 2 ) ? ATLAS_BACKOFF_MAX : _backoff * 2;
+	}
+	else if ( ++_failures < ATLAS_BREAKER_THRESHOLD ) return;
+	_health = ATLAS_HEALTH_OPEN;
+	_next_probe = _clock->millis() + _backoff;
+	if ( debug() ) { Serial.print(F("Circuit unresponsive, next probe in ")); Serial.println(_backoff);}
+}
+
+void Atlas::_markRequest() {
+	_request_millis = _clock->millis();
+	_reply_seen = false;
+	_framer.reset(); // a partial line left from before belongs to nothing
+	_code_pending = false;
+}
+
+void Atlas::_stampReading() {
+	if ( ! _reply_seen ) return; // Nothing came back, keep the times of the last good reading
+	_reading_request_millis = _request_millis;
+	_reading_millis = _first_byte_millis;
+}
+
+int16_t Atlas::_delayUntilSerialData(uint32_t delay_millis) {
 	if ( offline() ) return -1;
-	uint32_t _request_start = millis();
+	uint32_t _request_start = _clock->millis();
 	int16_t peek_byte;
-	while ( (millis() - _request_start) <= delay_millis)
+	while ( (_clock->millis() - _request_start) <= delay_millis)
 	{
 		peek_byte = Serial_AS->peek();
 		if ( peek_byte == 13 ) Serial_AS->read(); // pop off a CR.
-		else if ( peek_byte != -1 ) return peek_byte;
+		else if ( peek_byte != -1 ) {
+			if ( ! _reply_seen ) {
+				_first_byte_millis = _clock->millis();
+				_reply_seen = true;
+			}
+			return peek_byte;
+		}
+		else _clock->idle();
 	}
 	return -1;
 }
 
-void Atlas::_getResult(const uint16_t result_delay){
-	// read last message from Serial_AS and save it to _result.
-	if ( debug()) {
-		if ( result_delay ) Serial.print(_delayUntilSerialData(result_delay));
-		else Serial.print(F("noDelay"));
+atlas_frame_type Atlas::_getResult(const uint16_t result_delay){
+	// read the next result line from Serial_AS into _result. Events ("*RS" etc.) in front of it are skipped.
+	_result_len = 0;
+	_result[0] = 0;
+	atlas_frame_type frame = ATLAS_FRAME_NONE;
+	if ( online() ) frame = _readFrame(ATLAS_LINE_TIMEOUT + result_delay, true);
+	if ( frame == ATLAS_FRAME_RESPONSE ) _code_pending = true; // e.g. "*ER" instead of a result
+	if ( debug()) { Serial.print(F("Got ")); Serial.print(_result_len); Serial.print(F(" byte result:")); Serial.println(_result);}
+	return frame;
+}
+
+atlas_frame_type Atlas::_frameByte(const char c) {
+	if ( ! _reply_seen && c != '\r' ) {
+		_first_byte_millis = _clock->millis();
+		_reply_seen = true;
 	}
-	if ( online() ) {
-		Serial_AS->setTimeout(3000);
-		_result_len = Serial_AS->readBytesUntil('\r',_result,ATLAS_SERIAL_RESULT_LEN);
-		Serial_AS->setTimeout(1000); // default
+	atlas_frame_type frame = _framer.push(c);
+	if ( frame == ATLAS_FRAME_DATA && _framer.data() == _result ) _result_len = _framer.dataLength();
+	else if ( frame == ATLAS_FRAME_EVENT ) _frameEvent(_framer.code());
+	return frame;
+}
+
+atlas_frame_type Atlas::_readFrame(const uint32_t timeout, const bool want_data) {
+	atlas_frame_type frame = ATLAS_FRAME_NONE;
+	uint32_t start = _clock->millis();
+	if ( ! want_data ) _framer.setDataBuffer(NULL,0);
+	while ( frame != ATLAS_FRAME_RESPONSE && ! ( want_data && frame == ATLAS_FRAME_DATA ) && ! _code_pending ) {
+		int c = Serial_AS->read();
+		if ( c >= 0 ) frame = _frameByte(c);
+		else if ( _clock->millis() - start > timeout ) { frame = ATLAS_FRAME_NONE; break;}
+		else _clock->idle();
 	}
-	else _result_len = 0;
-	_result[_result_len] = 0; // null terminate
-	if ( debug()) { Serial.print(F("Got ")); Serial.print(_result_len); Serial.print(F(" byte result:")); Serial.println(_result);}
+	_framer.setDataBuffer(_result,ATLAS_SERIAL_RESULT_LEN);
+	return frame;
+}
+
+void Atlas::_putCommand(const char * str) {
+	while ( *str ) _putChar(*str++);
+}
+
+void Atlas::_putChar(const char c) {
+	if ( _beginCommand() ) Serial_AS->write((uint8_t)c);
+	if ( debug() ) {
+		if ( c == '\r' ) Serial.println(F("<CR>"));
+		else Serial.write(c);
+	}
+}
+
+void Atlas::_putUInt(uint32_t value) {
+	// Most significant digit first, so no buffer is needed.
+	uint32_t digit = 1;
+	while ( value / digit >= 10 ) digit *= 10;
+	for ( ; digit ; digit /= 10 ) {
+		_putChar('0' + value / digit);
+		value %= digit;
+	}
+}
+
+void Atlas::_putInt(const int32_t value) {
+	if ( value < 0 ) {
+		_putChar('-');
+		_putUInt((uint32_t)(-(value + 1)) + 1); // safe for INT32_MIN
+	}
+	else _putUInt(value);
 }
 
+void Atlas::_putFixed(float value, const uint8_t precision) {
+	// Equivalent to dtostrf(value,0,precision) but without the float formatting library.
+	// %f is not supported by the default AVR printf, which is why this exists.
+	uint32_t scale = 1;
+	for ( uint8_t i = 0 ; i < precision ; i++ ) scale *= 10;
+	bool negative = value < 0;
+	if ( negative ) value = -value;
+	float scaled_f = value * scale + 0.5; // round half away from zero
+	if ( scaled_f != scaled_f ) scaled_f = 0; // NaN
+	else if ( scaled_f > 4.0e9 ) scaled_f = 4.0e9; // Don't overflow uint32_t
+	uint32_t scaled = (uint32_t)scaled_f;
+	if ( negative && scaled ) _putChar('-'); // no "-0.0"
+	_putUInt(scaled / scale);
+	if ( precision ) {
+		_putChar('.');
+		uint32_t fraction = scaled % scale;
+		for ( uint32_t digit = scale / 10 ; digit ; digit /= 10 ) {
+			_putChar('0' + fraction / digit);
+			fraction %= digit;
+		}
+	}
+}
 
 uint8_t Atlas::_strCmp(const char *str1, const char *str2) const {
 	// Compares two strings. returns mismatch or 0 if they match
+	if ( str1 == NULL ) return 1; // strtok() found nothing, e.g. no reply
 	while (*str1 && *str1 == *str2)
 	++str1, ++str2;
 	return *str1;
+}
+
+float Atlas::_nextField(char *&field, char *copy, const uint8_t size) const {
+	// Reads one comma separated number and leaves field at the next one. copy gets the text as sent.
+	// Call it and ignore the value to skip a field.
+	char *end;
+	float value = strtod(field,&end);
+	if ( copy && size ) {
+		uint8_t length = end - field;
+		if ( length >= size ) length = size - 1;
+		memcpy(copy,field,length);
+		copy[length] = '\0';
+	}
+	while ( *end && *end != ',' && *end != '\r' ) end++; // not a number, e.g. a tag
+	field = ( *end == ',' ) ? end + 1 : end;
+	return value;
+}
+
+uint8_t Atlas::_countFields(const char *line) const {
+	if ( !line || !*line || *line == '\r' ) return 0;
+	uint8_t count = 1;
+	for ( ; *line && *line != '\r' ; line++ ) if ( *line == ',' ) count++;
+	return count;
 }
\ No newline at end of file
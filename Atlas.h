@@ -22,10 +22,20 @@ Copyright (c) 2015 Ryan Neve <Ryan@PlanktosInstruments.com>
 #define _Atlas_h
 
 #define ATLAS_SERIAL_RESULT_LEN 50
-#define ATLAS_COMMAND_LENGTH 20
+#define ATLAS_BREAKER_THRESHOLD	3		// consecutive failed commands before we stop trying
+#define ATLAS_BACKOFF_MIN		1000	// first wait before probing an unresponsive circuit
+#define ATLAS_BACKOFF_MAX		300000	// longest wait between probes (5 min)
+#define ATLAS_LINE_TIMEOUT		3000	// longest wait for the rest of a result line
+
+// millis() wraps every 49 days, so always compare times by signed difference.
+#define ATLAS_TIME_DIFF(a,b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)))
 
 #include <Arduino.h>
 #include <HardwareSerial.h>
+#include <AtlasTransport.h>
+#include <AtlasFramer.h>
+#include <AtlasLatency.h>
+#include <AtlasClock.h>
 
 enum tristate {
 	TRI_ON = true,
@@ -33,16 +43,41 @@ enum tristate {
 	TRI_UNKNOWN = 3
 };
 
+enum atlas_health {
+	ATLAS_HEALTH_CLOSED,	// Responding normally
+	ATLAS_HEALTH_OPEN,		// Unresponsive, commands fail fast until the next probe
+	ATLAS_HEALTH_HALF_OPEN	// Probing, the next command decides
+};
+
 class Atlas {
 	public:
 		Atlas() {
 			_connected = false; // No communications seen
 			_online = true; // Only used if there is a multiplexer
 			_debug = false;
+			_reply_seen = false;
+			_reading_request_millis = 0;
+			_reading_millis = 0;
+			_health = ATLAS_HEALTH_CLOSED;
+			_failures = 0;
+			_timeouts = 0;
+			_backoff = ATLAS_BACKOFF_MIN;
+			_next_probe = 0;
+			_command_open = false;
+			_command_sent = false;
+			_needs_init = false;
+			_latency = NULL;
+			_clock = AtlasClock::arduino();
+			_code_pending = false;
+			_result_len = 0;
+			_result[0] = 0;
+			_framer.setDataBuffer(_result,ATLAS_SERIAL_RESULT_LEN);
 		}
+		virtual void	initialize() {} // Overridden by each circuit. Re-run by service() after recovery.
 		void			begin();
 		void			begin(const uint32_t baud_rate);
 		void			begin(HardwareSerial *serial,const uint32_t baud_rate);
+		void			begin(AtlasTransport *transport,const uint32_t baud_rate); // tty, tee, replay...
 		uint32_t		getBaudRate() const {return _baud_rate;}
 		bool			online() const { return _online;} 
 		bool			offline() const { return ! _online;} // Multiplexer switched to different instrument.
@@ -55,20 +90,75 @@ class Atlas {
 		void			debugOff(){_debug = false;}
 		bool			debug() const {return _debug;}
 		uint16_t		flushSerial(); // protected
+		// When the last completed reading was requested and when its first byte arrived, in millis().
+		uint32_t		getReadingRequestTime() const { return _reading_request_millis;}
+		uint32_t		getReadingTime() const { return _reading_millis;}
+		// Circuit breaker. Call service() from loop() to probe unresponsive circuits in the background.
+		void			service();
+		void			listen() { _listen();} // just the first part of service(): take in events, never sends or waits
+		atlas_health	getHealth() const { return _health;}
+		uint32_t		getTimeouts() const { return _timeouts;} // Total commands that got no reply
+		void			resetHealth();
+		void			attachLatency(AtlasLatency *latency) { _latency = latency;} // times every answered command
+		AtlasLatency *	getLatency() const { return _latency;}
+		void			setClock(AtlasClock *clock) { _clock = clock;} // all of its timing, see AtlasClock.h
+		AtlasClock *	getClock() const { return _clock;}
 	protected:
-		HardwareSerial*	Serial_AS;
-		void			_getResult(const uint16_t result_delay); // reads line into _result[]
-		int16_t			_delayUntilSerialData(uint32_t delay_millis) const;
+		AtlasTransport*	Serial_AS;
+		atlas_frame_type	_getResult(const uint16_t result_delay); // reads line into _result[]
+		// Feeds one received byte through the framer. Finished data lines land in _result.
+		atlas_frame_type	_frameByte(const char c);
+		// Reads until a data line or "*OK"/"*ER" is complete, or timeout. Events are handled on the way.
+		// Without want_data, data lines are skipped and _result is left alone.
+		atlas_frame_type	_readFrame(const uint32_t timeout, const bool want_data);
+		virtual void	_frameEvent(const char *) {} // "*RS" etc. from the framer
+		virtual void	_listen() {} // between commands, take in anything the circuit sends on its own
+		void			_requestInit() { _needs_init = true;} // service() will run initialize()
+		int16_t			_delayUntilSerialData(uint32_t delay_millis);
 		uint8_t			_strCmp(const char *str1, const char *str2) const ;
+		float			_nextField(char *&field, char *copy = NULL, const uint8_t size = 0) const; // number at field, then past its comma
+		uint8_t			_countFields(const char *line) const;
 		void			_setConnected(); // Once connected, assume we stay connected.
+		void			_markRequest(); // Command sent, start timing its reply
+		bool			_failFast(); // true if the breaker is open and the command should not be sent
+		bool			_beginCommand(); // whether this command goes out, decided once before its first byte
+		bool			_commandSent(); // what _beginCommand() decided. The next _put*() decides afresh.
+		void			_commandSucceeded();
+		void			_commandFailed();
+		virtual void	_probe() {} // Cheapest command that proves the circuit is alive
+		void			_stampReading(); // Reply parsed as a reading, keep its times
+		// Command encoder. Each call writes straight to Serial_AS, so commands are built in one pass
+		// with no staging buffer and no printf. The whole command is sent or none of it.
+		void			_putCommand(const char * str); // opcode or literal text
+		void			_putChar(const char c);
+		void			_putUInt(uint32_t value);
+		void			_putInt(const int32_t value);
+		void			_putFixed(float value, const uint8_t precision); // fixed point decimal
 		
 		uint32_t		_baud_rate;
 		char			_result[ATLAS_SERIAL_RESULT_LEN]; // Could this be static to save a little memory?
 		uint8_t			_result_len;
-		char			_command[ATLAS_COMMAND_LENGTH]; // Could this be static to save a little memory?
+		uint32_t		_request_millis;	// last command sent
+		uint32_t		_first_byte_millis;	// first byte of its reply
+		bool			_reply_seen;		// _first_byte_millis is valid for _request_millis
+		AtlasFramer		_framer;
+		bool			_code_pending;		// "*OK"/"*ER" came instead of a result, _framer.code() has it
+		AtlasClock *	_clock;
 	private:
 		bool			_debug;
 		bool			_online; // Are we connected? Usually for use with multiplexer.
 		bool			_connected; // Set to true when communications established
+		uint32_t		_reading_request_millis;
+		uint32_t		_reading_millis;
+		atlas_health	_health;
+		uint8_t			_failures;	// consecutive
+		uint32_t		_timeouts;	// total
+		uint32_t		_backoff;
+		uint32_t		_next_probe;
+		bool			_command_open; // _beginCommand() has decided for the command being written
+		bool			_command_sent;
+		bool			_needs_init; // Recovered, run initialize() from service()
+		AtlasLatency *	_latency;
+		AtlasSerialTransport	_serial_transport; // used when begin() is given a HardwareSerial
 };
 #endif
\ No newline at end of file
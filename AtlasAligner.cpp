@@ -0,0 +1,127 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#include <AtlasAligner.h>
+
+/*               PUBLIC METHODS                      */
+
+void AtlasAligner::begin(const uint8_t channels, const uint32_t period, const uint32_t tolerance) {
+	begin(channels,period,tolerance,ATLAS_ALIGN_LINEAR);
+}
+
+void AtlasAligner::begin(const uint8_t channels, const uint32_t period, const uint32_t tolerance, const atlas_align_mode mode) {
+	_channels = ( channels > ATLAS_ALIGN_CHANNELS ) ? ATLAS_ALIGN_CHANNELS : channels;
+	_period = period ? period : 1;
+	_tolerance = tolerance;
+	_mode = mode;
+	clear();
+}
+
+void AtlasAligner::clear() {
+	for ( uint8_t ch = 0 ; ch < ATLAS_ALIGN_CHANNELS ; ch++ ) {
+		_head[ch] = 0;
+		_count[ch] = 0;
+	}
+	_have_frame = false;
+}
+
+void AtlasAligner::push(const uint8_t channel, const uint32_t time, const float value) {
+	if ( channel >= _channels ) return;
+	// Readings normally arrive in order. Drop anything older than what we already hold.
+	if ( _count[channel] ) {
+		uint8_t newest = ( _head[channel] + ATLAS_ALIGN_DEPTH - 1 ) % ATLAS_ALIGN_DEPTH;
+		if ( ATLAS_TIME_DIFF(time,_time[channel][newest]) <= 0 ) return;
+	}
+	_time[channel][_head[channel]] = time;
+	_value[channel][_head[channel]] = value;
+	_head[channel] = ( _head[channel] + 1 ) % ATLAS_ALIGN_DEPTH;
+	if ( _count[channel] < ATLAS_ALIGN_DEPTH ) _count[channel]++;
+}
+
+uint32_t AtlasAligner::latestCommonTime() const {
+	uint32_t common = 0;
+	bool first = true;
+	for ( uint8_t ch = 0 ; ch < _channels ; ch++ ) {
+		if ( ! _count[ch] ) continue;
+		uint8_t newest = ( _head[ch] + ATLAS_ALIGN_DEPTH - 1 ) % ATLAS_ALIGN_DEPTH;
+		if ( first || ATLAS_TIME_DIFF(_time[ch][newest],common) < 0 ) common = _time[ch][newest];
+		first = false;
+	}
+	return common;
+}
+
+bool AtlasAligner::sample(const uint32_t time, atlas_frame *frame) const {
+	// Returns true only if every channel produced a value.
+	frame->time = time;
+	frame->valid = 0;
+	for ( uint8_t ch = 0 ; ch < _channels ; ch++ ) {
+		if ( _sampleChannel(ch,time,&frame->value[ch]) ) frame->valid |= (1 << ch);
+		else frame->value[ch] = NAN;
+	}
+	return frame->valid == (uint8_t)((1 << _channels) - 1);
+}
+
+bool AtlasAligner::frame(atlas_frame *frame) {
+	// Emits the next grid point that all channels have readings at or beyond, so the
+	// frame never has to extrapolate. Returns false if there isn't one yet.
+	for ( uint8_t ch = 0 ; ch < _channels ; ch++ ) if ( ! _count[ch] ) return false;
+	uint32_t common = latestCommonTime();
+	int32_t since_origin = ATLAS_TIME_DIFF(common,_origin);
+	if ( since_origin < 0 ) return false;
+	uint32_t grid = _origin + ( (uint32_t)since_origin / _period ) * _period;
+	if ( _have_frame && ATLAS_TIME_DIFF(grid,_last_frame) <= 0 ) return false; // already sent
+	_last_frame = grid;
+	_have_frame = true;
+	sample(grid,frame);
+	return true;
+}
+
+/*              PRIVATE METHODS                      */
+
+bool AtlasAligner::_sampleChannel(const uint8_t channel, const uint32_t time, float *value) const {
+	uint8_t count = _count[channel];
+	if ( ! count ) return false;
+	// Walk from oldest to newest looking for the readings either side of time.
+	uint8_t oldest = ( _head[channel] + ATLAS_ALIGN_DEPTH - count ) % ATLAS_ALIGN_DEPTH;
+	int8_t before = -1;
+	int8_t after = -1;
+	for ( uint8_t i = 0 ; i < count ; i++ ) {
+		uint8_t slot = ( oldest + i ) % ATLAS_ALIGN_DEPTH;
+		if ( ATLAS_TIME_DIFF(_time[channel][slot],time) <= 0 ) before = slot;
+		else { after = slot; break; }
+	}
+	uint32_t gap_before = ( before >= 0 ) ? (uint32_t)ATLAS_TIME_DIFF(time,_time[channel][before]) : 0xFFFFFFFF;
+	uint32_t gap_after  = ( after  >= 0 ) ? (uint32_t)ATLAS_TIME_DIFF(_time[channel][after],time)  : 0xFFFFFFFF;
+	if ( _mode == ATLAS_ALIGN_LINEAR && before >= 0 && after >= 0 ) {
+		// Only interpolate across a gap we would have been willing to bridge from either end.
+		if ( gap_before > _tolerance && gap_after > _tolerance ) return false;
+		float span = (float)( gap_before + gap_after );
+		*value = _value[channel][before] + ( _value[channel][after] - _value[channel][before] ) * ( gap_before / span );
+		return true;
+	}
+	// Nearest, or only one side available
+	if ( gap_before <= gap_after ) {
+		if ( gap_before > _tolerance ) return false;
+		*value = _value[channel][before];
+	}
+	else {
+		if ( gap_after > _tolerance ) return false;
+		*value = _value[channel][after];
+	}
+	return true;
+}
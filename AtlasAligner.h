@@ -0,0 +1,80 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Groups readings from several sensors into one sample frame on a common
+	time grid. Each channel keeps its last few timestamped values and is
+	resampled (nearest or linear) onto the grid time.
+============================================================================*/
+#ifndef _Atlas_Aligner_h
+#define _Atlas_Aligner_h
+
+#include <Arduino.h>
+#include <Atlas.h>
+
+#ifndef ATLAS_ALIGN_CHANNELS
+	#define ATLAS_ALIGN_CHANNELS 8	// max channels, one bit each in atlas_frame.valid
+#endif
+#ifndef ATLAS_ALIGN_DEPTH
+	#define ATLAS_ALIGN_DEPTH 4		// readings kept per channel
+#endif
+
+enum atlas_align_mode {
+	ATLAS_ALIGN_NEAREST,	// value of the closest reading in time
+	ATLAS_ALIGN_LINEAR		// interpolate between the readings either side
+};
+
+struct atlas_frame {
+	uint32_t	time;	// grid time in millis()
+	uint8_t		valid;	// bit n set if value[n] is good
+	float		value[ATLAS_ALIGN_CHANNELS];
+};
+
+class AtlasAligner {
+	public:
+		AtlasAligner() {
+			_channels = 0;
+			_period = 1000;
+			_origin = 0;
+			_tolerance = 0;
+			_mode = ATLAS_ALIGN_LINEAR;
+			_last_frame = 0;
+			_have_frame = false;
+		}
+		void		begin(const uint8_t channels, const uint32_t period, const uint32_t tolerance);
+		void		begin(const uint8_t channels, const uint32_t period, const uint32_t tolerance, const atlas_align_mode mode);
+		void		setOrigin(const uint32_t origin) { _origin = origin;} // Grid is origin + n * period
+		void		clear();
+		void		push(const uint8_t channel, const uint32_t time, const float value);
+		void		push(const uint8_t channel, const Atlas &sensor, const float value) { push(channel,sensor.getReadingTime(),value);}
+		bool		sample(const uint32_t time, atlas_frame *frame) const; // resample all channels at time
+		bool		frame(atlas_frame *frame); // next grid frame that every channel has reached
+		uint32_t	latestCommonTime() const; // oldest of the channels' newest readings
+	private:
+		bool		_sampleChannel(const uint8_t channel, const uint32_t time, float *value) const;
+		uint8_t		_channels;
+		uint32_t	_period;
+		uint32_t	_origin;
+		uint32_t	_tolerance; // how far from a reading a grid point may be and still use it
+		atlas_align_mode	_mode;
+		uint32_t	_last_frame;
+		bool		_have_frame;
+		uint32_t	_time[ATLAS_ALIGN_CHANNELS][ATLAS_ALIGN_DEPTH];
+		float		_value[ATLAS_ALIGN_CHANNELS][ATLAS_ALIGN_DEPTH];
+		uint8_t		_head[ATLAS_ALIGN_CHANNELS];	// next slot to write
+		uint8_t		_count[ATLAS_ALIGN_CHANNELS];
+};
+#endif
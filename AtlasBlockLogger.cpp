@@ -0,0 +1,132 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#include <AtlasBlockLogger.h>
+
+AtlasBlockLogger::AtlasBlockLogger() {
+	_sink = NULL;
+	_filling = 0;
+	_used = 0;
+	_full = 0;
+	_watched_count = 0;
+	_dropped = 0;
+	_written = 0;
+	_clock = AtlasClock::arduino();
+}
+
+void AtlasBlockLogger::begin(AtlasBlockSink *sink) {
+	_sink = sink;
+}
+
+bool AtlasBlockLogger::watch(EZO *sensor) {
+	if ( _watched_count >= ATLAS_LOG_MAX_WATCHED ) return false;
+	_watched[_watched_count++] = sensor;
+	return true;
+}
+
+bool AtlasBlockLogger::write(const uint8_t *data, const uint16_t length) {
+	// Room in the block being filled plus the free ones after it
+	uint32_t room = ( ATLAS_LOG_BLOCK_SIZE - _used ) + (uint32_t)( ATLAS_LOG_BLOCKS - 1 - _full ) * ATLAS_LOG_BLOCK_SIZE;
+	if ( length > room ) { _dropped++; return false;}
+	uint16_t done = 0;
+	while ( done < length ) {
+		uint16_t chunk = ATLAS_LOG_BLOCK_SIZE - _used;
+		if ( chunk > length - done ) chunk = length - done;
+		memcpy(_blocks[_filling] + _used,data + done,chunk);
+		_used += chunk;
+		done += chunk;
+		if ( _used == ATLAS_LOG_BLOCK_SIZE ) { // full, start the next
+			_full++;
+			_filling = ( _filling + 1 ) % ATLAS_LOG_BLOCKS;
+			_used = 0;
+		}
+	}
+	return true;
+}
+
+bool AtlasBlockLogger::logLine(const char *line) {
+	char buffer[ATLAS_LOG_LINE_LENGTH];
+	uint16_t length = strlen(line);
+	if ( length >= ATLAS_LOG_LINE_LENGTH ) { _dropped++; return false;}
+	memcpy(buffer,line,length);
+	buffer[length++] = '\n';
+	return write((const uint8_t *)buffer,length);
+}
+
+bool AtlasBlockLogger::logReading(EZO *sensor, const char *tag) {
+	char line[ATLAS_LOG_LINE_LENGTH];
+	char value[16];
+	uint8_t length = snprintf(line,sizeof(line),"%lu",(unsigned long)sensor->getReadingTime());
+	uint8_t mask = sensor->getChannelMask();
+	for ( int8_t channel = -1 ; channel < EZO_MAX_CHANNELS ; channel++ ) {
+		const char *field = tag;
+		if ( channel >= 0 ) {
+			if ( !( mask & ( 1 << channel ) ) ) continue;
+			dtostrf(sensor->getValue(channel),1,3,value);
+			// trim "7.250" to "7.25" and "50000.000" to "50000"
+			char *end = value + strlen(value) - 1;
+			if ( strchr(value,'.') ) {
+				while ( *end == '0' ) *end-- = '\0';
+				if ( *end == '.' ) *end = '\0';
+			}
+			field = value;
+		}
+		uint8_t field_length = strlen(field);
+		if ( length + 1 + field_length + 1 >= ATLAS_LOG_LINE_LENGTH ) { _dropped++; return false;}
+		line[length++] = ',';
+		memcpy(line + length,field,field_length);
+		length += field_length;
+	}
+	line[length++] = '\n';
+	return write((const uint8_t *)line,length);
+}
+
+bool AtlasBlockLogger::service() {
+	if ( !_full || !_sink || !_quiet() ) return false;
+	return _writeOldest();
+}
+
+bool AtlasBlockLogger::flush(const uint32_t timeout) {
+	// Each write is one block, so this overruns timeout by at most one block's write time
+	uint32_t start = _clock->millis();
+	if ( !_sink ) return false;
+	while ( _full ) {
+		if ( ATLAS_TIME_DIFF(_clock->millis(),start) >= (int32_t)timeout || !_writeOldest() ) return false;
+	}
+	if ( _used ) {
+		if ( ATLAS_TIME_DIFF(_clock->millis(),start) >= (int32_t)timeout || !_sink->writeBlock(_blocks[_filling],_used) ) return false;
+		_written++;
+		_used = 0;
+	}
+	int32_t left = (int32_t)timeout - ATLAS_TIME_DIFF(_clock->millis(),start);
+	return _sink->sync(left > 0 ? left : 0);
+}
+
+/*              PRIVATE METHODS                      */
+bool AtlasBlockLogger::_writeOldest() {
+	uint8_t oldest = ( _filling + ATLAS_LOG_BLOCKS - _full ) % ATLAS_LOG_BLOCKS;
+	if ( !_sink->writeBlock(_blocks[oldest],ATLAS_LOG_BLOCK_SIZE) ) return false;
+	_full--;
+	_written++;
+	return true;
+}
+
+bool AtlasBlockLogger::_quiet() const {
+	for ( uint8_t i = 0 ; i < _watched_count ; i++ ) if ( _watched[i]->busy() ) return false;
+	return true;
+}
@@ -0,0 +1,96 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Logs readings in whole 512 byte blocks, so the card sees one aligned
+	write per block instead of one small write per reading. log() only
+	copies into the block being filled; full blocks are written by service()
+	while the next one fills, and not while a watched circuit has a command
+	in flight. If storage falls behind and every block is full, records are
+	dropped (getDropped()) rather than making the caller wait.
+	
+		AtlasStreamSink sink(&sd_file);
+		AtlasBlockLogger logger;
+		logger.begin(&sink);
+		logger.watch(&EC_sensor);
+		// in loop():
+		EC_sensor.querySingleReading();
+		logger.logReading(&EC_sensor,"ec");
+		logger.service();
+		// on power fail:
+		logger.flush(50); // ms
+	
+	Each ATLAS_LOG_BLOCKS costs ATLAS_LOG_BLOCK_SIZE bytes of RAM.
+============================================================================*/
+#ifndef _Atlas_Block_Logger_h
+#define _Atlas_Block_Logger_h
+
+#include <Atlas_EZO.h>
+
+#define ATLAS_LOG_BLOCK_SIZE	512 // SD sector
+#ifndef ATLAS_LOG_BLOCKS
+#define ATLAS_LOG_BLOCKS		2	// one filling, one waiting to be written
+#endif
+#define ATLAS_LOG_MAX_WATCHED	8
+#define ATLAS_LOG_LINE_LENGTH	128
+
+// Where the blocks go. writeBlock() gets whole blocks, except the last one from flush().
+class AtlasBlockSink {
+	public:
+		virtual			~AtlasBlockSink() {}
+		virtual bool	writeBlock(const uint8_t *block, const uint16_t length) = 0; // false: try again later
+		virtual bool	sync(const uint32_t) { return true;} // everything written is on the medium
+};
+
+// Any Print, e.g. an SD library File
+class AtlasStreamSink: public AtlasBlockSink {
+	public:
+		AtlasStreamSink(Print *file) { _file = file;}
+		bool			writeBlock(const uint8_t *block, const uint16_t length) { return _file->write(block,length) == length;}
+		bool			sync(const uint32_t) { _file->flush(); return true;}
+	private:
+		Print *			_file;
+};
+
+class AtlasBlockLogger {
+	public:
+		AtlasBlockLogger();
+		void			begin(AtlasBlockSink *sink);
+		bool			watch(EZO *sensor); // service() won't write while it's busy()
+		bool			write(const uint8_t *data, const uint16_t length); // all or nothing
+		bool			logLine(const char *line); // adds the newline
+		bool			logReading(EZO *sensor, const char *tag); // "<reading ms>,<tag>,<value>,..." for each channel
+		bool			service(); // writes at most one full block, true if it did
+		bool			flush(const uint32_t timeout); // full blocks, then the partial one, then sync. false if out of time
+		uint16_t		getPending() const { return _full;} // full blocks not yet written
+		uint32_t		getDropped() const { return _dropped;} // records
+		uint32_t		getBlocksWritten() const { return _written;}
+		void			setClock(AtlasClock *clock) { _clock = clock;} // times flush()
+	private:
+		bool			_writeOldest();
+		bool			_quiet() const;
+		AtlasBlockSink *	_sink;
+		uint8_t			_blocks[ATLAS_LOG_BLOCKS][ATLAS_LOG_BLOCK_SIZE];
+		uint8_t			_filling; // block being filled
+		uint16_t		_used; // bytes in it
+		uint8_t			_full; // blocks waiting, oldest is _filling - _full
+		EZO *			_watched[ATLAS_LOG_MAX_WATCHED];
+		uint8_t			_watched_count;
+		uint32_t		_dropped;
+		uint32_t		_written;
+		AtlasClock *	_clock;
+};
+#endif
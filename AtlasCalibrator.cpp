@@ -0,0 +1,228 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#include <AtlasCalibrator.h>
+#include <math.h>
+
+AtlasCalibrator::AtlasCalibrator() {
+	_sensor = NULL;
+	_do = NULL;
+	_ec = NULL;
+	_ph = NULL;
+	_orp = NULL;
+	_type = EZO_UNKNOWN_CIRCUIT;
+	_point_count = 0;
+	_point = 0;
+	_channel = 0;
+	_state = ATLAS_CAL_IDLE;
+	_error = ATLAS_CAL_OK;
+	_interval = ATLAS_CAL_INTERVAL;
+	_timeout = ATLAS_CAL_TIMEOUT;
+	_reading = false;
+	_head = 0;
+	_count = 0;
+	_slope = 0.0;
+	_stddev = 0.0;
+	setStability(0.0,0.0);
+}
+
+// Defaults are about what the probes settle to in a few minutes. Tighten with setStability().
+void AtlasCalibrator::begin(EZO_DO *sensor) {
+	_begin(sensor,EZO_DO_CIRCUIT); _do = sensor;
+	_channel = EZO_DO_CH_MGL;
+	setStability(0.05,0.02); // mg/L
+}
+void AtlasCalibrator::begin(EZO_EC *sensor) {
+	_begin(sensor,EZO_EC_CIRCUIT); _ec = sensor;
+	_channel = EZO_EC_CH_EC;
+	setStability(0.005,0.002,true); // 0.5 %/min, 0.2 %
+}
+void AtlasCalibrator::begin(EZO_PH *sensor) {
+	_begin(sensor,EZO_PH_CIRCUIT); _ph = sensor;
+	_channel = EZO_PH_CH_PH;
+	setStability(0.02,0.01); // pH
+}
+void AtlasCalibrator::begin(EZO_ORP *sensor) {
+	_begin(sensor,EZO_ORP_CIRCUIT); _orp = sensor;
+	_channel = EZO_ORP_CH_ORP;
+	setStability(1.0,0.5); // mV
+}
+
+bool AtlasCalibrator::addPoint(const atlas_cal_point point, const float standard) {
+	if ( _point_count >= ATLAS_CAL_MAX_POINTS ) return false;
+	_points[_point_count] = point;
+	_standards[_point_count] = standard;
+	_point_count++;
+	return true;
+}
+
+void AtlasCalibrator::setStability(const float max_slope, const float max_stddev, const bool relative) {
+	_max_slope = max_slope;
+	_max_stddev = max_stddev;
+	_relative = relative;
+}
+
+void AtlasCalibrator::start(const bool clear_first) {
+	_error = ATLAS_CAL_OK;
+	_point = 0;
+	if ( _sensor == NULL || _point_count == 0 ) { _fail(ATLAS_CAL_ERR_SETUP); return;}
+	for ( uint8_t i = 0 ; i < _point_count ; i++ ) {
+		bool ok;
+		switch ( _points[i] ) {
+			case ATLAS_CAL_DO_ATM: case ATLAS_CAL_DO_ZERO:	ok = ( _do != NULL ); break;
+			case ATLAS_CAL_PH_MID: case ATLAS_CAL_PH_LOW: case ATLAS_CAL_PH_HIGH:	ok = ( _ph != NULL ); break;
+			case ATLAS_CAL_ORP:								ok = ( _orp != NULL ); break;
+			default:										ok = ( _ec != NULL ); break;
+		}
+		if ( ! ok ) { _fail(ATLAS_CAL_ERR_SETUP); return;}
+	}
+	if ( clear_first ) _sensor->clearCalibration();
+	_state = ATLAS_CAL_WAIT_PROBE;
+}
+
+void AtlasCalibrator::proceed() {
+	if ( _state != ATLAS_CAL_WAIT_PROBE ) return;
+	_head = 0;
+	_count = 0;
+	_slope = 0.0;
+	_stddev = 0.0;
+	_point_start = _sensor->getClock()->millis();
+	_next_reading = _point_start;
+	_state = ATLAS_CAL_SETTLING;
+}
+
+void AtlasCalibrator::abort() {
+	if ( _reading ) {
+		// Bounded: pollCommand() gives up at the command's deadline. idle() yields meanwhile.
+		while ( ! _sensor->pollCommand() ) _sensor->getClock()->idle();
+		_sensor->finishCommand();
+		_reading = false;
+	}
+	_state = ATLAS_CAL_IDLE;
+}
+
+atlas_cal_state AtlasCalibrator::update() {
+	if ( _state != ATLAS_CAL_SETTLING ) return _state;
+	uint32_t now = _sensor->getClock()->millis();
+	if ( _reading ) {
+		if ( ! _sensor->pollCommand() ) return _state;
+		_reading = false;
+		_sensor->finishCommand();
+		if ( ATLAS_TIME_DIFF(_sensor->getReadingRequestTime(),_requested) >= 0 ) { // it replied, so the reading is new
+			_time[_head] = _sensor->getReadingTime();
+			_value[_head] = _sensor->getValue(_channel);
+			_head = ( _head + 1 ) % ATLAS_CAL_WINDOW;
+			if ( _count < ATLAS_CAL_WINDOW ) _count++;
+			if ( _stable() ) {
+				if ( _calibrate(_points[_point],_standards[_point]) != EZO_RESPONSE_OK ) _fail(ATLAS_CAL_ERR_REJECTED);
+				else if ( ++_point < _point_count ) _state = ATLAS_CAL_WAIT_PROBE;
+				else _finish();
+				return _state;
+			}
+		}
+	}
+	if ( ATLAS_TIME_DIFF(now,_point_start) > (int32_t)_timeout ) { _fail(ATLAS_CAL_ERR_TIMEOUT); return _state;}
+	if ( ! _reading && ATLAS_TIME_DIFF(now,_next_reading) >= 0 ) {
+		_next_reading = now + _interval;
+		_requested = now;
+		_reading = _sensor->startReading(); // false while the breaker is open, try again next interval
+	}
+	return _state;
+}
+
+float AtlasCalibrator::getLastValue() const {
+	if ( ! _count ) return NAN;
+	return _value[( _head + ATLAS_CAL_WINDOW - 1 ) % ATLAS_CAL_WINDOW];
+}
+
+/*              PRIVATE METHODS                      */
+
+void AtlasCalibrator::_begin(EZO *sensor, ezo_circuit_type type) {
+	_sensor = sensor;
+	_type = type;
+	_do = NULL; _ec = NULL; _ph = NULL; _orp = NULL;
+	_point_count = 0;
+	_state = ATLAS_CAL_IDLE;
+}
+
+bool AtlasCalibrator::_stable() {
+	// Least squares slope against time (minutes) and the spread of the window.
+	if ( _count < ATLAS_CAL_WINDOW ) return false;
+	uint32_t t0 = _time[_head]; // oldest
+	float mean_t = 0.0, mean_v = 0.0;
+	uint8_t i;
+	for ( i = 0 ; i < _count ; i++ ) {
+		mean_t += ( _time[i] - t0 ) / 60000.0;
+		mean_v += _value[i];
+	}
+	mean_t /= _count;
+	mean_v /= _count;
+	float stt = 0.0, stv = 0.0, svv = 0.0;
+	for ( i = 0 ; i < _count ; i++ ) {
+		float dt = ( _time[i] - t0 ) / 60000.0 - mean_t;
+		float dv = _value[i] - mean_v;
+		stt += dt * dt;
+		stv += dt * dv;
+		svv += dv * dv;
+	}
+	_slope = ( stt > 0.0 ) ? stv / stt : 0.0;
+	_stddev = sqrt(svv / ( _count - 1 ));
+	if ( _points[_point] == ATLAS_CAL_EC_DRY ) { // a fraction of about 0 would never be met
+		return fabs(_slope) <= ATLAS_CAL_DRY_SLOPE && _stddev <= ATLAS_CAL_DRY_STDDEV;
+	}
+	float scale = _relative ? fabs(mean_v) : 1.0;
+	return fabs(_slope) <= _max_slope * scale && _stddev <= _max_stddev * scale;
+}
+
+ezo_response AtlasCalibrator::_calibrate(const atlas_cal_point point, const float standard) {
+	switch ( point ) {
+		case ATLAS_CAL_DO_ATM:	return _do->calibrate(EZO_DO_CAL_ATM);
+		case ATLAS_CAL_DO_ZERO:	return _do->calibrate(EZO_DO_CAL_ZERO);
+		case ATLAS_CAL_EC_DRY:	return _ec->calibrate(EZO_EC_CAL_DRY);
+		case ATLAS_CAL_EC_ONE:	return _ec->calibrate(EZO_EC_CAL_ONE,(uint32_t)standard);
+		case ATLAS_CAL_EC_LOW:	return _ec->calibrate(EZO_EC_CAL_LOW,(uint32_t)standard);
+		case ATLAS_CAL_EC_HIGH:	return _ec->calibrate(EZO_EC_CAL_HIGH,(uint32_t)standard);
+		case ATLAS_CAL_PH_MID:	return _ph->calibrate(EZO_PH_CAL_MID,standard);
+		case ATLAS_CAL_PH_LOW:	return _ph->calibrate(EZO_PH_CAL_LOW,standard);
+		case ATLAS_CAL_PH_HIGH:	return _ph->calibrate(EZO_PH_CAL_HIGH,standard);
+		case ATLAS_CAL_ORP:		return _orp->calibrate(EZO_ORP_CAL_VALUE,standard);
+		default:				return EZO_RESPONSE_UK;
+	}
+}
+
+void AtlasCalibrator::_finish() {
+	// The circuit should now report one point per Cal we sent (dry doesn't count).
+	uint8_t expected = 0;
+	for ( uint8_t i = 0 ; i < _point_count ; i++ ) if ( _points[i] != ATLAS_CAL_EC_DRY ) expected++;
+	_sensor->queryCalibration();
+	uint8_t reported;
+	switch ( _sensor->getCalibration() ) {
+		case EZO_CAL_CALIBRATED:	// ORP
+		case EZO_CAL_SINGLE:		reported = 1; break;
+		case EZO_CAL_DOUBLE:		reported = 2; break;
+		case EZO_CAL_TRIPLE:		reported = 3; break;
+		default:					reported = 0; break;
+	}
+	if ( reported < expected || ( expected == 0 && reported != 0 ) ) _fail(ATLAS_CAL_ERR_VERIFY);
+	else _state = ATLAS_CAL_DONE;
+}
+
+void AtlasCalibrator::_fail(const atlas_cal_error error) {
+	_error = error;
+	_state = ATLAS_CAL_FAILED;
+}
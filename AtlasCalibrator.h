@@ -0,0 +1,141 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Calibrates a DO, EC, pH or ORP circuit. For each point it keeps taking
+	readings until the last ATLAS_CAL_WINDOW of them are stable (small
+	slope and small spread), then sends that point's Cal command. When all
+	points are done it checks the result with queryCalibration().
+	
+		cal.begin(&PH_sensor);
+		cal.addPoint(ATLAS_CAL_PH_MID,7.00);
+		cal.addPoint(ATLAS_CAL_PH_LOW,4.00);
+		cal.start();
+		// in loop():
+		switch ( cal.update() ) {
+			case ATLAS_CAL_WAIT_PROBE: // ask for the probe to go in the next solution, then
+				cal.proceed(); break;
+			...
+		}
+============================================================================*/
+#ifndef _Atlas_Calibrator_h
+#define _Atlas_Calibrator_h
+
+#include <Atlas_EZO_DO.h>
+#include <Atlas_EZO_EC.h>
+#include <Atlas_EZO_ORP.h>
+#include <Atlas_EZO_PH.h>
+
+#define ATLAS_CAL_MAX_POINTS	3
+#define ATLAS_CAL_WINDOW		8		// readings judged for stability
+#define ATLAS_CAL_INTERVAL		1000	// ms between readings
+#define ATLAS_CAL_TIMEOUT		600000	// give up on a point that hasn't settled after 10 min
+#define ATLAS_CAL_DRY_SLOPE		1.0		// uS/cm per minute, for ATLAS_CAL_EC_DRY
+#define ATLAS_CAL_DRY_STDDEV	0.5		// uS/cm
+
+enum atlas_cal_point {
+	ATLAS_CAL_DO_ATM,	// probe in air
+	ATLAS_CAL_DO_ZERO,	// probe in zero oxygen solution
+	ATLAS_CAL_EC_DRY,	// dry probe, before the others
+	ATLAS_CAL_EC_ONE,	// single point, uS/cm
+	ATLAS_CAL_EC_LOW,
+	ATLAS_CAL_EC_HIGH,
+	ATLAS_CAL_PH_MID,	// first, it clears the other pH points
+	ATLAS_CAL_PH_LOW,
+	ATLAS_CAL_PH_HIGH,
+	ATLAS_CAL_ORP,		// mV
+	ATLAS_CAL_NO_POINT	// getPoint() before the first point is added or after the last is done
+};
+
+enum atlas_cal_state {
+	ATLAS_CAL_IDLE,
+	ATLAS_CAL_WAIT_PROBE,	// Waiting for proceed(): probe is in place for the next point
+	ATLAS_CAL_SETTLING,		// Reading until stable
+	ATLAS_CAL_DONE,			// All points taken and the circuit agrees
+	ATLAS_CAL_FAILED		// See getError()
+};
+
+enum atlas_cal_error {
+	ATLAS_CAL_OK,
+	ATLAS_CAL_ERR_TIMEOUT,	// never settled
+	ATLAS_CAL_ERR_REJECTED,	// Cal command didn't get *OK
+	ATLAS_CAL_ERR_VERIFY,	// queryCalibration() reports fewer points than we took
+	ATLAS_CAL_ERR_SETUP		// no points, or a point for a different circuit
+};
+
+class AtlasCalibrator {
+	public:
+		AtlasCalibrator();
+		void			begin(EZO_DO *sensor);
+		void			begin(EZO_EC *sensor);
+		void			begin(EZO_PH *sensor);
+		void			begin(EZO_ORP *sensor);
+		bool			addPoint(const atlas_cal_point point, const float standard = 0.0);
+		// Stable when |slope| <= max_slope per minute and standard deviation <= max_stddev.
+		// Relative: both are fractions of the mean (used for EC, whose range is huge).
+		// The EC dry point reads about 0, so it always uses ATLAS_CAL_DRY_SLOPE and ATLAS_CAL_DRY_STDDEV.
+		void			setStability(const float max_slope, const float max_stddev, const bool relative = false);
+		void			setInterval(const uint32_t interval) { _interval = interval;}
+		void			setTimeout(const uint32_t timeout) { _timeout = timeout;}
+		void			setChannel(const uint8_t channel) { _channel = channel;} // which value to watch
+		void			start(const bool clear_first = true);
+		void			proceed();
+		atlas_cal_state	update(); // call often from loop()
+		void			abort();
+		atlas_cal_state	getState() const { return _state;}
+		atlas_cal_error	getError() const { return _error;}
+		uint8_t			getPointIndex() const { return _point;}
+		atlas_cal_point	getPoint() const { return _point < _point_count ? _points[_point] : ATLAS_CAL_NO_POINT;}
+		float			getLastValue() const; // NAN before the first reading of a point
+		float			getSlope() const { return _slope;} // per minute, over the window
+		float			getStdDev() const { return _stddev;}
+		uint8_t			getReadings() const { return _count;} // in the window so far
+	private:
+		void			_begin(EZO *sensor, ezo_circuit_type type);
+		bool			_stable();
+		ezo_response	_calibrate(const atlas_cal_point point, const float standard);
+		void			_finish();
+		void			_fail(const atlas_cal_error error);
+		EZO *			_sensor;
+		EZO_DO *		_do;
+		EZO_EC *		_ec;
+		EZO_PH *		_ph;
+		EZO_ORP *		_orp;
+		ezo_circuit_type	_type;
+		atlas_cal_point	_points[ATLAS_CAL_MAX_POINTS];
+		float			_standards[ATLAS_CAL_MAX_POINTS];
+		uint8_t			_point_count;
+		uint8_t			_point;
+		uint8_t			_channel;
+		atlas_cal_state	_state;
+		atlas_cal_error	_error;
+		float			_max_slope;
+		float			_max_stddev;
+		bool			_relative;
+		uint32_t		_interval;
+		uint32_t		_timeout;
+		uint32_t		_point_start;
+		uint32_t		_next_reading;
+		uint32_t		_requested; // when the reading in flight was started
+		bool			_reading; // one in flight
+		uint32_t		_time[ATLAS_CAL_WINDOW]; // ring of reading times
+		float			_value[ATLAS_CAL_WINDOW];
+		uint8_t			_head;
+		uint8_t			_count;
+		float			_slope;
+		float			_stddev;
+};
+#endif
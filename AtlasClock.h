@@ -0,0 +1,58 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Where the library gets its time. Everything that times something asks
+	a clock rather than calling millis() and delay() itself, so a circuit,
+	the scheduler and the rest can run on a clock other than the board's:
+	
+		AtlasVirtualClock sim; // host/, time moves only when asked to
+		PH_sensor.setClock(&sim);
+		sched.setClock(&sim);
+	
+	Left alone, everything uses AtlasClock::arduino(). Give the circuits
+	and whatever drives them the same clock, or their times won't compare.
+	
+	delay() is for the fixed waits the EZO circuits need, in real
+	milliseconds. idle() is called by busy waits between polls, which lets
+	a virtual clock move on to the next thing that will happen. baudRate()
+	is what to open a serial port at for a given rate on the wire.
+============================================================================*/
+#ifndef _Atlas_Clock_h
+#define _Atlas_Clock_h
+
+#include <Arduino.h>
+
+class AtlasClock {
+	public:
+		virtual uint32_t	millis() = 0; // wraps, compare with ATLAS_TIME_DIFF()
+		virtual void	delay(const uint32_t ms) = 0;
+		virtual void	idle() {} // nothing to do until something arrives
+		virtual uint32_t	baudRate(const uint32_t baud_rate) { return baud_rate;}
+		static AtlasClock *	arduino(); // the board's own
+};
+
+// millis() and delay() from the Arduino core. On AVR the clock prescaler (CLKPR)
+// slows the core's timer and the UART too, so waits are shortened and baud rates
+// raised to match.
+class AtlasArduinoClock: public AtlasClock {
+	public:
+		uint32_t		millis() { return ::millis();}
+		void			delay(const uint32_t ms) { ::delay(ms >> CLKPR);}
+		void			idle() { yield();}
+		uint32_t		baudRate(const uint32_t baud_rate) { return baud_rate << CLKPR;}
+};
+#endif
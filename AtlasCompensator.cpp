@@ -0,0 +1,199 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#include <AtlasCompensator.h>
+#include <math.h>
+
+AtlasCompensator::AtlasCompensator() {
+	_sensor_count = 0;
+	_input_count = 0;
+	_link_count = 0;
+	_sorted = false;
+	_error = ATLAS_COMP_OK;
+	_sent_count = 0;
+	_skipped_count = 0;
+}
+
+bool AtlasCompensator::addSensor(EZO *sensor) {
+	if ( _find(sensor) != ATLAS_COMP_NONE ) return true;
+	if ( _sensor_count >= ATLAS_COMP_MAX_SENSORS ) { _error = ATLAS_COMP_ERR_FULL; return false;}
+	_sensors[_sensor_count] = sensor;
+	_read_ok[_sensor_count] = false;
+	_use_rt[_sensor_count] = false;
+	_resets[_sensor_count] = sensor->getEventCount(EZO_RESPONSE_RS);
+	_sensor_count++;
+	_sorted = false;
+	return true;
+}
+
+uint8_t AtlasCompensator::addInput() {
+	if ( _input_count >= ATLAS_COMP_MAX_INPUTS ) { _error = ATLAS_COMP_ERR_FULL; return ATLAS_COMP_NONE;}
+	_input_set[_input_count] = false;
+	return _input_count++;
+}
+
+void AtlasCompensator::setInput(const uint8_t input, const float value) {
+	if ( input >= _input_count ) return;
+	_inputs[input] = value;
+	_input_set[input] = true;
+}
+
+bool AtlasCompensator::link(EZO *source, const uint8_t channel, EZO *target, const ezo_compensation kind, const float tolerance) {
+	uint8_t from = _find(source);
+	if ( from == ATLAS_COMP_NONE ) { _error = ATLAS_COMP_ERR_UNKNOWN; return false;}
+	if ( !_addLink(from,channel,_find(target),kind,tolerance) ) return false;
+	_link_input[_link_count - 1] = false;
+	_sorted = false;
+	return true;
+}
+
+bool AtlasCompensator::linkInput(const uint8_t input, EZO *target, const ezo_compensation kind, const float tolerance) {
+	if ( input >= _input_count ) { _error = ATLAS_COMP_ERR_UNKNOWN; return false;}
+	if ( !_addLink(input,0,_find(target),kind,tolerance) ) return false;
+	_link_input[_link_count - 1] = true;
+	return true;
+}
+
+void AtlasCompensator::useReadWithTemp(EZO *target, const bool use) {
+	uint8_t i = _find(target);
+	if ( i != ATLAS_COMP_NONE ) _use_rt[i] = use;
+}
+
+bool AtlasCompensator::wasRead(EZO *sensor) const {
+	uint8_t i = _find(sensor);
+	return i != ATLAS_COMP_NONE && _read_ok[i];
+}
+
+void AtlasCompensator::invalidate() {
+	for ( uint8_t l = 0 ; l < _link_count ; l++ ) _link_valid[l] = false;
+}
+
+uint8_t AtlasCompensator::update() {
+	uint8_t count = 0;
+	for ( uint8_t i = 0 ; i < _sensor_count ; i++ ) _read_ok[i] = false;
+	if ( !_sorted && !_sort() ) return 0;
+	for ( uint8_t n = 0 ; n < _sensor_count ; n++ ) {
+		uint8_t s = _order[n];
+		EZO *sensor = _sensors[s];
+		// A reset circuit has forgotten its compensation
+		uint16_t resets = sensor->getEventCount(EZO_RESPONSE_RS);
+		if ( resets != _resets[s] ) {
+			_resets[s] = resets;
+			for ( uint8_t l = 0 ; l < _link_count ; l++ ) if ( _link_target[l] == s ) _link_valid[l] = false;
+		}
+		uint8_t rt_link = ATLAS_COMP_NONE;
+		float rt_temp = 0.0;
+		for ( uint8_t l = 0 ; l < _link_count ; l++ ) {
+			float value;
+			if ( _link_target[l] != s || !_linkValue(l,value) ) continue;
+			if ( _use_rt[s] && _link_kind[l] == EZO_COMP_TEMP ) { // sent with the reading
+				rt_link = l; rt_temp = value;
+				continue;
+			}
+			if ( !_due(l,value) ) { _skipped_count++; continue;}
+			if ( sensor->setCompensation(_link_kind[l],value) == EZO_RESPONSE_OK ) _sent(l,value);
+		}
+		ezo_response response;
+		uint32_t requested = sensor->getClock()->millis();
+		if ( rt_link != ATLAS_COMP_NONE ) {
+			response = sensor->queryReadingWithTemp(rt_temp);
+			if ( response == EZO_RESPONSE_ER ) { // old firmware, back to T then R
+				if ( sensor->debug() ) Serial.println(F("RT not supported, using T and R"));
+				_use_rt[s] = false;
+				if ( _due(rt_link,rt_temp) && sensor->setCompensation(EZO_COMP_TEMP,rt_temp) == EZO_RESPONSE_OK ) _sent(rt_link,rt_temp);
+				response = sensor->querySingleReading();
+			}
+			else _sent(rt_link,rt_temp);
+		}
+		else response = sensor->querySingleReading();
+		// Only a reading that came back feeds the links. With response codes off there's no *OK, so
+		// look for the reading itself: stamped since the request, and not a failed reply.
+		_read_ok[s] = ( response == EZO_RESPONSE_OK );
+		if ( response == EZO_RESPONSE_UK && sensor->getResult()[0] ) {
+			_read_ok[s] = ATLAS_TIME_DIFF(sensor->getReadingRequestTime(),requested) >= 0;
+		}
+		if ( _read_ok[s] ) count++;
+	}
+	return count;
+}
+
+/*              PRIVATE METHODS                      */
+uint8_t AtlasCompensator::_find(EZO *sensor) const {
+	for ( uint8_t i = 0 ; i < _sensor_count ; i++ ) if ( _sensors[i] == sensor ) return i;
+	return ATLAS_COMP_NONE;
+}
+
+bool AtlasCompensator::_addLink(const uint8_t source, const uint8_t channel, const uint8_t target, const ezo_compensation kind, const float tolerance) {
+	if ( target == ATLAS_COMP_NONE ) { _error = ATLAS_COMP_ERR_UNKNOWN; return false;}
+	if ( _link_count >= ATLAS_COMP_MAX_LINKS ) { _error = ATLAS_COMP_ERR_FULL; return false;}
+	_link_source[_link_count] = source;
+	_link_channel[_link_count] = channel;
+	_link_target[_link_count] = target;
+	_link_kind[_link_count] = kind;
+	_link_tolerance[_link_count] = tolerance;
+	_link_valid[_link_count] = false;
+	_link_count++;
+	return true;
+}
+
+// Kahn's algorithm over the sensor to sensor links: a sensor goes after everything feeding it.
+bool AtlasCompensator::_sort() {
+	uint8_t in_degree[ATLAS_COMP_MAX_SENSORS];
+	uint8_t done = 0;
+	for ( uint8_t i = 0 ; i < _sensor_count ; i++ ) in_degree[i] = 0;
+	for ( uint8_t l = 0 ; l < _link_count ; l++ ) {
+		if ( !_link_input[l] && _link_source[l] != _link_target[l] ) in_degree[_link_target[l]]++;
+	}
+	// _order doubles as the queue: [done, tail) are ready
+	uint8_t tail = 0;
+	for ( uint8_t i = 0 ; i < _sensor_count ; i++ ) if ( in_degree[i] == 0 ) _order[tail++] = i;
+	while ( done < tail ) {
+		uint8_t s = _order[done++];
+		for ( uint8_t l = 0 ; l < _link_count ; l++ ) {
+			if ( _link_input[l] || _link_source[l] != s || _link_target[l] == s ) continue;
+			if ( --in_degree[_link_target[l]] == 0 ) _order[tail++] = _link_target[l];
+		}
+	}
+	if ( done < _sensor_count ) { _error = ATLAS_COMP_ERR_CYCLE; return false;}
+	_error = ATLAS_COMP_OK;
+	_sorted = true;
+	return true;
+}
+
+// Only passes on a value read this cycle, or an input that has been set
+bool AtlasCompensator::_linkValue(const uint8_t link, float &value) const {
+	uint8_t source = _link_source[link];
+	if ( _link_input[link] ) {
+		if ( !_input_set[source] ) return false;
+		value = _inputs[source];
+		return true;
+	}
+	if ( !_read_ok[source] ) return false;
+	value = _sensors[source]->getValue(_link_channel[link]);
+	return true;
+}
+
+bool AtlasCompensator::_due(const uint8_t link, const float value) const {
+	return !_link_valid[link] || fabs(value - _link_sent[link]) > _link_tolerance[link];
+}
+
+void AtlasCompensator::_sent(const uint8_t link, const float value) {
+	_link_sent[link] = value;
+	_link_valid[link] = true;
+	_sent_count++;
+}
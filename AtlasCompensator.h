@@ -0,0 +1,98 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Keeps compensation values flowing between sensors. Declare once which
+	value feeds which compensation, then call update() each cycle: sensors
+	are read sources first, and a compensation is only sent when its value
+	has moved more than the link's tolerance.
+	
+		comp.addSensor(&EC_sensor);
+		comp.addSensor(&DO_sensor);
+		uint8_t water_temp = comp.addInput();
+		comp.linkInput(water_temp, &EC_sensor, EZO_COMP_TEMP, 0.1);
+		comp.linkInput(water_temp, &DO_sensor, EZO_COMP_TEMP, 0.1);
+		comp.link(&EC_sensor, EZO_EC_CH_SAL, &DO_sensor, EZO_COMP_SAL_PPT, 0.5);
+		// in loop():
+		comp.setInput(water_temp, thermistor.read());
+		comp.update();
+============================================================================*/
+#ifndef _Atlas_Compensator_h
+#define _Atlas_Compensator_h
+
+#include <Atlas_EZO.h>
+
+#define ATLAS_COMP_MAX_SENSORS	8
+#define ATLAS_COMP_MAX_LINKS	8
+#define ATLAS_COMP_MAX_INPUTS	4
+#define ATLAS_COMP_NONE			255
+
+enum atlas_comp_error {
+	ATLAS_COMP_OK,
+	ATLAS_COMP_ERR_FULL,	// too many sensors, links or inputs
+	ATLAS_COMP_ERR_UNKNOWN,	// link to a sensor that wasn't added
+	ATLAS_COMP_ERR_CYCLE	// the links loop back on themselves, nothing is read
+};
+
+class AtlasCompensator {
+	public:
+		AtlasCompensator();
+		bool			addSensor(EZO *sensor);
+		uint8_t			addInput(); // ATLAS_COMP_NONE if full
+		void			setInput(const uint8_t input, const float value);
+		// source's channel (see the driver's channel enum) feeds target's compensation
+		bool			link(EZO *source, const uint8_t channel, EZO *target, const ezo_compensation kind, const float tolerance);
+		bool			linkInput(const uint8_t input, EZO *target, const ezo_compensation kind, const float tolerance);
+		// Read target with "RT,<temp>" instead of "T,<temp>" then "R". Falls back for good if the firmware answers *ER.
+		void			useReadWithTemp(EZO *target, const bool use = true);
+		uint8_t			update(); // Number of sensors read successfully
+		bool			wasRead(EZO *sensor) const; // by the last update()
+		void			invalidate(); // resend every compensation on the next update()
+		atlas_comp_error	getError() const { return _error;}
+		uint16_t		getSent() const { return _sent_count;} // compensation commands sent
+		uint16_t		getSkipped() const { return _skipped_count;} // not sent, within tolerance
+	private:
+		uint8_t			_find(EZO *sensor) const;
+		bool			_addLink(const uint8_t source, const uint8_t channel, const uint8_t target, const ezo_compensation kind, const float tolerance);
+		bool			_sort();
+		bool			_linkValue(const uint8_t link, float &value) const;
+		bool			_due(const uint8_t link, const float value) const;
+		void			_sent(const uint8_t link, const float value);
+		EZO *			_sensors[ATLAS_COMP_MAX_SENSORS];
+		uint8_t			_sensor_count;
+		uint8_t			_order[ATLAS_COMP_MAX_SENSORS];
+		bool			_sorted;
+		bool			_read_ok[ATLAS_COMP_MAX_SENSORS];
+		bool			_use_rt[ATLAS_COMP_MAX_SENSORS];
+		uint16_t		_resets[ATLAS_COMP_MAX_SENSORS]; // RS count when last compensated
+		float			_inputs[ATLAS_COMP_MAX_INPUTS];
+		bool			_input_set[ATLAS_COMP_MAX_INPUTS];
+		uint8_t			_input_count;
+		// links: source is a sensor index, or an input when _link_input is set
+		uint8_t			_link_source[ATLAS_COMP_MAX_LINKS];
+		uint8_t			_link_channel[ATLAS_COMP_MAX_LINKS];
+		bool			_link_input[ATLAS_COMP_MAX_LINKS];
+		uint8_t			_link_target[ATLAS_COMP_MAX_LINKS];
+		ezo_compensation	_link_kind[ATLAS_COMP_MAX_LINKS];
+		float			_link_tolerance[ATLAS_COMP_MAX_LINKS];
+		float			_link_sent[ATLAS_COMP_MAX_LINKS]; // value the circuit has now
+		bool			_link_valid[ATLAS_COMP_MAX_LINKS];
+		uint8_t			_link_count;
+		atlas_comp_error	_error;
+		uint16_t		_sent_count;
+		uint16_t		_skipped_count;
+};
+#endif
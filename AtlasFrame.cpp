@@ -0,0 +1,220 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#include <AtlasFrame.h>
+#include <math.h>
+
+#define ATLAS_FRAME_MAX_VALUE	0x3FFFFFFFL // fixed point limit, so differences fit in 32 bits
+
+static const int32_t POWERS_OF_10[ATLAS_FRAME_MAX_DECIMALS + 1] = { 1, 10, 100, 1000, 10000, 100000, 1000000};
+
+// CRC-8 (polynomial 0x07) of the field count and each field's decimals
+static uint8_t schemaId(const uint8_t *decimals, const uint8_t count) {
+	uint8_t crc = 0;
+	for ( int16_t i = -1 ; i < count ; i++ ) {
+		crc ^= ( i < 0 ) ? count : decimals[i];
+		for ( uint8_t bit = 0 ; bit < 8 ; bit++ ) crc = ( crc & 0x80 ) ? ( crc << 1 ) ^ 0x07 : crc << 1;
+	}
+	return crc;
+}
+
+static uint8_t * putZigzag(uint8_t *out, const int32_t value) {
+	uint32_t zigzag = ( (uint32_t)value << 1 ) ^ (uint32_t)( value >> 31 );
+	while ( zigzag >= 0x80 ) { *out++ = zigzag | 0x80; zigzag >>= 7;}
+	*out++ = zigzag;
+	return out;
+}
+
+static const uint8_t * getZigzag(const uint8_t *in, const uint8_t *end, int32_t &value) {
+	uint32_t zigzag = 0;
+	for ( uint8_t shift = 0 ; in < end && shift < 35 ; shift += 7 ) {
+		uint8_t byte = *in++;
+		zigzag |= (uint32_t)( byte & 0x7F ) << shift;
+		if ( !( byte & 0x80 ) ) {
+			value = (int32_t)( zigzag >> 1 ) ^ -(int32_t)( zigzag & 1 );
+			return in;
+		}
+	}
+	return NULL;
+}
+
+/*              ENCODER                      */
+AtlasFrameEncoder::AtlasFrameEncoder() {
+	_field_count = 0;
+	_sequence = 0;
+	_key_interval = ATLAS_FRAME_KEY_INTERVAL;
+	_since_key = 0;
+	_key_due = true; // the first frame
+}
+
+bool AtlasFrameEncoder::addField(EZO *sensor, const uint8_t channel, const uint8_t decimals) {
+	if ( _field_count >= ATLAS_FRAME_MAX_FIELDS || decimals > ATLAS_FRAME_MAX_DECIMALS ) return false;
+	_ezo[_field_count] = sensor;
+	_rgb[_field_count] = NULL;
+	_channel[_field_count] = channel;
+	_decimals[_field_count] = decimals;
+	_reading_time[_field_count] = 0;
+	_status[_field_count] = ATLAS_FIELD_MISSING;
+	_field_count++;
+	_key_due = true;
+	return true;
+}
+
+bool AtlasFrameEncoder::addField(RGB *sensor, const uint8_t channel) {
+	if ( !addField((EZO *)NULL,channel,0) ) return false;
+	_rgb[_field_count - 1] = sensor;
+	return true;
+}
+
+uint8_t AtlasFrameEncoder::getSchemaId() const {
+	return schemaId(_decimals,_field_count);
+}
+
+uint8_t AtlasFrameEncoder::encode(uint8_t *frame, const uint8_t size) {
+	int32_t values[ATLAS_FRAME_MAX_FIELDS];
+	atlas_frame_status status[ATLAS_FRAME_MAX_FIELDS];
+	uint8_t mask_bytes = ( _field_count + 7 ) / 8;
+	uint8_t absent[ATLAS_FRAME_MAX_FIELDS / 8];
+	uint8_t failed[ATLAS_FRAME_MAX_FIELDS / 8];
+	bool any_absent = false;
+	for ( uint8_t i = 0 ; i < mask_bytes ; i++ ) absent[i] = failed[i] = 0;
+	for ( uint8_t field = 0 ; field < _field_count ; field++ ) {
+		status[field] = _read(field,values[field]);
+		if ( status[field] == ATLAS_FIELD_OK ) continue;
+		any_absent = true;
+		absent[field / 8] |= 1 << ( field % 8 );
+		if ( status[field] == ATLAS_FIELD_FAILED ) failed[field / 8] |= 1 << ( field % 8 );
+	}
+	bool key = _key_due || ( _key_interval && _since_key >= _key_interval );
+	// Worst case size before writing anything, so a short buffer leaves the state alone
+	if ( size < 2 + ( any_absent ? 2 * mask_bytes : 0 ) + 5 * _field_count ) return 0;
+	uint8_t *p = frame;
+	*p++ = ( key ? ATLAS_FRAME_KEY : 0 ) | ( any_absent ? ATLAS_FRAME_STATUS : 0 ) | ( _sequence & ATLAS_FRAME_SEQUENCE );
+	*p++ = getSchemaId();
+	if ( any_absent ) {
+		for ( uint8_t i = 0 ; i < mask_bytes ; i++ ) *p++ = absent[i];
+		for ( uint8_t i = 0 ; i < mask_bytes ; i++ ) *p++ = failed[i];
+	}
+	for ( uint8_t field = 0 ; field < _field_count ; field++ ) {
+		if ( status[field] != ATLAS_FIELD_OK ) continue;
+		bool delta = !key && _status[field] == ATLAS_FIELD_OK;
+		p = putZigzag(p,delta ? values[field] - _previous[field] : values[field]);
+		_previous[field] = values[field];
+		_reading_time[field] = _ezo[field] ? _ezo[field]->getReadingTime() : _rgb[field]->getReadingTime();
+	}
+	for ( uint8_t field = 0 ; field < _field_count ; field++ ) _status[field] = status[field];
+	_sequence = ( _sequence + 1 ) & ATLAS_FRAME_SEQUENCE;
+	_since_key = key ? 1 : _since_key + 1;
+	_key_due = false;
+	return p - frame;
+}
+
+/*              ENCODER PRIVATE METHODS                      */
+atlas_frame_status AtlasFrameEncoder::_read(const uint8_t field, int32_t &value) {
+	float reading;
+	if ( _rgb[field] ) {
+		int16_t raw = _rgb[field]->getValue(_channel[field]);
+		if ( raw == NO_SENSOR_DATA ) return ATLAS_FIELD_MISSING;
+		if ( raw == NO_SENSOR_COMMS || raw == SENSOR_COMMS_FAILED ) return ATLAS_FIELD_FAILED;
+		if ( _rgb[field]->getReadingTime() == _reading_time[field] ) return ATLAS_FIELD_FAILED; // nothing new since the last frame
+		reading = raw;
+	}
+	else {
+		EZO *sensor = _ezo[field];
+		if ( !( sensor->getChannelMask() & ( 1 << _channel[field] ) ) ) return ATLAS_FIELD_MISSING;
+		if ( sensor->getHealth() == ATLAS_HEALTH_OPEN ) return ATLAS_FIELD_FAILED;
+		if ( sensor->getReadingTime() == _reading_time[field] ) return ATLAS_FIELD_FAILED; // nothing new since the last frame
+		reading = sensor->getValue(_channel[field]);
+	}
+	float scaled = reading * POWERS_OF_10[_decimals[field]];
+	if ( !( fabs(scaled) <= ATLAS_FRAME_MAX_VALUE ) ) return ATLAS_FIELD_FAILED; // also NaN
+	value = lround(scaled);
+	return ATLAS_FIELD_OK;
+}
+
+/*              DECODER                      */
+AtlasFrameDecoder::AtlasFrameDecoder() {
+	_field_count = 0;
+	_sequence = 0;
+	_synced = false;
+	_key = false;
+}
+
+bool AtlasFrameDecoder::addField(const uint8_t decimals) {
+	if ( _field_count >= ATLAS_FRAME_MAX_FIELDS || decimals > ATLAS_FRAME_MAX_DECIMALS ) return false;
+	_decimals[_field_count] = decimals;
+	_status[_field_count] = ATLAS_FIELD_MISSING;
+	_field_count++;
+	_synced = false;
+	return true;
+}
+
+uint8_t AtlasFrameDecoder::getSchemaId() const {
+	return schemaId(_decimals,_field_count);
+}
+
+atlas_frame_result AtlasFrameDecoder::decode(const uint8_t *frame, const uint8_t length) {
+	const uint8_t *end = frame + length;
+	if ( length < 2 ) return ATLAS_FRAME_SHORT;
+	uint8_t header = frame[0];
+	if ( frame[1] != getSchemaId() ) return ATLAS_FRAME_SCHEMA;
+	bool key = header & ATLAS_FRAME_KEY;
+	uint8_t sequence = header & ATLAS_FRAME_SEQUENCE;
+	if ( !key && ( !_synced || sequence != ( ( _sequence + 1 ) & ATLAS_FRAME_SEQUENCE ) ) ) {
+		_synced = false;
+		_sequence = sequence;
+		return ATLAS_FRAME_GAP;
+	}
+	const uint8_t *p = frame + 2;
+	uint8_t mask_bytes = ( _field_count + 7 ) / 8;
+	const uint8_t *absent = NULL, *failed = NULL;
+	if ( header & ATLAS_FRAME_STATUS ) {
+		if ( end - p < 2 * mask_bytes ) return ATLAS_FRAME_SHORT;
+		absent = p;
+		failed = p + mask_bytes;
+		p += 2 * mask_bytes;
+	}
+	// Decode into copies, so a bad frame leaves the last good one in place
+	int32_t values[ATLAS_FRAME_MAX_FIELDS];
+	atlas_frame_status status[ATLAS_FRAME_MAX_FIELDS];
+	for ( uint8_t field = 0 ; field < _field_count ; field++ ) {
+		uint8_t bit = 1 << ( field % 8 );
+		if ( absent && ( absent[field / 8] & bit ) ) {
+			status[field] = ( failed[field / 8] & bit ) ? ATLAS_FIELD_FAILED : ATLAS_FIELD_MISSING;
+			continue;
+		}
+		int32_t value;
+		if ( !( p = getZigzag(p,end,value) ) ) return ATLAS_FRAME_SHORT;
+		status[field] = ATLAS_FIELD_OK;
+		values[field] = ( !key && _status[field] == ATLAS_FIELD_OK ) ? _value[field] + value : value;
+	}
+	if ( p != end ) return ATLAS_FRAME_SHORT;
+	for ( uint8_t field = 0 ; field < _field_count ; field++ ) {
+		_status[field] = status[field];
+		if ( status[field] == ATLAS_FIELD_OK ) _value[field] = values[field];
+	}
+	_sequence = sequence;
+	_synced = true;
+	_key = key;
+	return ATLAS_FRAME_OK;
+}
+
+float AtlasFrameDecoder::getValue(const uint8_t field) const {
+	if ( field >= _field_count || _status[field] != ATLAS_FIELD_OK ) return NAN;
+	return (float)_value[field] / POWERS_OF_10[_decimals[field]];
+}
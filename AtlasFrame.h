@@ -0,0 +1,115 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Packs readings into small binary frames for a radio uplink, and unpacks
+	them at the other end. Both ends list the same fields in the same order:
+	
+		// station
+		AtlasFrameEncoder frame;
+		frame.addField(&EC_sensor, EZO_EC_CH_EC, 0);	// uS, whole numbers
+		frame.addField(&EC_sensor, EZO_EC_CH_SAL, 2);
+		frame.addField(&DO_sensor, EZO_DO_CH_MGL, 2);
+		uint8_t length = frame.encode(payload, sizeof(payload));
+		
+		// gateway
+		AtlasFrameDecoder frame;
+		frame.addField(0); frame.addField(2); frame.addField(2);
+		if ( frame.decode(payload, length) == ATLAS_FRAME_OK ) ... frame.getValue(1) ...
+	
+	A frame is a header byte (key frame flag, status flag, 6 bit sequence),
+	the schema id, then, if any field is absent, a bitmask of absent fields
+	and a bitmask of which of those failed. Then each present field as a
+	zigzag varint of its fixed point value. The first frame, every
+	setKeyInterval() frames and frames after requestKey() carry whole values
+	(key frames). The others carry the difference from the previous frame,
+	where the field was present in both.
+============================================================================*/
+#ifndef _Atlas_Frame_h
+#define _Atlas_Frame_h
+
+#include <Atlas_EZO.h>
+#include <AtlasRGB.h>
+
+#define ATLAS_FRAME_MAX_FIELDS		16
+#define ATLAS_FRAME_MAX_DECIMALS	6
+#define ATLAS_FRAME_MAX_BYTES		( 2 + 2 * ATLAS_FRAME_MAX_FIELDS / 8 + 5 * ATLAS_FRAME_MAX_FIELDS )
+#define ATLAS_FRAME_KEY_INTERVAL	16
+#define ATLAS_FRAME_KEY				0x80 // header: values are whole, not differences
+#define ATLAS_FRAME_STATUS			0x40 // header: absent and failed masks follow
+#define ATLAS_FRAME_SEQUENCE		0x3F
+
+enum atlas_frame_status {
+	ATLAS_FIELD_OK,
+	ATLAS_FIELD_MISSING,	// channel not enabled on the circuit, or NO_SENSOR_DATA
+	ATLAS_FIELD_FAILED		// no new reading, circuit unresponsive, or out of range
+};
+
+enum atlas_frame_result {
+	ATLAS_FRAME_OK,
+	ATLAS_FRAME_SHORT,	// truncated or corrupt
+	ATLAS_FRAME_SCHEMA,	// built from a different field list
+	ATLAS_FRAME_GAP		// frame(s) lost, differences can't be applied until the next key frame
+};
+
+class AtlasFrameEncoder {
+	public:
+		AtlasFrameEncoder();
+		bool			addField(EZO *sensor, const uint8_t channel, const uint8_t decimals);
+		bool			addField(RGB *sensor, const uint8_t channel); // whole numbers
+		void			setKeyInterval(const uint8_t frames) { _key_interval = frames;} // 0: only the first and requested ones
+		void			requestKey() { _key_due = true;} // e.g. the gateway reported a gap
+		uint8_t			encode(uint8_t *frame, const uint8_t size); // bytes written, 0 if size is too small
+		uint8_t			getFieldCount() const { return _field_count;}
+		uint8_t			getSchemaId() const;
+		atlas_frame_status	getStatus(const uint8_t field) const { return _status[field];} // as last encoded
+	private:
+		atlas_frame_status	_read(const uint8_t field, int32_t &value);
+		EZO *			_ezo[ATLAS_FRAME_MAX_FIELDS];
+		RGB *			_rgb[ATLAS_FRAME_MAX_FIELDS];
+		uint8_t			_channel[ATLAS_FRAME_MAX_FIELDS];
+		uint8_t			_decimals[ATLAS_FRAME_MAX_FIELDS];
+		uint32_t		_reading_time[ATLAS_FRAME_MAX_FIELDS]; // of the reading last sent, to spot stale ones
+		int32_t			_previous[ATLAS_FRAME_MAX_FIELDS];
+		atlas_frame_status	_status[ATLAS_FRAME_MAX_FIELDS];
+		uint8_t			_field_count;
+		uint8_t			_sequence;
+		uint8_t			_key_interval;
+		uint8_t			_since_key;
+		bool			_key_due;
+};
+
+class AtlasFrameDecoder {
+	public:
+		AtlasFrameDecoder();
+		bool			addField(const uint8_t decimals);
+		atlas_frame_result	decode(const uint8_t *frame, const uint8_t length);
+		float			getValue(const uint8_t field) const;
+		atlas_frame_status	getStatus(const uint8_t field) const { return _status[field];}
+		uint8_t			getFieldCount() const { return _field_count;}
+		uint8_t			getSequence() const { return _sequence;}
+		bool			isKey() const { return _key;} // last frame decoded was a key frame
+		uint8_t			getSchemaId() const;
+	private:
+		uint8_t			_decimals[ATLAS_FRAME_MAX_FIELDS];
+		int32_t			_value[ATLAS_FRAME_MAX_FIELDS];
+		atlas_frame_status	_status[ATLAS_FRAME_MAX_FIELDS];
+		uint8_t			_field_count;
+		uint8_t			_sequence;
+		bool			_synced; // have a key frame and no gap since
+		bool			_key;
+};
+#endif
@@ -0,0 +1,47 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#include <AtlasFramer.h>
+
+atlas_frame_type AtlasFramer::push(const char c) {
+	if ( c == '\n' ) return ATLAS_FRAME_NONE; // not sent by EZO circuits, but harmless
+	if ( c != '\r' ) {
+		if ( _state == 0 ) { // first byte says what kind of line it is
+			_state = ( c == '*' ) ? 2 : 1;
+			_len = 0;
+			_truncated = false;
+		}
+		if ( _state == 2 ) {
+			if ( _len < ATLAS_FRAME_CODE_LEN - 1 ) _code[_len++] = c;
+		}
+		else if ( _len + 1 < _data_size ) _data[_len++] = c; // always room for the NUL
+		else _truncated = true;
+		return ATLAS_FRAME_NONE;
+	}
+	uint8_t state = _state;
+	_state = 0;
+	if ( state == 0 ) return ATLAS_FRAME_NONE; // empty line
+	if ( state == 1 ) {
+		if ( _data_size ) _data[_len] = 0;
+		_data_len = _len;
+		return ATLAS_FRAME_DATA;
+	}
+	_code[_len] = 0;
+	if ( ( _code[1] == 'O' && _code[2] == 'K' ) || ( _code[1] == 'E' && _code[2] == 'R' ) ) return ATLAS_FRAME_RESPONSE;
+	return ATLAS_FRAME_EVENT;
+}
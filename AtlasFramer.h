@@ -0,0 +1,61 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Splits the byte stream from a circuit into <CR> terminated lines, one
+	byte at a time, and says what each finished line is. Data lines are
+	written straight into the caller's buffer (Atlas::_result), so nothing
+	is copied. Lines starting with '*' go to a small separate buffer so a
+	"*OK" can't overwrite a result that hasn't been parsed yet.
+	push() does a constant amount of work per byte and never waits, so it
+	can be fed from a poll loop or an interrupt.
+============================================================================*/
+#ifndef _Atlas_Framer_h
+#define _Atlas_Framer_h
+
+#include <Arduino.h>
+
+#define ATLAS_FRAME_CODE_LEN 8 // "*OK" etc. plus room for odd firmware
+
+enum atlas_frame_type {
+	ATLAS_FRAME_NONE,		// No line finished with this byte
+	ATLAS_FRAME_DATA,		// Result line, in the data buffer
+	ATLAS_FRAME_RESPONSE,	// "*OK" or "*ER", the end of a command
+	ATLAS_FRAME_EVENT		// "*RS", "*RE", "*SL", "*WA", "*OV", "*UV" etc. Can turn up at any time.
+};
+
+class AtlasFramer {
+	public:
+		AtlasFramer() { setDataBuffer(NULL,0); reset(); _data_len = 0; _truncated = false; _code[0] = 0;}
+		// Where data lines go. NULL discards them (they are still framed).
+		void			setDataBuffer(char *buffer, const uint8_t size) { _data = buffer; _data_size = size;}
+		atlas_frame_type	push(const char c);
+		void			reset() { _state = 0; _len = 0;} // drop a partial line
+		bool			inLine() const { return _state != 0;}
+		const char *	data() const { return _data;}
+		uint8_t			dataLength() const { return _data_len;}
+		bool			truncated() const { return _truncated;} // last data line didn't fit
+		const char *	code() const { return _code;} // last '*' line, NUL terminated
+	private:
+		char *			_data;
+		uint8_t			_data_size;
+		uint8_t			_data_len;
+		char			_code[ATLAS_FRAME_CODE_LEN];
+		uint8_t			_state; // 0 between lines, 1 in a data line, 2 in a '*' line
+		uint8_t			_len; // bytes kept of the current line
+		bool			_truncated;
+};
+#endif
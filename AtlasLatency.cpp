@@ -0,0 +1,42 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#include <AtlasLatency.h>
+
+// A short command answers in tens of ms, a reading in 600-1000 ms (longer for RGB)
+static const uint16_t BOUNDS[ATLAS_LATENCY_BUCKETS - 1] = { 25, 50, 100, 250, 500, 1000, 2500 };
+
+void AtlasLatency::clear() {
+	for ( uint8_t i = 0 ; i < ATLAS_LATENCY_BUCKETS ; i++ ) _counts[i] = 0;
+	_count = 0;
+	_sum = 0;
+	_max = 0;
+}
+
+void AtlasLatency::add(const uint32_t ms) {
+	uint8_t bucket = 0;
+	while ( bucket < ATLAS_LATENCY_BUCKETS - 1 && ms > BOUNDS[bucket] ) bucket++;
+	_counts[bucket]++;
+	_count++;
+	_sum += ms;
+	if ( ms > _max ) _max = ms;
+}
+
+uint32_t AtlasLatency::getBound(const uint8_t bucket) {
+	return bucket < ATLAS_LATENCY_BUCKETS - 1 ? BOUNDS[bucket] : 0xFFFFFFFF;
+}
@@ -0,0 +1,46 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Command latency histogram: time from sending a command to the first
+	byte of its reply, in fixed buckets. Attach one to a circuit with
+	Atlas::attachLatency() and every answered command is counted.
+	Commands that get no reply count as timeouts instead (getTimeouts()).
+============================================================================*/
+#ifndef _Atlas_Latency_h
+#define _Atlas_Latency_h
+
+#include <Arduino.h>
+
+#define ATLAS_LATENCY_BUCKETS 8 // the last one is everything slower
+
+class AtlasLatency {
+	public:
+		AtlasLatency() { clear();}
+		void			clear();
+		void			add(const uint32_t ms);
+		uint32_t		getCount() const { return _count;}
+		uint32_t		getSum() const { return _sum;} // ms
+		uint32_t		getMax() const { return _max;}
+		uint32_t		getBucket(const uint8_t bucket) const { return bucket < ATLAS_LATENCY_BUCKETS ? _counts[bucket] : 0;} // not cumulative
+		static uint32_t	getBound(const uint8_t bucket); // upper bound in ms, 0xFFFFFFFF for the last
+	private:
+		uint32_t		_counts[ATLAS_LATENCY_BUCKETS];
+		uint32_t		_count;
+		uint32_t		_sum;
+		uint32_t		_max;
+};
+#endif
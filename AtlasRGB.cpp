@@ -21,10 +21,6 @@ Copyright (c) 2015 Ryan Neve <Ryan@PlanktosInstruments.com>
 ============================================================================*/
 //#define ATLAS_RGB_DEBUG
 
-#define NO_SENSOR_DATA		-999	// This means we didn't want the data based on configuration
-#define NO_SENSOR_COMMS		-888	// Couldn't communicate with sensor
-#define SENSOR_COMMS_FAILED	-777	// Communications with sensor failing.
-
 #include <HardwareSerial.h>
 #include <AtlasRGB.h>
 
@@ -53,8 +49,7 @@ void RGB::initialize(const rgb_mode mode){
 }
 
 tristate RGB::querySingleReading(){
-	strncpy(_command,"R\r",ATLAS_COMMAND_LENGTH); // This is the single reading command
-	_sendCommand(_command,true);
+	_sendCommand("R\r",true);
 #ifdef ATLAS_RGB_DEBUG
 	Serial.print(F("qSR got _result: ")); Serial.println(_result);
 	Serial.print(F("_mode is: "));
@@ -83,6 +78,7 @@ tristate RGB::querySingleReading(){
 	}
 	// now parse _result
 	// response will depend on _mode.	
+	_stampReading();
 	bool _red_parsed = false;
 	bool _green_parsed = false;
 	bool _blue_parsed = false;
@@ -160,25 +156,23 @@ tristate RGB::querySingleReading(){
 
 
 void RGB::enableContinuousReadings() {
-	strncpy(_command,"C\r",ATLAS_COMMAND_LENGTH);
-	_sendCommand(_command,false);
+	_sendCommand("C\r",false);
 }
 
 void RGB::disableContinuousReadings() {
-	strncpy(_command,"E\r",ATLAS_COMMAND_LENGTH);
-	_sendCommand(_command,false);
-	delay(1100 >> CLKPR); // Time for one last set of values
+	_sendCommand("E\r",false);
+	_clock->delay(1100); // Time for one last set of values
 	flushSerial();
 }
  
 tristate RGB::setMode(const rgb_mode mode) {
 	tristate result = TRI_UNKNOWN;
 	_rgb_mode = mode;
-	sprintf(_command,"M%d\r",mode);
 #ifdef ATLAS_RGB_DEBUG
-	if ( debug() ) { Serial.print(F("Setting RGB Mode with command "));	Serial.println(_command);}
+	if ( debug() ) { Serial.print(F("Setting RGB Mode to "));	Serial.println(mode);}
 #endif
-	_sendCommand(_command,true);
+	_putChar('M'); _putUInt(mode); _putChar('\r');
+	_endCommand(true,DEFAULT_COMMAND_DELAY);
 	// The ENV-RGB will respond:  "[RGB|lx|RGB+lx]\r"
 	if ( !_strCmp(_result,"RGB") && mode == RGB_DEFAULT){
 		result = TRI_ON;
@@ -210,24 +204,23 @@ tristate RGB::setMode(const rgb_mode mode) {
 }
 tristate RGB::queryInfo(){
 	tristate result = TRI_UNKNOWN;
-	strncpy(_command,"I\r",ATLAS_COMMAND_LENGTH);
 #ifdef ATLAS_RGB_DEBUG
-	if ( debug() )  {Serial.print(F("Querying RGB info with command "));	Serial.println(_command);}
+	if ( debug() )  Serial.println(F("Querying RGB info"));
 #endif
-	_sendCommand(_command,true);
+	_sendCommand("I\r",true);
 	// The ENV-RGB will respond:  "C,V<version>,<date>\r". C is for Color.
 	char * pch;
 	pch = strtok(_result,",\r");
-	if (pch[0] == 'C'){
+	if ( pch && pch[0] == 'C'){
 		pch = strtok(NULL, ",\r");
-		if ( pch[0] == 'V') {
+		if ( pch && pch[0] == 'V') {
 			// Parse version
 			result = TRI_ON;
 			_setConnected();
 			strncpy(_firmware_version,pch,sizeof(_firmware_version));
 		}
-		pch = strtok(NULL, ",\r");
-		strncpy(_firmware_date,pch,sizeof(_firmware_version));
+		if ( pch ) pch = strtok(NULL, ",\r");
+		if ( pch ) strncpy(_firmware_date,pch,sizeof(_firmware_version));
 	}
 	else {
 		result = TRI_OFF;
@@ -242,13 +235,38 @@ tristate RGB::queryInfo(){
 
 void RGB::_sendCommand(const char * command,const bool has_result){_sendCommand(command,has_result,DEFAULT_COMMAND_DELAY);}
 void RGB::_sendCommand(const char * command,const bool has_result,const uint16_t result_delay){
-	if ( online() ) Serial_AS->print(command);
+	_putCommand(command);
+	_endCommand(has_result,result_delay);
+}
+void RGB::_endCommand(const bool has_result,const uint16_t result_delay){
+	// The command has already been written by _putCommand() and friends.
+	if ( ! _commandSent() ) {
+		_result_len = 0; _result[0] = 0;
+		return;
+	}
+	_markRequest();
 	if ( has_result ) {
 		if ( _delayUntilSerialData(10000) == -1 ){
 #ifdef ATLAS_RGB_DEBUG
 			Serial.println(F("No data found while waiting for result"));
 #endif
+			_commandFailed();
 		}
+		else _commandSucceeded();
 		_getResult(result_delay);
 	}
+}
+
+int16_t RGB::getValue(const uint8_t channel) const {
+	switch ( channel ) {
+		case RGB_CH_RED:		return _red;
+		case RGB_CH_GREEN:		return _green;
+		case RGB_CH_BLUE:		return _blue;
+		case RGB_CH_LUX_RED:	return _lx_red;
+		case RGB_CH_LUX_GREEN:	return _lx_green;
+		case RGB_CH_LUX_BLUE:	return _lx_blue;
+		case RGB_CH_LUX_TOTAL:	return _lx_total;
+		case RGB_CH_LUX_BEYOND:	return _lx_beyond;
+		default:				return NO_SENSOR_DATA;
+	}
 }
\ No newline at end of file
@@ -29,10 +29,14 @@ Copyright (c) 2015 Ryan Neve <Ryan@PlanktosInstruments.com>
 #include <Atlas.h>
 
 #define BAUD_RATE_RGB_DEFAULT 38400
-//#define ATLAS_COMMAND_LENGTH 10
 #define DEFAULT_COMMAND_DELAY 1000
 //#define ATLAS_SERIAL_RESULT_LEN 50
 #define RGB_DATA_LEN 6
+
+// Stored in place of a value
+#define NO_SENSOR_DATA		-999	// This means we didn't want the data based on configuration
+#define NO_SENSOR_COMMS		-888	// Couldn't communicate with sensor
+#define SENSOR_COMMS_FAILED	-777	// Communications with sensor failing.
 /*
 R		Take a single color reading
 C		Take continues color readings every 1200 milliseconds
@@ -48,6 +52,17 @@ enum rgb_mode {
 	RGB_ALL		= 3
 };
 
+enum rgb_channel { // see getValue()
+	RGB_CH_RED,
+	RGB_CH_GREEN,
+	RGB_CH_BLUE,
+	RGB_CH_LUX_RED,
+	RGB_CH_LUX_GREEN,
+	RGB_CH_LUX_BLUE,
+	RGB_CH_LUX_TOTAL,
+	RGB_CH_LUX_BEYOND
+};
+
 
 class RGB: public Atlas {
 	public:
@@ -74,6 +89,7 @@ class RGB: public Atlas {
 		int16_t		getLuxTotal() const {return _lx_total;}
 		int16_t		getLuxBeyond() const {return _lx_beyond;}
 		bool		getSaturated() const {return _saturated;}
+		int16_t		getValue(const uint8_t channel) const; // may be one of the NO_SENSOR_DATA etc. codes
 		char		red[RGB_DATA_LEN];
 		char		green[RGB_DATA_LEN];
 		char		blue[RGB_DATA_LEN];
@@ -86,6 +102,8 @@ class RGB: public Atlas {
 	private:
 		void		_sendCommand(const char * command, const bool has_result);
 		void		_sendCommand(const char * command, const bool has_result,const uint16_t result_delay);
+		void		_endCommand(const bool has_result,const uint16_t result_delay); // after _put*()
+		void		_probe() { queryInfo();}
 		rgb_mode	_rgb_mode;
 		int16_t		_red;
 		int16_t		_green;
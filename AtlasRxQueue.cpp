@@ -0,0 +1,86 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#include <AtlasRxQueue.h>
+
+// The other side's index is loaded with acquire and our own is stored with release,
+// so the bytes are in the buffer before the index that publishes them.
+#define ATLAS_RX_LOAD(index)		__atomic_load_n(&(index),__ATOMIC_ACQUIRE)
+#define ATLAS_RX_STORE(index,value)	__atomic_store_n(&(index),(atlas_rx_index)(value),__ATOMIC_RELEASE)
+
+AtlasRxQueue::AtlasRxQueue(uint8_t *buffer, const atlas_rx_index size) {
+	_buffer = buffer;
+	_mask = size - 1;
+	_head = 0;
+	_tail = 0;
+	_dropped = 0;
+}
+
+bool AtlasRxQueue::push(const uint8_t byte) {
+	atlas_rx_index head = _head;
+	if ( (atlas_rx_index)( head - ATLAS_RX_LOAD(_tail) ) > _mask ) { _dropped++; return false;}
+	_buffer[head & _mask] = byte;
+	ATLAS_RX_STORE(_head,head + 1);
+	return true;
+}
+
+bool AtlasRxQueue::full() const {
+	return (atlas_rx_index)( _head - ATLAS_RX_LOAD(_tail) ) > _mask;
+}
+
+int AtlasRxQueue::available() const {
+	return (atlas_rx_index)( ATLAS_RX_LOAD(_head) - _tail );
+}
+
+int AtlasRxQueue::read() {
+	atlas_rx_index tail = _tail;
+	if ( tail == ATLAS_RX_LOAD(_head) ) return -1;
+	uint8_t byte = _buffer[tail & _mask];
+	ATLAS_RX_STORE(_tail,tail + 1);
+	return byte;
+}
+
+int AtlasRxQueue::peek() const {
+	if ( _tail == ATLAS_RX_LOAD(_head) ) return -1;
+	return _buffer[_tail & _mask];
+}
+
+void AtlasRxQueue::clear() {
+	ATLAS_RX_STORE(_tail,ATLAS_RX_LOAD(_head));
+}
+
+/*              QUEUE TRANSPORT                      */
+
+AtlasQueueTransport::AtlasQueueTransport(AtlasTransport *port, AtlasRxQueue *queue) {
+	_port = port;
+	_queue = queue;
+	_auto_pump = true;
+	_pumping = 0;
+}
+
+void AtlasQueueTransport::pump() {
+	// One producer at a time: an interrupt or thread that finds a pump() running leaves it to finish.
+	if ( __atomic_exchange_n(&_pumping,1,__ATOMIC_ACQUIRE) ) return;
+	// Leaves bytes in the port once the queue is full rather than dropping them here.
+	while ( ! _queue->full() && _port->available() > 0 ) {
+		int byte = _port->read();
+		if ( byte < 0 ) break;
+		_queue->push(byte);
+	}
+	__atomic_store_n(&_pumping,0,__ATOMIC_RELEASE);
+}
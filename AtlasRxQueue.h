@@ -0,0 +1,86 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Single producer, single consumer byte queue. No locks and no cli():
+	the producer only writes _head, the consumer only writes _tail.
+	Producer: AtlasQueueTransport::pump(), from a timer interrupt, from
+	yield() or from available() (auto-pump). pump() won't run inside
+	another pump(), so an interrupt landing in the middle of one returns
+	at once instead of becoming a second producer. Nothing else may call
+	push() while pump() is in use.
+	Consumer: the drivers, through AtlasQueueTransport.
+	
+	The buffer is the caller's. Its size must be a power of two, at most
+	128 on AVR (8 bit indices, so they are read and written atomically)
+	and at most 32768 elsewhere.
+============================================================================*/
+#ifndef _Atlas_Rx_Queue_h
+#define _Atlas_Rx_Queue_h
+
+#include <Arduino.h>
+#include <AtlasTransport.h>
+
+#if defined(__AVR__)
+typedef uint8_t atlas_rx_index;
+#else
+typedef uint16_t atlas_rx_index;
+#endif
+
+class AtlasRxQueue {
+	public:
+		AtlasRxQueue(uint8_t *buffer, const atlas_rx_index size);
+		// Producer side
+		bool			push(const uint8_t byte); // false (and counted) if full
+		bool			full() const;
+		uint32_t		getDropped() const { return _dropped;}
+		// Consumer side
+		int				available() const;
+		int				read();
+		int				peek() const;
+		void			clear(); // drops everything queued; consumer side
+	private:
+		uint8_t *		_buffer;
+		atlas_rx_index	_mask;
+		atlas_rx_index	_head; // next free slot, written by the producer
+		atlas_rx_index	_tail; // next byte to read, written by the consumer
+		uint32_t		_dropped;
+};
+
+// Reads through an AtlasRxQueue. pump() moves bytes from the port into the queue. By default
+// available(), read() and peek() pump; with a timer interrupt pumping, setAutoPump(false)
+// saves the drivers the work.
+class AtlasQueueTransport: public AtlasTransport {
+	public:
+		AtlasQueueTransport(AtlasTransport *port, AtlasRxQueue *queue);
+		void			begin(const uint32_t baud_rate) { _port->begin(baud_rate);}
+		void			setAutoPump(const bool on) { _auto_pump = on;}
+		void			pump(); // returns at once if a pump() is already running
+		int				available() { if ( _auto_pump ) pump(); return _queue->available();}
+		int				read() { if ( _auto_pump ) pump(); return _queue->read();}
+		int				peek() { if ( _auto_pump ) pump(); return _queue->peek();}
+		size_t			write(uint8_t byte) { return _port->write(byte);}
+		size_t			write(const uint8_t *buffer, size_t size) { return _port->write(buffer,size);}
+		void			flush() { _port->flush();}
+		AtlasRxQueue *	getQueue() { return _queue;}
+		using Print::write;
+	private:
+		AtlasTransport *	_port;
+		AtlasRxQueue *	_queue;
+		bool			_auto_pump;
+		uint8_t			_pumping; // set while pump() runs
+};
+#endif
@@ -0,0 +1,368 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#include <AtlasScheduler.h>
+
+AtlasScheduler::AtlasScheduler() {
+	_count = 0;
+	for ( uint8_t bus = 0 ; bus < ATLAS_SCHED_MAX_BUSES ; bus++ ) {
+		_running[bus] = ATLAS_SCHED_NONE;
+		_job[bus] = ATLAS_JOB_NONE;
+		_mux[bus] = ATLAS_SCHED_NO_MUX;
+	}
+	_auto_sleep = false;
+	_clock = AtlasClock::arduino();
+	_accounted = _clock->millis();
+	_mux_callback = NULL;
+	_mux_context = NULL;
+	_callback = NULL;
+	_context = NULL;
+}
+
+uint8_t AtlasScheduler::addTask(EZO *sensor, const uint32_t period, const uint8_t bus, const uint8_t mux) {
+	if ( _count >= ATLAS_SCHED_MAX_TASKS || bus >= ATLAS_SCHED_MAX_BUSES ) return ATLAS_SCHED_NONE;
+	atlas_sched_task &t = _tasks[_count];
+	t.sensor = sensor;
+	t.period = period;
+	t.bus = bus;
+	t.mux = mux;
+	t.state = period ? ATLAS_TASK_WAITING : ATLAS_TASK_IDLE;
+	t.release = _clock->millis(); // first reading right away
+	t.deadline = t.release + period;
+	t.started = 0;
+	switch ( sensor->getCircuitType() ) { // datasheet reading times, until we learn better
+		case EZO_DO_CIRCUIT:
+		case EZO_EC_CIRCUIT:	t.duration = 600; break;
+		case EZO_PH_CIRCUIT:
+		case EZO_ORP_CIRCUIT:	t.duration = 900; break;
+		case EZO_RGB_CIRCUIT:	t.duration = 400; break;
+		default:				t.duration = 1000; break;
+	}
+	t.sleep = TRI_UNKNOWN;
+	t.asleep = false;
+	t.wake_latency = ATLAS_SCHED_WAKE_LATENCY;
+	t.settle = ATLAS_SCHED_WAKE_SETTLE;
+	t.ready = t.release;
+	t.awake_ua = ATLAS_SCHED_AWAKE_UA;
+	t.asleep_ua = ATLAS_SCHED_ASLEEP_UA;
+	t.charge_mas = 0;
+	t.charge_frac = 0;
+	t.accounted_ms = 0;
+	t.runs = 0;
+	t.missed = 0;
+	t.lateness = 0;
+	t.max_lateness = 0;
+	return _count++;
+}
+
+void AtlasScheduler::setDuration(const uint8_t task, const uint16_t duration) {
+	if ( task < _count ) _tasks[task].duration = duration;
+}
+
+void AtlasScheduler::setSleep(const uint8_t task, const bool sleep, const uint16_t settle) {
+	if ( task >= _count ) return;
+	_tasks[task].sleep = sleep ? TRI_ON : TRI_OFF;
+	_tasks[task].settle = settle;
+}
+
+void AtlasScheduler::setCurrent(const uint8_t task, const uint16_t awake_ua, const uint16_t asleep_ua) {
+	if ( task >= _count ) return;
+	_tasks[task].awake_ua = awake_ua;
+	_tasks[task].asleep_ua = asleep_ua;
+}
+
+void AtlasScheduler::setPeriod(const uint8_t task, const uint32_t period) {
+	if ( task >= _count ) return;
+	atlas_sched_task &t = _tasks[task];
+	t.period = period;
+	if ( t.state == ATLAS_TASK_RUNNING ) return; // takes effect when it finishes
+	t.release = _clock->millis() + period;
+	t.deadline = t.release + period;
+	t.state = period ? ATLAS_TASK_WAITING : ATLAS_TASK_IDLE;
+}
+
+bool AtlasScheduler::request(const uint8_t task, const uint32_t deadline) {
+	if ( task >= _count || _tasks[task].state == ATLAS_TASK_RUNNING ) return false;
+	atlas_sched_task &t = _tasks[task];
+	t.release = _clock->millis();
+	t.deadline = t.release + deadline;
+	t.state = ATLAS_TASK_WAITING;
+	return true;
+}
+
+void AtlasScheduler::service() {
+	uint32_t now = _clock->millis();
+	_account(now);
+	// Commands in flight
+	for ( uint8_t bus = 0 ; bus < ATLAS_SCHED_MAX_BUSES ; bus++ ) {
+		if ( _job[bus] != ATLAS_JOB_NONE && _tasks[_running[bus]].sensor->pollCommand() ) _complete(bus);
+	}
+	now = _clock->millis();
+	// Too late to start: count it and move on to the next period
+	for ( uint8_t task = 0 ; task < _count ; task++ ) {
+		atlas_sched_task &t = _tasks[task];
+		if ( t.state != ATLAS_TASK_WAITING || ATLAS_TIME_DIFF(now,t.deadline) < 0 ) continue;
+		t.missed++;
+		_nextRelease(task);
+	}
+	for ( uint8_t bus = 0 ; bus < ATLAS_SCHED_MAX_BUSES ; bus++ ) {
+		if ( _job[bus] != ATLAS_JOB_NONE ) continue;
+		uint8_t task = _pick(bus,now);
+		// A wake that falls due while the next reading runs goes before it. It only takes
+		// a moment, and if the bus is idle now it is done before that reading is released.
+		uint8_t next = task;
+		uint32_t from = now;
+		if ( next == ATLAS_SCHED_NONE ) {
+			for ( uint8_t other = 0 ; other < _count ; other++ ) {
+				const atlas_sched_task &o = _tasks[other];
+				if ( o.bus != bus || o.state != ATLAS_TASK_WAITING || o.asleep ) continue;
+				if ( next == ATLAS_SCHED_NONE || ATLAS_TIME_DIFF(o.release,_tasks[next].release) < 0 ) next = other;
+			}
+			if ( next != ATLAS_SCHED_NONE && ATLAS_TIME_DIFF(_tasks[next].release,now) > 0 ) from = _tasks[next].release;
+		}
+		uint8_t sleeper = _wakeDue(bus,next == ATLAS_SCHED_NONE ? now : from + _tasks[next].duration);
+		if ( sleeper != ATLAS_SCHED_NONE && task == ATLAS_SCHED_NONE && ATLAS_TIME_DIFF(now,_tasks[sleeper].release - _wakeLead(sleeper)) < 0
+			&& ATLAS_TIME_DIFF(now + _tasks[sleeper].wake_latency + ATLAS_SCHED_WAKE_GUARD,from) > 0 ) {
+			sleeper = ATLAS_SCHED_NONE; // not due yet, and too late to fit in before the next reading
+		}
+		if ( sleeper != ATLAS_SCHED_NONE ) {
+			atlas_sched_task &s = _tasks[sleeper];
+			_select(sleeper);
+			s.started = now;
+			if ( s.sensor->startWake() ) {
+				_running[bus] = sleeper;
+				_job[bus] = ATLAS_JOB_WAKE;
+			}
+			else { // offline or breaker open. Let the reading find out.
+				s.asleep = false;
+				s.ready = now;
+			}
+			continue;
+		}
+		if ( task == ATLAS_SCHED_NONE ) continue;
+		atlas_sched_task &t = _tasks[task];
+		_select(task);
+		uint32_t late = ATLAS_TIME_DIFF(now,t.release);
+		t.lateness = late > 0xFFFF ? 0xFFFF : late;
+		if ( t.lateness > t.max_lateness ) t.max_lateness = t.lateness;
+		t.started = now;
+		if ( t.sensor->startReading() ) {
+			t.state = ATLAS_TASK_RUNNING;
+			_running[bus] = task;
+			_job[bus] = ATLAS_JOB_READ;
+		}
+		else _finish(task,t.sensor->getLastResponse()); // offline or breaker open, nothing sent
+	}
+}
+
+void AtlasScheduler::setClock(AtlasClock *clock) {
+	_clock = clock;
+	_accounted = clock->millis();
+}
+
+uint32_t AtlasScheduler::getNextEvent() const {
+	// Anything due by now was dealt with by the service() just before
+	uint32_t now = _clock->millis();
+	uint32_t next = now + ATLAS_SCHED_IDLE_MAX;
+	for ( uint8_t bus = 0 ; bus < ATLAS_SCHED_MAX_BUSES ; bus++ ) {
+		if ( _job[bus] != ATLAS_JOB_NONE ) _sooner(next,now,_tasks[_running[bus]].sensor->getCommandDeadline()); // gives up on the reply
+	}
+	for ( uint8_t task = 0 ; task < _count ; task++ ) {
+		const atlas_sched_task &t = _tasks[task];
+		if ( t.state != ATLAS_TASK_WAITING ) continue;
+		_sooner(next,now,t.asleep ? t.release - _wakeLead(task) : t.release);
+		if ( ! t.asleep ) _sooner(next,now,t.ready);
+		_sooner(next,now,t.deadline);
+	}
+	return next;
+}
+
+float AtlasScheduler::getCharge(const uint8_t task) const {
+	if ( task >= _count ) return 0.0;
+	return ( _tasks[task].charge_mas + _tasks[task].charge_frac / 1000000.0 ) / 3600.0;
+}
+
+float AtlasScheduler::getAverageCurrent(const uint8_t task) const {
+	if ( task >= _count || ! _tasks[task].accounted_ms ) return 0.0;
+	const atlas_sched_task &t = _tasks[task];
+	return ( t.charge_mas * 1000.0 + t.charge_frac / 1000.0 ) / t.accounted_ms;
+}
+
+uint8_t AtlasScheduler::getUtilization(const uint8_t bus) const {
+	uint32_t permille = 0;
+	for ( uint8_t task = 0 ; task < _count ; task++ ) {
+		const atlas_sched_task &t = _tasks[task];
+		if ( t.bus == bus && t.period ) permille += (uint32_t)t.duration * 1000 / t.period;
+	}
+	return permille >= 2550 ? 255 : permille / 10;
+}
+
+void AtlasScheduler::resetStats() {
+	for ( uint8_t task = 0 ; task < _count ; task++ ) {
+		atlas_sched_task &t = _tasks[task];
+		t.runs = 0;
+		t.missed = 0;
+		t.max_lateness = 0;
+		t.charge_mas = 0;
+		t.charge_frac = 0;
+		t.accounted_ms = 0;
+	}
+}
+
+/*              PRIVATE METHODS                      */
+
+void AtlasScheduler::_complete(const uint8_t bus) {
+	uint8_t task = _running[bus];
+	atlas_sched_task &t = _tasks[task];
+	atlas_bus_job job = _job[bus];
+	ezo_response response = t.sensor->finishCommand();
+	uint32_t now = _clock->millis();
+	_running[bus] = ATLAS_SCHED_NONE;
+	_job[bus] = ATLAS_JOB_NONE;
+	switch ( job ) {
+		case ATLAS_JOB_READ:
+			_finish(task,response);
+			break;
+		case ATLAS_JOB_WAKE:
+			if ( response == EZO_RESPONSE_WA ) {
+				int32_t error = ATLAS_TIME_DIFF(now,t.started) - t.wake_latency;
+				t.wake_latency += error / 4;
+			}
+			t.asleep = false; // "*ER" means it was awake already. No answer: the reading will tell.
+			t.ready = now + t.settle;
+			break;
+		case ATLAS_JOB_SLEEP:
+			// No answer: it may be asleep. A wake byte to an awake circuit only gets "*ER",
+			// but a reading sent to a sleeping one is eaten as the wake byte.
+			t.asleep = response == EZO_RESPONSE_SL || response == EZO_RESPONSE_UK;
+			break;
+		default:
+			break;
+	}
+}
+
+void AtlasScheduler::_finish(const uint8_t task, const ezo_response response) {
+	atlas_sched_task &t = _tasks[task];
+	uint32_t now = _clock->millis();
+	t.runs++;
+	// A reply to this reading moves the reading time past its start
+	bool replied = ATLAS_TIME_DIFF(t.sensor->getReadingTime(),t.started) >= 0 && t.sensor->getReadingTime() != 0;
+	if ( replied ) {
+		int32_t error = ATLAS_TIME_DIFF(now,t.started) - t.duration;
+		t.duration += error / 4; // EMA, quick to follow a slower firmware
+	}
+	if ( ! replied || ATLAS_TIME_DIFF(now,t.deadline) > 0 ) t.missed++;
+	if ( _callback ) _callback(task,t.sensor,response,_context);
+	_nextRelease(task);
+	// Sleep if the gap is long enough to be worth waking up from
+	if ( ! _maySleep(task) || t.asleep || _job[t.bus] != ATLAS_JOB_NONE ) return;
+	if ( t.state == ATLAS_TASK_WAITING && ATLAS_TIME_DIFF(t.release,now) <= (int32_t)( _wakeLead(task) + ATLAS_SCHED_MIN_SLEEP ) ) return;
+	_select(task);
+	t.started = now;
+	if ( t.sensor->startSleep() ) {
+		_running[t.bus] = task;
+		_job[t.bus] = ATLAS_JOB_SLEEP;
+	}
+}
+
+void AtlasScheduler::_nextRelease(const uint8_t task) {
+	atlas_sched_task &t = _tasks[task];
+	if ( ! t.period ) { t.state = ATLAS_TASK_IDLE; return;}
+	uint32_t now = _clock->millis();
+	t.release += t.period;
+	while ( ATLAS_TIME_DIFF(now,t.release + t.period) >= 0 ) { // whole periods went by, don't catch up in a burst
+		t.release += t.period;
+		t.missed++;
+	}
+	t.deadline = t.release + t.period;
+	t.state = ATLAS_TASK_WAITING;
+}
+
+uint8_t AtlasScheduler::_pick(const uint8_t bus, const uint32_t now) const {
+	uint8_t best = ATLAS_SCHED_NONE;
+	for ( uint8_t task = 0 ; task < _count ; task++ ) {
+		const atlas_sched_task &t = _tasks[task];
+		if ( t.bus != bus || t.state != ATLAS_TASK_WAITING || ATLAS_TIME_DIFF(now,t.release) < 0 ) continue;
+		if ( t.asleep || ATLAS_TIME_DIFF(now,t.ready) < 0 ) continue; // still waking
+		if ( best == ATLAS_SCHED_NONE || ATLAS_TIME_DIFF(t.deadline,_tasks[best].deadline) < 0 ) best = task;
+	}
+	if ( best == ATLAS_SCHED_NONE ) return best;
+	// Readings can't be interrupted. If a more urgent one is released before this one
+	// would finish, and this one can still make its deadline after it, wait for it.
+	const atlas_sched_task &b = _tasks[best];
+	for ( uint8_t task = 0 ; task < _count ; task++ ) {
+		const atlas_sched_task &u = _tasks[task];
+		if ( u.bus != bus || u.state != ATLAS_TASK_WAITING || ATLAS_TIME_DIFF(now,u.release) >= 0 ) continue;
+		if ( ATLAS_TIME_DIFF(u.deadline,b.deadline) >= 0 ) continue;
+		if ( ATLAS_TIME_DIFF(u.release,now + b.duration) >= 0 ) continue; // done before it's due
+		if ( ATLAS_TIME_DIFF(u.release + u.duration + b.duration,b.deadline) <= 0 ) return ATLAS_SCHED_NONE;
+	}
+	return best;
+}
+
+uint8_t AtlasScheduler::_wakeDue(const uint8_t bus, const uint32_t by) const {
+	uint8_t first = ATLAS_SCHED_NONE;
+	for ( uint8_t task = 0 ; task < _count ; task++ ) {
+		const atlas_sched_task &t = _tasks[task];
+		if ( t.bus != bus || ! t.asleep || t.state != ATLAS_TASK_WAITING ) continue;
+		if ( ATLAS_TIME_DIFF(by,t.release - _wakeLead(task)) < 0 ) continue;
+		if ( first == ATLAS_SCHED_NONE || ATLAS_TIME_DIFF(t.release,_tasks[first].release) < 0 ) first = task;
+	}
+	return first;
+}
+
+bool AtlasScheduler::_maySleep(const uint8_t task) const {
+	const atlas_sched_task &t = _tasks[task];
+	if ( t.sleep == TRI_OFF || ( t.sleep == TRI_UNKNOWN && ! _auto_sleep ) ) return false;
+	return t.awake_ua > t.asleep_ua;
+}
+
+void AtlasScheduler::_sooner(uint32_t &next, const uint32_t now, const uint32_t time) {
+	if ( ATLAS_TIME_DIFF(time,now) > 0 && ATLAS_TIME_DIFF(time,next) < 0 ) next = time;
+}
+
+uint32_t AtlasScheduler::_wakeLead(const uint8_t task) const {
+	return (uint32_t)_tasks[task].wake_latency + _tasks[task].settle + ATLAS_SCHED_WAKE_GUARD;
+}
+
+void AtlasScheduler::_select(const uint8_t task) {
+	const atlas_sched_task &t = _tasks[task];
+	if ( t.mux == ATLAS_SCHED_NO_MUX ) return;
+	if ( _mux[t.bus] != t.mux ) {
+		if ( _mux_callback ) _mux_callback(t.bus,t.mux,_mux_context);
+		_mux[t.bus] = t.mux;
+	}
+	for ( uint8_t other = 0 ; other < _count ; other++ ) {
+		if ( _tasks[other].bus != t.bus || _tasks[other].mux == ATLAS_SCHED_NO_MUX ) continue;
+		if ( other == task ) _tasks[other].sensor->setOnline();
+		else _tasks[other].sensor->setOffline();
+	}
+}
+
+void AtlasScheduler::_account(const uint32_t now) {
+	uint32_t elapsed = now - _accounted;
+	_accounted = now;
+	for ( uint8_t task = 0 ; task < _count ; task++ ) {
+		atlas_sched_task &t = _tasks[task];
+		uint64_t used = (uint64_t)( t.asleep ? t.asleep_ua : t.awake_ua ) * elapsed; // uA ms
+		t.charge_frac += used % 1000000;
+		t.charge_mas += used / 1000000 + t.charge_frac / 1000000;
+		t.charge_frac %= 1000000;
+		t.accounted_ms += elapsed;
+	}
+}
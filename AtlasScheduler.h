@@ -0,0 +1,169 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Takes periodic readings from many circuits without delay(). Each task
+	is one circuit with a period, or 0 for readings on request(). Each
+	service() call starts the released task with the earliest deadline on
+	every free bus, using the non-blocking startReading(). Here a bus is a
+	serial port, and tasks on one bus take turns. The deadline of a periodic
+	reading is its next release.
+	
+		uint8_t ph = sched.addTask(&PH_sensor,5000,0,0); // every 5 s, bus 0, mux channel 0
+		uint8_t dox = sched.addTask(&DO_sensor,10000,0,1);
+		uint8_t ec = sched.addTask(&EC_sensor,60000,0,2);
+		uint8_t rgb = sched.addTask(&RGB_sensor,0,1); // on request, bus 1 (no mux)
+		sched.setMuxCallback(selectChannel,NULL);
+		sched.setAutoSleep(true); // sleep between readings where it pays
+		sched.setCallback(onReading,NULL);
+		// in loop():
+		sched.service();
+		if ( button ) sched.request(rgb);
+	
+	How long a reading takes starts from the datasheet and is learned as
+	readings come in. A bus stays idle rather than start a reading that
+	would make a more urgent one, due before it finishes, late. A reading
+	that can't start before its deadline is skipped and counted as missed,
+	and so is one that finishes late.
+	
+	Sleep: after a reading, a circuit that may sleep is sent to sleep if the
+	gap to its next reading is longer than waking it back up takes, plus
+	ATLAS_SCHED_MIN_SLEEP. It is woken early enough to be ready at its
+	release: the learned time from the wake byte to "*WA", plus a settle
+	time for the readings to become valid. It is woken even earlier if a
+	reading on the same bus would otherwise hold up the wake. A circuit
+	that only reads on request sleeps until asked, so those readings are
+	late by the wake time. Charge used is tallied per circuit from its
+	awake and asleep currents (setCurrent()).
+	
+	The mux callback is called before each command on a bus when the
+	channel changes. The scheduler then sets the chosen circuit online()
+	and the others on that bus offline().
+============================================================================*/
+#ifndef _Atlas_Scheduler_h
+#define _Atlas_Scheduler_h
+
+#include <Atlas_EZO.h>
+
+#define ATLAS_SCHED_MAX_TASKS		8
+#define ATLAS_SCHED_MAX_BUSES		4
+#define ATLAS_SCHED_NO_MUX			255
+#define ATLAS_SCHED_NONE			255
+#define ATLAS_SCHED_DEMAND_DEADLINE	2000 // ms after request()
+#define ATLAS_SCHED_WAKE_LATENCY	100	// ms from wake byte to "*WA", first guess
+#define ATLAS_SCHED_WAKE_SETTLE		1000 // ms from "*WA" to a good reading
+#define ATLAS_SCHED_WAKE_GUARD		50	// ms of slack when pre-waking
+#define ATLAS_SCHED_MIN_SLEEP		2000 // ms, shorter naps aren't worth the wake
+#define ATLAS_SCHED_IDLE_MAX		60000 // ms, furthest getNextEvent() looks
+// Roughly what the EZO datasheets give at 5 V with the LED on. Measure yours.
+#define ATLAS_SCHED_AWAKE_UA		18000
+#define ATLAS_SCHED_ASLEEP_UA		1000
+
+typedef void (*atlas_mux_callback)(const uint8_t bus, const uint8_t channel, void *context);
+typedef void (*atlas_sched_callback)(const uint8_t task, EZO *sensor, const ezo_response response, void *context);
+
+enum atlas_task_state {
+	ATLAS_TASK_WAITING,	// for its release
+	ATLAS_TASK_RUNNING,	// reading in flight
+	ATLAS_TASK_IDLE		// on request, nothing requested
+};
+
+enum atlas_bus_job {
+	ATLAS_JOB_NONE,
+	ATLAS_JOB_READ,
+	ATLAS_JOB_SLEEP,	// waiting for "*SL"
+	ATLAS_JOB_WAKE		// waiting for "*WA"
+};
+
+struct atlas_sched_task {
+	EZO *			sensor;
+	uint32_t		period; // ms, 0: on request
+	uint8_t			bus;
+	uint8_t			mux; // channel or ATLAS_SCHED_NO_MUX
+	atlas_task_state	state;
+	uint32_t		release; // millis() the next reading is due
+	uint32_t		deadline;
+	uint32_t		started; // last command on the bus
+	uint16_t		duration; // expected ms, learned
+	tristate		sleep; // TRI_UNKNOWN: as setAutoSleep()
+	bool			asleep;
+	uint16_t		wake_latency; // ms from wake byte to "*WA", learned
+	uint16_t		settle; // ms from "*WA" to a good reading
+	uint32_t		ready; // millis() readings are good again after a wake
+	uint16_t		awake_ua;
+	uint16_t		asleep_ua;
+	uint32_t		charge_mas; // mA s
+	uint32_t		charge_frac; // uA ms, below 1 mA s
+	uint32_t		accounted_ms; // time the charge covers
+	uint32_t		runs;
+	uint32_t		missed;
+	uint16_t		lateness; // ms from release to start, last reading
+	uint16_t		max_lateness;
+};
+
+class AtlasScheduler {
+	public:
+		AtlasScheduler();
+		uint8_t			addTask(EZO *sensor, const uint32_t period, const uint8_t bus, const uint8_t mux = ATLAS_SCHED_NO_MUX); // ATLAS_SCHED_NONE if full
+		void			setMuxCallback(atlas_mux_callback callback, void *context) { _mux_callback = callback; _mux_context = context;}
+		void			setCallback(atlas_sched_callback callback, void *context) { _callback = callback; _context = context;}
+		void			setDuration(const uint8_t task, const uint16_t duration); // ms, replaces the datasheet figure
+		void			setAutoSleep(const bool sleep) { _auto_sleep = sleep;} // for tasks without setSleep()
+		void			setSleep(const uint8_t task, const bool sleep, const uint16_t settle = ATLAS_SCHED_WAKE_SETTLE);
+		void			setCurrent(const uint8_t task, const uint16_t awake_ua, const uint16_t asleep_ua);
+		void			setPeriod(const uint8_t task, const uint32_t period); // next release moves to now + period
+		bool			request(const uint8_t task, const uint32_t deadline = ATLAS_SCHED_DEMAND_DEADLINE); // ms from now
+		void			service();
+		// Call after service(): millis() when it next has something to do, unless a reply comes
+		// first. Until then the board can sleep, or a virtual clock skip ahead.
+		uint32_t		getNextEvent() const;
+		void			setClock(AtlasClock *clock); // the one its circuits use
+		uint32_t		getRuns(const uint8_t task) const { return task < _count ? _tasks[task].runs : 0;}
+		uint32_t		getMissed(const uint8_t task) const { return task < _count ? _tasks[task].missed : 0;}
+		uint16_t		getLateness(const uint8_t task) const { return task < _count ? _tasks[task].lateness : 0;} // start jitter, ms
+		uint16_t		getMaxLateness(const uint8_t task) const { return task < _count ? _tasks[task].max_lateness : 0;}
+		uint16_t		getDuration(const uint8_t task) const { return task < _count ? _tasks[task].duration : 0;}
+		uint16_t		getWakeLatency(const uint8_t task) const { return task < _count ? _tasks[task].wake_latency : 0;}
+		bool			isAsleep(const uint8_t task) const { return task < _count && _tasks[task].asleep;}
+		float			getCharge(const uint8_t task) const; // mAh since addTask() or resetStats()
+		float			getAverageCurrent(const uint8_t task) const; // mA
+		uint8_t			getUtilization(const uint8_t bus) const; // % of the bus the periodic tasks need
+		void			resetStats();
+	private:
+		void			_finish(const uint8_t task, const ezo_response response);
+		void			_complete(const uint8_t bus); // job on the bus is done
+		void			_nextRelease(const uint8_t task);
+		uint8_t			_pick(const uint8_t bus, const uint32_t now) const;
+		uint8_t			_wakeDue(const uint8_t bus, const uint32_t by) const; // sleeper to wake by then
+		bool			_maySleep(const uint8_t task) const;
+		uint32_t		_wakeLead(const uint8_t task) const;
+		static void		_sooner(uint32_t &next, const uint32_t now, const uint32_t time); // next = time if it's between
+		void			_select(const uint8_t task); // mux and online()
+		void			_account(const uint32_t now);
+		atlas_sched_task	_tasks[ATLAS_SCHED_MAX_TASKS];
+		uint8_t			_count;
+		uint8_t			_running[ATLAS_SCHED_MAX_BUSES]; // task with a command in flight per bus
+		atlas_bus_job	_job[ATLAS_SCHED_MAX_BUSES];
+		uint8_t			_mux[ATLAS_SCHED_MAX_BUSES]; // channel selected per bus
+		bool			_auto_sleep;
+		uint32_t		_accounted; // millis() of the last _account()
+		AtlasClock *	_clock;
+		atlas_mux_callback	_mux_callback;
+		void *			_mux_context;
+		atlas_sched_callback	_callback;
+		void *			_context;
+};
+#endif
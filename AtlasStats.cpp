@@ -0,0 +1,77 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#include <AtlasStats.h>
+#include <math.h>
+
+void AtlasStats::clear() {
+	_count = 0;
+	_last = 0.0;
+	_mean = 0.0;
+	_m2 = 0.0;
+	_min = 0.0;
+	_max = 0.0;
+	_ema = 0.0;
+	_filled = 0;
+	_oldest = 0;
+}
+
+void AtlasStats::add(const float value) {
+	_last = value;
+	_count++;
+	// Welford
+	float delta = value - _mean;
+	_mean += delta / _count;
+	_m2 += delta * ( value - _mean );
+	if ( _count == 1 ) {
+		_min = _max = _ema = value;
+	}
+	else {
+		if ( value < _min ) _min = value;
+		if ( value > _max ) _max = value;
+		_ema += _alpha * ( value - _ema );
+	}
+	// Median window: take the oldest out of the sorted copy, then insert the new one.
+	uint8_t i;
+	if ( _filled == ATLAS_STATS_WINDOW ) {
+		float old = _window[_oldest];
+		for ( i = 0 ; i < _filled - 1 && _sorted[i] != old ; i++ ) {}
+		for ( ; i < _filled - 1 ; i++ ) _sorted[i] = _sorted[i + 1];
+		_filled--;
+	}
+	_window[_oldest] = value;
+	_oldest = ( _oldest + 1 ) % ATLAS_STATS_WINDOW;
+	for ( i = _filled ; i > 0 && _sorted[i - 1] > value ; i-- ) _sorted[i] = _sorted[i - 1];
+	_sorted[i] = value;
+	_filled++;
+}
+
+float AtlasStats::getVariance() const {
+	if ( _count < 2 ) return 0.0;
+	return _m2 / ( _count - 1 );
+}
+
+float AtlasStats::getStdDev() const {
+	return sqrt(getVariance());
+}
+
+float AtlasStats::getMedian() const {
+	if ( _filled == 0 ) return 0.0;
+	if ( _filled & 1 ) return _sorted[_filled / 2];
+	return ( _sorted[_filled / 2 - 1] + _sorted[_filled / 2] ) / 2;
+}
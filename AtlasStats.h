@@ -0,0 +1,64 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Running statistics for one channel: count, mean and variance (Welford),
+	min, max, an exponential moving average and the median of the last
+	ATLAS_STATS_WINDOW values. Fixed size, no heap. Attach one to a
+	driver channel with EZO::attachStats() and it is updated as each
+	reading is parsed. Send a summary and clear() it to start the next
+	period.
+============================================================================*/
+#ifndef _Atlas_Stats_h
+#define _Atlas_Stats_h
+
+#include <Arduino.h>
+
+#ifndef ATLAS_STATS_WINDOW
+#define ATLAS_STATS_WINDOW 9 // readings in the running median. Odd is best.
+#endif
+#define ATLAS_STATS_ALPHA 0.1 // default EMA weight of the newest reading
+
+class AtlasStats {
+	public:
+		AtlasStats() { _alpha = ATLAS_STATS_ALPHA; clear();}
+		void			clear();
+		void			setAlpha(const float alpha) { _alpha = alpha;} // 0 < alpha <= 1
+		void			add(const float value);
+		uint32_t		getCount() const { return _count;}
+		float			getLast() const { return _last;}
+		float			getMean() const { return _mean;}
+		float			getVariance() const; // sample variance, 0 until there are two readings
+		float			getStdDev() const;
+		float			getMin() const { return _min;}
+		float			getMax() const { return _max;}
+		float			getEMA() const { return _ema;}
+		float			getMedian() const; // of the last ATLAS_STATS_WINDOW readings
+	private:
+		uint32_t		_count;
+		float			_last;
+		float			_mean;
+		float			_m2;	// sum of squared differences from the mean
+		float			_min;
+		float			_max;
+		float			_ema;
+		float			_alpha;
+		float			_sorted[ATLAS_STATS_WINDOW]; // window, kept in order
+		float			_window[ATLAS_STATS_WINDOW]; // window, in arrival order (ring)
+		uint8_t			_filled;
+		uint8_t			_oldest;
+};
+#endif
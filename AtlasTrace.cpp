@@ -0,0 +1,181 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#include <AtlasTrace.h>
+#include <Atlas.h> // ATLAS_TIME_DIFF
+
+/*               TEE                      */
+
+AtlasTeeTransport::AtlasTeeTransport(AtlasTransport *transport, Print *trace) {
+	_transport = transport;
+	_trace = trace;
+	_header_written = false;
+	_direction = 0;
+	_len = 0;
+	_start = 0;
+	_last_start = 0;
+	_clock = AtlasClock::arduino();
+}
+
+int AtlasTeeTransport::available() {
+	int count = _transport->available();
+	// A reply is often followed by a long quiet spell. Don't hold the record back until the next byte.
+	if ( ! count && _len && ATLAS_TIME_DIFF(_clock->millis(),_start) > ATLAS_TRACE_COALESCE ) flushTrace();
+	return count;
+}
+
+int AtlasTeeTransport::read() {
+	int byte = _transport->read();
+	if ( byte >= 0 ) _record(0,(uint8_t)byte);
+	return byte;
+}
+
+size_t AtlasTeeTransport::write(uint8_t byte) {
+	_record(ATLAS_TRACE_TX,byte);
+	return _transport->write(byte);
+}
+
+void AtlasTeeTransport::flushTrace() {
+	if ( ! _header_written ) {
+		_trace->write((const uint8_t *)ATLAS_TRACE_MAGIC,4);
+		_header_written = true;
+		_last_start = _start;
+	}
+	if ( ! _len ) return;
+	_trace->write((uint8_t)(_direction | _len));
+	uint32_t delta = _start - _last_start;
+	do { // LEB128
+		uint8_t b = delta & 0x7F;
+		delta >>= 7;
+		_trace->write((uint8_t)(delta ? b | 0x80 : b));
+	} while ( delta );
+	_trace->write(_buf,_len);
+	_last_start = _start;
+	_len = 0;
+}
+
+void AtlasTeeTransport::_record(const uint8_t direction, const uint8_t byte) {
+	uint32_t now = _clock->millis();
+	if ( _len && ( direction != _direction || _len >= ATLAS_TRACE_MAX_RECORD || ATLAS_TIME_DIFF(now,_start) > ATLAS_TRACE_COALESCE ) ) {
+		flushTrace();
+	}
+	if ( ! _len ) {
+		if ( ! _header_written ) {
+			_start = now;
+			flushTrace(); // just the header
+		}
+		_direction = direction;
+		_start = now;
+	}
+	_buf[_len++] = byte;
+}
+
+/*               REPLAY                      */
+
+AtlasReplayTransport::AtlasReplayTransport(Stream *trace) {
+	_trace = trace;
+	_speed = 1.0;
+	_end = false;
+	_direction = 0;
+	_remaining = 0;
+	_due = 0;
+	_mismatches = 0;
+	_dropped = 0;
+	_clock = AtlasClock::arduino();
+}
+
+bool AtlasReplayTransport::open() {
+	const char magic[] = ATLAS_TRACE_MAGIC;
+	for ( uint8_t i = 0 ; i < 4 ; i++ ) {
+		if ( _trace->read() != magic[i] ) {
+			_end = true;
+			return false;
+		}
+	}
+	_due = _clock->millis();
+	return _nextRecord();
+}
+
+int AtlasReplayTransport::available() {
+	return _rxDue() ? _remaining : 0;
+}
+
+int AtlasReplayTransport::peek() {
+	return _rxDue() ? _trace->peek() : -1;
+}
+
+int AtlasReplayTransport::read() {
+	if ( ! _rxDue() ) return -1;
+	int byte = _trace->read();
+	if ( --_remaining == 0 ) _nextRecord();
+	return byte;
+}
+
+size_t AtlasReplayTransport::write(uint8_t byte) {
+	// Whatever the circuit said that the driver didn't read is gone once the driver moves on.
+	while ( _remaining && _direction != ATLAS_TRACE_TX ) {
+		_trace->read();
+		_dropped++;
+		if ( --_remaining == 0 ) _nextRecord();
+	}
+	if ( ! _remaining ) {
+		_mismatches++; // Trace is finished, driver is still talking
+		return 1;
+	}
+	if ( _trace->read() != byte ) _mismatches++;
+	if ( --_remaining == 0 ) {
+		_due = _clock->millis(); // The reply is timed from the end of the command
+		_nextRecord();
+	}
+	return 1;
+}
+
+/*              PRIVATE METHODS                      */
+
+bool AtlasReplayTransport::_nextRecord() {
+	int tag = _trace->read();
+	if ( tag < 0 ) {
+		_end = true;
+		_remaining = 0;
+		return false;
+	}
+	uint32_t delta = 0;
+	uint8_t shift = 0;
+	int b;
+	do {
+		b = _trace->read();
+		if ( b < 0 ) break;
+		delta |= (uint32_t)(b & 0x7F) << shift;
+		shift += 7;
+	} while ( ( b & 0x80 ) && shift < 32 );
+	_direction = tag & ATLAS_TRACE_TX;
+	_remaining = tag & 0x7F;
+	_due += _scale(delta);
+	if ( ! _remaining ) return _nextRecord(); // empty record, shouldn't happen
+	return true;
+}
+
+bool AtlasReplayTransport::_rxDue() {
+	if ( ! _remaining || _direction == ATLAS_TRACE_TX ) return false;
+	return ATLAS_TIME_DIFF(_clock->millis(),_due) >= 0;
+}
+
+uint32_t AtlasReplayTransport::_scale(const uint32_t delta_ms) const {
+	if ( _speed <= 0 ) return 0;
+	return (uint32_t)( delta_ms / _speed );
+}
@@ -0,0 +1,98 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Record and replay the byte stream exchanged with a circuit.
+	
+	Trace format: the 4 byte magic "ATR1", then records of
+		<tag> <delta_ms> <payload>
+	tag		bit 7 set for bytes sent to the circuit (TX), clear for bytes
+			received from it (RX). Bits 0-6 are the payload length, 1-127.
+	delta_ms	milliseconds since the previous record, as a LEB128 varint.
+	payload	the bytes themselves.
+============================================================================*/
+#ifndef _Atlas_Trace_h
+#define _Atlas_Trace_h
+
+#include <Arduino.h>
+#include <AtlasTransport.h>
+#include <AtlasClock.h>
+
+#define ATLAS_TRACE_MAGIC		"ATR1"
+#define ATLAS_TRACE_TX			0x80
+#ifndef ATLAS_TRACE_MAX_RECORD
+	#define ATLAS_TRACE_MAX_RECORD	32	// bytes buffered before a record is written. 127 max.
+#endif
+#define ATLAS_TRACE_COALESCE	2	// ms. Bytes closer together than this share a record.
+
+// Passes everything through to another transport and writes a trace of it to a Print (SD file, FILE...).
+class AtlasTeeTransport: public AtlasTransport {
+	public:
+		AtlasTeeTransport(AtlasTransport *transport, Print *trace);
+		void			begin(const uint32_t baud_rate) { _transport->begin(baud_rate);}
+		int				available();
+		int				read();
+		int				peek() { return _transport->peek();}
+		size_t			write(uint8_t byte);
+		void			flush() { _transport->flush();}
+		void			flushTrace(); // Write out the record being built. Call before closing the trace.
+		void			setClock(AtlasClock *clock) { _clock = clock;} // times the records
+		using Print::write;
+	private:
+		void			_record(const uint8_t direction, const uint8_t byte);
+		AtlasTransport*	_transport;
+		Print*			_trace;
+		bool			_header_written;
+		uint8_t			_direction;
+		uint8_t			_len;
+		uint32_t		_start;			// time of first byte in _buf
+		uint32_t		_last_start;	// time of the previous record
+		AtlasClock *	_clock;
+		uint8_t			_buf[ATLAS_TRACE_MAX_RECORD];
+};
+
+// Plays a trace back as if it were the circuit. RX bytes become available at their recorded
+// times, measured from when the driver finished sending the command they answer.
+class AtlasReplayTransport: public AtlasTransport {
+	public:
+		AtlasReplayTransport(Stream *trace);
+		bool			open(); // Check the magic. Returns false if this isn't a trace.
+		void			setSpeed(const float speed) { _speed = speed;} // 1.0 = as recorded, 0 = no waiting
+		bool			done() const { return _remaining == 0 && _end;}
+		uint16_t		getMismatches() const { return _mismatches;} // TX bytes that differed from the trace
+		uint16_t		getDropped() const { return _dropped;} // RX bytes the driver never read
+		void			setClock(AtlasClock *clock) { _clock = clock;} // before open()
+		void			begin(const uint32_t) {} // replay runs at whatever rate was recorded
+		int				available();
+		int				read();
+		int				peek();
+		size_t			write(uint8_t byte);
+		using Print::write;
+	private:
+		bool			_nextRecord(); // load the next record header
+		bool			_rxDue();
+		uint32_t		_scale(const uint32_t delta_ms) const;
+		Stream*			_trace;
+		float			_speed;
+		bool			_end;
+		uint8_t			_direction;
+		uint8_t			_remaining; // payload bytes left in this record
+		uint32_t		_due;		// when this record's bytes may be read
+		uint16_t		_mismatches;
+		uint16_t		_dropped;
+		AtlasClock *	_clock;
+};
+#endif
@@ -0,0 +1,52 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	A transport is anything that carries bytes to and from a circuit: a
+	HardwareSerial port, a Linux tty (see host/), or a trace being recorded
+	or replayed (see AtlasTrace.h).
+============================================================================*/
+#ifndef _Atlas_Transport_h
+#define _Atlas_Transport_h
+
+#include <Arduino.h>
+#include <HardwareSerial.h>
+
+class AtlasTransport: public Stream {
+	public:
+		virtual void	begin(const uint32_t baud_rate) = 0;
+		virtual void	flush() {}
+		using Print::write;
+};
+
+// Wraps a HardwareSerial. Atlas::begin(HardwareSerial *,baud) uses one of these internally.
+class AtlasSerialTransport: public AtlasTransport {
+	public:
+		AtlasSerialTransport() { _serial = NULL;}
+		AtlasSerialTransport(HardwareSerial *serial) { _serial = serial;}
+		void			setSerial(HardwareSerial *serial) { _serial = serial;}
+		void			begin(const uint32_t baud_rate) { _serial->begin(baud_rate);}
+		int				available() { return _serial->available();}
+		int				read() { return _serial->read();}
+		int				peek() { return _serial->peek();}
+		size_t			write(uint8_t byte) { return _serial->write(byte);}
+		size_t			write(const uint8_t *buffer, size_t size) { return _serial->write(buffer,size);}
+		void			flush() { _serial->flush();}
+		using Print::write;
+	private:
+		HardwareSerial*	_serial;
+};
+#endif
@@ -29,6 +29,7 @@ Copyright (c) 2015 Ryan Neve <Ryan@PlanktosInstruments.com>
 
 #include <HardwareSerial.h>
 #include <Atlas_EZO.h>
+#include <AtlasStats.h>
 
 
 
@@ -47,6 +48,7 @@ void EZO::printResponse(char * buf, const ezo_response response){
 		case EZO_RESPONSE_RE:		strncpy(buf,"RE",3); break; 	// The circuit has com
 		case EZO_RESPONSE_SL:		strncpy(buf,"SL",3); break; 	// The circuit has bee
 		case EZO_RESPONSE_WA:		strncpy(buf,"WA",3); break; 	// The circuit has wok
+		case EZO_RESPONSE_BR:		strncpy(buf,"BR",3); break; 	// Unresponsive, not sent
 		case EZO_I2C_RESPONSE_NA:	strncpy(buf,"INA",4); break; 	// No Data = 255
 		case EZO_I2C_RESPONSE_ND:	strncpy(buf,"IND",4); break; 	// No Data = 255
 		case EZO_I2C_RESPONSE_PE:	strncpy(buf,"IPE",4); break; 	// Pending = 254
@@ -59,24 +61,21 @@ void EZO::printResponse(char * buf, const ezo_response response){
 
 ezo_response EZO::enableContinuousReadings(){
 	if ( _i2c_address != 0 ) return EZO_I2C_RESPONSE_NA; // i2c mode has no continuous mode
-	strncpy(_command,"C,1\r",ATLAS_COMMAND_LENGTH);
-	return _sendCommand(_command,false,true);
+	return _sendCommand("C,1\r",false,true);
 }
 ezo_response EZO::disableContinuousReadings(){
 	if ( _i2c_address != 0 ) {
 		_continuous_mode = TRI_OFF;
 		return EZO_RESPONSE_OK; // i2c mode has no continuous mode
 	}
-	strncpy(_command,"C,0\r",ATLAS_COMMAND_LENGTH);
-	return _sendCommand(_command,false,true);
+	return _sendCommand("C,0\r",false,true);
 }
 ezo_response EZO::queryContinuousReadings(){
 	if ( _i2c_address != 0 ) {
 		_continuous_mode = TRI_OFF;
 		return EZO_RESPONSE_NA; // i2c mode has no continuous mode
 	}
-	strncpy(_command,"C,?\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,true);
+	ezo_response response = _sendCommand("C,?\r",true,true);
 	_continuous_mode = TRI_UNKNOWN;
 	// _result will be "?C,<0|1>\r"
 	if ( _result[0] == '?' && _result[1] == 'C' && _result[2] == ',') {
@@ -88,15 +87,15 @@ ezo_response EZO::queryContinuousReadings(){
 
 
 ezo_response EZO::queryCalibration() {
-	strncpy(_command,"Cal,?\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,true);
-	// _result will be "?Cal,<n>\r"
-	char * pch;
-	pch = strtok(_result,",\r");
-	if ( !_strCmp(pch,"Cal,")) {
-		pch = strtok(NULL, ",\r"); // should be a single digit
+	ezo_response response = _sendCommand("Cal,?\r",true,true);
+	parseCalibration();
+	return response;
+}
+void EZO::parseCalibration() {
+	// _result will be "?CAL,<n>\r" (case varies with firmware)
+	if ( !strncasecmp(_result,"?CAL,",5)) {
 		_calibration_status	= EZO_CAL_UNKNOWN;
-		switch ( pch[0] ) {
+		switch ( _result[5] ) { // should be a single digit
 			case '0': // All
 				_calibration_status	= EZO_CAL_NOT_CALIBRATED;
 				break;
@@ -114,44 +113,43 @@ ezo_response EZO::queryCalibration() {
 				break;
 		}
 	}
-	return response;
 }
 
 ezo_response EZO::clearCalibration(){
-	strncpy(_command,"Cal,clear\r",ATLAS_COMMAND_LENGTH);
-	return _sendCommand(_command,false,true);
+	return _sendCommand("Cal,clear\r",false,true);
 }
 
 ezo_response EZO::setName(char * name){
-	_command_len = sprintf(_command,"NAME,%s\r",name);
-	return _sendCommand(_command,false,true);
+	_putCommand("NAME,"); _putCommand(name); _putChar('\r');
+	return _endCommand(false,true);
 }
 ezo_response EZO::queryName(){
-	strncpy(_command,"NAME,?\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,true);
+	ezo_response response = _sendCommand("NAME,?\r",true,true);
 	// Parse _result
 	// Format: "?NAME,<NAME>\r". If there is no name, nothing will be returned!
 	char * pch;
 	pch = strtok(_result,",\r"); // should be "?NAME"
 	if ( !_strCmp(pch,"?NAME")) {
 		pch = strtok(NULL, ",\r");
-		strncpy(_name,pch,sizeof(_name));
+		if ( pch ) strncpy(_name,pch,sizeof(_name));
+		else _name[0] = 0;
 	}
 	else strncpy(_name,"UNKNOWN",EZO_NAME_LENGTH); // TEMPORARY UNTIL WE ACTUALLY DO THE PARSING
 	return response;
 }
 
 ezo_response EZO::queryInfo(){
-	strncpy(_command,"I\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,true);
+	ezo_response response = _sendCommand("I\r",true,true);
 	// reply is in the format "?I,<device>,<firmware>\r"
 	char * pch;
+	if ( _result_len <= 3 ) return response; // no reply, or not one we know
 	pch = strtok(_result+ 3,",\r");
 	if      ( !_strCmp(pch,"DO"))  _circuit_type = EZO_DO_CIRCUIT;
 	else if ( !_strCmp(pch,"EC"))  _circuit_type = EZO_EC_CIRCUIT;
 	else if ( !_strCmp(pch,"ORP")) _circuit_type = EZO_ORP_CIRCUIT;
 	else if ( !_strCmp(pch,"PH"))  _circuit_type = EZO_PH_CIRCUIT;
-	pch = strtok(NULL, ",\r");
+	if ( pch ) pch = strtok(NULL, ",\r");
+	if ( !pch ) return response;
 	strncpy(_firmware,pch,6);
 	//float firmware_f = atof(pch);
 	if ( _checkVersionResetCommand(atof(_firmware)) ) strncpy(_reset_command, "Factory",8); 
@@ -168,16 +166,17 @@ boolean EZO::_checkVersionResetCommand(const float firmware_f){
 	return false;
 }
 ezo_response EZO::enableLED(){
-	strncpy(_command,"L,1\r",ATLAS_COMMAND_LENGTH);
-	return _sendCommand(_command,false,true);
+	return _sendCommand("L,1\r",false,true);
 }
 ezo_response EZO::disableLED(){
-	strncpy(_command,"L,0\r",ATLAS_COMMAND_LENGTH);
-	return _sendCommand(_command,false,true);
+	return _sendCommand("L,0\r",false,true);
 }
 ezo_response EZO::queryLED(){
-	strncpy(_command,"L,?\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,true);
+	ezo_response response = _sendCommand("L,?\r",true,true);
+	parseLED();
+	return response;
+}
+void EZO::parseLED(){
 	_led = TRI_UNKNOWN;
 	// Parse _result
 	// Format: "?L,<1|0>\r"
@@ -185,18 +184,18 @@ ezo_response EZO::queryLED(){
 	pch = strtok(_result,",\r");
 	if ( !_strCmp(pch,"?L")) {
 		pch = strtok(NULL, ",\r");
-		if ( pch[0] == '0')			_led = TRI_OFF;
+		if ( !pch )					_led = TRI_UNKNOWN;
+		else if ( pch[0] == '0')	_led = TRI_OFF;
 		else if ( pch[0] == '1')	_led = TRI_ON;
 		else						_led = TRI_UNKNOWN;
 	}
-	return response;
 }
 
 ezo_response EZO::setI2CAddress(uint8_t address){
 	ezo_response response = EZO_RESPONSE_ER;
 	if ( address >= I2C_MIN_ADDRESS && address <= I2C_MAX_ADDRESS ){
-		_command_len = sprintf(_command,"I2C,%d\r",address);
-		response = _sendCommand(_command, false,true);
+		_putCommand("I2C,"); _putUInt(address); _putChar('\r');
+		response = _endCommand(false,true);
 		if ( response != EZO_RESPONSE_ER ) _i2c_address = address;
 	}
 	else response = EZO_RESPONSE_ER;
@@ -205,13 +204,13 @@ ezo_response EZO::setI2CAddress(uint8_t address){
 
 ezo_response EZO::enableResponse(){
 	if ( _i2c_address != 0 ) return EZO_I2C_RESPONSE_S; // Not Applicable
-	_command_len = sprintf(_command,"%s,1\r",EZO_RESPONSE_COMMAND);
-	return _sendCommand(_command,false,true);
+	_putCommand(EZO_RESPONSE_COMMAND); _putCommand(",1\r");
+	return _endCommand(false,true);
 }
 ezo_response EZO::disableResponse(){
 	if ( _i2c_address != 0 ) return EZO_I2C_RESPONSE_F; // Not Applicable
-	_command_len = sprintf(_command,"%s,0\r",EZO_RESPONSE_COMMAND);
-	return _sendCommand(_command,false,false);
+	_putCommand(EZO_RESPONSE_COMMAND); _putCommand(",0\r");
+	return _endCommand(false,false);
 }
 tristate EZO::queryResponse() {
 	// Se if response_mode is on.
@@ -219,20 +218,21 @@ tristate EZO::queryResponse() {
 		_response_mode = TRI_ON;  // Always on for i2c
 	}
 	else {
-		_command_len = sprintf(_command,"%s,?\r",EZO_RESPONSE_COMMAND);
-		_sendCommand(_command, true,true); // Documentation is wrong
+		_putCommand(EZO_RESPONSE_COMMAND); _putCommand(",?\r");
+		_endCommand(true,true); // Documentation is wrong
 		// Parse _result. Reply should be "?RESPONSE,<1|0>\r";
 		char * pch;
 		pch = strtok(_result,",\r");
 		//Serial.print("Checking("); Serial.print(pch); Serial.println(")");
 		if ( !_strCmp(pch,"?RESPONSE")) {
 			pch = strtok(NULL, ",\r");
-			if ( pch[0] == '0') 		_response_mode = TRI_OFF;
+			if ( !pch )					_response_mode = TRI_UNKNOWN;
+			else if ( pch[0] == '0') 	_response_mode = TRI_OFF;
 			else if ( pch[0] == '1')	_response_mode = TRI_ON;
 			else						_response_mode = TRI_UNKNOWN;
 		}
 		if (debug()) {
-			Serial.print(F("Response mode from: ")); Serial.print(pch);
+			Serial.print(F("Response mode from: ")); if ( pch ) Serial.print(pch);
 			if ( _response_mode == TRI_OFF ) Serial.println(F(" off"));
 			else if ( _response_mode == TRI_ON ) Serial.println(F(" on"));
 			else if ( _response_mode == TRI_UNKNOWN ) Serial.println(F(" unknown"));
@@ -258,9 +258,9 @@ ezo_response EZO::setBaudRate(const uint32_t baud_rate) {
 			return EZO_RESPONSE_ER;
 	}
 	// send command to circuit
-	_command_len = sprintf(_command,"SERIAL,%lu\r",_baud_rate);
-	ezo_response response = _sendCommand(_command,false,true);
-	Serial_AS->begin(_baud_rate); // This might better be done elsewhere....
+	_putCommand("SERIAL,"); _putUInt(_baud_rate); _putChar('\r');
+	ezo_response response = _endCommand(false,true);
+	Serial_AS->begin(_clock->baudRate(_baud_rate)); // This might better be done elsewhere....
 	_delayUntilSerialData(500);	flushSerial(); // We might get a *RS and *RE after this which we want to ignore
 	return response;
 }
@@ -272,7 +272,7 @@ ezo_response EZO::fixBaudRate(const uint32_t desired_baud_rate){
 	ezo_response response;
 	for ( i = 0 ; i < 7 ; i++) {
 		//Serial.print("Trying baud rate:"); Serial.println(baud_rates[i]);
-		Serial_AS->begin(baud_rates[i]); // Sets local baud rate
+		Serial_AS->begin(_clock->baudRate(baud_rates[i])); // Sets local baud rate
 		Serial_AS->write('\r');
 		//_delayUntilSerialData(500);	flushSerial();
 		disableContinuousReadings(); 
@@ -286,26 +286,33 @@ ezo_response EZO::fixBaudRate(const uint32_t desired_baud_rate){
 	//Serial_AS->write('\r');
 	//flushSerial();
 	//return setBaudRate(_baud_rate);
-	delay(1000 >> CLKPR);	flushSerial();
+	_clock->delay(1000);	flushSerial();
 	return response;
 }
 
 ezo_response EZO::sleep(){
-	strncpy(_command,"SLEEP\r",ATLAS_COMMAND_LENGTH);
-	return _sendCommand(_command, false,true);
+	_expect_event = EZO_RESPONSE_SL;
+	ezo_response response = _sendCommand("SLEEP\r", false,true);
+	_expect_event = EZO_RESPONSE_UK;
+	return response;
 }
 ezo_response EZO::wake(){
 	flushSerial();	//Need to clear "*SL"
-	strncpy(_command,"\r",ATLAS_COMMAND_LENGTH); // any character
-	return _sendCommand(_command, false,true); // EZO_RESPONSE_WA if successful
+	_expect_event = EZO_RESPONSE_WA;
+	ezo_response response = _sendCommand("\r", false,true); // EZO_RESPONSE_WA if successful
+	_expect_event = EZO_RESPONSE_UK;
+	return response;
 }
 
 ezo_response EZO::queryStatus(){
-	strncpy(_command,"STATUS\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command, true, true);
+	ezo_response response = _sendCommand("STATUS\r", true, true);
+	parseStatus();
+	return response;
+}
+void EZO::parseStatus(){
 	// _result should be in the format "?STATUS,<ezo_restart_code>,<voltage>\r"
 	// parse code into ezo_restart_code;
-	Serial.print(F("Parsing(")); Serial.print(_result); Serial.println(")");
+	if ( debug() ) { Serial.print(F("Parsing(")); Serial.print(_result); Serial.println(")");}
 	char code = 'U';
 	if ( _result[0] == '?' ) {
 		code = _result[8];
@@ -318,51 +325,184 @@ ezo_response EZO::queryStatus(){
 			default:  _restart_code = EZO_RESTART_N; break;	// none or no response
 		}
 		// parse voltage
-		Serial.print(F("Parsing(")); Serial.print(_result+10); Serial.println(")");
+		if ( debug() ) { Serial.print(F("Parsing(")); Serial.print(_result+10); Serial.println(")");}
 		_voltage = atof(_result + 10);
 		if ( debug() ) { Serial.print(F("Voltage is:")); Serial.println(_voltage);}
 	}
-	return response;
 }
 
 ezo_response EZO::reset(){
-	_command_len = sprintf(_command,"%s\r",_reset_command); // depends on device now.
-	//strncpy(_command,"X\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,false, true);
+	_putCommand(_reset_command); _putChar('\r'); // depends on device now.
+	_expect_event = EZO_RESPONSE_RS;
+	ezo_response response = _endCommand(false, true);
+	_expect_event = EZO_RESPONSE_UK;
 	// User should REALLY call child.initiaize() after this.
 	return response;
 }
 
 ezo_response EZO::setTempComp(const float temp_C){
-	char buf[10];
-	dtostrf(temp_C,4,1,buf);
 	_temp_comp = temp_C; // store value locally
-	_command_len = sprintf(_command,"T,%s\r",buf);
-	return _sendCommand(_command, false,true);
+	_putCommand("T,"); _putFixed(temp_C,1); _putChar('\r');
+	return _endCommand(false,true);
+}
+ezo_response EZO::setCompensation(const ezo_compensation kind, const float value){
+	if ( kind == EZO_COMP_TEMP ) return setTempComp(value);
+	return EZO_RESPONSE_ER;
+}
+
+ezo_response EZO::querySingleReading(){
+	ezo_response response = _sendCommand("R\r",true,2000,true); // with 2 sec timeout
+	_parseReading();
+	return response;
 }
+
+ezo_response EZO::queryReadingWithTemp(const float temp_C){
+	_putCommand("RT,"); _putFixed(temp_C,1); _putChar('\r');
+	ezo_response response = _endCommand(true,2000,true);
+	if ( response != EZO_RESPONSE_ER ) _temp_comp = temp_C;
+	_parseReading();
+	return response;
+}
+
 ezo_response EZO::queryTempComp(){
-	strncpy(_command,"T,?\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command, true,true);
+	ezo_response response = _sendCommand("T,?\r", true,true);
+	parseTempComp();
+	return response;
+}
+void EZO::parseTempComp(){
 	// _result should be in the format "?T,<temp_C>\r"
 	_temp_comp = EZO_EC_DEFAULT_TEMP;
 	if ( _result[0] == '?' && _result[1] == 'T' ) {
 		_temp_comp = atof(_result + 3);
 	}
 	if ( debug() ) {Serial.print(F("Temperature Compensation set to:")); Serial.println(_temp_comp);}
-	return response;
 }
  
+/*              READING LAYOUTS                      */
+
+ezo_layout_group EZO::layoutGroup(const ezo_layout_group *layout, const uint8_t group) {
+	ezo_layout_group entry;
+	memcpy_P(&entry,&layout[group],sizeof(entry));
+	return entry;
+}
+
+uint8_t EZO::layoutFields(const ezo_layout_group *layout, const uint8_t groups, const uint8_t outputs, uint8_t *fields) {
+	uint8_t count = 0;
+	for ( uint8_t group = 0 ; group < groups ; group++ ) {
+		ezo_layout_group entry = layoutGroup(layout,group);
+		if ( entry.output && !( outputs & entry.output ) ) continue;
+		if ( entry.tag && count < EZO_LAYOUT_FIELDS ) fields[count++] = EZO_LAYOUT_TAG;
+		for ( uint8_t value = 0 ; value < entry.values && count < EZO_LAYOUT_FIELDS ; value++ ) fields[count++] = entry.channel + value;
+	}
+	return count;
+}
+
+/*              NON-BLOCKING COMMANDS                      */
+
+bool EZO::startCommand(const char * command, const bool has_result, const bool has_response){
+	return startCommand(command, has_result, has_response, NULL);
+}
+
+bool EZO::startCommand(const char * command, const bool has_result, const bool has_response, ezo_parser parser){
+	// Returns false if nothing was sent. getLastResponse() says why.
+	if ( _cmd_state != EZO_CMD_IDLE ) return false; // finish the last one first
+	if ( offline() )		{ _last_response = EZO_RESPONSE_OL; return false;}
+	if ( _i2c_address != 0 ){ _last_response = EZO_I2C_RESPONSE_NA; return false;}
+	if ( ! _beginCommand() ) { _commandSent(); _last_response = EZO_RESPONSE_BR; return false;}
+	_putCommand(command);
+	_commandSent();
+	_markRequest();
+	_result_len = 0; _result[0] = 0;
+	_response_len = 0; _response[0] = 0;
+	// "*SL" and "*WA" come even with response codes off
+	_cmd_has_response = has_response && ( _response_mode != TRI_OFF || _expect_event != EZO_RESPONSE_UK );
+	_cmd_replied = false;
+	_cmd_parser = parser;
+	_last_response = has_response ? EZO_RESPONSE_UK : EZO_RESPONSE_NA;
+	if ( has_result )				_cmd_state = EZO_CMD_WAIT_RESULT;
+	else if ( _cmd_has_response )	_cmd_state = EZO_CMD_WAIT_RESPONSE;
+	else							_cmd_state = EZO_CMD_DONE;
+	if ( _cmd_state == EZO_CMD_WAIT_RESPONSE ) _framer.setDataBuffer(NULL,0);
+	_cmd_deadline = _clock->millis() + ( has_result ? EZO_RESULT_TIMEOUT : EZO_RESPONSE_TIMEOUT );
+	return true;
+}
+
+bool EZO::startSleep(){
+	_expect_event = EZO_RESPONSE_SL;
+	if ( startCommand("SLEEP\r",false,true) ) return true;
+	_expect_event = EZO_RESPONSE_UK;
+	return false;
+}
+
+bool EZO::startWake(){
+	// Any byte wakes the circuit. Nothing but "*SL" can be waiting, and the framer skips events.
+	_expect_event = EZO_RESPONSE_WA;
+	if ( startCommand("\r",false,true) ) return true;
+	_expect_event = EZO_RESPONSE_UK;
+	return false;
+}
+
+bool EZO::pollCommand(){
+	while ( ( _cmd_state == EZO_CMD_WAIT_RESULT || _cmd_state == EZO_CMD_WAIT_RESPONSE ) && Serial_AS->available() > 0 ) {
+		int c = Serial_AS->read();
+		if ( c < 0 ) break;
+		atlas_frame_type frame = _frameByte(c);
+		if ( frame == ATLAS_FRAME_EVENT && _code_pending ) { // the event startSleep()/startWake() waits for
+			_code_pending = false;
+			_cmd_replied = true;
+			_last_response = _expect_event;
+			_cmd_state = EZO_CMD_DONE;
+			break;
+		}
+		if ( frame == ATLAS_FRAME_NONE || frame == ATLAS_FRAME_EVENT ) continue;
+		_cmd_replied = true;
+		if ( frame == ATLAS_FRAME_RESPONSE ) {
+			// "*OK", or e.g. "*ER" where the result should be
+			strncpy(_response,_framer.code(),EZO_RESPONSE_LENGTH - 1);
+			_response[EZO_RESPONSE_LENGTH - 1] = 0;
+			_response_len = strlen(_response);
+			_last_response = _decodeResponse(_response);
+			_cmd_state = EZO_CMD_DONE;
+		}
+		else if ( _cmd_state != EZO_CMD_WAIT_RESULT ) continue; // stray data line, already ignored by the framer
+		else if ( _cmd_has_response ) {
+			_cmd_state = EZO_CMD_WAIT_RESPONSE;
+			_cmd_deadline = _clock->millis() + EZO_RESPONSE_TIMEOUT;
+			_framer.setDataBuffer(NULL,0); // keep the result safe until it is parsed
+		}
+		else _cmd_state = EZO_CMD_DONE;
+	}
+	if ( _cmd_state == EZO_CMD_DONE ) _framer.setDataBuffer(_result,ATLAS_SERIAL_RESULT_LEN);
+	if ( ( _cmd_state == EZO_CMD_WAIT_RESULT || _cmd_state == EZO_CMD_WAIT_RESPONSE ) && ATLAS_TIME_DIFF(_clock->millis(),_cmd_deadline) >= 0 ) {
+		if ( _cmd_state == EZO_CMD_WAIT_RESULT ) { _result_len = 0; _result[0] = 0;}
+		_cmd_state = EZO_CMD_DONE; // Timed out. _last_response stays UK.
+		_framer.setDataBuffer(_result,ATLAS_SERIAL_RESULT_LEN);
+	}
+	return _cmd_state == EZO_CMD_DONE;
+}
+
+ezo_response EZO::finishCommand(){
+	if ( _cmd_state != EZO_CMD_DONE ) return EZO_RESPONSE_UK; // not finished
+	_cmd_state = EZO_CMD_IDLE;
+	_expect_event = EZO_RESPONSE_UK;
+	if ( _cmd_replied ) _commandSucceeded();
+	else if ( _cmd_has_response || _result_len || _cmd_parser ) _commandFailed();
+	if ( _cmd_parser ) (this->*_cmd_parser)();
+	_cmd_parser = NULL;
+	return _last_response;
+}
+
 /*              COMMON PRIVATE METHODS                      */
 
 void EZO::_initialize() {
 	// Get setup values
-	delay(2000 >> CLKPR);
+	_clock->delay(2000);
 	for (uint8_t tries = 0; tries < 3; tries++) {
 		if (debug())	Serial.println(F("Flushing Serial, "));
 		flushSerial();
 		if (debug()) Serial.println(F("Querying Response, "));
 		queryResponse();
-		if (connected()) break;
+		if (connected() || getHealth() == ATLAS_HEALTH_OPEN) break;
 	}
 	if (!connected()) {
 		if (debug()) Serial.println(F("Communications falure, aborting"));
@@ -377,9 +517,7 @@ void EZO::_initialize() {
 	if (debug()) Serial.println(F("Querying continuous readings, "));
 	queryContinuousReadings();
 	if (debug()) {
-		char buf[40];
-		sprintf(buf,"Continuous result: %s.",getResult());
-		Serial.println(buf);
+		Serial.print(F("Continuous result: ")); Serial.println(getResult());
 		Serial.println(F("Querying status, "));
 	}
 	queryStatus();
@@ -393,35 +531,47 @@ ezo_response EZO::_sendCommand(const char * command, const bool has_result, cons
 }
 
 ezo_response EZO::_sendCommand(const char * command, const bool has_result, const uint16_t result_delay, const bool has_response) {
-	if ( offline() ) return EZO_RESPONSE_OL;
-	char byte_to_send = command[0];
+	if ( _i2c_address == 0 && online() ) _putCommand(command);
+	return _endCommand(has_result, result_delay, has_response);
+}
+
+ezo_response EZO::_endCommand(const bool has_result, const bool has_response){
+	return _endCommand(has_result, 0, has_response); // no extra delay
+}
+
+ezo_response EZO::_endCommand(const bool has_result, const uint16_t result_delay, const bool has_response) {
+	// The command has already been written by _putCommand() and friends. Collect result and response.
+	if ( ! _commandSent() ) {
+		_result_len = 0; _result[0] = 0; // Nothing was sent, so there is no reply for the parser
+		if ( offline() ) return EZO_RESPONSE_OL;
+		return _last_response = EZO_RESPONSE_BR;
+	}
+	_markRequest();
 	if ( _i2c_address == 0 ) {
-		//uint8_t command_len = sizeof(&command);
-		if ( debug() ) Serial.print(F("Sending command:"));
-		int8_t i = 0;
-		while (byte_to_send != 0 && i < ATLAS_COMMAND_LENGTH) {
-			Serial_AS->write((uint8_t)byte_to_send);
-			if ( debug() ) {
-				if ( byte_to_send == '\r' ) Serial.println(F("<CR>"));
-				else Serial.write((char)byte_to_send);
-			}
-			i++;
-			byte_to_send = command[i];
-		}
+		bool replied = true;
 		if ( has_result ) {
 			if ( _delayUntilSerialData(SEND_COMMAND_DELAY) != -1 ) {
 				_getResult(result_delay);
 			}
-			else if ( debug() ) Serial.println(F("No data found while waiting for result"));
+			else {
+				replied = false;
+				_result_len = 0; _result[0] = 0; // Don't leave the last reply for the parser
+				if ( debug() ) Serial.println(F("No data found while waiting for result"));
+			}
 		}
-		if ( has_response ) {
-			delay(300 >> CLKPR);
-			if ( Serial_AS->peek() == '*' || _response_mode == TRI_ON  || _response_mode == TRI_UNKNOWN ) {
+		if ( has_response && ( replied || ! has_result ) ) { // No point waiting for a response to a command that was ignored
+			_clock->delay(300);
+			if ( _code_pending || _expect_event != EZO_RESPONSE_UK || Serial_AS->peek() == '*' || _response_mode == TRI_ON  || _response_mode == TRI_UNKNOWN ) {
 				_last_response = _getResponse();
+				if ( _response_len == 0 ) replied = false;
 			}
 			else _last_response = EZO_RESPONSE_UK;
 		}
+		else if ( has_response ) _last_response = EZO_RESPONSE_UK;
 		else _last_response = EZO_RESPONSE_NA;
+		if ( ! has_result && ! has_response ) {} // Nothing to judge the circuit by
+		else if ( replied ) _commandSucceeded();
+		else _commandFailed();
 	}
 	else { // i2c NOT DONE YET
 		// Send command via i2c
@@ -440,20 +590,18 @@ ezo_response EZO::_getResponse(){ // Serial only
 	else {
 		// If _resonse_mode is ON, check for command response.
 		// Response should be a two letter code preceded by '*'
-		//if ( Serial_AS->peek() == -1 || ) 
-		_delayUntilSerialData(1000); // Wait for first non <CR> data
-		_response_len = Serial_AS->readBytesUntil('\r',_response,EZO_RESPONSE_LENGTH);
-		// format: "*<ezo_response>\r"
-		if (_response_mode == TRI_OFF)			_last_response = EZO_RESPONSE_NA;
-		else if ( !memcmp(_response,"*OK",3))	{ _last_response = EZO_RESPONSE_OK; _setConnected(); }
-		else if ( !memcmp(_response,"*ER",3))	{ _last_response = EZO_RESPONSE_ER; _setConnected(); }
-		else if ( !memcmp(_response,"*OV",3))	{ _last_response = EZO_RESPONSE_OV; _setConnected(); }
-		else if ( !memcmp(_response,"*UV",3))	{ _last_response = EZO_RESPONSE_UV; _setConnected(); }
-		else if ( !memcmp(_response,"*RS",3))	{ _last_response = EZO_RESPONSE_RS; _setConnected(); }
-		else if ( !memcmp(_response,"*RE",3))	{ _last_response = EZO_RESPONSE_RE; _setConnected(); }
-		else if ( !memcmp(_response,"*SL",3))	{ _last_response = EZO_RESPONSE_SL; _setConnected(); }
-		else if ( !memcmp(_response,"*WA",3))	{ _last_response = EZO_RESPONSE_WA; _setConnected(); }
-		else									_last_response = EZO_RESPONSE_UK;
+		// format: "*<ezo_response>\r". It may already have arrived in place of a result.
+		atlas_frame_type frame = ATLAS_FRAME_RESPONSE;
+		if ( ! _code_pending ) frame = _readFrame(EZO_RESPONSE_TIMEOUT,false);
+		if ( frame == ATLAS_FRAME_RESPONSE || _code_pending ) { // _code_pending: an event we were waiting for
+			strncpy(_response,_framer.code(),EZO_RESPONSE_LENGTH - 1);
+			_response[EZO_RESPONSE_LENGTH - 1] = 0;
+			_response_len = strlen(_response);
+		}
+		else { _response_len = 0; _response[0] = 0;}
+		_code_pending = false;
+		if ( _response_mode == TRI_OFF && _expect_event == EZO_RESPONSE_UK ) _last_response = EZO_RESPONSE_NA;
+		else _last_response = _decodeResponse(_response); // events come with response codes off too
 	}
 	if ( debug() ) {
 		Serial.print(F("Got response:")); Serial.print(_response); Serial.print(F("= "));
@@ -465,8 +613,74 @@ ezo_response EZO::_getResponse(){ // Serial only
 	return _last_response;
 }
 
+ezo_response EZO::_decodeResponse(const char * response){
+	ezo_response code = EZO_RESPONSE_UK;
+	if ( response[0] != '*' ) return code;
+	else if ( !memcmp(response,"*OK",3))	code = EZO_RESPONSE_OK;
+	else if ( !memcmp(response,"*ER",3))	code = EZO_RESPONSE_ER;
+	else if ( !memcmp(response,"*OV",3))	code = EZO_RESPONSE_OV;
+	else if ( !memcmp(response,"*UV",3))	code = EZO_RESPONSE_UV;
+	else if ( !memcmp(response,"*RS",3))	code = EZO_RESPONSE_RS;
+	else if ( !memcmp(response,"*RE",3))	code = EZO_RESPONSE_RE;
+	else if ( !memcmp(response,"*SL",3))	code = EZO_RESPONSE_SL;
+	else if ( !memcmp(response,"*WA",3))	code = EZO_RESPONSE_WA;
+	else return code;
+	_setConnected();
+	return code;
+}
+
+uint16_t EZO::getEventCount(const ezo_response event) const {
+	if ( event < EZO_RESPONSE_OV || event > EZO_RESPONSE_WA ) return 0;
+	return _event_counts[event - EZO_RESPONSE_OV];
+}
+
+void EZO::resetEventCounts() {
+	for ( uint8_t i = 0 ; i < EZO_EVENT_COUNT ; i++ ) _event_counts[i] = 0;
+}
+
+void EZO::_frameEvent(const char * code) {
+	ezo_response event = _decodeResponse(code);
+	if ( event < EZO_RESPONSE_OV || event > EZO_RESPONSE_WA ) return;
+	if ( _event_counts[event - EZO_RESPONSE_OV] < 0xFFFF ) _event_counts[event - EZO_RESPONSE_OV]++;
+	if ( debug() ) { Serial.print(F("Event:")); Serial.println(code);}
+	if ( event == _expect_event ) _code_pending = true; // the reply we're waiting for
+	if ( event == EZO_RESPONSE_RS ) {
+		_invalidate();
+		if ( _reinit_on_reset ) _requestInit();
+	}
+	if ( _event_callback ) _event_callback(this, event, _event_context);
+}
+
+void EZO::_listen() {
+	// Only between commands, and only on serial. A partial line is kept for next time.
+	if ( busy() || _i2c_address != 0 ) return;
+	_framer.setDataBuffer(NULL,0);
+	while ( Serial_AS->available() > 0 ) {
+		int c = Serial_AS->read();
+		if ( c < 0 ) break;
+		_frameByte(c);
+	}
+	_framer.setDataBuffer(_result,ATLAS_SERIAL_RESULT_LEN);
+}
+
+void EZO::_record(const uint8_t channel, const float value) {
+	if ( _stats[channel] ) _stats[channel]->add(value);
+}
+
+void EZO::_invalidate() {
+	// Power on defaults may not be what we set, so assume nothing until asked again.
+	_continuous_mode = TRI_UNKNOWN;
+	_response_mode = TRI_UNKNOWN;
+	_led = TRI_UNKNOWN;
+	_calibration_status = EZO_CAL_UNKNOWN;
+}
+
+void EZO::_probe(){
+	queryResponse(); // One short round trip
+}
+
 void EZO::_geti2cResult(){
-	delay(300 >> CLKPR);  //After 300ms an I2C read command can be issued to get the response/reply
+	_clock->delay(300);  //After 300ms an I2C read command can be issued to get the response/reply
 	// Send read command
 	// Parse.
 	// First byte is response code [255,254,2,1] should be put in _response[0]
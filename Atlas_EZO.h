@@ -36,10 +36,16 @@ Copyright (c) 2015 Ryan Neve <Ryan@PlanktosInstruments.com>
 #include <Atlas.h>
 
 #define DEFAULT_ATLAS_TIMEOUT 1100
+#define EZO_RESULT_TIMEOUT		5000	// Longest wait for a result line (same as SEND_COMMAND_DELAY)
+#define EZO_RESPONSE_TIMEOUT	1000	// Longest wait for "*OK" etc. after the result
 #define I2C_MIN_ADDRESS 1
 #define I2C_MAX_ADDRESS 127
 #define EZO_NAME_LENGTH 20
 #define EZO_RESPONSE_LENGTH 10
+#define EZO_EVENT_COUNT 6 // EZO_RESPONSE_OV to EZO_RESPONSE_WA
+#define EZO_MAX_CHANNELS 8 // values in one reading (RGB has the most)
+#define EZO_LAYOUT_FIELDS 11 // values and tags in one reading (RGB: 8 and 3)
+#define EZO_LAYOUT_TAG 0xFF // in a field list, a tag rather than a value
 
 
 const char EZO_RESPONSE_COMMAND[] = "RESPONSE";
@@ -70,6 +76,7 @@ enum ezo_response {
 	EZO_RESPONSE_RE,	// The circuit has completed boot up
 	EZO_RESPONSE_SL,	// The circuit has been put to sleep
 	EZO_RESPONSE_WA,	// The circuit has woken up from sleep
+	EZO_RESPONSE_BR,	// Not sent, circuit unresponsive (see getHealth())
 	EZO_I2C_RESPONSE_NA,	// I2c not inresponse mode
 	EZO_I2C_RESPONSE_ND,	// No Data = 255
 	EZO_I2C_RESPONSE_PE,	// Pending = 254
@@ -78,6 +85,20 @@ enum ezo_response {
 	EZO_I2C_RESPONSE_UK		// UnKnown
 };
 
+enum ezo_compensation { // see setCompensation()
+	EZO_COMP_TEMP,		// deg C. DO, EC, pH
+	EZO_COMP_SAL_US,	// DO only, conductivity in uS
+	EZO_COMP_SAL_PPT,	// DO only, salinity in ppt (EC's PSS-78 salinity)
+	EZO_COMP_PRES		// DO only, kPa
+};
+
+enum ezo_command_state { // Non-blocking commands, see startCommand()
+	EZO_CMD_IDLE,
+	EZO_CMD_WAIT_RESULT,
+	EZO_CMD_WAIT_RESPONSE,
+	EZO_CMD_DONE		// Reply complete (or timed out), call finishCommand()
+};
+
 enum ezo_restart_code {
 	EZO_RESTART_P,	// Power on reset
 	EZO_RESTART_S,	// Software reset
@@ -96,6 +117,36 @@ enum ezo_cal_status {
 	EZO_CAL_TRIPLE // PH only
 };
 
+// One group of values in a reading, in the order the circuit sends them. Each driver
+// has a table of these (EZO_EC_LAYOUT, ...) that its parsers and the host log decoder share.
+// The tables and their tags are in PROGMEM: read them with EZO::layoutGroup().
+struct ezo_layout_group {
+	uint8_t		output;		// output flag that turns the group on, 0 if always sent
+	const char *	tag;		// sent ahead of the values, NULL if none
+	uint8_t		channel;	// channel of the first value, the rest follow
+	uint8_t		values;
+};
+
+// A driver with a fixed parser lists its layout once, as ROW(output,tag,channel,values) lines in a
+// macro (EZO_EC_LAYOUT_ROWS ...). EZO_LAYOUT_ENTRY makes the PROGMEM table from it. EZO_FIXED_GROUP
+// expands it inside _parseFixed<OUTPUTS>(): each test on OUTPUTS is a constant, and each value goes
+// straight to the driver's _storeChannel<channel>(). Up to 3 values a group.
+#define EZO_LAYOUT_ENTRY(output,tag,channel,values)	{ output, tag, channel, values },
+#define EZO_FIXED_GROUP(output,tag,channel,values) \
+	if ( (output) == 0 || ( OUTPUTS & (output) ) ) { \
+		_skipTag(field,tag); \
+		_storeChannel<(channel)>(field); \
+		if ( (values) > 1 ) _storeChannel<(channel) + 1>(field); \
+		if ( (values) > 2 ) _storeChannel<(channel) + 2>(field); \
+	}
+
+class EZO;
+class AtlasStats;
+typedef void (EZO::*ezo_parser)(); // Parses _result once a non-blocking command completes
+// Called as soon as "*RS", "*RE", "*SL", "*WA", "*OV" or "*UV" is seen, possibly in the middle of a command.
+// Don't send commands from it.
+typedef void (*ezo_event_callback)(EZO *sensor, const ezo_response event, void *context);
+
 class EZO: public Atlas {
 	public:
 		EZO() { // default constructor
@@ -116,7 +167,16 @@ class EZO: public Atlas {
 			// DO v1.7
 			// EC v1.8
 			strncpy(_reset_command, "X",8); // default
+			_cmd_state = EZO_CMD_IDLE;
+			_cmd_parser = NULL;
+			_event_callback = NULL;
+			_event_context = NULL;
+			_expect_event = EZO_RESPONSE_UK;
+			_reinit_on_reset = false;
+			resetEventCounts();
+			for ( uint8_t i = 0 ; i < EZO_MAX_CHANNELS ; i++ ) _stats[i] = NULL;
 		}
+		virtual void	initialize() { _initialize();} // generic EZO
 		ezo_response	enableContinuousReadings();
 		ezo_response	disableContinuousReadings();
 		ezo_response	queryContinuousReadings();
@@ -151,17 +211,62 @@ class EZO: public Atlas {
 		ezo_response	reset(); // for most but not all EZO sensors
 		ezo_response	setTempComp(const float temp_C);
 		ezo_response	queryTempComp();
+		virtual ezo_response	setCompensation(const ezo_compensation kind, const float value); // ER if the circuit hasn't got it
+		virtual ezo_response	querySingleReading();
+		ezo_response	queryReadingWithTemp(const float temp_C); // "RT,<temp>": compensate and read in one command. Newer firmware only.
 		float			getTempComp() {return _temp_comp;}
 		char *			getResult() { return _result;}
+		// Non-blocking commands. startCommand() sends and returns. Call pollCommand() until it returns
+		// true, then finishCommand() to parse the reply and get the response code. Serial only.
+		bool			startCommand(const char * command, const bool has_result, const bool has_response);
+		bool			startCommand(const char * command, const bool has_result, const bool has_response, ezo_parser parser);
+		bool			startReading() { return startCommand("R\r",true,true,&EZO::_parseReading);}
+		bool			startSleep(); // done when "*SL" arrives
+		bool			startWake(); // done when "*WA" arrives
+		// Parsers to pass to startCommand(). Each reads _result as the blocking query does.
+		void			parseLED();			// "L,?"
+		void			parseStatus();		// "STATUS"
+		void			parseTempComp();	// "T,?"
+		void			parseCalibration();	// "Cal,?"
+		bool			pollCommand(); // reads whatever is available, never waits
+		ezo_response	finishCommand();
+		bool			busy() const { return _cmd_state != EZO_CMD_IDLE;}
+		ezo_command_state	getCommandState() const { return _cmd_state;}
+		uint32_t		getCommandDeadline() const { return _cmd_deadline;} // millis() pollCommand() gives up
+		// Unsolicited events. A "*RS" forgets everything cached about the circuit's settings.
+		void			setEventCallback(ezo_event_callback callback, void *context) { _event_callback = callback; _event_context = context;}
+		uint16_t		getEventCount(const ezo_response event) const;
+		void			resetEventCounts();
+		void			setReinitializeOnReset(const bool on) { _reinit_on_reset = on;} // initialize() again from service()
+		// Running statistics, updated as each reading is parsed. Channels are per circuit (ezo_ec_channel etc.).
+		void			attachStats(const uint8_t channel, AtlasStats *stats) { if ( channel < EZO_MAX_CHANNELS ) _stats[channel] = stats;}
+		AtlasStats *	getStats(const uint8_t channel) const { return channel < EZO_MAX_CHANNELS ? _stats[channel] : NULL;}
+		virtual float	getValue(const uint8_t) const { return 0.0;} // last parsed value of a channel
+		virtual uint8_t	getChannelMask() const { return 1;} // bit n set: channel n is in a reading
+		ezo_circuit_type	getCircuitType() const { return _circuit_type;} // known after queryInfo()
+		// Reading layouts. layoutFields() gives the channel of each field sent with these
+		// outputs on (EZO_LAYOUT_TAG for a tag), and how many there are.
+		static ezo_layout_group	layoutGroup(const ezo_layout_group *layout, const uint8_t group);
+		static uint8_t	layoutFields(const ezo_layout_group *layout, const uint8_t groups, const uint8_t outputs, uint8_t *fields);
 	protected:
 		ezo_response	_sendCommand(const char * command, const bool has_result, const bool has_response);
 		ezo_response	_sendCommand(const char * command, const bool has_result, const uint16_t result_delay, const bool has_response);
-		uint8_t			_command_len;
+		ezo_response	_endCommand(const bool has_result, const bool has_response); // after _put*()
+		ezo_response	_endCommand(const bool has_result, const uint16_t result_delay, const bool has_response);
 		float			_temp_comp;
 		ezo_cal_status	_calibration_status;
 		void			_initialize();
 		char			_response[EZO_RESPONSE_LENGTH]; // holds string response code "*xx\r" where xx is a two letter code.
 		char			_reset_command[8];
+		void			_probe();
+		virtual void	_parseReading() {} // Each circuit parses its own "R" reply
+		ezo_response	_decodeResponse(const char * response); // "*OK" etc.
+		void			_frameEvent(const char * code);
+		void			_listen();
+		virtual void	_invalidate(); // circuit reset, cached settings are unknown. Circuits add their own.
+		ezo_response	_expect_event; // reply to SLEEP, wake or reset comes as an event
+		void			_record(const uint8_t channel, const float value); // a parsed value, to its stats if any
+		void			_skipTag(char *&field, const char *tag) const { if ( tag ) _nextField(field);} // for EZO_FIXED_GROUP
 	private:
 		//bool			_device_information();
 		ezo_response	_getResponse(); // Serial only
@@ -181,6 +286,16 @@ class EZO: public Atlas {
 		uint16_t		_i2c_address;
 		float			_voltage;
 		uint32_t		_request_timeout;
+		ezo_command_state	_cmd_state;
+		bool			_cmd_has_response;
+		bool			_cmd_replied;
+		uint32_t		_cmd_deadline;
+		ezo_parser		_cmd_parser;
+		ezo_event_callback	_event_callback;
+		void *			_event_context;
+		uint16_t		_event_counts[EZO_EVENT_COUNT];
+		bool			_reinit_on_reset;
+		AtlasStats *	_stats[EZO_MAX_CHANNELS];
 };
 
 
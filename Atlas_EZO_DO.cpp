@@ -25,6 +25,10 @@ DO	v2.0
 //#include <HardwareSerial.h>
 #include <Atlas_EZO_DO.h>
 
+const ezo_layout_group EZO_DO_LAYOUT[EZO_DO_LAYOUT_GROUPS] PROGMEM = {
+	EZO_DO_LAYOUT_ROWS(EZO_LAYOUT_ENTRY)
+};
+
 /*              DO PUBLIC METHODS                      */
 
 void EZO_DO::initialize() {
@@ -40,9 +44,15 @@ void EZO_DO::initialize() {
 
 }
 
-ezo_response	setCalibrationAtm();
-ezo_response	clearCalibration();
-
+ezo_response EZO_DO::calibrate(ezo_do_calibration_command command) {
+	switch ( command ){
+		case EZO_DO_CAL_CLEAR:	return clearCalibration();
+		case EZO_DO_CAL_ATM:	return _sendCommand("Cal\r",false,true); // probe in air
+		case EZO_DO_CAL_ZERO:	return _sendCommand("Cal,0\r",false,true); // probe in zero solution
+		case EZO_DO_CAL_QUERY:	return queryCalibration();
+		default:				return EZO_RESPONSE_UK;
+	}
+}
 
 ezo_response EZO_DO::enableOutput(do_output output) {
 	return _changeOutput(output,1);
@@ -51,9 +61,12 @@ ezo_response EZO_DO::disableOutput(do_output output) {
 	return _changeOutput(output,0);
 }
 ezo_response EZO_DO::queryOutput() {
-	strncpy(_command,"O,?\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,2000,true); // with 2 sec timeout
-																   // _response will be ?O,EC,TDS,S,SG if all are enabled
+	ezo_response response = _sendCommand("O,?\r",true,2000,true); // with 2 sec timeout
+	parseOutput();
+	return response;
+}
+void EZO_DO::parseOutput() {
+	// _result will be ?O,%,DO if both are enabled
 	if (_result[0] == '?' && _result[1] == 'O' && _result[2] == ',') {
 		_sat_output  = TRI_OFF;
 		_dox_output = TRI_OFF;
@@ -65,7 +78,6 @@ ezo_response EZO_DO::queryOutput() {
 			pch = strtok(NULL, ",\r");
 		}
 	}
-	return response;
 }
 
 void  EZO_DO::printOutputs(){
@@ -84,66 +96,82 @@ tristate EZO_DO::getOutput(do_output output) {
 		default: return TRI_UNKNOWN;
 	}
 }
+uint8_t EZO_DO::getChannelMask() const {
+	// Unknown outputs count, as _parseReading() assumes them on
+	uint8_t mask = 0;
+	if ( _dox_output != TRI_OFF ) mask |= 1 << EZO_DO_CH_MGL;
+	if ( _sat_output != TRI_OFF ) mask |= 1 << EZO_DO_CH_SAT;
+	return mask;
+}
+uint8_t EZO_DO::getOutputs() const {
+	uint8_t outputs = 0;
+	if ( _dox_output == TRI_ON ) outputs |= EZO_DO_OUT_MGL;
+	if ( _sat_output == TRI_ON ) outputs |= EZO_DO_OUT_SAT;
+	return outputs;
+}
 
 
 ezo_response EZO_DO::querySingleReading() {
-	int8_t width;
-	uint8_t precision;
-	strncpy(_command,"R\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,2000,true); // with 2 sec timeout
-	bool sat_parsed = false;
-	bool dox_parsed = false;
-	char * pch;
-	pch = strtok(_result,",\r");
-	while ( pch != NULL) {
-		if ( _dox_output && ! dox_parsed){
-			_dox = atof(pch); // convert string to float
-			dox_parsed = true;
-			width = 8;	precision = 2;
-			dtostrf(_dox,width,precision,dox); // Dissolved oxygen in mg/l
-			if ( debug() )  {
-				Serial.print(F("Raw DO mg/l value: ")); Serial.println(pch);
-				Serial.print(F("Dissolved Oxygen is ")); Serial.println(dox);
-			}
-		}
-		else if ( _sat_output && !sat_parsed) {
-			_sat = atof(pch);// convert string to float
-			sat_parsed = true;
-			if ( _sat < 100.0 ) width = 4;
-			else width = 5;
-			precision = 1;
-			dtostrf(_sat,width,precision,sat); // saturation in %
-			if ( debug() ) {
-				Serial.print(F("Raw Sat.% value ")); Serial.println(pch);
-				Serial.print(F("Saturation % is ")); Serial.println(sat);
-			}
-		}
-		pch = strtok(NULL, ",\r");
-	}
+	ezo_response response = _sendCommand("R\r",true,2000,true); // with 2 sec timeout
+	_parseReading();
 	return response;
 }
 
+void EZO_DO::_parseReading() {
+	_stampReading();
+	bool known = ( _dox_output != TRI_UNKNOWN && _sat_output != TRI_UNKNOWN );
+	if ( _fixed_parser && known && getOutputs() == _fixed_outputs ) {
+		(this->*_fixed_parser)();
+		return;
+	}
+	// Unknown outputs are taken as on, as the circuit ships, but only if the reply has that many fields
+	uint8_t outputs = 0;
+	if ( _dox_output != TRI_OFF ) outputs |= EZO_DO_OUT_MGL;
+	if ( _sat_output != TRI_OFF ) outputs |= EZO_DO_OUT_SAT;
+	uint8_t fields[EZO_LAYOUT_FIELDS];
+	uint8_t count = layoutFields(EZO_DO_LAYOUT,EZO_DO_LAYOUT_GROUPS,outputs,fields);
+	if ( !known && _countFields(_result) != count ) {
+		if ( debug() ) Serial.println(F("DO outputs unknown, call queryOutput()"));
+		return;
+	}
+	char * field = _result;
+	for ( uint8_t i = 0 ; i < count && *field && *field != '\r' ; i++ ) _storeField(fields[i],field);
+	if ( debug() ) { Serial.print(F("DO reading: ")); Serial.println(_result);}
+}
+
+void EZO_DO::_storeField(const uint8_t channel, char *&field) {
+	switch ( channel ) {
+		case EZO_DO_CH_MGL:	_storeChannel<EZO_DO_CH_MGL>(field);	break;
+		case EZO_DO_CH_SAT:	_storeChannel<EZO_DO_CH_SAT>(field);	break;
+		default:			_nextField(field); break; // a tag
+	}
+}
+
 ezo_response EZO_DO::setSalComp(uint32_t sal_uS) {
 	_sal_uS_comp = sal_uS;
 	_sal_ppt_comp = 0.00;
-	_command_len = sprintf(_command,"S,%lu\r",sal_uS);
-	return _sendCommand(_command, false,true);
+	_putCommand("S,"); _putUInt(sal_uS); _putChar('\r');
+	return _endCommand(false,true);
 }
 ezo_response EZO_DO::setSalPPTComp(float sal_ppt) {
 	_sal_uS_comp = 0;
 	_sal_ppt_comp = sal_ppt;
-	_command_len = sprintf(_command,"S,%4.1f,PPT\r",(double)sal_ppt);
-	return _sendCommand(_command, false,true);
+	_putCommand("S,"); _putFixed(sal_ppt,1); _putCommand(",PPT\r");
+	return _endCommand(false,true);
 }
 ezo_response EZO_DO::querySalComp(){
-	strncpy(_command,"S,?\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command, true,true);
+	ezo_response response = _sendCommand("S,?\r", true,true);
+	parseSalComp();
+	return response;
+}
+void EZO_DO::parseSalComp() {
 	// _result should be in the format "?S,<sal_us>,<uS|ppt>\r" // wrong in documentation
 	if ( debug() )  Serial.print(F("Salinity Compensation set to:"));
 	if ( _result[0] == '?' && _result[1] == 'S' && _result[2] == ',' ) {
 		char * pch;
 		char temp_sal_comp[10];
 		pch = strtok(_result+ 3,",\r"); // value
+		if ( !pch ) return;
 		strncpy(temp_sal_comp,pch,10);
 		pch = strtok(NULL, ",\r"); // "us" or "ppt"
 		if ( !_strCmp(pch,"uS")){
@@ -156,41 +184,57 @@ ezo_response EZO_DO::querySalComp(){
 			_sal_ppt_comp = atof(temp_sal_comp);
 			if ( debug() ) {Serial.print(_sal_ppt_comp);	Serial.println(" ppt");}
 		}
-	} 
-	return response;
+	}
 }
 
 
+ezo_response EZO_DO::setCompensation(const ezo_compensation kind, const float value) {
+	switch ( kind ) {
+		case EZO_COMP_SAL_US:	return setSalComp((uint32_t)value);
+		case EZO_COMP_SAL_PPT:	return setSalPPTComp(value);
+		case EZO_COMP_PRES:		return setPresComp(value);
+		default:				return EZO::setCompensation(kind,value);
+	}
+}
+
 ezo_response EZO_DO::setPresComp(float pressure_kpa) {
 	// This parameter can be omitted if the water is less than 10 meters deep.
-	_command_len = sprintf(_command,"P,%6.2f\r",(double)pressure_kpa);
-	return _sendCommand(_command, false,true);
+	_putCommand("P,"); _putFixed(pressure_kpa,2); _putChar('\r');
+	return _endCommand(false,true);
 }
 ezo_response EZO_DO::queryPresComp(){
-	strncpy(_command,"P,?\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command, true,true);
-	// _result should be in the format "?T,<temp_C>\r"
-	_temp_comp = EZO_EC_DEFAULT_TEMP;
+	ezo_response response = _sendCommand("P,?\r", true,true);
+	parsePresComp();
+	return response;
+}
+void EZO_DO::parsePresComp() {
+	// _result should be in the format "?P,<pressure_kpa>\r"
 	if ( _result[0] == '?' && _result[1] == 'P' ) {
-		_temp_comp = atof(_result + 3);
+		_pressure = atof(_result + 3);
 	}
-	if ( debug() ) { Serial.print(F("Pressure Compensation set to:")); Serial.println(_temp_comp);}
-	return response;
+	if ( debug() ) { Serial.print(F("Pressure Compensation set to:")); Serial.println(_pressure);}
 }
 
 
 /*              DO PRIVATE METHODS                      */
+void EZO_DO::_invalidate() {
+	EZO::_invalidate();
+	_sat_output = TRI_UNKNOWN;
+	_dox_output = TRI_UNKNOWN;
+}
+
 ezo_response EZO_DO::_changeOutput(do_output output,int8_t enable_output) {
 	// format is "O,[parameter],[0|1]\r"
-	uint8_t PARAMETER_LEN = 10;
-	char parameter[PARAMETER_LEN];
+	const char * parameter;
+	tristate * flag;
 	switch (output) {
-		case EZO_DO_OUT_SAT:
-			strncpy(parameter,"%",PARAMETER_LEN); break;
-		case EZO_DO_OUT_MGL:
-			strncpy(parameter,"DO",PARAMETER_LEN); break;
+		case EZO_DO_OUT_SAT:	parameter = "%";	flag = &_sat_output; break;
+		case EZO_DO_OUT_MGL:	parameter = "DO";	flag = &_dox_output; break;
 		default: return EZO_RESPONSE_UK;
 	}
-	_command_len = sprintf(_command,"O,%s,%d\r",parameter,enable_output);
-	return _sendCommand(_command,false,true);
+	_putCommand("O,"); _putCommand(parameter); _putChar(','); _putChar(enable_output ? '1' : '0'); _putChar('\r');
+	ezo_response response = _endCommand(false,true);
+	// Without *OK we can't tell if it took
+	*flag = ( response == EZO_RESPONSE_OK ) ? ( enable_output ? TRI_ON : TRI_OFF ) : TRI_UNKNOWN;
+	return response;
 }
@@ -33,6 +33,18 @@ enum do_output {
 	EZO_DO_OUT_SAT		= 2,
 };
 
+enum ezo_do_channel { // for attachStats()
+	EZO_DO_CH_MGL,
+	EZO_DO_CH_SAT
+};
+
+// The groups of a reading in the order the circuit sends them, see EZO_FIXED_GROUP
+#define EZO_DO_LAYOUT_ROWS(ROW) \
+	ROW(EZO_DO_OUT_MGL,	NULL, EZO_DO_CH_MGL,	1) \
+	ROW(EZO_DO_OUT_SAT,	NULL, EZO_DO_CH_SAT,	1)
+#define EZO_DO_LAYOUT_GROUPS 2
+extern const ezo_layout_group EZO_DO_LAYOUT[EZO_DO_LAYOUT_GROUPS] PROGMEM;
+
 enum ezo_do_calibration_command {
 	EZO_DO_CAL_CLEAR,
 	EZO_DO_CAL_ATM,
@@ -40,11 +52,17 @@ enum ezo_do_calibration_command {
 	EZO_DO_CAL_QUERY
 };
 
+class EZO_DO;
+typedef void (EZO_DO::*ezo_do_parser)();
+
 class EZO_DO: public EZO {
 public:
 	EZO_DO() {
 		_sat_output = TRI_UNKNOWN;
 		_dox_output = TRI_UNKNOWN;
+		_pressure = 0.0; // not queried yet
+		_fixed_parser = NULL;
+		_fixed_outputs = 0;
 	}
 	void			initialize();
 	ezo_response	calibrate(ezo_do_calibration_command command);
@@ -52,6 +70,13 @@ public:
 	ezo_response	disableOutput(do_output output);
 	ezo_response	queryOutput();
 	tristate		getOutput(do_output output);
+	void			parseOutput();		// for startCommand(), as EZO::parseLED()
+	void			parseSalComp();		// "S,?"
+	void			parsePresComp();	// "P,?"
+	uint8_t			getOutputs() const; // do_output flags known to be on
+	// Parser fixed at compile time for one output set, e.g. useParser<EZO_DO_OUT_MGL>().
+	// Used while queryOutput() agrees with it, the runtime parser otherwise.
+	template <uint8_t OUTPUTS> void	useParser() { _fixed_parser = &EZO_DO::_parseFixed<OUTPUTS>; _fixed_outputs = OUTPUTS;}
 	void			printOutputs();
 	ezo_response	querySingleReading();
 	ezo_response	setPresComp(float pressure_kpa);
@@ -62,14 +87,27 @@ public:
 	ezo_response	setSalPPTComp(float sal_ppt);
 	float			getSalPPTComp(){return _sal_ppt_comp;}
 	ezo_response	querySalComp();
+	ezo_response	setCompensation(const ezo_compensation kind, const float value);
 	uint16_t		querySal();
 	float			querySalPPT();
 	float			getSat() {return _sat;}
 	float			getDOx() { return _dox;}
+	float			getValue(const uint8_t channel) const { return channel == EZO_DO_CH_SAT ? _sat : _dox;}
+	uint8_t			getChannelMask() const;
 
 	char			sat[10];
 	char			dox[10];
 protected:
+	void			_parseReading(); // _result holds the reply to "R"
+	void			_invalidate();
+	template <uint8_t OUTPUTS> void	_parseFixed() {
+		// One pass in the field order EZO_DO_LAYOUT_ROWS gives for OUTPUTS, as EZO_EC::_parseFixed().
+		if ( _result_len == 0 ) return; // no reply, the last values stand
+		char * field = _result;
+		EZO_DO_LAYOUT_ROWS(EZO_FIXED_GROUP)
+	}
+	template <uint8_t CHANNEL> void	_storeChannel(char *&field) { _nextField(field);} // as EZO_EC
+	void			_storeField(const uint8_t channel, char *&field);
 private:
 	ezo_response	_changeOutput(do_output output,int8_t enable_output);
 
@@ -80,6 +118,12 @@ private:
 	float			_pressure;
 	uint32_t		_sal_uS_comp;
 	float			_sal_ppt_comp;
+	ezo_do_parser	_fixed_parser;
+	uint8_t			_fixed_outputs;
 };
 
+// The char arrays get the text as sent
+template <> inline void EZO_DO::_storeChannel<EZO_DO_CH_MGL>(char *&field)	{ _dox = _nextField(field,dox,sizeof(dox));	_record(EZO_DO_CH_MGL,_dox);}
+template <> inline void EZO_DO::_storeChannel<EZO_DO_CH_SAT>(char *&field)	{ _sat = _nextField(field,sat,sizeof(sat));	_record(EZO_DO_CH_SAT,_sat);}
+
 #endif
\ No newline at end of file
@@ -25,6 +25,10 @@ EC	v2.4
 //#include <HardwareSerial.h>
 #include <Atlas_EZO_EC.h>
 
+const ezo_layout_group EZO_EC_LAYOUT[EZO_EC_LAYOUT_GROUPS] PROGMEM = {
+	EZO_EC_LAYOUT_ROWS(EZO_LAYOUT_ENTRY)
+};
+
 /*              EC PUBLIC METHODS                      */
 
 void EZO_EC::initialize() {
@@ -33,39 +37,55 @@ void EZO_EC::initialize() {
 	queryK();
 	queryTempComp();
 	queryOutput();
+	applyOutputs();
 	if (debug()) Serial.println(F("EC Initialization Done"));
 }
 
 ezo_response EZO_EC::calibrate(ezo_ec_calibration_command command,uint32_t ec_standard) {
-	// NOT YET TESTED
-	ezo_response response = EZO_RESPONSE_UK;
 	switch ( command ){
-		case EZO_EC_CAL_CLEAR:	snprintf(_command,ATLAS_COMMAND_LENGTH,"Cal,clear\r");	ec_standard = 1;	break;
-		case EZO_EC_CAL_DRY:	snprintf(_command,ATLAS_COMMAND_LENGTH,"Cal,dry\r");	ec_standard = 1;	break;
-		case EZO_EC_CAL_ONE:	snprintf(_command,ATLAS_COMMAND_LENGTH,"Cal,one,%lu\r",ec_standard);		break;
-		case EZO_EC_CAL_LOW:	snprintf(_command,ATLAS_COMMAND_LENGTH,"Cal,low,%lu\r",ec_standard);		break;
-		case EZO_EC_CAL_HIGH:	snprintf(_command,ATLAS_COMMAND_LENGTH,"Cal,high,%lu\r",ec_standard);		break;
-		case EZO_EC_CAL_QUERY:	response = queryCalibration(); ec_standard = 0;	break;
-		default:			ec_standard = 0;	break;
+		case EZO_EC_CAL_CLEAR:	return clearCalibration();
+		case EZO_EC_CAL_DRY:	return _sendCommand("Cal,dry\r",false,true);
+		case EZO_EC_CAL_ONE:	_putCommand("Cal,one,");	break;
+		case EZO_EC_CAL_LOW:	_putCommand("Cal,low,");	break;
+		case EZO_EC_CAL_HIGH:	_putCommand("Cal,high,");	break;
+		case EZO_EC_CAL_QUERY:	return queryCalibration();
+		default:				return EZO_RESPONSE_UK;
+	}
+	_putUInt(ec_standard); _putChar('\r');
+	return _endCommand(false,true);
+}
+
+float EZO_EC::getValue(const uint8_t channel) const {
+	switch ( channel ) {
+		case EZO_EC_CH_TDS:	return _tds;
+		case EZO_EC_CH_SAL:	return _sal;
+		case EZO_EC_CH_SG:	return _sg;
+		default:			return _ec;
 	}
-	if ( ec_standard ) response = _sendCommand(_command,false,true);
-	return response;
+}
+
+uint8_t EZO_EC::getChannelMask() const {
+	uint8_t mask = 0;
+	for ( uint8_t field = 0 ; field < _layout_count ; field++ ) mask |= 1 << _layout[field];
+	return mask;
 }
 
 ezo_response EZO_EC::setK(float k) {
-	_command_len = sprintf(_command,"K,%4.1f\r",(double)k);
-	return _sendCommand(_command, false,true);
+	_putCommand("K,"); _putFixed(k,1); _putChar('\r');
+	return _endCommand(false,true);
 }
 ezo_response EZO_EC::queryK() {
-	strncpy(_command,"K,?\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,true);
+	ezo_response response = _sendCommand("K,?\r",true,true);
+	parseK();
+	return response;
+}
+void EZO_EC::parseK() {
 	// _result will be "?K,<floating point K number>\r"
 	if ( _result[0] == '?' && _result[1] == 'K') {
 		// parse k
 		_k = atof(_result + 3);
 		if ( debug() ) { Serial.print(F("EC K value is:")); Serial.println(_k);}
 	}
-	return response;
 }
 ezo_response EZO_EC::enableOutput(ezo_ec_output output) {
 	return _changeOutput(output,1);
@@ -74,9 +94,12 @@ ezo_response EZO_EC::disableOutput(ezo_ec_output output) {
 	return _changeOutput(output,0);
 }
 ezo_response EZO_EC::queryOutput() {
-	strncpy(_command,"O,?\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,2000,true); // with 2 sec timeout
-																   // _response will be ?O,EC,TDS,S,SG if all are enabled
+	ezo_response response = _sendCommand("O,?\r",true,2000,true); // with 2 sec timeout
+	parseOutput();
+	return response;
+}
+void EZO_EC::parseOutput() {
+	// _result will be ?O,EC,TDS,S,SG if all are enabled
 	if (debug())  {Serial.print(F("EC Parsing:"));Serial.println(_result);}
 	char * pch;
 	pch = strtok(_result,",\r");
@@ -93,6 +116,19 @@ ezo_response EZO_EC::queryOutput() {
 			pch = strtok(NULL, ",\r");
 		}
 	}
+	_setLayout();
+}
+ezo_response EZO_EC::applyOutputs() {
+	ezo_response response = EZO_RESPONSE_OK;
+	if ( !_wanted_outputs ) return response;
+	bool confirmed = true;
+	for ( uint8_t output = EZO_EC_OUT_EC ; output <= EZO_EC_OUT_SG ; output <<= 1 ) {
+		tristate wanted = ( _wanted_outputs & output ) ? TRI_ON : TRI_OFF;
+		if ( getOutput((ezo_ec_output)output) == wanted ) continue;
+		response = _changeOutput((ezo_ec_output)output,wanted);
+		if ( response != EZO_RESPONSE_OK ) confirmed = false;
+	}
+	if ( !confirmed ) response = queryOutput(); // find out what the circuit really has
 	return response;
 }
 void  EZO_EC::printOutputs(){
@@ -118,82 +154,82 @@ tristate EZO_EC::getOutput(ezo_ec_output output) {
 	}
 }
 ezo_response EZO_EC::querySingleReading() {
-	int8_t width;
-	uint8_t precision;
-	strncpy(_command,"R\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,2000,true); // with 2 sec timeout
+	ezo_response response = _sendCommand("R\r",true,2000,true); // with 2 sec timeout
 																   // Response starts "EC," and ends in "\r". There may be up to 4 parameters in the following order:
 																   // EC,TDS,SAL,SG. The format of the output is determined by queryOutput() and saved in _xx_output.
-	bool ec_parsed = false;
-	bool tds_parsed = false;
-	bool sal_parsed = false;
-	bool sg_parsed = false;
-	//Serial.print("Parsing :"); Serial.println(_result);
-	char * pch;
-	pch = strtok(_result,",\r");
-	while ( pch != NULL) {
-		//Serial.print("  part:"); Serial.println(pch);
-		if ( _ec_output && !ec_parsed) {
-			_ec = atof(pch); // Convert parsed string to float attribute
-			ec_parsed = true;
-			if ( _ec <= 999.9 ) width = 5;
-			else if ( _ec >= 1000 && _ec <= 9999 ) width = 4;
-			else if ( _ec >= 10000  && _ec <= 99990 ) width = 5;
-			else width = 6; // 100,000+
-			if ( _ec <= 99.99 ) precision = 2;
-			else if ( _ec <= 999.9 ) precision = 1;
-			else precision = 0; // 1000+
-			dtostrf(_ec,width,precision,ec); // Save to ec char array for easier logging.
-											 //Serial.print("EC= "); Serial.print(_ec); Serial.print(" = "); Serial.println(ec);
-		}
-		else if ( _tds_output && ! tds_parsed){
-			_tds = atof(pch);
-			tds_parsed = true;
-			width = 6;
-			precision = 1;
-			dtostrf(_tds,width,precision,tds);
-		}
-		else if ( _s_output && ! sal_parsed){
-			_sal = atof(pch);
-			sal_parsed = true;
-			width = 7;
-			precision = 2;
-			dtostrf(_sal,width,precision,sal);
-		}
-		else if ( _sg_output && ! sg_parsed){
-			_sg = atof(pch);
-			sg_parsed = true;
-			if ( _sg < 10.00 ) {
-				width = 5; precision = 3;
-			}
-			else {
-				width = 7;
-				precision = 2;
-			}
-			dtostrf(_sg,width,precision,sg);
-		}
-		pch = strtok(NULL, ",\r");
-	}
+	_parseReading();
 	return response;
 }
 
+void EZO_EC::_parseReading() {
+	// Fields come in _layout order, so each one is stored without testing the outputs again
+	_stampReading();
+	if ( _fixed_parser && _layout_known && _outputs == _fixed_outputs ) {
+		(this->*_fixed_parser)();
+		return;
+	}
+	if ( !_layout_known && _countFields(_result) != _layout_count ) {
+		// Assuming the unknown outputs are on doesn't fit this reply, so no field can be placed
+		if ( debug() ) Serial.println(F("EC outputs unknown, call queryOutput()"));
+		return;
+	}
+	char * field = _result;
+	for ( uint8_t i = 0 ; i < _layout_count && *field && *field != '\r' ; i++ ) _storeField(_layout[i],field);
+}
+
+void EZO_EC::_storeField(const uint8_t channel, char *&field) {
+	switch ( channel ) {
+		case EZO_EC_CH_EC:	_storeChannel<EZO_EC_CH_EC>(field);		break;
+		case EZO_EC_CH_TDS:	_storeChannel<EZO_EC_CH_TDS>(field);	break;
+		case EZO_EC_CH_SAL:	_storeChannel<EZO_EC_CH_SAL>(field);	break;
+		case EZO_EC_CH_SG:	_storeChannel<EZO_EC_CH_SG>(field);		break;
+		default:			_nextField(field); break; // a tag
+	}
+}
+
 /*              EC PRIVATE  METHODS                      */
 
+void EZO_EC::_invalidate() {
+	EZO::_invalidate();
+	_k = -1.0; // Unknown
+	_ec_output = TRI_UNKNOWN;
+	_tds_output = TRI_UNKNOWN;
+	_s_output = TRI_UNKNOWN;
+	_sg_output = TRI_UNKNOWN;
+	_setLayout();
+}
+
+void EZO_EC::_setLayout() {
+	// Outputs not known to be off are assumed on, as the circuit ships with all four.
+	// _parseReading() checks that against the field count while any are unknown.
+	_layout_count = 0;
+	_outputs = 0;
+	_layout_known = true;
+	for ( uint8_t group = 0 ; group < EZO_EC_LAYOUT_GROUPS ; group++ ) {
+		ezo_layout_group entry = layoutGroup(EZO_EC_LAYOUT,group);
+		tristate state = getOutput((ezo_ec_output)entry.output);
+		if ( state == TRI_OFF ) continue;
+		if ( state == TRI_ON ) _outputs |= entry.output;
+		else _layout_known = false;
+		_layout[_layout_count++] = entry.channel;
+	}
+}
+
 ezo_response EZO_EC::_changeOutput(ezo_ec_output output,int8_t enable_output) {
 	// format is "O,[parameter],[0|1]\r"
-	uint8_t PARAMETER_LEN = 10;
-	char parameter[PARAMETER_LEN];
+	const char * parameter;
+	tristate * flag;
 	switch (output) {
-		case EZO_EC_OUT_EC:
-			strncpy(parameter,"EC",PARAMETER_LEN); break;
-		case EZO_EC_OUT_TDS:
-			strncpy(parameter,"TDS",PARAMETER_LEN); break;
-		case EZO_EC_OUT_S:
-			strncpy(parameter,"S",PARAMETER_LEN); break;
-		case EZO_EC_OUT_SG:
-			strncpy(parameter,"SG",PARAMETER_LEN); break;
+		case EZO_EC_OUT_EC:		parameter = "EC";	flag = &_ec_output; break;
+		case EZO_EC_OUT_TDS:	parameter = "TDS";	flag = &_tds_output; break;
+		case EZO_EC_OUT_S:		parameter = "S";	flag = &_s_output; break;
+		case EZO_EC_OUT_SG:		parameter = "SG";	flag = &_sg_output; break;
 		default: return EZO_RESPONSE_UK;
 	}
-	_command_len = sprintf(_command,"O,%s,%d\r",parameter,enable_output);
-	return _sendCommand(_command,false,true);
+	_putCommand("O,"); _putCommand(parameter); _putChar(','); _putChar(enable_output ? '1' : '0'); _putChar('\r');
+	ezo_response response = _endCommand(false,true);
+	// Without *OK we can't tell if it took
+	*flag = ( response == EZO_RESPONSE_OK ) ? ( enable_output ? TRI_ON : TRI_OFF ) : TRI_UNKNOWN;
+	_setLayout();
+	return response;
 }
\ No newline at end of file
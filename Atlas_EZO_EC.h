@@ -34,6 +34,22 @@ enum ezo_ec_output {
 	EZO_EC_OUT_SG		= 8
 };
 
+enum ezo_ec_channel { // for attachStats()
+	EZO_EC_CH_EC,
+	EZO_EC_CH_TDS,
+	EZO_EC_CH_SAL,
+	EZO_EC_CH_SG
+};
+
+// The groups of a reading in the order the circuit sends them, see EZO_FIXED_GROUP
+#define EZO_EC_LAYOUT_ROWS(ROW) \
+	ROW(EZO_EC_OUT_EC,	NULL, EZO_EC_CH_EC,		1) \
+	ROW(EZO_EC_OUT_TDS,	NULL, EZO_EC_CH_TDS,	1) \
+	ROW(EZO_EC_OUT_S,	NULL, EZO_EC_CH_SAL,	1) \
+	ROW(EZO_EC_OUT_SG,	NULL, EZO_EC_CH_SG,		1)
+#define EZO_EC_LAYOUT_GROUPS 4
+extern const ezo_layout_group EZO_EC_LAYOUT[EZO_EC_LAYOUT_GROUPS] PROGMEM;
+
 enum ezo_ec_calibration_command {
 	EZO_EC_CAL_CLEAR,
 	EZO_EC_CAL_DRY,
@@ -43,6 +59,9 @@ enum ezo_ec_calibration_command {
 	EZO_EC_CAL_QUERY
 };
 
+class EZO_EC;
+typedef void (EZO_EC::*ezo_ec_parser)();
+
 class EZO_EC: public EZO {
 public:
 	EZO_EC() {
@@ -55,6 +74,10 @@ public:
 		_tds = 0.0;		
 		_sal = 0.0;		
 		_sg = 0.0;		
+		_wanted_outputs = 0; // leave the circuit as it is
+		_fixed_parser = NULL;
+		_fixed_outputs = 0;
+		_setLayout();
 	}
 	void			initialize();		
 	ezo_response	calibrate(ezo_ec_calibration_command command) { return calibrate(command,0);}
@@ -66,20 +89,44 @@ public:
 	ezo_response	disableOutput(ezo_ec_output output);
 	ezo_response	queryOutput();
 	tristate		getOutput(ezo_ec_output output);
+	void			parseK();		// for startCommand(), as EZO::parseLED()
+	void			parseOutput();
+	// Only what's read: EZO_EC_OUT_ flags ORed. initialize() then turns the rest off, shortening every reply.
+	void			setWantedOutputs(const uint8_t outputs) { _wanted_outputs = outputs;}
+	ezo_response	applyOutputs(); // Enables/disables only the outputs that differ from queryOutput()
+	uint8_t			getOutputs() const { return _outputs;} // EZO_EC_OUT_ flags known to be on
+	// Parser fixed at compile time for one output set, e.g. useParser<EZO_EC_OUT_EC | EZO_EC_OUT_S>().
+	// Used while queryOutput() agrees with it, the runtime parser otherwise.
+	template <uint8_t OUTPUTS> void	useParser() { _fixed_parser = &EZO_EC::_parseFixed<OUTPUTS>; _fixed_outputs = OUTPUTS;}
 	void			printOutputs();
 	ezo_response	querySingleReading();
 	float			getEC() const { return _ec;}
 	float			getTDS() const { return _tds;}
 	float			getSAL() const { return _sal;}
 	float			getSG()  const { return _sg;}
+	float			getValue(const uint8_t channel) const;
+	uint8_t			getChannelMask() const;
 
 	char			ec[10];
 	char			tds[10];
 	char			sal[10];
 	char			sg[10];
 protected:
+	void			_parseReading(); // _result holds the reply to "R"
+	void			_invalidate();
+	template <uint8_t OUTPUTS> void	_parseFixed() {
+		// One pass in the circuit's field order, expanded from EZO_EC_LAYOUT_ROWS for OUTPUTS
+		// by the compiler: no output tests or table walk are left to run.
+		if ( _result_len == 0 ) return; // no reply, the last values stand
+		char * field = _result;
+		EZO_EC_LAYOUT_ROWS(EZO_FIXED_GROUP)
+	}
+	// One field of a reading into its channel, then past it. Both parsers store through these.
+	template <uint8_t CHANNEL> void	_storeChannel(char *&field) { _nextField(field);} // none: skip it
+	void			_storeField(const uint8_t channel, char *&field); // the channel known at run time
 private:
 	ezo_response	_changeOutput(ezo_ec_output output,int8_t enable_output);
+	void			_setLayout();
 
 	float			_k;
 	tristate		_ec_output;
@@ -90,5 +137,18 @@ private:
 	float			_tds;	//mg/L
 	float			_sal;	// PSS-78 (no units)
 	float			_sg;	// Dimensionless unit
+	uint8_t			_wanted_outputs;
+	uint8_t			_layout[EZO_EC_LAYOUT_GROUPS]; // channel of each field in a reading, from EZO_EC_LAYOUT and the outputs
+	uint8_t			_layout_count;
+	bool			_layout_known; // no output is TRI_UNKNOWN
+	uint8_t			_outputs;
+	ezo_ec_parser	_fixed_parser;
+	uint8_t			_fixed_outputs;
 };
+
+// The char arrays get the text as sent
+template <> inline void EZO_EC::_storeChannel<EZO_EC_CH_EC>(char *&field)	{ _ec  = _nextField(field,ec,sizeof(ec));	_record(EZO_EC_CH_EC,_ec);}
+template <> inline void EZO_EC::_storeChannel<EZO_EC_CH_TDS>(char *&field)	{ _tds = _nextField(field,tds,sizeof(tds));	_record(EZO_EC_CH_TDS,_tds);}
+template <> inline void EZO_EC::_storeChannel<EZO_EC_CH_SAL>(char *&field)	{ _sal = _nextField(field,sal,sizeof(sal));	_record(EZO_EC_CH_SAL,_sal);}
+template <> inline void EZO_EC::_storeChannel<EZO_EC_CH_SG>(char *&field)	{ _sg  = _nextField(field,sg,sizeof(sg));	_record(EZO_EC_CH_SG,_sg);}
 #endif
\ No newline at end of file
@@ -27,30 +27,42 @@ ORP	v???
 //#include <HardwareSerial.h>
 #include <Atlas_EZO_ORP.h>
 
+const ezo_layout_group EZO_ORP_LAYOUT[EZO_ORP_LAYOUT_GROUPS] PROGMEM = {
+	{ 0, NULL, EZO_ORP_CH_ORP, 1}
+};
+
 /*              ORP PUBLIC METHODS                      */
 void EZO_ORP::initialize() {
 	_initialize();
 	if (debug()) Serial.println(F("ORP Initialization Done"));
 }
 
-/*
-ezo_response EZO_ORP::calibrate(uint32_t known_orp) {
-_command_len = sprintf(_command,"Cal,%ld\r",known_orp);
-return _sendCommand(_command,false,true);
-
+ezo_response EZO_ORP::calibrate(ezo_orp_calibration_command command,uint32_t orp_standard) {
+	return calibrate(command,(float)orp_standard);
 }
-ezo_response EZO_ORP::calibrate(float known_orp) {
-_command_len = sprintf(_command,"Cal,%6.2f\r",(double)known_orp);
-return _sendCommand(_command,false,true);
 
+ezo_response EZO_ORP::calibrate(ezo_orp_calibration_command command,float orp_standard) {
+	switch ( command ){
+		case EZO_ORP_CAL_CLEAR:	return clearCalibration();
+		case EZO_ORP_CAL_VALUE:	break;
+		case EZO_ORP_CAL_QUERY:	return queryCalibration();
+		default:				return EZO_RESPONSE_UK;
+	}
+	_putCommand("Cal,"); _putFixed(orp_standard,1); _putChar('\r');
+	return _endCommand(false,true);
 }
-*/
 ezo_response EZO_ORP::querySingleReading() {
-	strncpy(_command,"R\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,2000,true); // with 2 sec timeout
+	ezo_response response = _sendCommand("R\r",true,2000,true); // with 2 sec timeout
+	_parseReading();
+	return response;
+}
+
+void EZO_ORP::_parseReading() {
+	_stampReading();
+	if ( ! _result_len ) return; // nothing came back, keep the last reading
 	strncpy(orp,_result,10);
 	_orp = atof(orp);
-	return response;
+	_record(EZO_ORP_CH_ORP,_orp);
 }
 
 /*              ORP PRIVATE  METHODS                      */
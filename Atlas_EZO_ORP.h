@@ -26,10 +26,16 @@ EZO ORP	v??
 #include <Atlas_EZO.h>
 /*-------------------- ORP --------------------*/
 
+enum ezo_orp_channel { // for attachStats()
+	EZO_ORP_CH_ORP
+};
+
+#define EZO_ORP_LAYOUT_GROUPS 1
+extern const ezo_layout_group EZO_ORP_LAYOUT[EZO_ORP_LAYOUT_GROUPS] PROGMEM;
+
 enum ezo_orp_calibration_command {
 	EZO_ORP_CAL_CLEAR,
-	EZO_ORP_CAL_ATM,
-	EZO_ORP_CAL_ZERO,
+	EZO_ORP_CAL_VALUE,	// probe in a solution of known mV
 	EZO_ORP_CAL_QUERY
 };
 
@@ -41,10 +47,13 @@ public:
 	void			initialize();
 	ezo_response	calibrate(ezo_orp_calibration_command command) { return calibrate(command,(uint32_t)0);}
 	ezo_response	calibrate(ezo_orp_calibration_command command,float orp_standard);
-	ezo_response	calibrate(ezo_orp_calibration_command command,uint32_t orp_standard);
+	ezo_response	calibrate(ezo_orp_calibration_command command,uint32_t orp_standard); // mV
 	ezo_response	querySingleReading();
 	float			getORP() const { return _orp;}		
+	float			getValue(const uint8_t) const { return _orp;}
 	char			orp[10];
+protected:
+	void			_parseReading(); // _result holds the reply to "R"
 private:
 	float			_orp;
 };
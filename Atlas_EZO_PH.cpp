@@ -24,18 +24,41 @@ PH	v2.0
 
 //#include <HardwareSerial.h>
 #include <Atlas_EZO_PH.h>
+
+const ezo_layout_group EZO_PH_LAYOUT[EZO_PH_LAYOUT_GROUPS] PROGMEM = {
+	{ 0, NULL, EZO_PH_CH_PH, 1}
+};
 /*              PH PUBLIC METHODS                      */
 void EZO_PH::initialize() {
 	_initialize();
 	if (debug()) Serial.println(F("PH Initialization Done"));
 }
 
+ezo_response EZO_PH::calibrate(ezo_ph_calibration_command command,float ph_standard) {
+	switch ( command ){
+		case EZO_PH_CAL_CLEAR:	return clearCalibration();
+		case EZO_PH_CAL_MID:	_putCommand("Cal,mid,");	break;
+		case EZO_PH_CAL_LOW:	_putCommand("Cal,low,");	break;
+		case EZO_PH_CAL_HIGH:	_putCommand("Cal,high,");	break;
+		case EZO_PH_CAL_QUERY:	return queryCalibration();
+		default:				return EZO_RESPONSE_UK;
+	}
+	_putFixed(ph_standard,2); _putChar('\r');
+	return _endCommand(false,true);
+}
+
 ezo_response EZO_PH::querySingleReading() {
-	strncpy(_command,"R\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,2000,true); // with 2 sec timeout
+	ezo_response response = _sendCommand("R\r",true,2000,true); // with 2 sec timeout
+	_parseReading();
+	return response;
+}
+
+void EZO_PH::_parseReading() {
+	_stampReading();
+	if ( ! _result_len ) return; // nothing came back, keep the last reading
 	strncpy(ph,_result,10);
 	_ph = atof(ph);
-	return response;
+	_record(EZO_PH_CH_PH,_ph);
 }
 
 /*              pH PRIVATE  METHODS                      */
@@ -28,10 +28,18 @@ EZO PH	v2.0
 
 /*-------------------- pH --------------------*/
 
+enum ezo_ph_channel { // for attachStats()
+	EZO_PH_CH_PH
+};
+
+#define EZO_PH_LAYOUT_GROUPS 1
+extern const ezo_layout_group EZO_PH_LAYOUT[EZO_PH_LAYOUT_GROUPS] PROGMEM;
+
 enum ezo_ph_calibration_command {
 	EZO_PH_CAL_CLEAR,
-	EZO_PH_CAL_ATM,
-	EZO_PH_CAL_ZERO,
+	EZO_PH_CAL_MID,		// always first, it clears the other points
+	EZO_PH_CAL_LOW,
+	EZO_PH_CAL_HIGH,
 	EZO_PH_CAL_QUERY
 };
 
@@ -42,10 +50,13 @@ public:
 	}
 	void			initialize();
 	ezo_response	querySingleReading();
-	ezo_response	calibrate(ezo_ph_calibration_command command) { return calibrate(command,0);}
-	ezo_response	calibrate(ezo_ph_calibration_command command,uint32_t ph_standard);
+	ezo_response	calibrate(ezo_ph_calibration_command command) { return calibrate(command,(float)0.0);}
+	ezo_response	calibrate(ezo_ph_calibration_command command,float ph_standard); // e.g. EZO_PH_CAL_MID,7.00
 	float			getPH() const { return _ph;}
+	float			getValue(const uint8_t) const { return _ph;}
 	char	ph[10];
+protected:
+	void			_parseReading(); // _result holds the reply to "R"
 private:
 	float	_ph;
 };
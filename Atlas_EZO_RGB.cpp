@@ -24,6 +24,13 @@ RGB	v??
 
 //#include <HardwareSerial.h>
 #include <Atlas_EZO_RGB.h>
+
+const char EZO_RGB_TAG_PROX[] PROGMEM = "P";
+const char EZO_RGB_TAG_LUX[] PROGMEM = "Lux";
+const char EZO_RGB_TAG_CIE[] PROGMEM = "xyY";
+const ezo_layout_group EZO_RGB_LAYOUT[EZO_RGB_LAYOUT_GROUPS] PROGMEM = {
+	EZO_RGB_LAYOUT_ROWS(EZO_LAYOUT_ENTRY)
+};
 /*              RGB PUBLIC METHODS                      */
 void EZO_RGB::initialize() {
 	_initialize(); // Generic EZO initialization
@@ -32,6 +39,10 @@ void EZO_RGB::initialize() {
 				   // _brightness = 0 and _auto_bright  = TRI_ON
 				   // proximity detection disabled and ir brightness low(1)
 	if ( connected() ) initialize(0,TRI_ON,0,1);
+	if ( connected() && _wanted_outputs ) {
+		queryOutput();
+		applyOutputs();
+	}
 	if (debug()) Serial.println(F("RGB Initialization Done"));
 }
 
@@ -55,69 +66,83 @@ void EZO_RGB::initialize(int8_t brightness,tristate auto_bright,int16_t prox_dis
 } 
 
 ezo_response EZO_RGB::querySingleReading()  {
-	enum parsing_modes {PARSING_RGB,PARSING_PROX,PARSING_LUX,PARSING_CIE};
-	parsing_modes parsing_data = PARSING_RGB;
-	strncpy(_command,"R\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,4000,true); // with 2 sec timeout
+	ezo_response response = _sendCommand("R\r",true,4000,true); // with 2 sec timeout
 																   // Response is a comma delimited set of numbers which end in "\r". There may be up to 6 parameters in the following order:
 																   // [R,G,B,][P,<prox>,][Lux,<lux>,][xyY,<CIE_x>,<CIE_y>,<CIE_Y>]. The format of the output is determined by queryOutput() and saved in _xx_output.
+	_parseReading();
+	return response;
+}
+
+void EZO_RGB::_parseReading() {
+	_stampReading();
+	bool known = ( _rgb_output != TRI_UNKNOWN && _prox_output != TRI_UNKNOWN && _lux_output != TRI_UNKNOWN && _cie_output != TRI_UNKNOWN );
+	if ( _fixed_parser && known && getOutputs() == _fixed_outputs ) {
+		(this->*_fixed_parser)();
+		return;
+	}
 	if (debug()) {Serial.print(F("Parsing :")); Serial.println(_result);}
-	char * pch;
-	pch = strtok(_result,",\r");
-	while ( pch != NULL) {
-		//Serial.print("  parsing:"); Serial.print(pch);
-		if		( !_strCmp(pch,"xyY,") ) parsing_data = PARSING_CIE;
-		else if ( !_strCmp(pch,"Lux,") ) parsing_data = PARSING_LUX;
-		else if ( !_strCmp(pch,"P,"  ) ) parsing_data = PARSING_PROX;
-		else parsing_data = PARSING_RGB; // Which for some reason has no preceding tag.
-		switch (parsing_data){
-			case PARSING_RGB:
-				//Serial.println(" = RGB");
-				// Should already have red value
-				strncpy(red,pch,sizeof(red));
-				_red = atoi(pch);			// Convert parsed string to integer 
-				pch = strtok(NULL, ",\r");	// Next value (green)
-				strncpy(green,pch,sizeof(green));
-				_green = atoi(pch);
-				pch = strtok(NULL, ",\r");	// Next value (blue)
-				strncpy(blue,pch,sizeof(blue));
-				_blue = atoi(pch); 
-				break;
-			case PARSING_PROX:
-				//Serial.println(" = PROX");
-				pch = strtok(NULL, ",\r");	 // Get next value
-				strncpy(prox,pch,sizeof(prox));
-				_prox = atoi(prox); // Convert parsed string to integer
-				break;
-			case PARSING_LUX:
-				//Serial.println(" = LUX");
-				pch = strtok(NULL, ",\r");	 // Get next value
-				strncpy(lux,pch,sizeof(lux));
-				_lux = atoi(lux); // Convert parsed string to float attribute
-				break;
-			case PARSING_CIE:
-				//Serial.println(" = CIE");
-				// two floats then an int
-				pch = strtok(NULL, ",\r");	 // Get next value
-				strncpy(cie_x,pch,sizeof(cie_x));
-				_cie_x = atof(cie_x); // Convert parsed string to float attribute
-				pch = strtok(NULL, ",\r");	
-				strncpy(cie_y,pch,sizeof(cie_y));
-				_cie_y = atof(cie_y);
-				pch = strtok(NULL, ",\r");	 // Get next value
-				strncpy(cie_Y,pch,sizeof(cie_Y));
-				_cie_Y = atoi(cie_Y); // Convert parsed string to integer
-				break;
+	// Each tag in EZO_RGB_LAYOUT says which group's values follow, so the outputs needn't be known.
+	// Values ahead of any tag are the first group's, RGB, which has none.
+	ezo_layout_group group = layoutGroup(EZO_RGB_LAYOUT,0);
+	uint8_t value = 0;
+	char * field = _result;
+	while ( *field && *field != '\r' ) {
+		uint8_t tagged = _tagGroup(field);
+		if ( tagged < EZO_RGB_LAYOUT_GROUPS ) {
+			group = layoutGroup(EZO_RGB_LAYOUT,tagged);
+			value = 0;
+			_nextField(field); // the tag
 		}
-		pch = strtok(NULL, ",\r");
+		else if ( value < group.values ) _storeField(group.channel + value++,field);
+		else _nextField(field); // more than the group has
+	}
+}
+
+void EZO_RGB::_storeField(const uint8_t channel, char *&field) {
+	switch ( channel ) {
+		case EZO_RGB_CH_RED:		_storeChannel<EZO_RGB_CH_RED>(field);		break;
+		case EZO_RGB_CH_GREEN:		_storeChannel<EZO_RGB_CH_GREEN>(field);		break;
+		case EZO_RGB_CH_BLUE:		_storeChannel<EZO_RGB_CH_BLUE>(field);		break;
+		case EZO_RGB_CH_PROX:		_storeChannel<EZO_RGB_CH_PROX>(field);		break;
+		case EZO_RGB_CH_LUX:		_storeChannel<EZO_RGB_CH_LUX>(field);		break;
+		case EZO_RGB_CH_CIE_X:		_storeChannel<EZO_RGB_CH_CIE_X>(field);		break;
+		case EZO_RGB_CH_CIE_Y:		_storeChannel<EZO_RGB_CH_CIE_Y>(field);		break;
+		case EZO_RGB_CH_CIE_LUM:	_storeChannel<EZO_RGB_CH_CIE_LUM>(field);	break;
+		default:					_nextField(field); break; // a tag
+	}
+}
+
+uint8_t EZO_RGB::_tagGroup(const char *field) const {
+	uint8_t length = 0;
+	while ( field[length] && field[length] != ',' && field[length] != '\r' ) length++;
+	for ( uint8_t group = 0 ; group < EZO_RGB_LAYOUT_GROUPS ; group++ ) {
+		ezo_layout_group entry = layoutGroup(EZO_RGB_LAYOUT,group);
+		if ( entry.tag && strlen_P(entry.tag) == length && !strncmp_P(field,entry.tag,length) ) return group;
+	}
+	return EZO_RGB_LAYOUT_GROUPS;
+}
+
+float EZO_RGB::getValue(const uint8_t channel) const {
+	switch ( channel ) {
+		case EZO_RGB_CH_RED:		return _red;
+		case EZO_RGB_CH_GREEN:		return _green;
+		case EZO_RGB_CH_BLUE:		return _blue;
+		case EZO_RGB_CH_PROX:		return _prox;
+		case EZO_RGB_CH_LUX:		return _lux;
+		case EZO_RGB_CH_CIE_X:		return _cie_x;
+		case EZO_RGB_CH_CIE_Y:		return _cie_y;
+		case EZO_RGB_CH_CIE_LUM:	return _cie_Y;
+		default:					return 0.0;
 	}
-	return response;
 }
 
 ezo_response EZO_RGB::queryOutput() {
-	strncpy(_command,"O,?\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,2000,true); // with 2 sec timeout
-																   // _response will be ?O,[RGB,][PROX,][LUX,][CIE] if all are enabled
+	ezo_response response = _sendCommand("O,?\r",true,2000,true); // with 2 sec timeout
+	parseOutput();
+	return response;
+}
+void EZO_RGB::parseOutput() {
+	// _result will be ?O,[RGB,][PROX,][LUX,][CIE] if all are enabled
 	if (debug()) {Serial.print(F("RGB Parsing:"));Serial.println(_result);}
 	char * pch;
 	pch = strtok(_result,",\r");
@@ -134,7 +159,6 @@ ezo_response EZO_RGB::queryOutput() {
 			pch = strtok(NULL, ",\r");
 		}
 	}
-	return response;
 }
 void  EZO_RGB::printOutputs(){
 	// No need to check _debug here
@@ -158,12 +182,44 @@ tristate EZO_RGB::getOutput(ezo_rgb_output output) {
 		default:				return TRI_UNKNOWN;
 	}
 }
+uint8_t EZO_RGB::getChannelMask() const {
+	// Unknown outputs count, the tag scanning parser takes whatever comes
+	const tristate state[EZO_RGB_LAYOUT_GROUPS] = { _rgb_output, _prox_output, _lux_output, _cie_output};
+	uint8_t mask = 0;
+	for ( uint8_t group = 0 ; group < EZO_RGB_LAYOUT_GROUPS ; group++ ) {
+		if ( state[group] == TRI_OFF ) continue;
+		ezo_layout_group entry = layoutGroup(EZO_RGB_LAYOUT,group);
+		for ( uint8_t value = 0 ; value < entry.values ; value++ ) mask |= 1 << ( entry.channel + value );
+	}
+	return mask;
+}
+uint8_t EZO_RGB::getOutputs() const {
+	uint8_t outputs = 0;
+	if ( _rgb_output == TRI_ON )	outputs |= EZO_RGB_OUT_RGB;
+	if ( _prox_output == TRI_ON )	outputs |= EZO_RGB_OUT_PROX;
+	if ( _lux_output == TRI_ON )	outputs |= EZO_RGB_OUT_LUX;
+	if ( _cie_output == TRI_ON )	outputs |= EZO_RGB_OUT_CIE;
+	return outputs;
+}
 ezo_response EZO_RGB::enableOutput(ezo_rgb_output output) {
 	return _changeOutput(output,1);
 }
 ezo_response EZO_RGB::disableOutput(ezo_rgb_output output) {
 	return _changeOutput(output,0);
 }
+ezo_response EZO_RGB::applyOutputs() {
+	ezo_response response = EZO_RESPONSE_OK;
+	if ( !_wanted_outputs ) return response;
+	bool confirmed = true;
+	for ( uint8_t output = EZO_RGB_OUT_RGB ; output <= EZO_RGB_OUT_CIE ; output <<= 1 ) {
+		tristate wanted = ( _wanted_outputs & output ) ? TRI_ON : TRI_OFF;
+		if ( getOutput((ezo_rgb_output)output) == wanted ) continue;
+		response = _changeOutput((ezo_rgb_output)output,wanted);
+		if ( response != EZO_RESPONSE_OK ) confirmed = false;
+	}
+	if ( !confirmed ) response = queryOutput(); // find out what the circuit really has
+	return response;
+}
 
 ezo_response EZO_RGB::setLEDbrightness(int8_t brightness){
 	return setLEDbrightness(brightness,true);
@@ -179,59 +235,53 @@ ezo_response EZO_RGB::setLEDbrightness(int8_t brightness,bool auto_led) {
 	// Set LED brightness from 0 to 100
 	// Response is "L,%[,T]<CR>"
 	ezo_response brightness_result = EZO_RESPONSE_UK;
-	if ( auto_led ) _command_len = sprintf(_command,"L,%d,T\r",brightness);
-	else _command_len = sprintf(_command,"L,%d\r",brightness);
 	if ( debug() ) { Serial.print(F("Setting LED to ")); Serial.println(brightness); }
-	brightness_result  = _sendCommand(_command,true,true);
+	_putCommand("L,"); _putInt(brightness);
+	if ( auto_led ) _putCommand(",T");
+	_putChar('\r');
+	brightness_result  = _endCommand(true,true);
 	if (brightness_result == EZO_RESPONSE_OK) _brightness = brightness; // We can probably make this assumption.
 	return brightness_result;
 }
 ezo_response EZO_RGB::queryLEDbrightness() {
 	// Find out what LED brightness is. Call getLEDbrightness() for value
 	// Response is:?L,<%>[,T]<CR>
-	strncpy(_command,"L,?\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,true);
+	ezo_response response = _sendCommand("L,?\r",true,true);
 	if (debug()) {Serial.print(F("RGB Parsing LED:"));Serial.println(_result);}
 	char * pch;
 	pch = strtok(_result,",\r");
 	if (!_strCmp(pch,"?L,")) {
 		pch = strtok(NULL, ",\r");
-		_brightness = atoi(pch);
-		pch = strtok(NULL, ",\r");
-		if ( pch[0] == 'T' ) _auto_bright = TRI_ON;
+		if ( pch ) _brightness = atoi(pch);
+		if ( pch ) pch = strtok(NULL, ",\r");
+		if ( pch && pch[0] == 'T' ) _auto_bright = TRI_ON; // ",T" only with auto brightness
 		else _auto_bright = TRI_OFF;
 	}
 	return response;
 }
 
 ezo_response EZO_RGB::disableProximity(){
-	strncpy(_command,"P,0\r",ATLAS_COMMAND_LENGTH);
-	return _sendCommand(_command,false,true);
+	return _sendCommand("P,0\r",false,true);
 }
 ezo_response EZO_RGB::enableProximity(){
-	strncpy(_command,"P,1\r",ATLAS_COMMAND_LENGTH);
-	return _sendCommand(_command,false,true);
+	return _sendCommand("P,1\r",false,true);
 }
 ezo_response EZO_RGB::enableProximity(int16_t distance){
 	//make sure we're in range. MAY NOT BE NECESSARY
-	_command_len = sprintf(_command,"P,%d\r",distance);
-	return _sendCommand(_command,false,true);
+	_putCommand("P,"); _putInt(distance); _putChar('\r');
+	return _endCommand(false,true);
 }
 ezo_response EZO_RGB::proximityLED_Low(){
-	strncpy(_command,"P,L\r",ATLAS_COMMAND_LENGTH);
-	return _sendCommand(_command,false,true);
+	return _sendCommand("P,L\r",false,true);
 }
 ezo_response EZO_RGB::proximityLED_Med(){
-	strncpy(_command,"P,M\r",ATLAS_COMMAND_LENGTH);
-	return _sendCommand(_command,false,true);
+	return _sendCommand("P,M\r",false,true);
 }
 ezo_response EZO_RGB::proximityLED_High(){
-	strncpy(_command,"P,H\r",ATLAS_COMMAND_LENGTH);
-	return _sendCommand(_command,false,true);
+	return _sendCommand("P,H\r",false,true);
 }
 ezo_response EZO_RGB::queryProximity(){
-	strncpy(_command,"P,?\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,true);
+	ezo_response response = _sendCommand("P,?\r",true,true);
 	// Response is:
 	// ?P,<distance>,<LED_power>
 	// Where distance = 0,2-1023 and LED_power = H|M|L
@@ -240,9 +290,10 @@ ezo_response EZO_RGB::queryProximity(){
 	pch = strtok(_result,",\r");
 	if (!_strCmp(pch,"?P,")) {
 		pch = strtok(NULL, ",\r");
-		_prox_distance = atoi(pch);
-		pch = strtok(NULL, ",\r");
-		if ( pch[0] == 'H' ) _IR_bright = 3;
+		if ( pch ) _prox_distance = atoi(pch);
+		if ( pch ) pch = strtok(NULL, ",\r");
+		if ( !pch ) _IR_bright = 0;
+		else if ( pch[0] == 'H' ) _IR_bright = 3;
 		else if ( pch[0] == 'M' ) _IR_bright = 2;
 		else if ( pch[0] == 'L' ) _IR_bright = 1;
 		else _IR_bright = 0;
@@ -251,16 +302,13 @@ ezo_response EZO_RGB::queryProximity(){
 }
 
 ezo_response EZO_RGB::enableMatching(){
-	strncpy(_command,"M,1\r",ATLAS_COMMAND_LENGTH);
-	return _sendCommand(_command,false,true);
+	return _sendCommand("M,1\r",false,true);
 }
 ezo_response EZO_RGB::disableMatching(){
-	strncpy(_command,"M,0\r",ATLAS_COMMAND_LENGTH);
-	return _sendCommand(_command,false,true);
+	return _sendCommand("M,0\r",false,true);
 }
 ezo_response EZO_RGB::queryMatching(){
-	strncpy(_command,"M,?\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,true);
+	ezo_response response = _sendCommand("M,?\r",true,true);
 	// Response is:
 	// ?M,<matching><CR>
 	// Where matching = 0 or 1
@@ -269,7 +317,8 @@ ezo_response EZO_RGB::queryMatching(){
 	pch = strtok(_result,",\r");
 	if (!_strCmp(pch,"?M,")) {
 		pch = strtok(NULL, ",\r");
-		if ( pch[0] == '0' ) _matching = TRI_OFF;
+		if ( !pch ) _matching = TRI_UNKNOWN;
+		else if ( pch[0] == '0' ) _matching = TRI_OFF;
 		else if ( pch[0] == '1' ) _matching = TRI_ON;
 		else _matching = TRI_UNKNOWN;
 	}
@@ -277,12 +326,15 @@ ezo_response EZO_RGB::queryMatching(){
 }
 
 ezo_response EZO_RGB::setGamma(float gamma_correction){
-	_command_len = sprintf(_command,"g,%4.3f\r",(double)gamma_correction);
-	return _sendCommand(_command,false,true);
+	_putCommand("G,"); _putFixed(gamma_correction,2); _putChar('\r'); // 0.01 to 4.99
+	return _endCommand(false,true);
 }
 ezo_response EZO_RGB::queryGamma(){
-	strncpy(_command,"G,?\r",ATLAS_COMMAND_LENGTH);
-	ezo_response response = _sendCommand(_command,true,true);
+	ezo_response response = _sendCommand("G,?\r",true,true);
+	parseGamma();
+	return response;
+}
+void EZO_RGB::parseGamma() {
 	// Response is:
 	// ?G,<gamma><CR>
 	// Where gamma = 0.01 to 4.99
@@ -291,28 +343,39 @@ ezo_response EZO_RGB::queryGamma(){
 	pch = strtok(_result,",\r");
 	if (!_strCmp(pch,"?G,")) {
 		pch = strtok(NULL, ",\r");
-		_gamma_correction = atof(pch);
+		if ( pch ) _gamma_correction = atof(pch);
 	}
-	return response;
 }
 /*              RGB PRIVATE  METHODS                      */
 
+void EZO_RGB::_invalidate() {
+	EZO::_invalidate();
+	_ezo_rgb_output = EZO_RGB_UNKNOWN;
+	_rgb_output		= TRI_UNKNOWN;
+	_prox_output	= TRI_UNKNOWN;
+	_lux_output		= TRI_UNKNOWN;
+	_cie_output		= TRI_UNKNOWN;
+	_brightness		= -1;
+	_auto_bright	= TRI_UNKNOWN;
+	_prox_distance	= -1;
+	_matching		= TRI_UNKNOWN;
+	_gamma_correction	= 0.00;
+}
+
 ezo_response EZO_RGB::_changeOutput(ezo_rgb_output output,int8_t enable_output) {
 	// format is "O,[parameter],[0|1]\r"
-	uint8_t PARAMETER_LEN = 10;
-	char parameter[PARAMETER_LEN];
+	const char * parameter;
+	tristate * flag;
 	switch (output) {
-		case EZO_RGB_OUT_RGB:
-			strncpy(parameter,"RGB",PARAMETER_LEN); break;
-		case EZO_RGB_OUT_PROX:
-			strncpy(parameter,"PROX",PARAMETER_LEN); break;
-		case EZO_RGB_OUT_LUX:
-			strncpy(parameter,"LUX",PARAMETER_LEN); break;
-		case EZO_RGB_OUT_CIE:
-			strncpy(parameter,"CIE",PARAMETER_LEN); break;
-		default:
-			break;
+		case EZO_RGB_OUT_RGB:	parameter = "RGB";	flag = &_rgb_output; break;
+		case EZO_RGB_OUT_PROX:	parameter = "PROX";	flag = &_prox_output; break;
+		case EZO_RGB_OUT_LUX:	parameter = "LUX";	flag = &_lux_output; break;
+		case EZO_RGB_OUT_CIE:	parameter = "CIE";	flag = &_cie_output; break;
+		default: return EZO_RESPONSE_UK;
 	}
-	_command_len = sprintf(_command,"O,%s,%d\r",parameter,enable_output);
-	return _sendCommand(_command,false,true);
+	_putCommand("O,"); _putCommand(parameter); _putChar(','); _putChar(enable_output ? '1' : '0'); _putChar('\r');
+	ezo_response response = _endCommand(false,true);
+	// Without *OK we can't tell if it took
+	*flag = ( response == EZO_RESPONSE_OK ) ? ( enable_output ? TRI_ON : TRI_OFF ) : TRI_UNKNOWN;
+	return response;
 }
\ No newline at end of file
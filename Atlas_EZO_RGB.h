@@ -35,6 +35,33 @@ enum ezo_rgb_output {
 	EZO_RGB_OUT_CIE		= 8
 };
 
+enum ezo_rgb_channel { // for attachStats()
+	EZO_RGB_CH_RED,
+	EZO_RGB_CH_GREEN,
+	EZO_RGB_CH_BLUE,
+	EZO_RGB_CH_PROX,
+	EZO_RGB_CH_LUX,
+	EZO_RGB_CH_CIE_X,
+	EZO_RGB_CH_CIE_Y,
+	EZO_RGB_CH_CIE_LUM	// CIE Y
+};
+
+// Each tag goes ahead of its values in a reading
+extern const char EZO_RGB_TAG_PROX[] PROGMEM;
+extern const char EZO_RGB_TAG_LUX[] PROGMEM;
+extern const char EZO_RGB_TAG_CIE[] PROGMEM;
+// The groups of a reading in the order the circuit sends them, see EZO_FIXED_GROUP
+#define EZO_RGB_LAYOUT_ROWS(ROW) \
+	ROW(EZO_RGB_OUT_RGB,	NULL,				EZO_RGB_CH_RED,		3) \
+	ROW(EZO_RGB_OUT_PROX,	EZO_RGB_TAG_PROX,	EZO_RGB_CH_PROX,	1) \
+	ROW(EZO_RGB_OUT_LUX,	EZO_RGB_TAG_LUX,	EZO_RGB_CH_LUX,		1) \
+	ROW(EZO_RGB_OUT_CIE,	EZO_RGB_TAG_CIE,	EZO_RGB_CH_CIE_X,	3)
+#define EZO_RGB_LAYOUT_GROUPS 4
+extern const ezo_layout_group EZO_RGB_LAYOUT[EZO_RGB_LAYOUT_GROUPS] PROGMEM;
+
+class EZO_RGB;
+typedef void (EZO_RGB::*ezo_rgb_parser)();
+
 class EZO_RGB: public EZO {
 public:
 	EZO_RGB() {
@@ -48,15 +75,27 @@ public:
 		_prox_distance	= -1; // unknown. Will be 0-1023
 		_matching		= TRI_UNKNOWN;
 		_gamma_correction	= 0.00; // not a valid number. Should be 0.01 to 4.99
+		_wanted_outputs = 0; // leave the circuit as it is
+		_fixed_parser = NULL;
+		_fixed_outputs = 0;
 		strncpy(_reset_command, "Factory",8); // special for RGB
 	}
 	void			initialize(); //uses defaults
 	void			initialize(int8_t brightness,tristate auto_bright,int16_t prox_distance, int8_t ir_brightness);
 	ezo_response	queryOutput();
 	tristate		getOutput(ezo_rgb_output output);
+	void			parseOutput();		// for startCommand(), as EZO::parseLED()
+	void			parseGamma();		// "G,?"
 	void			printOutputs();
 	ezo_response	enableOutput(ezo_rgb_output output);
 	ezo_response	disableOutput(ezo_rgb_output output);
+	// Only what's read: EZO_RGB_OUT_ flags ORed. initialize() then turns the rest off, shortening every reply.
+	void			setWantedOutputs(const uint8_t outputs) { _wanted_outputs = outputs;}
+	ezo_response	applyOutputs(); // Enables/disables only the outputs that differ from queryOutput()
+	uint8_t			getOutputs() const; // EZO_RGB_OUT_ flags known to be on
+	// Parser fixed at compile time for one output set, e.g. useParser<EZO_RGB_OUT_RGB | EZO_RGB_OUT_LUX>().
+	// Used while queryOutput() agrees with it, the tag scanning parser otherwise.
+	template <uint8_t OUTPUTS> void	useParser() { _fixed_parser = &EZO_RGB::_parseFixed<OUTPUTS>; _fixed_outputs = OUTPUTS;}
 
 	ezo_response	calibrate();
 	ezo_response	setLEDbrightness(int8_t brightness); // Brightness is 0 to 100
@@ -79,6 +118,7 @@ public:
 	// New section
 	ezo_response	setGamma(float gamma_correction);
 	ezo_response	queryGamma();
+	float			getGamma() const {return _gamma_correction;}
 
 
 	ezo_response	querySingleReading();
@@ -90,6 +130,8 @@ public:
 	float			getCIE_x() const {return _cie_x;}
 	float			getCIE_y() const {return _cie_y;}
 	int32_t			getCIE_Y() const {return _cie_Y;}
+	float			getValue(const uint8_t channel) const;
+	uint8_t			getChannelMask() const;
 
 	char			red[5];
 	char			green[5];
@@ -100,6 +142,18 @@ public:
 	char			cie_y[6];
 	char			cie_Y[7];
 protected:
+	void			_parseReading(); // _result holds the reply to "R"
+	void			_invalidate();
+	template <uint8_t OUTPUTS> void	_parseFixed() {
+		// One pass over "R,G,B,P,<prox>,Lux,<lux>,xyY,<x>,<y>,<Y>" in the field order EZO_RGB_LAYOUT_ROWS
+		// gives for OUTPUTS, tags skipped unread, as EZO_EC::_parseFixed().
+		if ( _result_len == 0 ) return; // no reply, the last values stand
+		char * field = _result;
+		EZO_RGB_LAYOUT_ROWS(EZO_FIXED_GROUP)
+	}
+	template <uint8_t CHANNEL> void	_storeChannel(char *&field) { _nextField(field);} // as EZO_EC
+	void			_storeField(const uint8_t channel, char *&field);
+	uint8_t			_tagGroup(const char *field) const; // group whose tag is at field, EZO_RGB_LAYOUT_GROUPS if none
 private:
 	ezo_response	_changeOutput(ezo_rgb_output output,int8_t enable_output); //DONE
 
@@ -123,5 +177,18 @@ private:
 	tristate		_prox_output;
 	tristate		_lux_output;
 	tristate		_cie_output;
+	uint8_t			_wanted_outputs;
+	ezo_rgb_parser	_fixed_parser;
+	uint8_t			_fixed_outputs;
 };
+
+// The char arrays get the text as sent
+template <> inline void EZO_RGB::_storeChannel<EZO_RGB_CH_RED>(char *&field)		{ _red		= _nextField(field,red,sizeof(red));		_record(EZO_RGB_CH_RED,_red);}
+template <> inline void EZO_RGB::_storeChannel<EZO_RGB_CH_GREEN>(char *&field)		{ _green	= _nextField(field,green,sizeof(green));	_record(EZO_RGB_CH_GREEN,_green);}
+template <> inline void EZO_RGB::_storeChannel<EZO_RGB_CH_BLUE>(char *&field)		{ _blue		= _nextField(field,blue,sizeof(blue));		_record(EZO_RGB_CH_BLUE,_blue);}
+template <> inline void EZO_RGB::_storeChannel<EZO_RGB_CH_PROX>(char *&field)		{ _prox		= _nextField(field,prox,sizeof(prox));		_record(EZO_RGB_CH_PROX,_prox);}
+template <> inline void EZO_RGB::_storeChannel<EZO_RGB_CH_LUX>(char *&field)		{ _lux		= _nextField(field,lux,sizeof(lux));		_record(EZO_RGB_CH_LUX,_lux);}
+template <> inline void EZO_RGB::_storeChannel<EZO_RGB_CH_CIE_X>(char *&field)		{ _cie_x	= _nextField(field,cie_x,sizeof(cie_x));	_record(EZO_RGB_CH_CIE_X,_cie_x);}
+template <> inline void EZO_RGB::_storeChannel<EZO_RGB_CH_CIE_Y>(char *&field)		{ _cie_y	= _nextField(field,cie_y,sizeof(cie_y));	_record(EZO_RGB_CH_CIE_Y,_cie_y);}
+template <> inline void EZO_RGB::_storeChannel<EZO_RGB_CH_CIE_LUM>(char *&field)	{ _cie_Y	= _nextField(field,cie_Y,sizeof(cie_Y));	_record(EZO_RGB_CH_CIE_LUM,_cie_Y);}
 #endif
@@ -29,6 +29,7 @@ void setup(){
 }
 
 void loop(){
+  EC_sensor.service(); // probes the circuit if it stopped responding, and re-initializes it when it comes back
   EC_sensor.querySingleReading();
   Serial.println("The EC values are:");
   Serial.print("    EC  = "); Serial.println(EC_sensor.getEC());
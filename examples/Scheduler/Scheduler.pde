@@ -0,0 +1,57 @@
+#include <Atlas_EZO_DO.h>
+#include <Atlas_EZO_EC.h>
+#include <Atlas_EZO_PH.h>
+#include <Atlas_EZO_RGB.h>
+#include <AtlasScheduler.h>
+
+// pH, DO and EC share Serial2 through a 4 channel multiplexer. RGB has Serial3 to itself.
+#define BAUD_RATE		9600
+#define PIN_ATLAS_SELECT_S0	7
+#define PIN_ATLAS_SELECT_S1	8
+#define PIN_BUTTON		4
+
+EZO_PH		PH_sensor;
+EZO_DO		DO_sensor;
+EZO_EC		EC_sensor;
+EZO_RGB		RGB_sensor;
+AtlasScheduler	sched;
+uint8_t		rgb_task;
+
+void selectChannel(const uint8_t bus, const uint8_t channel, void *context) {
+  digitalWrite(PIN_ATLAS_SELECT_S0, channel & 1);
+  digitalWrite(PIN_ATLAS_SELECT_S1, channel & 2);
+  delay(2); // let the mux settle
+}
+
+void onReading(const uint8_t task, EZO *sensor, const ezo_response response, void *context) {
+  Serial.print("task "); Serial.print(task);
+  Serial.print(" at "); Serial.print(sensor->getReadingTime());
+  Serial.print(": "); Serial.print(sensor->getValue(0));
+  Serial.print("  missed "); Serial.print(sched.getMissed(task));
+  Serial.print("  average mA "); Serial.println(sched.getAverageCurrent(task));
+}
+
+void setup(){
+  pinMode(PIN_ATLAS_SELECT_S0,OUTPUT);
+  pinMode(PIN_ATLAS_SELECT_S1,OUTPUT);
+  pinMode(PIN_BUTTON,INPUT_PULLUP);
+  Serial.begin(57600);
+  Serial2.begin(BAUD_RATE);
+  Serial3.begin(BAUD_RATE);
+  selectChannel(0, 0, NULL); PH_sensor.begin(&Serial2,BAUD_RATE); PH_sensor.initialize();
+  selectChannel(0, 1, NULL); DO_sensor.begin(&Serial2,BAUD_RATE); DO_sensor.initialize();
+  selectChannel(0, 2, NULL); EC_sensor.begin(&Serial2,BAUD_RATE); EC_sensor.initialize();
+  RGB_sensor.begin(&Serial3,BAUD_RATE); RGB_sensor.initialize();
+  sched.addTask(&PH_sensor, 5000, 0, 0);   // every 5 s on bus 0, mux channel 0
+  sched.addTask(&DO_sensor, 10000, 0, 1);  // every 10 s
+  sched.addTask(&EC_sensor, 60000, 0, 2);  // every minute
+  rgb_task = sched.addTask(&RGB_sensor, 0, 1); // bus 1, only when asked
+  sched.setMuxCallback(selectChannel, NULL);
+  sched.setAutoSleep(true);                // EC and RGB sleep between readings, woken in time
+  sched.setCallback(onReading, NULL);
+}
+
+void loop(){
+  sched.service(); // never waits for a reply
+  if ( digitalRead(PIN_BUTTON) == LOW ) sched.request(rgb_task);
+}
@@ -0,0 +1,90 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Just enough of the Arduino core to build the library on Linux.
+	Put this directory on the include path ahead of the library (-Ihost -I.).
+============================================================================*/
+#ifndef _Atlas_Host_Arduino_h
+#define _Atlas_Host_Arduino_h
+
+#define ATLAS_HOST 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define CLKPR	0	// AVR clock prescaler, always 1:1 here
+#define DEC		10
+#define HEX		16
+#define PROGMEM
+#define memcpy_P	memcpy
+#define strlen_P	strlen
+#define strncmp_P	strncmp
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+unsigned long	millis();
+unsigned long	micros();
+void			delay(unsigned long ms);
+void			yield();
+char *			dtostrf(double value, signed char width, unsigned char precision, char *buf);
+
+class Print {
+	public:
+		virtual			~Print() {}
+		virtual size_t	write(uint8_t byte) = 0;
+		virtual size_t	write(const uint8_t *buffer, size_t size);
+		size_t			write(const char *str) { return str ? write((const uint8_t *)str,strlen(str)) : 0;}
+		size_t			write(const char *buffer, size_t size) { return write((const uint8_t *)buffer,size);}
+		virtual void	flush() {}
+		size_t			print(const __FlashStringHelper *str) { return write((const char *)str);}
+		size_t			print(const char *str) { return write(str);}
+		size_t			print(char c) { return write((uint8_t)c);}
+		size_t			print(unsigned char n, int base = DEC) { return print((unsigned long)n,base);}
+		size_t			print(int n, int base = DEC) { return print((long)n,base);}
+		size_t			print(unsigned int n, int base = DEC) { return print((unsigned long)n,base);}
+		size_t			print(long n, int base = DEC);
+		size_t			print(unsigned long n, int base = DEC);
+		size_t			print(double n, int digits = 2);
+		size_t			println() { return write("\r\n");}
+		template <typename T> size_t println(T value) { size_t n = print(value); return n + println();}
+		template <typename T> size_t println(T value, int format) { size_t n = print(value,format); return n + println();}
+};
+
+class Stream: public Print {
+	public:
+		Stream() { _timeout = 1000;}
+		virtual int		available() = 0;
+		virtual int		read() = 0;
+		virtual int		peek() = 0;
+		void			setTimeout(unsigned long timeout) { _timeout = timeout;}
+		size_t			readBytesUntil(char terminator, char *buffer, size_t length);
+	protected:
+		int				timedRead();
+		unsigned long	_timeout;
+};
+
+#include <HardwareSerial.h>
+
+#endif
@@ -0,0 +1,178 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#ifndef ARDUINO // Linux only
+
+#include <AtlasBoard.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+AtlasBoard::AtlasBoard() {
+	_region = NULL;
+	_name[0] = '\0';
+	_count = 0;
+}
+
+bool AtlasBoard::create(const char *name) {
+	close();
+	int fd = shm_open(name,O_RDWR | O_CREAT,0644);
+	if ( fd < 0 ) return false;
+	if ( ftruncate(fd,sizeof(atlas_board_region)) != 0 ) { ::close(fd); return false;}
+	void *map = mmap(NULL,sizeof(atlas_board_region),PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+	::close(fd);
+	if ( map == MAP_FAILED ) return false;
+	_region = (atlas_board_region *)map;
+	// A board left by an earlier run starts over. Readers recheck the header.
+	__atomic_store_n(&_region->header.magic,0,__ATOMIC_RELEASE);
+	for ( uint8_t slot = 0 ; slot < ATLAS_BOARD_SLOTS ; slot++ ) {
+		__atomic_store_n(&_region->slots[slot].used,0,__ATOMIC_RELAXED);
+		__atomic_store_n(&_region->slots[slot].sequence,0,__ATOMIC_RELAXED); // an odd one would stall readers
+	}
+	_region->header.version = ATLAS_BOARD_VERSION;
+	_region->header.slots = ATLAS_BOARD_SLOTS;
+	_region->header.slot_size = sizeof(atlas_board_slot);
+	_region->header.writer_pid = getpid();
+	__atomic_store_n(&_region->header.magic,ATLAS_BOARD_MAGIC,__ATOMIC_RELEASE);
+	strncpy(_name,name,ATLAS_BOARD_NAME_LENGTH - 1);
+	_name[ATLAS_BOARD_NAME_LENGTH - 1] = '\0';
+	_count = 0;
+	return true;
+}
+
+void AtlasBoard::close() {
+	if ( ! _region ) return;
+	munmap(_region,sizeof(atlas_board_region));
+	_region = NULL;
+}
+
+bool AtlasBoard::unlink() {
+	return _name[0] && shm_unlink(_name) == 0;
+}
+
+int AtlasBoard::addSensor(const char *name, EZO *sensor) {
+	if ( ! _region || _count >= ATLAS_BOARD_SLOTS ) return -1;
+	atlas_board_slot &slot = _region->slots[_count];
+	memset(&slot.reading,0,sizeof(slot.reading));
+	strncpy(slot.reading.name,name,ATLAS_BOARD_NAME_LENGTH - 1);
+	slot.reading.circuit = sensor->getCircuitType();
+	slot.reading.health = sensor->getHealth();
+	slot.reading.channel_mask = sensor->getChannelMask();
+	slot.reading.response = EZO_RESPONSE_NA;
+	__atomic_store_n(&slot.used,1,__ATOMIC_RELEASE);
+	_sensors[_count] = sensor;
+	return _count++;
+}
+
+bool AtlasBoard::publish(const uint8_t slot, EZO *sensor, const ezo_response response) {
+	if ( ! _region || slot >= _count ) return false;
+	atlas_board_slot &s = _region->slots[slot];
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME,&now);
+	uint32_t sequence = __atomic_load_n(&s.sequence,__ATOMIC_RELAXED);
+	__atomic_store_n(&s.sequence,sequence + 1,__ATOMIC_RELAXED); // odd: being written
+	__atomic_thread_fence(__ATOMIC_RELEASE); // readers see it odd before any new field
+	atlas_board_reading &r = s.reading;
+	r.commands++;
+	r.timeouts = sensor->getTimeouts();
+	r.health = sensor->getHealth();
+	r.response = response;
+	r.circuit = sensor->getCircuitType();
+	// Only a reply parsed as a reading moves getReadingTime(). Anything else leaves the last reading up.
+	if ( sensor->getReadingTime() != r.reading_ms ) {
+		r.wall_ms = (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+		r.reading_ms = sensor->getReadingTime();
+		r.readings++;
+		r.channel_mask = sensor->getChannelMask();
+		for ( uint8_t channel = 0 ; channel < EZO_MAX_CHANNELS ; channel++ ) {
+			r.values[channel] = ( r.channel_mask & ( 1 << channel ) ) ? sensor->getValue(channel) : 0.0;
+		}
+	}
+	__atomic_store_n(&s.sequence,sequence + 2,__ATOMIC_RELEASE); // even: done
+	return true;
+}
+
+bool AtlasBoard::publish(EZO *sensor, const ezo_response response) {
+	for ( uint8_t slot = 0 ; slot < _count ; slot++ ) {
+		if ( _sensors[slot] == sensor ) return publish(slot,sensor,response);
+	}
+	return false;
+}
+
+void AtlasBoard::pollCallback(uint8_t, EZO *sensor, ezo_response response, void *board) {
+	((AtlasBoard *)board)->publish(sensor,response);
+}
+
+bool AtlasBoardReader::attach(const char *name) {
+	detach();
+	int fd = shm_open(name,O_RDONLY,0);
+	if ( fd < 0 ) return false;
+	struct stat st;
+	if ( fstat(fd,&st) != 0 || (size_t)st.st_size < sizeof(atlas_board_region) ) { ::close(fd); return false;}
+	void *map = mmap(NULL,sizeof(atlas_board_region),PROT_READ,MAP_SHARED,fd,0);
+	::close(fd);
+	if ( map == MAP_FAILED ) return false;
+	const atlas_board_region *region = (const atlas_board_region *)map;
+	if ( __atomic_load_n(&region->header.magic,__ATOMIC_ACQUIRE) != ATLAS_BOARD_MAGIC
+		|| region->header.version != ATLAS_BOARD_VERSION || region->header.slot_size != sizeof(atlas_board_slot) ) {
+		munmap(map,sizeof(atlas_board_region));
+		return false;
+	}
+	_region = region;
+	return true;
+}
+
+void AtlasBoardReader::detach() {
+	if ( ! _region ) return;
+	munmap((void *)_region,sizeof(atlas_board_region));
+	_region = NULL;
+}
+
+int AtlasBoardReader::find(const char *name) const {
+	atlas_board_reading reading;
+	for ( uint8_t slot = 0 ; slot < getSlotCount() ; slot++ ) {
+		if ( read(slot,reading) && ! strncmp(reading.name,name,ATLAS_BOARD_NAME_LENGTH) ) return slot;
+	}
+	return -1;
+}
+
+uint8_t AtlasBoardReader::getSlotCount() const {
+	return _region ? _region->header.slots : 0;
+}
+
+bool AtlasBoardReader::read(const int slot, atlas_board_reading &reading) const {
+	if ( ! _region || slot < 0 || slot >= getSlotCount() ) return false;
+	const atlas_board_slot &s = _region->slots[slot];
+	if ( ! __atomic_load_n(&s.used,__ATOMIC_ACQUIRE) ) return false;
+	for ( uint32_t tries = 0 ; tries < ATLAS_BOARD_READ_TRIES ; tries++ ) {
+		uint32_t before = __atomic_load_n(&s.sequence,__ATOMIC_ACQUIRE);
+		if ( before & 1 ) continue; // being written, a few hundred ns at most
+		memcpy(&reading,(const void *)&s.reading,sizeof(reading));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE); // the copy happens before the recheck
+		if ( __atomic_load_n(&s.sequence,__ATOMIC_RELAXED) == before ) return true;
+	}
+	return false; // a writer that died mid-publish leaves the sequence odd
+}
+
+uint32_t AtlasBoardReader::getSequence(const int slot) const {
+	if ( ! _region || slot < 0 || slot >= getSlotCount() ) return 0;
+	return __atomic_load_n(&_region->slots[slot].sequence,__ATOMIC_ACQUIRE);
+}
+#endif
@@ -0,0 +1,121 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Linux only. Publishes the latest reading, time and health of each sensor
+	in a shared memory board, so a dashboard, alarm and uploader can all read
+	current values without owning a serial port or asking the poller.
+	
+	The polling process creates the board and names its sensors:
+		AtlasBoard board;
+		board.create("/atlas");
+		board.addSensor("tank1-ec",&EC_sensor);
+		poller.addCallback(AtlasBoard::pollCallback,&board); // alongside an AtlasServer's
+	Every finished command then updates that sensor's health, timeouts and
+	response. Its values, times and readings count only change when the
+	command brought back a new reading, so configuration commands, timeouts
+	and breaker rejections are counted in commands but never shown as data.
+	
+	Other processes attach read-only:
+		AtlasBoardReader board;
+		board.attach("/atlas");
+		atlas_board_reading reading;
+		if ( board.read(board.find("tank1-ec"),reading) ) ...
+	
+	Each slot is a seqlock: the writer makes the sequence odd, writes, then
+	makes it even again. read() copies the slot and retries if the sequence
+	was odd or changed, so readers never block the writer, never see a torn
+	reading and never make a system call. After ATLAS_BOARD_READ_TRIES it
+	returns false rather than spin on a slot whose writer died mid-publish.
+	One writer per slot. The poller only completes one command per port at
+	a time, so its callback is safe even with worker threads.
+============================================================================*/
+#ifndef _Atlas_Board_h
+#define _Atlas_Board_h
+
+#include <Atlas_EZO.h>
+
+#define ATLAS_BOARD_MAGIC		0x41544c42 // "ATLB"
+#define ATLAS_BOARD_VERSION		2
+#define ATLAS_BOARD_SLOTS		32
+#define ATLAS_BOARD_NAME_LENGTH	24
+#define ATLAS_BOARD_READ_TRIES	100000 // read() gives up after this many torn copies
+
+struct atlas_board_reading {
+	char			name[ATLAS_BOARD_NAME_LENGTH];
+	int64_t			wall_ms; // CLOCK_REALTIME when the reading was published, comparable across processes
+	uint32_t		reading_ms; // getReadingTime(), the poller's millis()
+	uint32_t		readings; // new readings published so far
+	uint32_t		commands; // finished commands, readings or not
+	uint32_t		timeouts; // getTimeouts()
+	uint8_t			channel_mask;
+	uint8_t			health; // atlas_health
+	uint8_t			response; // ezo_response of the last command
+	uint8_t			circuit; // ezo_circuit_type
+	float			values[EZO_MAX_CHANNELS];
+};
+
+struct atlas_board_slot {
+	uint32_t			sequence; // odd while being written
+	uint32_t			used;
+	atlas_board_reading	reading;
+} __attribute__((aligned(64))); // one cache line pair per slot, no false sharing
+
+struct atlas_board_header {
+	uint32_t			magic;
+	uint16_t			version;
+	uint16_t			slots;
+	uint32_t			slot_size;
+	uint32_t			writer_pid;
+} __attribute__((aligned(64)));
+
+struct atlas_board_region {
+	atlas_board_header	header;
+	atlas_board_slot	slots[ATLAS_BOARD_SLOTS];
+};
+
+class AtlasBoard {
+	public:
+		AtlasBoard();
+		~AtlasBoard() { close();}
+		bool			create(const char *name); // shm_open() name, e.g. "/atlas"
+		void			close(); // leaves the board for readers, see unlink()
+		bool			unlink();
+		int				addSensor(const char *name, EZO *sensor); // slot or -1
+		bool			publish(const uint8_t slot, EZO *sensor, const ezo_response response);
+		bool			publish(EZO *sensor, const ezo_response response); // finds the slot
+		static void		pollCallback(uint8_t port, EZO *sensor, ezo_response response, void *board); // for AtlasPoller
+	private:
+		atlas_board_region *	_region;
+		char			_name[ATLAS_BOARD_NAME_LENGTH];
+		EZO *			_sensors[ATLAS_BOARD_SLOTS];
+		uint8_t			_count;
+};
+
+class AtlasBoardReader {
+	public:
+		AtlasBoardReader() { _region = NULL;}
+		~AtlasBoardReader() { detach();}
+		bool			attach(const char *name);
+		void			detach();
+		int				find(const char *name) const; // slot or -1
+		uint8_t			getSlotCount() const;
+		bool			read(const int slot, atlas_board_reading &reading) const; // false if unused, out of range or stuck
+		uint32_t		getSequence(const int slot) const; // changes on every publish
+	private:
+		const atlas_board_region *	_region;
+};
+#endif
@@ -0,0 +1,294 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#if !defined(ARDUINO) && __cplusplus >= 202002L // Linux, C++20
+
+#include <AtlasCoroutine.h>
+#include <algorithm>
+#include <poll.h>
+
+/*              AWAITABLES                      */
+
+AtlasCommandAwaiter::AtlasCommandAwaiter(AtlasLoop &loop, EZO &sensor, const char *command, const bool has_result, const bool has_response, ezo_parser parser, const bool reading)
+	: _loop(loop), _sensor(sensor) {
+	_command[0] = 0;
+	if ( command ) strncat(_command,command,ATLAS_LOOP_COMMAND_LEN - 1);
+	_has_result = has_result;
+	_has_response = has_response;
+	_parser = parser;
+	_reading = reading;
+	_refresh_command = NULL;
+	_refresh_parser = NULL;
+	_refreshing = false;
+	_started = false;
+	_response = EZO_RESPONSE_UK;
+}
+
+AtlasCommandAwaiter::AtlasCommandAwaiter(AtlasLoop &loop, EZO &sensor, const char *command, const char *refresh, ezo_parser refresh_parser)
+	: AtlasCommandAwaiter(loop,sensor,command,false,true,NULL) {
+	_refresh_command = refresh;
+	_refresh_parser = refresh_parser;
+}
+
+bool AtlasCommandAwaiter::await_ready() {
+	// Done already if it could not be sent (offline, breaker open).
+	if ( _sensor.busy() || _loop._unread(&_sensor) ) return false;
+	return ! _start();
+}
+
+void AtlasCommandAwaiter::await_suspend(std::coroutine_handle<> caller) {
+	_caller = caller;
+	_loop._commands.push_back(this);
+}
+
+bool AtlasCommandAwaiter::_start() {
+	if ( ! _command[0] ) return false; // nothing to send, resumes with UK
+	if ( _reading )	_started = _sensor.startReading();
+	else			_started = _sensor.startCommand(_command,_has_result,_has_response,_parser);
+	if ( ! _started ) _response = _sensor.getLastResponse();
+	return _started;
+}
+
+bool AtlasCommandAwaiter::_refresh() {
+	// Nothing to do unless the setter went and wasn't refused. The sensor is still ours:
+	// _service() runs this before any other waiting command can start on it.
+	if ( ! _refresh_command || _response == EZO_RESPONSE_ER ) return false;
+	_refreshing = _sensor.startCommand(_refresh_command,true,true,_refresh_parser);
+	return _refreshing;
+}
+
+void AtlasSleepAwaiter::await_suspend(std::coroutine_handle<> caller) {
+	AtlasLoop::timer t = { (uint32_t)( millis() + _ms ), caller };
+	_loop._timers.push_back(t);
+	std::push_heap(_loop._timers.begin(),_loop._timers.end(),AtlasLoop::_later);
+}
+
+/*              LOOP                      */
+
+void AtlasLoop::attach(EZO &sensor, AtlasPosixSerial &serial) {
+	attached a = { &sensor, serial.getFd() };
+	_attached.push_back(a);
+}
+
+void AtlasLoop::spawn(AtlasTask task) {
+	AtlasTask::handle h = task._handle;
+	task._handle = nullptr; // the loop owns it now
+	_tasks.push_back(h);
+	_ready.push_back(h);
+}
+
+void AtlasLoop::run() {
+	while ( ! _tasks.empty() ) runOnce(-1);
+}
+
+void AtlasLoop::runOnce(const int timeout_ms) {
+	// Resume everything runnable, then wait for the next reply, deadline or timer.
+	std::vector<std::coroutine_handle<>> ready;
+	ready.swap(_ready);
+	for ( size_t i = 0 ; i < ready.size() ; i++ ) ready[i].resume();
+	_finished.clear(); // their tasks have read the results
+	for ( size_t i = 0 ; i < _tasks.size() ; ) {
+		if ( _tasks[i].done() ) {
+			_tasks[i].destroy();
+			_tasks[i] = _tasks.back();
+			_tasks.pop_back();
+		}
+		else i++;
+	}
+	_service();
+	if ( ! _ready.empty() || _tasks.empty() ) return;
+	int wait = timeout_ms;
+	if ( ! _timers.empty() ) {
+		int32_t due = ATLAS_TIME_DIFF(_timers.front().due,millis());
+		if ( due < 0 ) due = 0;
+		if ( wait < 0 || due < wait ) wait = due;
+	}
+	if ( ! _commands.empty() && ( wait < 0 || wait > ATLAS_LOOP_TICK ) ) wait = ATLAS_LOOP_TICK;
+	std::vector<struct pollfd> fds;
+	for ( size_t i = 0 ; i < _commands.size() ; i++ ) {
+		int fd = _commands[i]->_started ? _fdFor(&_commands[i]->_sensor) : -1;
+		if ( fd >= 0 ) {
+			struct pollfd p = { fd, POLLIN, 0 };
+			fds.push_back(p);
+		}
+	}
+	if ( wait != 0 ) poll(fds.data(),fds.size(),wait);
+	_service();
+}
+
+AtlasCommandAwaiter AtlasLoop::setTempComp(EZO &sensor, const float temp_C) {
+	char command[ATLAS_LOOP_COMMAND_LEN];
+	snprintf(command,sizeof(command),"T,%.1f\r",temp_C);
+	return AtlasCommandAwaiter(*this,sensor,command,"T,?\r",&EZO::parseTempComp);
+}
+
+AtlasCommandAwaiter AtlasLoop::setK(EZO_EC &sensor, const float k) {
+	char command[ATLAS_LOOP_COMMAND_LEN];
+	snprintf(command,sizeof(command),"K,%.1f\r",k);
+	return AtlasCommandAwaiter(*this,sensor,command,"K,?\r",static_cast<ezo_parser>(&EZO_EC::parseK));
+}
+
+AtlasCommandAwaiter AtlasLoop::calibrate(EZO_DO &sensor, const ezo_do_calibration_command cal) {
+	switch ( cal ) {
+		case EZO_DO_CAL_CLEAR:	return _calibrate(sensor,"Cal,clear\r");
+		case EZO_DO_CAL_ATM:	return _calibrate(sensor,"Cal\r"); // probe in air
+		case EZO_DO_CAL_ZERO:	return _calibrate(sensor,"Cal,0\r"); // probe in zero solution
+		case EZO_DO_CAL_QUERY:	return queryCalibration(sensor);
+		default:				return _nothing(sensor);
+	}
+}
+
+AtlasCommandAwaiter AtlasLoop::setSalComp(EZO_DO &sensor, const uint32_t sal_uS) {
+	char command[ATLAS_LOOP_COMMAND_LEN];
+	snprintf(command,sizeof(command),"S,%u\r",(unsigned)sal_uS);
+	return AtlasCommandAwaiter(*this,sensor,command,"S,?\r",static_cast<ezo_parser>(&EZO_DO::parseSalComp));
+}
+
+AtlasCommandAwaiter AtlasLoop::setSalPPTComp(EZO_DO &sensor, const float sal_ppt) {
+	char command[ATLAS_LOOP_COMMAND_LEN];
+	snprintf(command,sizeof(command),"S,%.1f,PPT\r",sal_ppt);
+	return AtlasCommandAwaiter(*this,sensor,command,"S,?\r",static_cast<ezo_parser>(&EZO_DO::parseSalComp));
+}
+
+AtlasCommandAwaiter AtlasLoop::setPresComp(EZO_DO &sensor, const float pressure_kpa) {
+	char command[ATLAS_LOOP_COMMAND_LEN];
+	snprintf(command,sizeof(command),"P,%.2f\r",pressure_kpa);
+	return AtlasCommandAwaiter(*this,sensor,command,"P,?\r",static_cast<ezo_parser>(&EZO_DO::parsePresComp));
+}
+
+AtlasCommandAwaiter AtlasLoop::calibrate(EZO_PH &sensor, const ezo_ph_calibration_command cal, const float ph_standard) {
+	const char * point;
+	switch ( cal ) {
+		case EZO_PH_CAL_CLEAR:	return _calibrate(sensor,"Cal,clear\r");
+		case EZO_PH_CAL_MID:	point = "mid";	break;
+		case EZO_PH_CAL_LOW:	point = "low";	break;
+		case EZO_PH_CAL_HIGH:	point = "high";	break;
+		case EZO_PH_CAL_QUERY:	return queryCalibration(sensor);
+		default:				return _nothing(sensor);
+	}
+	char command[ATLAS_LOOP_COMMAND_LEN];
+	snprintf(command,sizeof(command),"Cal,%s,%.2f\r",point,ph_standard);
+	return _calibrate(sensor,command);
+}
+
+AtlasCommandAwaiter AtlasLoop::calibrate(EZO_ORP &sensor, const ezo_orp_calibration_command cal, const float orp_standard) {
+	switch ( cal ) {
+		case EZO_ORP_CAL_CLEAR:	return _calibrate(sensor,"Cal,clear\r");
+		case EZO_ORP_CAL_VALUE:	break;
+		case EZO_ORP_CAL_QUERY:	return queryCalibration(sensor);
+		default:				return _nothing(sensor);
+	}
+	char command[ATLAS_LOOP_COMMAND_LEN];
+	snprintf(command,sizeof(command),"Cal,%.1f\r",orp_standard);
+	return _calibrate(sensor,command);
+}
+
+AtlasCommandAwaiter AtlasLoop::setGamma(EZO_RGB &sensor, const float gamma_correction) {
+	char command[ATLAS_LOOP_COMMAND_LEN];
+	snprintf(command,sizeof(command),"G,%.2f\r",gamma_correction); // 0.01 to 4.99
+	return AtlasCommandAwaiter(*this,sensor,command,"G,?\r",static_cast<ezo_parser>(&EZO_RGB::parseGamma));
+}
+
+/*              PRIVATE METHODS                      */
+
+AtlasCommandAwaiter AtlasLoop::_changeOutput(EZO_EC &sensor, const ezo_ec_output output, const int8_t enable_output) {
+	// format is "O,[parameter],[0|1]\r", as EZO_EC::_changeOutput()
+	const char * parameter;
+	switch (output) {
+		case EZO_EC_OUT_EC:		parameter = "EC";	break;
+		case EZO_EC_OUT_TDS:	parameter = "TDS";	break;
+		case EZO_EC_OUT_S:		parameter = "S";	break;
+		case EZO_EC_OUT_SG:		parameter = "SG";	break;
+		default: return _nothing(sensor);
+	}
+	char command[ATLAS_LOOP_COMMAND_LEN];
+	snprintf(command,sizeof(command),"O,%s,%c\r",parameter,enable_output ? '1' : '0');
+	return AtlasCommandAwaiter(*this,sensor,command,"O,?\r",static_cast<ezo_parser>(&EZO_EC::parseOutput));
+}
+
+AtlasCommandAwaiter AtlasLoop::_changeOutput(EZO_DO &sensor, const do_output output, const int8_t enable_output) {
+	const char * parameter;
+	switch (output) {
+		case EZO_DO_OUT_SAT:	parameter = "%";	break;
+		case EZO_DO_OUT_MGL:	parameter = "DO";	break;
+		default: return _nothing(sensor);
+	}
+	char command[ATLAS_LOOP_COMMAND_LEN];
+	snprintf(command,sizeof(command),"O,%s,%c\r",parameter,enable_output ? '1' : '0');
+	return AtlasCommandAwaiter(*this,sensor,command,"O,?\r",static_cast<ezo_parser>(&EZO_DO::parseOutput));
+}
+
+AtlasCommandAwaiter AtlasLoop::_changeOutput(EZO_RGB &sensor, const ezo_rgb_output output, const int8_t enable_output) {
+	const char * parameter;
+	switch (output) {
+		case EZO_RGB_OUT_RGB:	parameter = "RGB";	break;
+		case EZO_RGB_OUT_PROX:	parameter = "PROX";	break;
+		case EZO_RGB_OUT_LUX:	parameter = "LUX";	break;
+		case EZO_RGB_OUT_CIE:	parameter = "CIE";	break;
+		default: return _nothing(sensor);
+	}
+	char command[ATLAS_LOOP_COMMAND_LEN];
+	snprintf(command,sizeof(command),"O,%s,%c\r",parameter,enable_output ? '1' : '0');
+	return AtlasCommandAwaiter(*this,sensor,command,"O,?\r",static_cast<ezo_parser>(&EZO_RGB::parseOutput));
+}
+
+AtlasCommandAwaiter AtlasLoop::_calibrate(EZO &sensor, const char *command) {
+	return AtlasCommandAwaiter(*this,sensor,command,"Cal,?\r",&EZO::parseCalibration);
+}
+
+int AtlasLoop::_fdFor(const EZO *sensor) const {
+	for ( size_t i = 0 ; i < _attached.size() ; i++ ) {
+		if ( _attached[i].sensor == sensor ) return _attached[i].fd;
+	}
+	return -1;
+}
+
+bool AtlasLoop::_unread(const EZO *sensor) const {
+	return std::find(_finished.begin(),_finished.end(),sensor) != _finished.end();
+}
+
+void AtlasLoop::_service() {
+	for ( size_t i = 0 ; i < _commands.size() ; ) {
+		AtlasCommandAwaiter *c = _commands[i];
+		bool done = false;
+		if ( ! c->_started ) {
+			// Its turn on the sensor, once the task before has read its result
+			if ( ! c->_sensor.busy() && ! _unread(&c->_sensor) ) done = ! c->_start();
+			if ( c->_started && c->_sensor.pollCommand() ) done = true;
+		}
+		else if ( c->_sensor.pollCommand() ) done = true;
+		if ( done && c->_refreshing ) c->_sensor.finishCommand(); // the query after a setter: the setter's _response stands
+		else if ( done && c->_started ) {
+			c->_response = c->_sensor.finishCommand();
+			if ( c->_refresh() ) done = false;
+		}
+		if ( done ) {
+			if ( c->_started ) _finished.push_back(&c->_sensor);
+			_ready.push_back(c->_caller);
+			_commands.erase(_commands.begin() + i); // keep FIFO order for tasks sharing a sensor
+		}
+		else i++;
+	}
+	while ( ! _timers.empty() && ATLAS_TIME_DIFF(millis(),_timers.front().due) >= 0 ) {
+		_ready.push_back(_timers.front().caller);
+		std::pop_heap(_timers.begin(),_timers.end(),_later);
+		_timers.pop_back();
+	}
+}
+
+#endif
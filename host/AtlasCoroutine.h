@@ -0,0 +1,206 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Linux, C++20 only. Coroutines over the non-blocking EZO commands.
+	One thread runs an AtlasLoop; any number of AtlasTask coroutines
+	co_await readings, commands and sleeps on it:
+	
+		AtlasTask logEC(AtlasLoop &loop, EZO_EC &ec) {
+			while ( true ) {
+				if ( co_await loop.read(ec) == EZO_RESPONSE_OK ) printf("%f\n",ec.getEC());
+				co_await loop.sleep(1000);
+			}
+		}
+		loop.spawn(logEC(loop,EC_sensor));
+		loop.run();
+	
+	The typed awaitables mirror the blocking API: co_await loop.queryK(ec)
+	leaves the value for ec.getK() just as ec.queryK() does. Setters send
+	the change and then the matching query, so the getter holds what the
+	circuit took; they resume with the setter's response. calibrate() ends
+	with "Cal,?", leaving getCalibration() up to date. What isn't here
+	(RGB brightness, proximity and matching, names, baud rates) goes
+	through query() and command().
+============================================================================*/
+#ifndef _Atlas_Coroutine_h
+#define _Atlas_Coroutine_h
+
+#if __cplusplus >= 202002L
+
+#include <Atlas_EZO.h>
+#include <Atlas_EZO_EC.h>
+#include <Atlas_EZO_DO.h>
+#include <Atlas_EZO_PH.h>
+#include <Atlas_EZO_ORP.h>
+#include <Atlas_EZO_RGB.h>
+#include <AtlasPosixSerial.h>
+#include <coroutine>
+#include <exception>
+#include <vector>
+
+#define ATLAS_LOOP_COMMAND_LEN	32
+#define ATLAS_LOOP_TICK			10	// ms between deadline checks while a command is in flight
+
+class AtlasLoop;
+
+class AtlasTask {
+	public:
+		struct promise_type;
+		typedef std::coroutine_handle<promise_type> handle;
+		struct final_awaiter {
+			bool			await_ready() noexcept { return false;}
+			std::coroutine_handle<>	await_suspend(handle h) noexcept {
+				// Back to whoever co_awaited us. Spawned tasks stop here and the loop frees them.
+				if ( h.promise().continuation ) return h.promise().continuation;
+				return std::noop_coroutine();
+			}
+			void			await_resume() noexcept {}
+		};
+		struct promise_type {
+			std::coroutine_handle<>	continuation;
+			AtlasTask		get_return_object() { return AtlasTask(handle::from_promise(*this));}
+			std::suspend_always	initial_suspend() noexcept { return {};}
+			final_awaiter	final_suspend() noexcept { return {};}
+			void			return_void() {}
+			void			unhandled_exception() { std::terminate();}
+		};
+		AtlasTask(AtlasTask &&other) : _handle(other._handle) { other._handle = nullptr;}
+		AtlasTask(const AtlasTask &) = delete;
+		~AtlasTask() { if ( _handle ) _handle.destroy();}
+		// co_await a task to run it to completion inside another task
+		bool			await_ready() const { return ! _handle || _handle.done();}
+		std::coroutine_handle<>	await_suspend(std::coroutine_handle<> caller) {
+			_handle.promise().continuation = caller;
+			return _handle;
+		}
+		void			await_resume() {}
+	private:
+		friend class AtlasLoop;
+		explicit AtlasTask(handle h) : _handle(h) {}
+		handle			_handle;
+};
+
+class AtlasCommandAwaiter {
+	public:
+		AtlasCommandAwaiter(AtlasLoop &loop, EZO &sensor, const char *command, const bool has_result, const bool has_response, ezo_parser parser, const bool reading = false);
+		AtlasCommandAwaiter(AtlasLoop &loop, EZO &sensor, const char *command, const char *refresh, ezo_parser refresh_parser); // a setter
+		bool			await_ready();
+		void			await_suspend(std::coroutine_handle<> caller);
+		ezo_response	await_resume() const { return _response;}
+	private:
+		friend class AtlasLoop;
+		bool			_start(); // false while another task is using the sensor
+		bool			_refresh(); // after a setter: its query goes next, on the same sensor
+		AtlasLoop &		_loop;
+		EZO &			_sensor;
+		char			_command[ATLAS_LOOP_COMMAND_LEN];
+		bool			_has_result;
+		bool			_has_response;
+		ezo_parser		_parser;
+		bool			_reading; // startReading(), which parses with the circuit's own parser
+		const char *	_refresh_command; // NULL for all but setters
+		ezo_parser		_refresh_parser;
+		bool			_refreshing;
+		bool			_started;
+		ezo_response	_response;
+		std::coroutine_handle<>	_caller;
+};
+
+class AtlasSleepAwaiter {
+	public:
+		AtlasSleepAwaiter(AtlasLoop &loop, const uint32_t ms) : _loop(loop), _ms(ms) {}
+		bool			await_ready() const { return _ms == 0;}
+		void			await_suspend(std::coroutine_handle<> caller);
+		void			await_resume() const {}
+	private:
+		AtlasLoop &		_loop;
+		uint32_t		_ms;
+};
+
+class AtlasLoop {
+	public:
+		// Optional. Lets the loop sleep in poll() until the circuit replies instead of ticking.
+		void			attach(EZO &sensor, AtlasPosixSerial &serial);
+		void			spawn(AtlasTask task);
+		void			run(); // until every spawned task has finished
+		void			runOnce(const int timeout_ms);
+		bool			empty() const { return _tasks.empty();}
+		// Awaitables. Each resumes with the command's ezo_response; results are read
+		// with the sensor's usual getters (getEC(), getResult() ...).
+		AtlasCommandAwaiter	read(EZO &sensor) { return AtlasCommandAwaiter(*this,sensor,"R\r",true,true,NULL,true);}
+		// parser: run on the reply, e.g. &EZO::parseLED. Without one the reply is left in getResult().
+		AtlasCommandAwaiter	query(EZO &sensor, const char *command, ezo_parser parser = NULL) { return AtlasCommandAwaiter(*this,sensor,command,true,true,parser);}
+		AtlasCommandAwaiter	command(EZO &sensor, const char *command) { return AtlasCommandAwaiter(*this,sensor,command,false,true,NULL);}
+		AtlasSleepAwaiter	sleep(const uint32_t ms) { return AtlasSleepAwaiter(*this,ms);}
+		// As EZO
+		AtlasCommandAwaiter	queryLED(EZO &sensor) { return query(sensor,"L,?\r",&EZO::parseLED);}
+		AtlasCommandAwaiter	enableLED(EZO &sensor) { return AtlasCommandAwaiter(*this,sensor,"L,1\r","L,?\r",&EZO::parseLED);}
+		AtlasCommandAwaiter	disableLED(EZO &sensor) { return AtlasCommandAwaiter(*this,sensor,"L,0\r","L,?\r",&EZO::parseLED);}
+		AtlasCommandAwaiter	queryStatus(EZO &sensor) { return query(sensor,"STATUS\r",&EZO::parseStatus);}
+		AtlasCommandAwaiter	queryTempComp(EZO &sensor) { return query(sensor,"T,?\r",&EZO::parseTempComp);}
+		AtlasCommandAwaiter	setTempComp(EZO &sensor, const float temp_C);
+		AtlasCommandAwaiter	queryCalibration(EZO &sensor) { return query(sensor,"Cal,?\r",&EZO::parseCalibration);}
+		// As EZO_EC
+		AtlasCommandAwaiter	queryK(EZO_EC &sensor) { return query(sensor,"K,?\r",static_cast<ezo_parser>(&EZO_EC::parseK));}
+		AtlasCommandAwaiter	setK(EZO_EC &sensor, const float k);
+		AtlasCommandAwaiter	queryOutput(EZO_EC &sensor) { return query(sensor,"O,?\r",static_cast<ezo_parser>(&EZO_EC::parseOutput));}
+		AtlasCommandAwaiter	enableOutput(EZO_EC &sensor, const ezo_ec_output output) { return _changeOutput(sensor,output,1);}
+		AtlasCommandAwaiter	disableOutput(EZO_EC &sensor, const ezo_ec_output output) { return _changeOutput(sensor,output,0);}
+		// As EZO_DO
+		AtlasCommandAwaiter	calibrate(EZO_DO &sensor, const ezo_do_calibration_command cal);
+		AtlasCommandAwaiter	queryOutput(EZO_DO &sensor) { return query(sensor,"O,?\r",static_cast<ezo_parser>(&EZO_DO::parseOutput));}
+		AtlasCommandAwaiter	enableOutput(EZO_DO &sensor, const do_output output) { return _changeOutput(sensor,output,1);}
+		AtlasCommandAwaiter	disableOutput(EZO_DO &sensor, const do_output output) { return _changeOutput(sensor,output,0);}
+		AtlasCommandAwaiter	querySalComp(EZO_DO &sensor) { return query(sensor,"S,?\r",static_cast<ezo_parser>(&EZO_DO::parseSalComp));}
+		AtlasCommandAwaiter	setSalComp(EZO_DO &sensor, const uint32_t sal_uS);
+		AtlasCommandAwaiter	setSalPPTComp(EZO_DO &sensor, const float sal_ppt);
+		AtlasCommandAwaiter	queryPresComp(EZO_DO &sensor) { return query(sensor,"P,?\r",static_cast<ezo_parser>(&EZO_DO::parsePresComp));}
+		AtlasCommandAwaiter	setPresComp(EZO_DO &sensor, const float pressure_kpa);
+		// As EZO_PH
+		AtlasCommandAwaiter	calibrate(EZO_PH &sensor, const ezo_ph_calibration_command cal, const float ph_standard = 0.0);
+		// As EZO_ORP
+		AtlasCommandAwaiter	calibrate(EZO_ORP &sensor, const ezo_orp_calibration_command cal, const float orp_standard = 0.0);
+		// As EZO_RGB
+		AtlasCommandAwaiter	queryOutput(EZO_RGB &sensor) { return query(sensor,"O,?\r",static_cast<ezo_parser>(&EZO_RGB::parseOutput));}
+		AtlasCommandAwaiter	enableOutput(EZO_RGB &sensor, const ezo_rgb_output output) { return _changeOutput(sensor,output,1);}
+		AtlasCommandAwaiter	disableOutput(EZO_RGB &sensor, const ezo_rgb_output output) { return _changeOutput(sensor,output,0);}
+		AtlasCommandAwaiter	queryGamma(EZO_RGB &sensor) { return query(sensor,"G,?\r",static_cast<ezo_parser>(&EZO_RGB::parseGamma));}
+		AtlasCommandAwaiter	setGamma(EZO_RGB &sensor, const float gamma_correction);
+	private:
+		friend class AtlasCommandAwaiter;
+		friend class AtlasSleepAwaiter;
+		struct attached { EZO *sensor; int fd;};
+		struct timer { uint32_t due; std::coroutine_handle<> caller;};
+		static bool		_later(const timer &a, const timer &b) { return ATLAS_TIME_DIFF(a.due,b.due) > 0;}
+		int				_fdFor(const EZO *sensor) const;
+		bool			_unread(const EZO *sensor) const; // on _finished
+		AtlasCommandAwaiter	_changeOutput(EZO_EC &sensor, const ezo_ec_output output, const int8_t enable_output);
+		AtlasCommandAwaiter	_changeOutput(EZO_DO &sensor, const do_output output, const int8_t enable_output);
+		AtlasCommandAwaiter	_changeOutput(EZO_RGB &sensor, const ezo_rgb_output output, const int8_t enable_output);
+		AtlasCommandAwaiter	_calibrate(EZO &sensor, const char *command); // then "Cal,?"
+		AtlasCommandAwaiter	_nothing(EZO &sensor) { return AtlasCommandAwaiter(*this,sensor,NULL,false,false,NULL);} // resumes with UK
+		void			_service(); // commands and timers that are done go on _ready
+		std::vector<AtlasTask::handle>	_tasks; // spawned, owned by the loop
+		std::vector<std::coroutine_handle<>>	_ready;
+		std::vector<AtlasCommandAwaiter *>	_commands;
+		std::vector<EZO *>	_finished; // sensors whose result hasn't been read by its task yet
+		std::vector<timer>	_timers; // min-heap on due
+		std::vector<attached>	_attached;
+};
+
+#endif
+#endif
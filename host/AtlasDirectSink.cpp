@@ -0,0 +1,218 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#ifndef ARDUINO // Linux only
+
+#include <AtlasDirectSink.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+AtlasDirectSink::AtlasDirectSink() {
+	_fd = -1;
+	_direct = false;
+	_offset = 0;
+	_ring = NULL;
+	_head = 0;
+	_count = 0;
+	_writing = false;
+	_stopping = false;
+	_failed = false;
+	_errors = 0;
+	_error = 0;
+}
+
+bool AtlasDirectSink::open(const char *path) {
+	close();
+	_fd = ::open(path,O_WRONLY | O_CREAT,0644);
+	if ( _fd < 0 ) return false;
+	struct stat st;
+	if ( fstat(_fd,&st) != 0 ) { ::close(_fd); _fd = -1; return false;}
+	_offset = st.st_size;
+	_direct = false;
+#ifdef O_DIRECT
+	if ( _canDirect(_fd,st) ) {
+		int direct_fd = ::open(path,O_WRONLY | O_DIRECT);
+		if ( direct_fd >= 0 ) { ::close(_fd); _fd = direct_fd; _direct = true;}
+	}
+#endif
+	if ( posix_memalign((void **)&_ring,ATLAS_DIRECT_ALIGNMENT,ATLAS_DIRECT_RING_BLOCKS * ATLAS_LOG_BLOCK_SIZE) != 0 ) {
+		_ring = NULL;
+		::close(_fd);
+		_fd = -1;
+		return false;
+	}
+	_head = 0;
+	_count = 0;
+	_writing = false;
+	_stopping = false;
+	_failed = false;
+	pthread_mutex_init(&_lock,NULL);
+	pthread_cond_init(&_queued,NULL);
+	pthread_cond_init(&_drained,NULL);
+	if ( pthread_create(&_thread,NULL,_writer,this) != 0 ) {
+		pthread_mutex_destroy(&_lock);
+		pthread_cond_destroy(&_queued);
+		pthread_cond_destroy(&_drained);
+		free(_ring);
+		_ring = NULL;
+		::close(_fd);
+		_fd = -1;
+		return false;
+	}
+	return true;
+}
+
+void AtlasDirectSink::close() {
+	if ( _fd < 0 ) return;
+	pthread_mutex_lock(&_lock);
+	_stopping = true;
+	pthread_cond_signal(&_queued);
+	pthread_mutex_unlock(&_lock);
+	pthread_join(_thread,NULL); // drains the ring first, unless the writer failed
+	fdatasync(_fd);
+	::close(_fd);
+	_fd = -1;
+	pthread_mutex_destroy(&_lock);
+	pthread_cond_destroy(&_queued);
+	pthread_cond_destroy(&_drained);
+	free(_ring);
+	_ring = NULL;
+}
+
+bool AtlasDirectSink::writeBlock(const uint8_t *block, const uint16_t length) {
+	if ( _fd < 0 || length > ATLAS_LOG_BLOCK_SIZE ) return false;
+	pthread_mutex_lock(&_lock);
+	if ( _failed || _count == ATLAS_DIRECT_RING_BLOCKS ) { pthread_mutex_unlock(&_lock); return false;}
+	uint16_t slot = _head;
+	pthread_mutex_unlock(&_lock);
+	// Only this thread fills slots, and the writer won't touch this one until _count says so
+	uint8_t *dest = _ring + slot * ATLAS_LOG_BLOCK_SIZE;
+	memcpy(dest,block,length);
+	uint16_t stored = length;
+	if ( _direct && length < ATLAS_LOG_BLOCK_SIZE ) {
+		memset(dest + length,'\n',ATLAS_LOG_BLOCK_SIZE - length);
+		stored = ATLAS_LOG_BLOCK_SIZE;
+	}
+	_lengths[slot] = stored;
+	pthread_mutex_lock(&_lock);
+	_head = ( _head + 1 ) % ATLAS_DIRECT_RING_BLOCKS;
+	_count++;
+	pthread_cond_signal(&_queued);
+	pthread_mutex_unlock(&_lock);
+	return true;
+}
+
+bool AtlasDirectSink::sync(const uint32_t timeout) {
+	if ( _fd < 0 ) return false;
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME,&deadline);
+	deadline.tv_sec += timeout / 1000;
+	deadline.tv_nsec += ( timeout % 1000 ) * 1000000L;
+	if ( deadline.tv_nsec >= 1000000000L ) { deadline.tv_sec++; deadline.tv_nsec -= 1000000000L;}
+	bool drained = true;
+	pthread_mutex_lock(&_lock);
+	while ( ( _count || _writing ) && !_failed ) {
+		if ( pthread_cond_timedwait(&_drained,&_lock,&deadline) == ETIMEDOUT ) { drained = false; break;}
+	}
+	pthread_mutex_unlock(&_lock);
+	if ( !drained || _failed ) return false;
+	return fdatasync(_fd) == 0;
+}
+
+/*              PRIVATE METHODS                      */
+// O_DIRECT needs offsets, lengths and buffers aligned to what the device wants
+bool AtlasDirectSink::_canDirect(const int fd, const struct stat &st) {
+	uint64_t offset_align = st.st_blksize;
+	uint64_t memory_align = st.st_blksize;
+#ifdef STATX_DIOALIGN
+	struct statx stx;
+	if ( statx(fd,"",AT_EMPTY_PATH,STATX_DIOALIGN,&stx) == 0 && ( stx.stx_mask & STATX_DIOALIGN ) ) {
+		offset_align = stx.stx_dio_offset_align; // 0: no direct I/O here, tmpfs and friends
+		memory_align = stx.stx_dio_mem_align;
+	}
+#else
+	(void)fd;
+#endif
+	if ( !offset_align || ATLAS_LOG_BLOCK_SIZE % offset_align ) return false;
+	if ( !memory_align || ATLAS_DIRECT_ALIGNMENT % memory_align ) return false;
+	return (uint64_t)st.st_size % offset_align == 0;
+}
+
+// Writes it all at _offset, trying again after a failure. Only moves _offset past what's written.
+bool AtlasDirectSink::_write(const uint8_t *data, const size_t bytes) {
+	size_t done = 0;
+	uint8_t failures = 0;
+	while ( done < bytes ) {
+		ssize_t n = pwrite(_fd,data + done,bytes - done,_offset + done);
+		if ( n < 0 && errno == EINTR ) continue;
+		if ( n <= 0 ) {
+			_errors++;
+			_error = ( n < 0 ) ? errno : ENOSPC;
+			if ( failures++ == ATLAS_DIRECT_RETRIES ) {
+				_offset += done;
+				return false;
+			}
+			struct timespec wait = { 0, ATLAS_DIRECT_RETRY_MS * 1000000L};
+			nanosleep(&wait,NULL);
+			continue;
+		}
+		done += n;
+	}
+	_offset += bytes;
+	return true;
+}
+
+void * AtlasDirectSink::_writer(void *arg) {
+	AtlasDirectSink *sink = (AtlasDirectSink *)arg;
+	pthread_mutex_lock(&sink->_lock);
+	for (;;) {
+		while ( !sink->_count && !sink->_stopping ) pthread_cond_wait(&sink->_queued,&sink->_lock);
+		if ( !sink->_count ) break; // stopping and drained
+		// Everything queued up to the end of the ring goes in one write,
+		// as long as it's whole blocks. A short block ends the run.
+		uint16_t first = ( sink->_head + ATLAS_DIRECT_RING_BLOCKS - sink->_count ) % ATLAS_DIRECT_RING_BLOCKS;
+		uint16_t blocks = 0;
+		size_t bytes = 0;
+		while ( blocks < sink->_count && first + blocks < ATLAS_DIRECT_RING_BLOCKS ) {
+			uint16_t length = sink->_lengths[first + blocks];
+			bytes += length;
+			blocks++;
+			if ( length < ATLAS_LOG_BLOCK_SIZE ) break;
+		}
+		sink->_writing = true;
+		pthread_mutex_unlock(&sink->_lock);
+		bool written = sink->_write(sink->_ring + first * ATLAS_LOG_BLOCK_SIZE,bytes);
+		pthread_mutex_lock(&sink->_lock);
+		if ( !written ) {
+			sink->_failed = true; // the blocks stay queued, nothing after them is written out of order
+			break;
+		}
+		sink->_count -= blocks;
+		sink->_writing = false;
+		if ( !sink->_count ) pthread_cond_broadcast(&sink->_drained);
+	}
+	sink->_writing = false;
+	pthread_cond_broadcast(&sink->_drained);
+	pthread_mutex_unlock(&sink->_lock);
+	return NULL;
+}
+#endif
@@ -0,0 +1,83 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Linux only. AtlasBlockLogger sink that appends blocks to a file from a
+	writer thread, so writeBlock() only copies into a ring and never waits
+	on the disk. The thread writes every block that has queued up with one
+	pwrite(). The file is opened with O_DIRECT when the filesystem's direct
+	I/O alignment (statx() STATX_DIOALIGN, or st_blksize where that isn't
+	known) divides ATLAS_LOG_BLOCK_SIZE and the existing length; otherwise
+	it goes through the page cache.
+	
+		AtlasDirectSink sink;
+		sink.open("/var/log/atlas.csv");
+		logger.begin(&sink);
+	
+	With O_DIRECT the partial block written by AtlasBlockLogger::flush() is
+	padded to ATLAS_LOG_BLOCK_SIZE with '\n', which log readers skip as
+	empty lines.
+	
+	A failed pwrite() is tried again ATLAS_DIRECT_RETRIES times. If it still
+	fails the writer stops: the blocks stay queued, writeBlock() and sync()
+	return false and hasFailed() says why (getError()).
+============================================================================*/
+#ifndef _Atlas_Direct_Sink_h
+#define _Atlas_Direct_Sink_h
+
+#include <AtlasBlockLogger.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define ATLAS_DIRECT_RING_BLOCKS	64	// queued blocks, 32 KB
+#define ATLAS_DIRECT_ALIGNMENT		4096
+#define ATLAS_DIRECT_RETRIES		3
+#define ATLAS_DIRECT_RETRY_MS		100
+
+class AtlasDirectSink: public AtlasBlockSink {
+	public:
+		AtlasDirectSink();
+		~AtlasDirectSink() { close();}
+		bool			open(const char *path); // appends
+		void			close(); // writes what's queued
+		bool			isDirect() const { return _direct;}
+		bool			writeBlock(const uint8_t *block, const uint16_t length); // false if the ring is full
+		bool			sync(const uint32_t timeout); // waits for the ring to drain, then fdatasync()
+		uint32_t		getWriteErrors() const { return _errors;} // failed pwrite() calls, retries included
+		bool			hasFailed() const { return _failed;} // the writer gave up, nothing more is written
+		int				getError() const { return _error;} // errno of the last failed pwrite()
+	private:
+		static void *	_writer(void *arg);
+		static bool		_canDirect(const int fd, const struct stat &st);
+		bool			_write(const uint8_t *data, const size_t bytes);
+		int				_fd;
+		bool			_direct;
+		uint64_t		_offset; // where the next block goes
+		uint8_t *		_ring; // ATLAS_DIRECT_RING_BLOCKS blocks, aligned
+		uint16_t		_lengths[ATLAS_DIRECT_RING_BLOCKS];
+		uint16_t		_head; // next slot to fill
+		uint16_t		_count; // filled slots, oldest is _head - _count
+		bool			_writing; // the thread has blocks out of the ring but not written
+		bool			_stopping;
+		bool			_failed;
+		uint32_t		_errors;
+		int				_error;
+		pthread_t		_thread;
+		pthread_mutex_t	_lock;
+		pthread_cond_t	_queued;
+		pthread_cond_t	_drained;
+};
+#endif
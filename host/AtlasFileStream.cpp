@@ -0,0 +1,66 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#ifndef ARDUINO // Linux only
+
+#include <AtlasFileStream.h>
+
+bool AtlasFileStream::open(const char *path, const char *mode) {
+	close();
+	_file = fopen(path,mode);
+	return _file != NULL;
+}
+
+void AtlasFileStream::close() {
+	if ( _file ) fclose(_file);
+	_file = NULL;
+}
+
+int AtlasFileStream::available() {
+	return peek() >= 0 ? 1 : 0;
+}
+
+int AtlasFileStream::read() {
+	if ( ! _file ) return -1;
+	int c = getc(_file);
+	return c == EOF ? -1 : c;
+}
+
+int AtlasFileStream::peek() {
+	if ( ! _file ) return -1;
+	int c = getc(_file);
+	if ( c == EOF ) return -1;
+	ungetc(c,_file);
+	return c;
+}
+
+size_t AtlasFileStream::write(uint8_t byte) {
+	if ( ! _file ) return 0;
+	return putc(byte,_file) == EOF ? 0 : 1;
+}
+
+size_t AtlasFileStream::write(const uint8_t *buffer, size_t size) {
+	if ( ! _file ) return 0;
+	return fwrite(buffer,1,size,_file);
+}
+
+void AtlasFileStream::flush() {
+	if ( _file ) fflush(_file);
+}
+
+#endif
@@ -0,0 +1,43 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	A Stream over a stdio FILE, so traces can be written and read on Linux
+	the same way an SD card File is used on the Arduino.
+============================================================================*/
+#ifndef _Atlas_File_Stream_h
+#define _Atlas_File_Stream_h
+
+#include <Arduino.h>
+
+class AtlasFileStream: public Stream {
+	public:
+		AtlasFileStream() { _file = NULL;}
+		~AtlasFileStream() { close();}
+		bool			open(const char *path, const char *mode);
+		void			close();
+		bool			isOpen() const { return _file != NULL;}
+		int				available();
+		int				read();
+		int				peek();
+		size_t			write(uint8_t byte);
+		size_t			write(const uint8_t *buffer, size_t size);
+		void			flush();
+		using Print::write;
+	private:
+		FILE*			_file;
+};
+#endif
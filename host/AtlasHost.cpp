@@ -0,0 +1,101 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#ifndef ARDUINO // Linux only
+
+#include <Arduino.h>
+#include <time.h>
+#include <sched.h>
+
+HardwareSerial Serial;
+
+unsigned long millis() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (unsigned long)now.tv_sec * 1000UL + now.tv_nsec / 1000000L;
+}
+
+unsigned long micros() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (unsigned long)now.tv_sec * 1000000UL + now.tv_nsec / 1000L;
+}
+
+void delay(unsigned long ms) {
+	struct timespec wait;
+	wait.tv_sec = ms / 1000;
+	wait.tv_nsec = ( ms % 1000 ) * 1000000L;
+	while ( nanosleep(&wait,&wait) != 0 ) {} // restart if interrupted
+}
+
+void yield() {
+	sched_yield();
+}
+
+char * dtostrf(double value, signed char width, unsigned char precision, char *buf) {
+	sprintf(buf,"%*.*f",width,precision,value);
+	return buf;
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+	size_t n = 0;
+	while ( size-- ) n += write(*buffer++);
+	return n;
+}
+
+size_t Print::print(long n, int base) {
+	char buf[24];
+	if ( base == HEX ) snprintf(buf,sizeof(buf),"%lX",n);
+	else snprintf(buf,sizeof(buf),"%ld",n);
+	return write(buf);
+}
+
+size_t Print::print(unsigned long n, int base) {
+	char buf[24];
+	if ( base == HEX ) snprintf(buf,sizeof(buf),"%lX",n);
+	else snprintf(buf,sizeof(buf),"%lu",n);
+	return write(buf);
+}
+
+size_t Print::print(double n, int digits) {
+	char buf[40];
+	snprintf(buf,sizeof(buf),"%.*f",digits,n);
+	return write(buf);
+}
+
+int Stream::timedRead() {
+	unsigned long start = millis();
+	do {
+		int c = read();
+		if ( c >= 0 ) return c;
+		yield();
+	} while ( millis() - start < _timeout );
+	return -1;
+}
+
+size_t Stream::readBytesUntil(char terminator, char *buffer, size_t length) {
+	size_t index = 0;
+	while ( index < length ) {
+		int c = timedRead();
+		if ( c < 0 || c == terminator ) break;
+		buffer[index++] = (char)c;
+	}
+	return index;
+}
+
+#endif
@@ -0,0 +1,207 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#ifndef ARDUINO // Linux only
+
+#include <AtlasLogDecoder.h>
+#include <Atlas_EZO_DO.h>
+#include <Atlas_EZO_EC.h>
+#include <Atlas_EZO_ORP.h>
+#include <Atlas_EZO_PH.h>
+#include <Atlas_EZO_RGB.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const double POWERS_OF_10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18
+};
+
+// Next '\r' or '\n' at or after p, or end
+static inline const char * lineEnd(const char *p, const char *end) {
+#ifdef __SSE2__
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	while ( end - p >= 16 ) {
+		__m128i block = _mm_loadu_si128((const __m128i *)p);
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block,cr),_mm_cmpeq_epi8(block,lf)));
+		if ( mask ) return p + __builtin_ctz(mask);
+		p += 16;
+	}
+#endif
+	while ( p < end && *p != '\r' && *p != '\n' ) p++;
+	return p;
+}
+
+// EZO numbers are plain decimals, so this skips strtod's locale and exponent handling.
+// Anything else in a value field fails.
+static inline bool parseNumber(const char *&p, const char *end, float &value) {
+	bool negative = false;
+	if ( p < end && ( *p == '-' || *p == '+' ) ) negative = ( *p++ == '-' );
+	uint64_t mantissa = 0;
+	int8_t scale = 0;
+	uint8_t digits = 0;
+	bool any = false;
+	for ( ; p < end && (uint8_t)( *p - '0' ) < 10 ; p++ ) {
+		any = true;
+		if ( digits < 18 ) { mantissa = mantissa * 10 + ( *p - '0' ); if ( mantissa ) digits++;}
+		else if ( scale < 18 ) scale++;
+	}
+	if ( p < end && *p == '.' ) {
+		for ( p++ ; p < end && (uint8_t)( *p - '0' ) < 10 ; p++ ) {
+			any = true;
+			if ( digits < 18 && scale > -18 ) { mantissa = mantissa * 10 + ( *p - '0' ); if ( mantissa ) digits++; scale--;}
+		}
+	}
+	if ( !any ) return false;
+	double result = mantissa;
+	if ( scale < 0 ) result /= POWERS_OF_10[-scale];
+	else if ( scale > 0 ) result *= POWERS_OF_10[scale];
+	value = negative ? -result : result;
+	return true;
+}
+
+AtlasLogDecoder::AtlasLogDecoder() {
+	_data = NULL;
+	_size = 0;
+	_field_count = 0;
+	for ( uint8_t i = 0 ; i < EZO_MAX_CHANNELS ; i++ ) _columns[i] = NULL;
+	_rows = 0;
+	_rejected = 0;
+	_events = 0;
+}
+
+bool AtlasLogDecoder::open(const char *path) {
+	close();
+	int fd = ::open(path,O_RDONLY);
+	if ( fd < 0 ) return false;
+	struct stat info;
+	if ( fstat(fd,&info) < 0 || info.st_size == 0 ) { ::close(fd); return false;}
+	void *data = mmap(NULL,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	::close(fd); // the mapping keeps the file
+	if ( data == MAP_FAILED ) return false;
+	madvise(data,info.st_size,MADV_SEQUENTIAL);
+	_data = (const char *)data;
+	_size = info.st_size;
+	return true;
+}
+
+void AtlasLogDecoder::close() {
+	_freeColumns();
+	if ( _data ) munmap((void *)_data,_size);
+	_data = NULL;
+	_size = 0;
+}
+
+bool AtlasLogDecoder::setLayout(const ezo_circuit_type circuit, const uint8_t outputs) {
+	switch ( circuit ) {
+		case EZO_DO_CIRCUIT:	return setLayout(EZO_DO_LAYOUT,EZO_DO_LAYOUT_GROUPS,outputs);
+		case EZO_EC_CIRCUIT:	return setLayout(EZO_EC_LAYOUT,EZO_EC_LAYOUT_GROUPS,outputs);
+		case EZO_ORP_CIRCUIT:	return setLayout(EZO_ORP_LAYOUT,EZO_ORP_LAYOUT_GROUPS,outputs);
+		case EZO_PH_CIRCUIT:	return setLayout(EZO_PH_LAYOUT,EZO_PH_LAYOUT_GROUPS,outputs);
+		case EZO_RGB_CIRCUIT:	return setLayout(EZO_RGB_LAYOUT,EZO_RGB_LAYOUT_GROUPS,outputs);
+		default:				return false;
+	}
+}
+
+bool AtlasLogDecoder::setLayout(const ezo_layout_group *layout, const uint8_t groups, const uint8_t outputs) {
+	_field_count = EZO::layoutFields(layout,groups,outputs,_fields);
+	for ( uint8_t field = 0 ; field < _field_count ; field++ ) {
+		if ( _fields[field] != ATLAS_DECODER_SKIP && _fields[field] >= EZO_MAX_CHANNELS ) { _field_count = 0; return false;}
+	}
+	return _field_count > 0;
+}
+
+uint32_t AtlasLogDecoder::decode() {
+	_freeColumns();
+	_rows = 0;
+	_rejected = 0;
+	_events = 0;
+	if ( !_data || !_field_count ) return 0;
+	size_t capacity = _countLines();
+	for ( uint8_t field = 0 ; field < _field_count ; field++ ) {
+		uint8_t channel = _fields[field];
+		if ( channel == ATLAS_DECODER_SKIP || _columns[channel] ) continue;
+		_columns[channel] = (float *)malloc(capacity * sizeof(float));
+		if ( !_columns[channel] ) { _freeColumns(); return 0;}
+	}
+	const char *p = _data;
+	const char *end = _data + _size;
+	while ( p < end ) {
+		const char *eol = lineEnd(p,end);
+		if ( eol > p ) {
+			if ( *p == '*' ) _events++;
+			else if ( _decodeLine(p,eol,_rows) ) _rows++;
+			else _rejected++;
+		}
+		p = eol + 1; // "\r\n" leaves an empty line, skipped above
+	}
+	return _rows;
+}
+
+const float * AtlasLogDecoder::getColumn(const uint8_t channel) const {
+	return channel < EZO_MAX_CHANNELS ? _columns[channel] : NULL;
+}
+
+/*              PRIVATE METHODS                      */
+size_t AtlasLogDecoder::_countLines() const {
+	// Every row ends at a '\r' or '\n' (or the end of the file), so this bounds the rows
+	size_t lines = 1;
+	const char *p = _data;
+	const char *end = _data + _size;
+#ifdef __SSE2__
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	for ( ; end - p >= 16 ; p += 16 ) {
+		__m128i block = _mm_loadu_si128((const __m128i *)p);
+		lines += __builtin_popcount(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block,cr),_mm_cmpeq_epi8(block,lf))));
+	}
+#endif
+	for ( ; p < end ; p++ ) if ( *p == '\r' || *p == '\n' ) lines++;
+	return lines;
+}
+
+bool AtlasLogDecoder::_decodeLine(const char *line, const char *end, const uint32_t row) {
+	// Values are written as they parse. A bad line is not counted, so the next one overwrites them.
+	for ( uint8_t field = 0 ; field < _field_count ; field++ ) {
+		if ( field && ( line >= end || *line++ != ',' ) ) return false;
+		uint8_t channel = _fields[field];
+		if ( channel == ATLAS_DECODER_SKIP ) {
+			while ( line < end && *line != ',' ) line++;
+			continue;
+		}
+		float value;
+		if ( !parseNumber(line,end,value) ) return false;
+		_columns[channel][row] = value;
+	}
+	return line == end;
+}
+
+void AtlasLogDecoder::_freeColumns() {
+	for ( uint8_t i = 0 ; i < EZO_MAX_CHANNELS ; i++ ) {
+		free(_columns[i]);
+		_columns[i] = NULL;
+	}
+}
+
+#endif
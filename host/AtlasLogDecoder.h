@@ -0,0 +1,67 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Linux only. Decodes a recorded continuous-mode log in bulk: the file is
+	memory-mapped, line ends are found 16 bytes at a time (SSE2 where the
+	compiler has it) and each number goes straight into a column. The field
+	order comes from the same EZO_xx_LAYOUT table the drivers parse with.
+	
+		AtlasLogDecoder log;
+		log.open("ec.log");
+		log.setLayout(EZO_EC_CIRCUIT, EZO_EC_OUT_EC | EZO_EC_OUT_S);
+		uint32_t rows = log.decode();
+		const float *sal = log.getColumn(EZO_EC_CH_SAL);
+	
+	Lines starting with '*' (*OK, *RS...) and blank lines are skipped. Lines
+	that don't fit the layout are counted by getRejected() and left out.
+============================================================================*/
+#ifndef _Atlas_Log_Decoder_h
+#define _Atlas_Log_Decoder_h
+
+#include <Atlas_EZO.h>
+
+#define ATLAS_DECODER_SKIP	EZO_LAYOUT_TAG // field is a tag, not a value
+
+class AtlasLogDecoder {
+	public:
+		AtlasLogDecoder();
+		~AtlasLogDecoder() { close();}
+		bool			open(const char *path);
+		void			close();
+		// outputs: the driver's output flags (EZO_EC_OUT_...), ignored for pH and ORP
+		bool			setLayout(const ezo_circuit_type circuit, const uint8_t outputs);
+		bool			setLayout(const ezo_layout_group *layout, const uint8_t groups, const uint8_t outputs);
+		uint32_t		decode(); // rows decoded
+		uint32_t		getRows() const { return _rows;}
+		uint32_t		getRejected() const { return _rejected;}
+		uint32_t		getEvents() const { return _events;} // '*' lines skipped
+		size_t			getSize() const { return _size;}
+		const float *	getColumn(const uint8_t channel) const; // NULL if the layout hasn't got it
+	private:
+		size_t			_countLines() const;
+		bool			_decodeLine(const char *line, const char *end, const uint32_t row);
+		void			_freeColumns();
+		const char *	_data;
+		size_t			_size;
+		uint8_t			_fields[EZO_LAYOUT_FIELDS]; // channel of each field, or ATLAS_DECODER_SKIP
+		uint8_t			_field_count;
+		float *			_columns[EZO_MAX_CHANNELS];
+		uint32_t		_rows;
+		uint32_t		_rejected;
+		uint32_t		_events;
+};
+#endif
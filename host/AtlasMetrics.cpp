@@ -0,0 +1,245 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#ifndef ARDUINO // Linux only
+
+#include <AtlasMetrics.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const char * RESPONSE_NAMES[] = { "OL", "NA", "UK", "OK", "ER", "OV", "UV", "RS", "RE", "SL", "WA", "BR",
+	"I2C_NA", "I2C_ND", "I2C_PE", "I2C_F", "I2C_S", "I2C_UK" };
+static const char * RESTART_NAMES[] = { "P", "S", "B", "W", "U", "N" };
+static const char * HEALTH_NAMES[] = { "closed", "open", "half_open" };
+
+AtlasMetrics::AtlasMetrics() {
+	_count = 0;
+	_text = (char *)malloc(ATLAS_METRICS_TEXT_LENGTH);
+	_length = 0;
+	_path[0] = '\0';
+	_interval = 0;
+	_last_write = 0;
+	_listen_fd = -1;
+	for ( uint8_t i = 0 ; i < ATLAS_METRICS_MAX_CONNECTIONS ; i++ ) _connections[i].fd = -1;
+}
+
+bool AtlasMetrics::addSensor(const char *name, EZO *sensor) {
+	if ( _count >= ATLAS_METRICS_MAX_SENSORS || strlen(name) >= ATLAS_METRICS_NAME_LENGTH ) return false;
+	for ( const char *c = name ; *c ; c++ ) if ( *c == '"' || *c == '\\' || *c == '\n' ) return false; // label value
+	strcpy(_names[_count],name);
+	_sensors[_count++] = sensor;
+	return true;
+}
+
+bool AtlasMetrics::setFile(const char *path, const uint32_t interval) {
+	if ( strlen(path) + 5 > sizeof(_path) ) return false; // room for ".tmp"
+	strcpy(_path,path);
+	_interval = interval;
+	_last_write = millis() - interval; // first write on the next service()
+	return true;
+}
+
+bool AtlasMetrics::listen(const uint16_t port) {
+	if ( _listen_fd >= 0 ) ::close(_listen_fd);
+	_listen_fd = socket(AF_INET,SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,0);
+	if ( _listen_fd < 0 ) return false;
+	int on = 1;
+	setsockopt(_listen_fd,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on));
+	struct sockaddr_in address;
+	memset(&address,0,sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // never on the network
+	if ( bind(_listen_fd,(struct sockaddr *)&address,sizeof(address)) != 0 || ::listen(_listen_fd,ATLAS_METRICS_MAX_CONNECTIONS) != 0 ) {
+		::close(_listen_fd);
+		_listen_fd = -1;
+		return false;
+	}
+	return true;
+}
+
+void AtlasMetrics::end() {
+	for ( uint8_t i = 0 ; i < ATLAS_METRICS_MAX_CONNECTIONS ; i++ ) {
+		if ( _connections[i].fd >= 0 ) ::close(_connections[i].fd);
+		_connections[i].fd = -1;
+	}
+	if ( _listen_fd >= 0 ) ::close(_listen_fd);
+	_listen_fd = -1;
+	free(_text);
+	_text = NULL;
+}
+
+void AtlasMetrics::service() {
+	if ( _path[0] && _interval && (uint32_t)( millis() - _last_write ) >= _interval ) {
+		_last_write = millis();
+		writeFile();
+	}
+	if ( _listen_fd < 0 ) return;
+	for (;;) {
+		uint8_t slot = 0;
+		while ( slot < ATLAS_METRICS_MAX_CONNECTIONS && _connections[slot].fd >= 0 ) slot++;
+		if ( slot == ATLAS_METRICS_MAX_CONNECTIONS ) break; // the rest wait in the backlog
+		int fd = accept4(_listen_fd,NULL,NULL,SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if ( fd < 0 ) break;
+		_connections[slot].fd = fd;
+		_connections[slot].accepted = millis();
+	}
+	for ( uint8_t i = 0 ; i < ATLAS_METRICS_MAX_CONNECTIONS ; i++ ) {
+		if ( _connections[i].fd >= 0 ) _serve(_connections[i]);
+	}
+}
+
+bool AtlasMetrics::writeFile() {
+	if ( ! _path[0] || ! render() ) return false;
+	char temp[sizeof(_path)];
+	int length = snprintf(temp,sizeof(temp),"%s.tmp",_path);
+	if ( length < 0 || (size_t)length >= sizeof(temp) ) return false;
+	int fd = open(temp,O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,0644);
+	if ( fd < 0 ) return false;
+	size_t done = 0;
+	while ( done < _length ) {
+		ssize_t n = write(fd,_text + done,_length - done);
+		if ( n < 0 && errno == EINTR ) continue;
+		if ( n <= 0 ) break;
+		done += n;
+	}
+	bool ok = done == _length && fsync(fd) == 0;
+	ok = ( close(fd) == 0 ) && ok;
+	if ( ok ) ok = rename(temp,_path) == 0;
+	if ( ! ok ) unlink(temp);
+	return ok;
+}
+
+const char * AtlasMetrics::render() {
+	if ( ! _text ) return NULL;
+	_length = 0;
+	_text[0] = '\0';
+	_family("atlas_connected","gauge","1 once the circuit has answered");
+	for ( uint8_t i = 0 ; i < _count ; i++ ) _append("atlas_connected{sensor=\"%s\"} %d\n",_names[i],_sensors[i]->connected());
+	_family("atlas_online","gauge","0 while a multiplexer has switched away from the circuit");
+	for ( uint8_t i = 0 ; i < _count ; i++ ) _append("atlas_online{sensor=\"%s\"} %d\n",_names[i],_sensors[i]->online());
+	_family("atlas_breaker","gauge","Circuit breaker state, 1 for the current one");
+	for ( uint8_t i = 0 ; i < _count ; i++ ) {
+		for ( uint8_t state = ATLAS_HEALTH_CLOSED ; state <= ATLAS_HEALTH_HALF_OPEN ; state++ ) {
+			_append("atlas_breaker{sensor=\"%s\",state=\"%s\"} %d\n",_names[i],HEALTH_NAMES[state],_sensors[i]->getHealth() == state);
+		}
+	}
+	_family("atlas_last_response","gauge","Response code of the last command, 1 for the current one");
+	for ( uint8_t i = 0 ; i < _count ; i++ ) {
+		uint8_t response = _sensors[i]->getLastResponse();
+		if ( response < sizeof(RESPONSE_NAMES) / sizeof(RESPONSE_NAMES[0]) ) {
+			_append("atlas_last_response{sensor=\"%s\",code=\"%s\"} 1\n",_names[i],RESPONSE_NAMES[response]);
+		}
+	}
+	_family("atlas_timeouts","counter","Commands that got no reply");
+	for ( uint8_t i = 0 ; i < _count ; i++ ) _append("atlas_timeouts_total{sensor=\"%s\"} %u\n",_names[i],_sensors[i]->getTimeouts());
+	_family("atlas_resets","counter","*RS events seen since start or resetEventCounts()");
+	for ( uint8_t i = 0 ; i < _count ; i++ ) _append("atlas_resets_total{sensor=\"%s\"} %u\n",_names[i],_sensors[i]->getEventCount(EZO_RESPONSE_RS));
+	_family("atlas_supply_volts","gauge","Supply voltage from the last queryStatus()");
+	for ( uint8_t i = 0 ; i < _count ; i++ ) _append("atlas_supply_volts{sensor=\"%s\"} %.3f\n",_names[i],_sensors[i]->getVoltage());
+	_family("atlas_restart_reason","gauge","Reason for the last restart from queryStatus(): P power on, S software, B brown-out, W watchdog, U unknown, N none");
+	for ( uint8_t i = 0 ; i < _count ; i++ ) {
+		uint8_t reason = _sensors[i]->getStatus();
+		if ( reason < sizeof(RESTART_NAMES) / sizeof(RESTART_NAMES[0]) ) {
+			_append("atlas_restart_reason{sensor=\"%s\",reason=\"%s\"} 1\n",_names[i],RESTART_NAMES[reason]);
+		}
+	}
+	_family("atlas_command_latency_seconds","histogram","Time from sending a command to the first byte of its reply");
+	for ( uint8_t i = 0 ; i < _count ; i++ ) {
+		const AtlasLatency *latency = _sensors[i]->getLatency();
+		if ( ! latency ) continue;
+		uint32_t cumulative = 0;
+		for ( uint8_t bucket = 0 ; bucket < ATLAS_LATENCY_BUCKETS - 1 ; bucket++ ) {
+			cumulative += latency->getBucket(bucket);
+			_append("atlas_command_latency_seconds_bucket{sensor=\"%s\",le=\"%g\"} %u\n",_names[i],AtlasLatency::getBound(bucket) / 1000.0,cumulative);
+		}
+		_append("atlas_command_latency_seconds_bucket{sensor=\"%s\",le=\"+Inf\"} %u\n",_names[i],latency->getCount());
+		_append("atlas_command_latency_seconds_count{sensor=\"%s\"} %u\n",_names[i],latency->getCount());
+		_append("atlas_command_latency_seconds_sum{sensor=\"%s\"} %.3f\n",_names[i],latency->getSum() / 1000.0);
+	}
+	_append("# EOF\n");
+	return _text;
+}
+
+/*              PRIVATE METHODS                      */
+
+void AtlasMetrics::_append(const char *format, ...) {
+	if ( _length >= ATLAS_METRICS_TEXT_LENGTH - 1 ) return;
+	va_list args;
+	va_start(args,format);
+	int n = vsnprintf(_text + _length,ATLAS_METRICS_TEXT_LENGTH - _length,format,args);
+	va_end(args);
+	if ( n > 0 ) _length += n;
+	if ( _length > ATLAS_METRICS_TEXT_LENGTH - 1 ) _length = ATLAS_METRICS_TEXT_LENGTH - 1; // truncated
+}
+
+void AtlasMetrics::_family(const char *name, const char *type, const char *help) {
+	_append("# TYPE %s %s\n# HELP %s %s\n",name,type,name,help);
+}
+
+void AtlasMetrics::_serve(atlas_metrics_connection &connection) {
+	char request[1024];
+	ssize_t n = recv(connection.fd,request,sizeof(request) - 1,0);
+	if ( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) {
+		if ( (uint32_t)( millis() - connection.accepted ) < ATLAS_METRICS_HTTP_TIMEOUT ) return; // not here yet
+	}
+	else if ( n > 0 ) {
+		// The first segment of a GET holds the request line. Anything else gets a 404.
+		request[n] = '\0';
+		bool metrics = ! strncmp(request,"GET /metrics ",13) || ! strncmp(request,"GET / ",6);
+		char header[200];
+		const char *body = metrics ? render() : "Not found\n";
+		size_t body_length = metrics ? _length : strlen(body);
+		int header_length = snprintf(header,sizeof(header),
+			"HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+			metrics ? "200 OK" : "404 Not Found",
+			metrics ? "application/openmetrics-text; version=1.0.0; charset=utf-8" : "text/plain",
+			(unsigned)body_length);
+		// The page is bigger than a socket buffer once there are a few latency histograms
+		uint32_t started = millis();
+		if ( _sendAll(connection.fd,header,header_length,started) ) _sendAll(connection.fd,body,body_length,started);
+	}
+	::close(connection.fd);
+	connection.fd = -1;
+}
+
+// Waits for room in the socket buffer, up to ATLAS_METRICS_HTTP_TIMEOUT after started
+bool AtlasMetrics::_sendAll(const int fd, const char *data, const size_t length, const uint32_t started) {
+	size_t done = 0;
+	while ( done < length ) {
+		ssize_t n = send(fd,data + done,length - done,MSG_DONTWAIT | MSG_NOSIGNAL);
+		if ( n > 0 ) { done += n; continue;}
+		if ( n < 0 && errno == EINTR ) continue;
+		if ( n < 0 && errno != EAGAIN && errno != EWOULDBLOCK ) return false; // scraper gone
+		int32_t left = ATLAS_METRICS_HTTP_TIMEOUT - (int32_t)( millis() - started );
+		if ( left <= 0 ) return false; // too slow, it gets a short read
+		struct pollfd p;
+		p.fd = fd;
+		p.events = POLLOUT;
+		if ( poll(&p,1,left) < 0 && errno != EINTR ) return false;
+	}
+	return true;
+}
+#endif
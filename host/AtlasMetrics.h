@@ -0,0 +1,85 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Linux only. Exports the health of each circuit in OpenMetrics text
+	format, for node_exporter's textfile collector or for a scraper.
+	
+		AtlasMetrics metrics;
+		EC_sensor.attachLatency(&ec_latency); // optional, gives the latency histogram
+		metrics.addSensor("tank1-ec",&EC_sensor);
+		metrics.setFile("/var/lib/node_exporter/textfile/atlas.prom",15000); // every 15 s
+		metrics.listen(9105); // optional, 127.0.0.1 only
+		// in the loop:
+		metrics.service();
+	
+	The file is written next to its final name and renamed over it, so a
+	scraper never reads half a file. service() doesn't wait for a request to
+	arrive, and one that hasn't arrived within ATLAS_METRICS_HTTP_TIMEOUT is
+	dropped. Once it has, service() sends the whole page, waiting up to
+	ATLAS_METRICS_HTTP_TIMEOUT for a slow scraper to make room.
+	
+	Supply voltage and restart reason are what the last queryStatus()
+	found, so call it now and then. A brown-out shows as restart reason "B"
+	and in atlas_resets_total.
+	
+	Sensors are read from the thread that calls service(). With AtlasPoller
+	workers, call service() between runs on the I/O thread.
+============================================================================*/
+#ifndef _Atlas_Metrics_h
+#define _Atlas_Metrics_h
+
+#include <Atlas_EZO.h>
+
+#define ATLAS_METRICS_MAX_SENSORS		16
+#define ATLAS_METRICS_NAME_LENGTH		32
+#define ATLAS_METRICS_TEXT_LENGTH		65536
+#define ATLAS_METRICS_MAX_CONNECTIONS	4
+#define ATLAS_METRICS_HTTP_TIMEOUT		1000 // ms
+
+struct atlas_metrics_connection {
+	int			fd; // -1: free
+	uint32_t	accepted; // millis()
+};
+
+class AtlasMetrics {
+	public:
+		AtlasMetrics();
+		~AtlasMetrics() { end();}
+		bool			addSensor(const char *name, EZO *sensor); // name becomes the sensor="" label
+		bool			setFile(const char *path, const uint32_t interval); // ms
+		bool			listen(const uint16_t port); // HTTP on loopback
+		void			end();
+		void			service(); // rewrites the file when due, answers HTTP
+		bool			writeFile(); // now
+		const char *	render(); // the whole exposition, valid until the next call
+	private:
+		void			_append(const char *format, ...) __attribute__((format(printf,2,3)));
+		void			_family(const char *name, const char *type, const char *help);
+		void			_serve(atlas_metrics_connection &connection);
+		bool			_sendAll(const int fd, const char *data, const size_t length, const uint32_t started);
+		EZO *			_sensors[ATLAS_METRICS_MAX_SENSORS];
+		char			_names[ATLAS_METRICS_MAX_SENSORS][ATLAS_METRICS_NAME_LENGTH];
+		uint8_t			_count;
+		char *			_text;
+		size_t			_length;
+		char			_path[256];
+		uint32_t		_interval;
+		uint32_t		_last_write;
+		int				_listen_fd;
+		atlas_metrics_connection	_connections[ATLAS_METRICS_MAX_CONNECTIONS];
+};
+#endif
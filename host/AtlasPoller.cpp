@@ -0,0 +1,308 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#ifndef ARDUINO // Linux only
+
+#include <AtlasPoller.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define ATLAS_POLLER_WAKE 0xFF // epoll tag for the event fd
+
+AtlasPoller::AtlasPoller() {
+	_port_count = 0;
+	_callback_count = 0;
+	_epoll_fd = -1;
+	_event_fd = -1;
+	_workers = 0;
+	_stopping = false;
+	_job_count = 0;
+	_done_count = 0;
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr,PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&_notify_lock,&attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+AtlasPoller::~AtlasPoller() {
+	end();
+	pthread_mutex_destroy(&_notify_lock);
+}
+
+bool AtlasPoller::begin(const uint8_t workers) {
+	if ( _epoll_fd >= 0 ) return true;
+	_epoll_fd = epoll_create1(0);
+	_event_fd = eventfd(0,EFD_NONBLOCK);
+	if ( _epoll_fd < 0 || _event_fd < 0 ) { // not end(), the mutex isn't made yet
+		if ( _epoll_fd >= 0 ) close(_epoll_fd);
+		if ( _event_fd >= 0 ) close(_event_fd);
+		_epoll_fd = -1;
+		_event_fd = -1;
+		return false;
+	}
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.u32 = ATLAS_POLLER_WAKE;
+	epoll_ctl(_epoll_fd,EPOLL_CTL_ADD,_event_fd,&ev);
+	pthread_mutex_init(&_lock,NULL);
+	pthread_cond_init(&_job_ready,NULL);
+	_stopping = false;
+	_workers = 0;
+	for ( uint8_t i = 0 ; i < workers && i < ATLAS_POLLER_MAX_WORKERS ; i++ ) {
+		if ( pthread_create(&_threads[i],NULL,_worker,this) != 0 ) break;
+		_workers++;
+	}
+	return true;
+}
+
+void AtlasPoller::end() {
+	if ( _workers ) {
+		pthread_mutex_lock(&_lock);
+		_stopping = true;
+		pthread_cond_broadcast(&_job_ready);
+		pthread_mutex_unlock(&_lock);
+		for ( uint8_t i = 0 ; i < _workers ; i++ ) pthread_join(_threads[i],NULL);
+		_workers = 0;
+	}
+	if ( _epoll_fd >= 0 ) {
+		pthread_mutex_destroy(&_lock);
+		pthread_cond_destroy(&_job_ready);
+		close(_epoll_fd);
+	}
+	if ( _event_fd >= 0 ) close(_event_fd);
+	_epoll_fd = -1;
+	_event_fd = -1;
+	_port_count = 0;
+}
+
+int AtlasPoller::addPort(EZO *sensor, AtlasPosixSerial *serial) {
+	if ( _epoll_fd < 0 || _port_count >= ATLAS_POLLER_MAX_PORTS || ! serial->isOpen() ) return -1;
+	uint8_t port = _port_count;
+	atlas_poll_port &p = _ports[port];
+	p.sensor = sensor;
+	p.serial = serial;
+	p.state = ATLAS_PORT_IDLE;
+	p.tag = 0;
+	p.head = 0;
+	p.count = 0;
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.u32 = port;
+	if ( epoll_ctl(_epoll_fd,EPOLL_CTL_ADD,serial->getFd(),&ev) != 0 ) return -1;
+	_port_count++;
+	return port;
+}
+
+void AtlasPoller::setCallback(atlas_poll_callback callback, void *context) {
+	_callback_count = 0;
+	if ( callback ) addCallback(callback,context);
+}
+
+bool AtlasPoller::addCallback(atlas_poll_callback callback, void *context) {
+	if ( _callback_count >= ATLAS_POLLER_CALLBACKS ) return false;
+	_callbacks[_callback_count] = callback;
+	_contexts[_callback_count] = context;
+	_callback_count++;
+	return true;
+}
+
+void AtlasPoller::removeCallback(atlas_poll_callback callback, void *context) {
+	for ( uint8_t i = 0 ; i < _callback_count ; i++ ) {
+		if ( _callbacks[i] != callback || _contexts[i] != context ) continue;
+		_callback_count--;
+		for ( uint8_t j = i ; j < _callback_count ; j++ ) {
+			_callbacks[j] = _callbacks[j + 1];
+			_contexts[j] = _contexts[j + 1];
+		}
+		return;
+	}
+}
+
+bool AtlasPoller::queueReading(const uint8_t port, const uint32_t tag) {
+	atlas_poll_job job;
+	job.command[0] = 0;
+	job.has_result = true;
+	job.has_response = true;
+	job.reading = true;
+	job.tag = tag;
+	return _queue(port,job);
+}
+
+bool AtlasPoller::queueCommand(const uint8_t port, const char *command, const bool has_result, const bool has_response, const uint32_t tag) {
+	atlas_poll_job job;
+	if ( strlen(command) >= ATLAS_POLLER_COMMAND_LEN ) return false;
+	strcpy(job.command,command);
+	job.has_result = has_result;
+	job.has_response = has_response;
+	job.reading = false;
+	job.tag = tag;
+	return _queue(port,job);
+}
+
+bool AtlasPoller::idle() const {
+	for ( uint8_t i = 0 ; i < _port_count ; i++ ) {
+		if ( _ports[i].state != ATLAS_PORT_IDLE || _ports[i].count ) return false;
+	}
+	return true;
+}
+
+void AtlasPoller::run(const int timeout_ms) {
+	// Only the I/O thread calls this. Waits at most timeout_ms, less while a command is in flight.
+	bool in_flight = false;
+	for ( uint8_t i = 0 ; i < _port_count ; i++ ) {
+		if ( _ports[i].state == ATLAS_PORT_BUSY ) in_flight = true;
+	}
+	int wait = timeout_ms;
+	if ( in_flight && ( wait < 0 || wait > ATLAS_POLLER_TICK ) ) wait = ATLAS_POLLER_TICK;
+	struct epoll_event events[ATLAS_POLLER_MAX_PORTS + 1];
+	int n = epoll_wait(_epoll_fd,events,ATLAS_POLLER_MAX_PORTS + 1,wait);
+	for ( int i = 0 ; i < n ; i++ ) {
+		uint32_t tag = events[i].data.u32;
+		if ( tag == ATLAS_POLLER_WAKE ) {
+			uint64_t count;
+			if ( ::read(_event_fd,&count,sizeof(count)) < 0 ) {} // just clears it
+			continue;
+		}
+		atlas_poll_port &p = _ports[tag];
+		if ( p.state == ATLAS_PORT_BUSY ) {
+			if ( p.sensor->pollCommand() ) _complete(tag);
+		}
+		else if ( p.state == ATLAS_PORT_IDLE ) {
+			p.sensor->listen(); // unsolicited, e.g. "*RS" after power up, goes to the event hooks
+		}
+	}
+	// Deadlines
+	for ( uint8_t i = 0 ; i < _port_count ; i++ ) {
+		if ( _ports[i].state == ATLAS_PORT_BUSY && _ports[i].sensor->pollCommand() ) _complete(i);
+	}
+	_reclaim();
+}
+
+uint32_t AtlasPoller::sweep(const int timeout_ms) {
+	uint32_t start = millis();
+	for ( uint8_t i = 0 ; i < _port_count ; i++ ) queueReading(i);
+	while ( ! idle() ) {
+		int32_t left = timeout_ms - (int32_t)(millis() - start);
+		if ( left <= 0 ) break;
+		run(left);
+	}
+	return millis() - start;
+}
+
+/*              PRIVATE METHODS                      */
+
+bool AtlasPoller::_queue(const uint8_t port, const atlas_poll_job &job) {
+	if ( port >= _port_count ) return false;
+	atlas_poll_port &p = _ports[port];
+	if ( p.count >= ATLAS_POLLER_QUEUE ) return false;
+	p.queue[( p.head + p.count ) % ATLAS_POLLER_QUEUE] = job;
+	p.count++;
+	if ( p.state == ATLAS_PORT_IDLE ) _startNext(port);
+	return true;
+}
+
+void AtlasPoller::_startNext(const uint8_t port) {
+	atlas_poll_port &p = _ports[port];
+	while ( p.state == ATLAS_PORT_IDLE && p.count ) {
+		atlas_poll_job &job = p.queue[p.head];
+		p.head = ( p.head + 1 ) % ATLAS_POLLER_QUEUE;
+		p.count--;
+		p.tag = job.tag;
+		bool started = job.reading ? p.sensor->startReading()
+			: p.sensor->startCommand(job.command,job.has_result,job.has_response);
+		if ( started ) {
+			p.state = ATLAS_PORT_BUSY;
+			if ( p.sensor->pollCommand() ) _complete(port); // nothing to wait for
+		}
+		else _notify(port,p.sensor->getLastResponse()); // offline or breaker open
+	}
+}
+
+void AtlasPoller::_complete(const uint8_t port) {
+	if ( ! _workers ) {
+		_parse(port);
+		_ports[port].state = ATLAS_PORT_IDLE;
+		_startNext(port);
+		return;
+	}
+	_ports[port].state = ATLAS_PORT_PARSING;
+	_watch(port,false); // the worker owns the sensor now, leave its serial alone
+	pthread_mutex_lock(&_lock);
+	_jobs[_job_count++] = port;
+	pthread_cond_signal(&_job_ready);
+	pthread_mutex_unlock(&_lock);
+}
+
+void AtlasPoller::_parse(const uint8_t port) {
+	atlas_poll_port &p = _ports[port];
+	ezo_response response = p.sensor->finishCommand();
+	_notify(port,response);
+}
+
+void AtlasPoller::_notify(const uint8_t port, const ezo_response response) {
+	// Workers and the I/O thread both get here
+	pthread_mutex_lock(&_notify_lock);
+	for ( uint8_t i = 0 ; i < _callback_count ; i++ ) _callbacks[i](port,_ports[port].sensor,response,_contexts[i]);
+	pthread_mutex_unlock(&_notify_lock);
+}
+
+void AtlasPoller::_reclaim() {
+	uint8_t done[ATLAS_POLLER_MAX_PORTS];
+	uint8_t count;
+	if ( ! _workers ) return;
+	pthread_mutex_lock(&_lock);
+	count = _done_count;
+	memcpy(done,_done,count);
+	_done_count = 0;
+	pthread_mutex_unlock(&_lock);
+	for ( uint8_t i = 0 ; i < count ; i++ ) {
+		_ports[done[i]].state = ATLAS_PORT_IDLE;
+		_watch(done[i],true);
+		_startNext(done[i]);
+	}
+}
+
+void AtlasPoller::_watch(const uint8_t port, const bool on) {
+	struct epoll_event ev;
+	ev.events = on ? (uint32_t)EPOLLIN : 0;
+	ev.data.u32 = port;
+	epoll_ctl(_epoll_fd,EPOLL_CTL_MOD,_ports[port].serial->getFd(),&ev);
+}
+
+void * AtlasPoller::_worker(void *self) {
+	AtlasPoller *poller = (AtlasPoller *)self;
+	uint64_t one = 1;
+	pthread_mutex_lock(&poller->_lock);
+	while ( true ) {
+		while ( ! poller->_job_count && ! poller->_stopping ) pthread_cond_wait(&poller->_job_ready,&poller->_lock);
+		if ( poller->_stopping ) break;
+		uint8_t port = poller->_jobs[0];
+		memmove(poller->_jobs,poller->_jobs + 1,--poller->_job_count);
+		pthread_mutex_unlock(&poller->_lock);
+		poller->_parse(port);
+		pthread_mutex_lock(&poller->_lock);
+		poller->_done[poller->_done_count++] = port;
+		if ( ::write(poller->_event_fd,&one,sizeof(one)) < 0 ) {} // wake the I/O thread
+	}
+	pthread_mutex_unlock(&poller->_lock);
+	return NULL;
+}
+
+#endif
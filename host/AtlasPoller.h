@@ -0,0 +1,126 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Linux only. Runs commands on many serial circuits at once.
+	One I/O thread (whoever calls run()) sends commands and collects replies
+	through epoll. Finished replies are parsed on a small worker pool.
+	A sensor belongs to exactly one thread at a time: the I/O thread while the
+	command is in flight, a worker while parsing. It is handed over through the
+	job and done queues, so the drivers themselves need no locks.
+	Bytes that turn up on an idle port ("*RS" after a brown-out etc.) go
+	through the sensor's framer on the I/O thread, so its event hooks see them.
+	
+	Up to ATLAS_POLLER_CALLBACKS callbacks see every finished job, e.g. an
+	AtlasServer and an AtlasBoard on the same poller. Add and remove them
+	before or between run() calls, not while workers are parsing. A job can
+	carry a tag, which getJobTag() returns inside the callback, so a caller
+	can match completions to its own jobs.
+	Callbacks run on a worker after a parse, or on the I/O thread when a job
+	can't start (offline, breaker open) or there are no workers. They never
+	run two at a time: callbacks need no locks between themselves, only
+	around state they share with other threads. The sensor is the
+	callback's to read until it returns. Queueing more work from a callback
+	is only safe with no workers.
+============================================================================*/
+#ifndef _Atlas_Poller_h
+#define _Atlas_Poller_h
+
+#include <Atlas_EZO.h>
+#include <AtlasPosixSerial.h>
+#include <pthread.h>
+
+#define ATLAS_POLLER_MAX_PORTS		16
+#define ATLAS_POLLER_MAX_WORKERS	8
+#define ATLAS_POLLER_QUEUE			8	// queued commands per port
+#define ATLAS_POLLER_COMMAND_LEN	32
+#define ATLAS_POLLER_TICK			10	// ms between deadline checks while a command is in flight
+#define ATLAS_POLLER_CALLBACKS		4
+
+typedef void (*atlas_poll_callback)(uint8_t port, EZO *sensor, ezo_response response, void *context);
+
+enum atlas_port_state {
+	ATLAS_PORT_IDLE,
+	ATLAS_PORT_BUSY,	// command in flight, owned by the I/O thread
+	ATLAS_PORT_PARSING	// reply complete, owned by a worker
+};
+
+struct atlas_poll_job {
+	char	command[ATLAS_POLLER_COMMAND_LEN];
+	bool	has_result;
+	bool	has_response;
+	bool	reading;	// parse with the driver's reading parser
+	uint32_t	tag;	// the caller's, 0: untagged
+};
+
+struct atlas_poll_port {
+	EZO *				sensor;
+	AtlasPosixSerial *	serial;
+	atlas_port_state	state;
+	uint32_t			tag; // of the job in flight or just finished
+	atlas_poll_job		queue[ATLAS_POLLER_QUEUE];
+	uint8_t				head;
+	uint8_t				count;
+};
+
+class AtlasPoller {
+	public:
+		AtlasPoller();
+		~AtlasPoller();
+		bool			begin(const uint8_t workers = 0); // 0: parse on the I/O thread
+		void			end();
+		// Sensor must already be begun on the serial port. Returns the port number or -1.
+		int				addPort(EZO *sensor, AtlasPosixSerial *serial);
+		void			setCallback(atlas_poll_callback callback, void *context); // replaces them all, NULL: none
+		bool			addCallback(atlas_poll_callback callback, void *context); // false if there are ATLAS_POLLER_CALLBACKS
+		void			removeCallback(atlas_poll_callback callback, void *context);
+		bool			queueReading(const uint8_t port, const uint32_t tag = 0);
+		bool			queueCommand(const uint8_t port, const char *command, const bool has_result, const bool has_response, const uint32_t tag = 0);
+		uint32_t		getJobTag(const uint8_t port) const { return _ports[port].tag;} // in a callback: the finished job's
+		bool			idle() const;
+		void			run(const int timeout_ms); // one epoll pass
+		uint32_t		sweep(const int timeout_ms); // one reading from every port, returns elapsed ms
+		atlas_port_state	getPortState(const uint8_t port) const { return _ports[port].state;}
+		uint8_t			getPortCount() const { return _port_count;}
+		EZO *			getSensor(const uint8_t port) const { return _ports[port].sensor;}
+	private:
+		bool			_queue(const uint8_t port, const atlas_poll_job &job);
+		void			_startNext(const uint8_t port);
+		void			_complete(const uint8_t port); // reply is in, hand it to a worker
+		void			_parse(const uint8_t port);
+		void			_notify(const uint8_t port, const ezo_response response);
+		void			_reclaim(); // ports the workers have finished with
+		void			_watch(const uint8_t port, const bool on);
+		static void *	_worker(void *self);
+		atlas_poll_port	_ports[ATLAS_POLLER_MAX_PORTS];
+		uint8_t			_port_count;
+		atlas_poll_callback	_callbacks[ATLAS_POLLER_CALLBACKS];
+		void *			_contexts[ATLAS_POLLER_CALLBACKS];
+		uint8_t			_callback_count;
+		pthread_mutex_t	_notify_lock; // one callback at a time, recursive for callbacks that queue more work
+		int				_epoll_fd;
+		int				_event_fd; // workers wake the I/O thread
+		pthread_t		_threads[ATLAS_POLLER_MAX_WORKERS];
+		uint8_t			_workers;
+		bool			_stopping;
+		pthread_mutex_t	_lock;
+		pthread_cond_t	_job_ready;
+		uint8_t			_jobs[ATLAS_POLLER_MAX_PORTS]; // ports waiting for a worker
+		uint8_t			_job_count;
+		uint8_t			_done[ATLAS_POLLER_MAX_PORTS]; // ports a worker has finished
+		uint8_t			_done_count;
+};
+#endif
@@ -0,0 +1,54 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#ifndef ARDUINO // Linux only
+
+#include <AtlasPosixClock.h>
+#include <time.h>
+#include <sched.h>
+#include <errno.h>
+
+static uint64_t _monotonicMillis() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+AtlasPosixClock::AtlasPosixClock(const uint32_t start) {
+	_origin = _monotonicMillis();
+	_start = start;
+}
+
+uint32_t AtlasPosixClock::millis() {
+	return _start + (uint32_t)( _monotonicMillis() - _origin );
+}
+
+void AtlasPosixClock::delay(const uint32_t ms) {
+	struct timespec until;
+	clock_gettime(CLOCK_MONOTONIC,&until);
+	until.tv_sec += ms / 1000;
+	until.tv_nsec += ( ms % 1000 ) * 1000000L;
+	if ( until.tv_nsec >= 1000000000L ) { until.tv_sec++; until.tv_nsec -= 1000000000L;}
+	while ( clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&until,NULL) == EINTR ) {}
+}
+
+void AtlasPosixClock::idle() {
+	sched_yield();
+}
+
+#endif
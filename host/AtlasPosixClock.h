@@ -0,0 +1,39 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	CLOCK_MONOTONIC as an AtlasClock. millis() counts from the given start
+	rather than from boot, so starting it just short of 0xFFFFFFFF tries out
+	the 49 day wrap in real time. delay() sleeps to an absolute time, so a
+	signal doesn't stretch it.
+============================================================================*/
+#ifndef _Atlas_Posix_Clock_h
+#define _Atlas_Posix_Clock_h
+
+#include <Arduino.h>
+#include <AtlasClock.h>
+
+class AtlasPosixClock: public AtlasClock {
+	public:
+		AtlasPosixClock(const uint32_t start = 0);
+		uint32_t		millis();
+		void			delay(const uint32_t ms);
+		void			idle(); // gives the CPU away
+	private:
+		uint64_t		_origin; // ms, CLOCK_MONOTONIC at start
+		uint32_t		_start;
+};
+#endif
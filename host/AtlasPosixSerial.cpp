@@ -0,0 +1,115 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#ifndef ARDUINO // Linux only
+
+#include <AtlasPosixSerial.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <errno.h>
+
+static speed_t _posixBaud(const uint32_t baud_rate) {
+	switch ( baud_rate ) {
+		case 300:		return B300;
+		case 1200:		return B1200;
+		case 2400:		return B2400;
+		case 19200:		return B19200;
+		case 38400:		return B38400;
+		case 57600:		return B57600;
+		case 115200:	return B115200;
+		default:		return B9600; // EZO default
+	}
+}
+
+AtlasPosixSerial::AtlasPosixSerial(const char *device) {
+	_device = device;
+	_fd = -1;
+	_rx_head = 0;
+	_rx_tail = 0;
+}
+
+AtlasPosixSerial::~AtlasPosixSerial() {
+	if ( _fd >= 0 ) close(_fd);
+}
+
+void AtlasPosixSerial::begin(const uint32_t baud_rate) {
+	if ( _fd < 0 ) {
+		_fd = open(_device,O_RDWR | O_NOCTTY | O_NONBLOCK);
+		if ( _fd < 0 ) {
+			fprintf(stderr,"Unable to open %s: %s\n",_device,strerror(errno));
+			return;
+		}
+	}
+	struct termios tty;
+	if ( tcgetattr(_fd,&tty) != 0 ) return;
+	cfmakeraw(&tty);
+	cfsetispeed(&tty,_posixBaud(baud_rate));
+	cfsetospeed(&tty,_posixBaud(baud_rate));
+	tty.c_cflag |= CLOCAL | CREAD;
+	tty.c_cflag &= ~( CSTOPB | CRTSCTS );
+	tty.c_cc[VMIN] = 0;
+	tty.c_cc[VTIME] = 0;
+	tcsetattr(_fd,TCSANOW,&tty);
+}
+
+int AtlasPosixSerial::available() {
+	_fill();
+	return _rx_tail - _rx_head;
+}
+
+int AtlasPosixSerial::read() {
+	if ( _rx_head == _rx_tail ) _fill();
+	if ( _rx_head == _rx_tail ) return -1;
+	return _rx[_rx_head++];
+}
+
+int AtlasPosixSerial::peek() {
+	if ( _rx_head == _rx_tail ) _fill();
+	if ( _rx_head == _rx_tail ) return -1;
+	return _rx[_rx_head];
+}
+
+size_t AtlasPosixSerial::write(const uint8_t *buffer, size_t size) {
+	if ( _fd < 0 ) return 0;
+	size_t sent = 0;
+	while ( sent < size ) {
+		ssize_t n = ::write(_fd,buffer + sent,size - sent);
+		if ( n > 0 ) sent += n;
+		else if ( n < 0 && errno != EAGAIN && errno != EINTR ) break;
+	}
+	return sent;
+}
+
+void AtlasPosixSerial::flush() {
+	if ( _fd >= 0 ) tcdrain(_fd);
+}
+
+void AtlasPosixSerial::_fill() {
+	if ( _fd < 0 ) return;
+	if ( _rx_head == _rx_tail ) _rx_head = _rx_tail = 0;
+	if ( _rx_tail == ATLAS_POSIX_RX_LEN ) { // compact
+		memmove(_rx,_rx + _rx_head,_rx_tail - _rx_head);
+		_rx_tail -= _rx_head;
+		_rx_head = 0;
+	}
+	ssize_t n = ::read(_fd,_rx + _rx_tail,ATLAS_POSIX_RX_LEN - _rx_tail);
+	if ( n > 0 ) _rx_tail += n;
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Linux tty (USB-UART etc.) transport. Raw 8N1, non-blocking.
+============================================================================*/
+#ifndef _Atlas_Posix_Serial_h
+#define _Atlas_Posix_Serial_h
+
+#include <Arduino.h>
+#include <AtlasTransport.h>
+
+#define ATLAS_POSIX_RX_LEN 256
+
+class AtlasPosixSerial: public AtlasTransport {
+	public:
+		AtlasPosixSerial(const char *device);
+		~AtlasPosixSerial();
+		bool			isOpen() const { return _fd >= 0;}
+		int				getFd() const { return _fd;}
+		void			begin(const uint32_t baud_rate); // opens the device on first call
+		int				available();
+		int				read();
+		int				peek();
+		size_t			write(uint8_t byte) { return write(&byte,1);}
+		size_t			write(const uint8_t *buffer, size_t size);
+		void			flush();
+		using Print::write;
+	protected:
+		void			_fill(); // read whatever the kernel has
+		const char *	_device;
+		int				_fd;
+		uint8_t			_rx[ATLAS_POSIX_RX_LEN];
+		uint16_t		_rx_head; // next byte to read
+		uint16_t		_rx_tail; // one past the last byte
+};
+#endif
@@ -0,0 +1,388 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#ifndef ARDUINO // Linux only
+
+#include <AtlasServer.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define ATLAS_SERVER_LISTEN 0xFF // epoll tag for the listening socket
+
+static void putU16(uint8_t *out, const uint16_t value) {
+	out[0] = value;
+	out[1] = value >> 8;
+}
+
+static void putU32(uint8_t *out, const uint32_t value) {
+	for ( uint8_t i = 0 ; i < 4 ; i++ ) out[i] = value >> ( 8 * i );
+}
+
+static uint16_t getU16(const uint8_t *in) {
+	return in[0] | ( in[1] << 8 );
+}
+
+AtlasServer::AtlasServer() {
+	_poller = NULL;
+	_path[0] = '\0';
+	_listen_fd = -1;
+	_epoll_fd = -1;
+	for ( uint8_t i = 0 ; i < ATLAS_SERVER_MAX_CLIENTS ; i++ ) {
+		_clients[i].fd = -1;
+		_clients[i].generation = 0;
+	}
+	_interval = 0;
+	_last_sweep = 0;
+	_next_tag = 1;
+	_done_head = 0;
+	_done_count = 0;
+	_done_lost = 0;
+	pthread_mutex_init(&_lock,NULL);
+}
+
+bool AtlasServer::begin(AtlasPoller *poller, const char *path) {
+	end();
+	struct sockaddr_un address;
+	if ( strlen(path) >= sizeof(address.sun_path) ) return false;
+	memset(&address,0,sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path,path);
+	_listen_fd = socket(AF_UNIX,SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC,0);
+	if ( _listen_fd < 0 ) return false;
+	::unlink(path); // left over from a previous run
+	if ( bind(_listen_fd,(struct sockaddr *)&address,sizeof(address)) != 0 || listen(_listen_fd,ATLAS_SERVER_MAX_CLIENTS) != 0 ) {
+		::close(_listen_fd);
+		_listen_fd = -1;
+		return false;
+	}
+	strcpy(_path,path);
+	_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.u32 = ATLAS_SERVER_LISTEN;
+	if ( _epoll_fd < 0 || epoll_ctl(_epoll_fd,EPOLL_CTL_ADD,_listen_fd,&ev) != 0 ) { end(); return false;}
+	_poller = poller;
+	for ( uint8_t port = 0 ; port < ATLAS_POLLER_MAX_PORTS ; port++ ) {
+		_pending_head[port] = 0;
+		_pending_count[port] = 0;
+		_reading_pending[port] = false;
+	}
+	_last_sweep = millis() - _interval; // first sweep right away
+	if ( ! _poller->addCallback(_onComplete,this) ) { end(); return false;}
+	return true;
+}
+
+void AtlasServer::end() {
+	for ( uint8_t i = 0 ; i < ATLAS_SERVER_MAX_CLIENTS ; i++ ) _close(i);
+	if ( _listen_fd >= 0 ) {
+		::close(_listen_fd);
+		::unlink(_path);
+		_listen_fd = -1;
+	}
+	if ( _epoll_fd >= 0 ) ::close(_epoll_fd);
+	_epoll_fd = -1;
+	if ( _poller ) _poller->removeCallback(_onComplete,this);
+	_poller = NULL;
+}
+
+void AtlasServer::service(const int timeout_ms) {
+	if ( _listen_fd < 0 ) return;
+	struct epoll_event events[ATLAS_SERVER_MAX_CLIENTS + 1];
+	int n = epoll_wait(_epoll_fd,events,ATLAS_SERVER_MAX_CLIENTS + 1,timeout_ms);
+	for ( int i = 0 ; i < n ; i++ ) {
+		if ( events[i].data.u32 == ATLAS_SERVER_LISTEN ) _accept();
+		else _receive(events[i].data.u32);
+	}
+	// Finished jobs, oldest first
+	for (;;) {
+		atlas_server_completion done;
+		pthread_mutex_lock(&_lock);
+		bool any = _done_count > 0;
+		if ( any ) {
+			done = _done[_done_head];
+			_done_head = ( _done_head + 1 ) % ATLAS_SERVER_COMPLETIONS;
+			_done_count--;
+		}
+		pthread_mutex_unlock(&_lock);
+		if ( ! any ) break;
+		_deliver(done);
+	}
+	_schedule();
+}
+
+uint8_t AtlasServer::getClientCount() const {
+	uint8_t count = 0;
+	for ( uint8_t i = 0 ; i < ATLAS_SERVER_MAX_CLIENTS ; i++ ) if ( _clients[i].fd >= 0 ) count++;
+	return count;
+}
+
+/*              PRIVATE METHODS                      */
+
+void AtlasServer::_onComplete(uint8_t port, EZO *sensor, ezo_response response, void *context) {
+	// I/O thread or a poller worker. The sensor is still ours to read until we return.
+	AtlasServer *server = (AtlasServer *)context;
+	uint32_t tag = server->_poller->getJobTag(port);
+	if ( ! tag ) return; // queued by someone else
+	pthread_mutex_lock(&server->_lock);
+	if ( server->_done_count == ATLAS_SERVER_COMPLETIONS ) { // only if others tag their jobs too
+		server->_done_head = ( server->_done_head + 1 ) % ATLAS_SERVER_COMPLETIONS;
+		server->_done_count--;
+		server->_done_lost++;
+	}
+	atlas_server_completion &done = server->_done[( server->_done_head + server->_done_count ) % ATLAS_SERVER_COMPLETIONS];
+	done.tag = tag;
+	done.port = port;
+	done.response = response;
+	done.health = sensor->getHealth();
+	done.channel_mask = sensor->getChannelMask();
+	done.reading_ms = sensor->getReadingTime();
+	for ( uint8_t channel = 0 ; channel < EZO_MAX_CHANNELS ; channel++ ) {
+		done.values[channel] = ( done.channel_mask & ( 1 << channel ) ) ? sensor->getValue(channel) : 0.0;
+	}
+	memcpy(done.result,sensor->getResult(),ATLAS_SERIAL_RESULT_LEN);
+	done.result[ATLAS_SERIAL_RESULT_LEN - 1] = '\0';
+	server->_done_count++;
+	pthread_mutex_unlock(&server->_lock);
+}
+
+void AtlasServer::_accept() {
+	for (;;) {
+		int fd = accept4(_listen_fd,NULL,NULL,SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if ( fd < 0 ) return;
+		uint8_t client = 0;
+		while ( client < ATLAS_SERVER_MAX_CLIENTS && _clients[client].fd >= 0 ) client++;
+		if ( client == ATLAS_SERVER_MAX_CLIENTS ) { ::close(fd); continue;} // full
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.u32 = client;
+		if ( epoll_ctl(_epoll_fd,EPOLL_CTL_ADD,fd,&ev) != 0 ) { ::close(fd); continue;}
+		atlas_server_client &c = _clients[client];
+		c.fd = fd;
+		c.generation++;
+		c.dropped = 0;
+		memset(c.channels,0,sizeof(c.channels));
+	}
+}
+
+void AtlasServer::_receive(const uint8_t client) {
+	uint8_t message[ATLAS_SERVER_MESSAGE_LEN];
+	for (;;) {
+		ssize_t length = recv(_clients[client].fd,message,sizeof(message),0);
+		if ( length < 0 && ( errno == EAGAIN || errno == EINTR ) ) return;
+		if ( length <= 0 ) { _close(client); return;} // gone
+		_handle(client,message,length);
+		if ( _clients[client].fd < 0 ) return;
+	}
+}
+
+void AtlasServer::_handle(const uint8_t client, const uint8_t *message, const ssize_t length) {
+	switch ( message[0] ) {
+		case ATLAS_MSG_LIST: {
+			uint8_t reply[2 + 3 * ATLAS_POLLER_MAX_PORTS];
+			uint8_t count = _poller->getPortCount();
+			reply[0] = ATLAS_MSG_PORTS;
+			reply[1] = count;
+			for ( uint8_t port = 0 ; port < count ; port++ ) {
+				EZO *sensor = _poller->getSensor(port);
+				reply[2 + 3 * port] = port;
+				reply[3 + 3 * port] = sensor->getCircuitType();
+				reply[4 + 3 * port] = sensor->getChannelMask();
+			}
+			_send(client,reply,2 + 3 * count);
+			return;
+		}
+		case ATLAS_MSG_SUBSCRIBE: {
+			if ( length != 3 ) break;
+			uint8_t port = message[1];
+			if ( port == ATLAS_SERVER_ALL_PORTS ) memset(_clients[client].channels,message[2],sizeof(_clients[client].channels));
+			else if ( port < _poller->getPortCount() ) _clients[client].channels[port] = message[2];
+			else _sendError(client,0,ATLAS_ERR_BAD_PORT);
+			return;
+		}
+		case ATLAS_MSG_COMMAND: {
+			if ( length < 5 ) break;
+			uint16_t id = getU16(message + 2);
+			char command[ATLAS_POLLER_COMMAND_LEN];
+			size_t command_length = length - 5;
+			if ( command_length + 2 > ATLAS_POLLER_COMMAND_LEN ) { _sendError(client,id,ATLAS_ERR_TOO_LONG); return;}
+			memcpy(command,message + 5,command_length);
+			command[command_length++] = '\r';
+			command[command_length] = '\0';
+			if ( message[1] >= _poller->getPortCount() ) _sendError(client,id,ATLAS_ERR_BAD_PORT);
+			else if ( ! _queue(message[1],client,id,command,message[4]) ) _sendError(client,id,ATLAS_ERR_QUEUE_FULL);
+			return;
+		}
+	}
+	_sendError(client,length >= 4 && message[0] == ATLAS_MSG_COMMAND ? getU16(message + 2) : 0,ATLAS_ERR_MALFORMED);
+}
+
+bool AtlasServer::_queue(const uint8_t port, const uint8_t client, const uint16_t id, const char *command, const uint8_t flags) {
+	if ( _pending_count[port] == ATLAS_SERVER_PENDING ) return false;
+	uint32_t tag = _next_tag++;
+	if ( ! _next_tag ) _next_tag = 1; // 0 is untagged
+	bool queued = command ? _poller->queueCommand(port,command,flags & ATLAS_CMD_HAS_RESULT,flags & ATLAS_CMD_HAS_RESPONSE,tag)
+		: _poller->queueReading(port,tag);
+	if ( ! queued ) return false;
+	// A job that can't start (breaker open) completes inside queue...(), but
+	// completions are only matched up in service(), after this.
+	atlas_server_origin &origin = _pending[port][( _pending_head[port] + _pending_count[port] ) % ATLAS_SERVER_PENDING];
+	origin.client = client;
+	origin.generation = client == ATLAS_SERVER_SCHEDULE ? 0 : _clients[client].generation;
+	origin.id = id;
+	origin.tag = tag;
+	_pending_count[port]++;
+	return true;
+}
+
+void AtlasServer::_deliver(const atlas_server_completion &done) {
+	uint8_t port = done.port;
+	uint8_t match = 0;
+	while ( match < _pending_count[port] && _pending[port][( _pending_head[port] + match ) % ATLAS_SERVER_PENDING].tag != done.tag ) match++;
+	if ( match == _pending_count[port] ) return; // not ours
+	// A port finishes its jobs in order, so any before this one were dropped from _done
+	atlas_server_origin origin;
+	for (;;) {
+		origin = _pending[port][_pending_head[port]];
+		_pending_head[port] = ( _pending_head[port] + 1 ) % ATLAS_SERVER_PENDING;
+		_pending_count[port]--;
+		if ( origin.tag == done.tag ) break;
+		if ( origin.client == ATLAS_SERVER_SCHEDULE ) _reading_pending[port] = false;
+		else if ( _clients[origin.client].fd >= 0 && _clients[origin.client].generation == origin.generation ) {
+			_sendError(origin.client,origin.id,ATLAS_ERR_LOST);
+		}
+	}
+	if ( origin.client == ATLAS_SERVER_SCHEDULE ) {
+		_reading_pending[port] = false;
+		uint8_t message[8 + 4 * EZO_MAX_CHANNELS];
+		message[0] = ATLAS_MSG_READING;
+		message[1] = port;
+		message[2] = done.response;
+		message[3] = done.health;
+		putU32(message + 5,done.reading_ms);
+		for ( uint8_t client = 0 ; client < ATLAS_SERVER_MAX_CLIENTS ; client++ ) {
+			uint8_t mask = _clients[client].channels[port] & done.channel_mask;
+			if ( _clients[client].fd < 0 || ! mask ) continue;
+			message[4] = mask;
+			size_t length = 9;
+			for ( uint8_t channel = 0 ; channel < EZO_MAX_CHANNELS ; channel++ ) {
+				if ( ! ( mask & ( 1 << channel ) ) ) continue;
+				memcpy(message + length,&done.values[channel],4);
+				length += 4;
+			}
+			_send(client,message,length);
+		}
+		return;
+	}
+	if ( _clients[origin.client].fd < 0 || _clients[origin.client].generation != origin.generation ) return; // asker left
+	uint8_t message[5 + ATLAS_SERIAL_RESULT_LEN];
+	size_t result_length = strlen(done.result);
+	message[0] = ATLAS_MSG_RESULT;
+	message[1] = port;
+	putU16(message + 2,origin.id);
+	message[4] = done.response;
+	memcpy(message + 5,done.result,result_length);
+	_send(origin.client,message,5 + result_length);
+}
+
+void AtlasServer::_schedule() {
+	if ( ! _interval || (uint32_t)( millis() - _last_sweep ) < _interval ) return;
+	_last_sweep += _interval;
+	if ( (uint32_t)( millis() - _last_sweep ) >= _interval ) _last_sweep = millis(); // fell behind, don't catch up in a burst
+	for ( uint8_t port = 0 ; port < _poller->getPortCount() ; port++ ) {
+		if ( _reading_pending[port] ) continue; // slow circuit, one reading at a time
+		if ( _queue(port,ATLAS_SERVER_SCHEDULE,0,NULL,0) ) _reading_pending[port] = true;
+	}
+}
+
+void AtlasServer::_send(const uint8_t client, const uint8_t *message, const size_t length) {
+	if ( send(_clients[client].fd,message,length,MSG_DONTWAIT | MSG_NOSIGNAL) < 0 ) {
+		if ( errno == EAGAIN || errno == EWOULDBLOCK ) _clients[client].dropped++;
+		else _close(client);
+	}
+}
+
+void AtlasServer::_sendError(const uint8_t client, const uint16_t id, const atlas_server_error error) {
+	uint8_t message[4];
+	message[0] = ATLAS_MSG_ERROR;
+	putU16(message + 1,id);
+	message[3] = error;
+	_send(client,message,sizeof(message));
+}
+
+void AtlasServer::_close(const uint8_t client) {
+	if ( _clients[client].fd < 0 ) return;
+	::close(_clients[client].fd); // also leaves the epoll set
+	_clients[client].fd = -1;
+}
+
+bool AtlasServerClient::connect(const char *path) {
+	close();
+	struct sockaddr_un address;
+	if ( strlen(path) >= sizeof(address.sun_path) ) return false;
+	memset(&address,0,sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path,path);
+	_fd = socket(AF_UNIX,SOCK_SEQPACKET | SOCK_CLOEXEC,0);
+	if ( _fd < 0 ) return false;
+	if ( ::connect(_fd,(struct sockaddr *)&address,sizeof(address)) != 0 ) { close(); return false;}
+	return true;
+}
+
+void AtlasServerClient::close() {
+	if ( _fd >= 0 ) ::close(_fd);
+	_fd = -1;
+}
+
+bool AtlasServerClient::list() {
+	uint8_t message = ATLAS_MSG_LIST;
+	return send(_fd,&message,1,MSG_NOSIGNAL) == 1;
+}
+
+bool AtlasServerClient::subscribe(const uint8_t port, const uint8_t channels) {
+	uint8_t message[3] = { ATLAS_MSG_SUBSCRIBE, port, channels };
+	return send(_fd,message,3,MSG_NOSIGNAL) == 3;
+}
+
+bool AtlasServerClient::command(const uint8_t port, const uint16_t id, const char *command, const uint8_t flags) {
+	uint8_t message[5 + ATLAS_POLLER_COMMAND_LEN];
+	size_t length = strlen(command);
+	if ( length > ATLAS_POLLER_COMMAND_LEN ) return false;
+	message[0] = ATLAS_MSG_COMMAND;
+	message[1] = port;
+	putU16(message + 2,id);
+	message[4] = flags;
+	memcpy(message + 5,command,length);
+	return send(_fd,message,5 + length,MSG_NOSIGNAL) == (ssize_t)( 5 + length );
+}
+
+int AtlasServerClient::receive(uint8_t *buffer, const int timeout_ms) {
+	struct pollfd p;
+	p.fd = _fd;
+	p.events = POLLIN;
+	int ready = poll(&p,1,timeout_ms);
+	if ( ready < 0 ) return errno == EINTR ? 0 : -1;
+	if ( ! ready ) return 0;
+	ssize_t length = recv(_fd,buffer,ATLAS_SERVER_MESSAGE_LEN,0);
+	return length > 0 ? length : -1;
+}
+#endif
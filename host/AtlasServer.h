@@ -0,0 +1,167 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Linux only. Serves the circuits on an AtlasPoller to any number of local
+	clients over a Unix domain socket. The server is the only thing that
+	talks to the ports. Clients subscribe to channels and get readings pushed
+	from one shared polling schedule. Their commands are queued onto the
+	right port in order, so two tools can no longer interleave replies on
+	one circuit.
+	
+		AtlasServer server;
+		server.begin(&poller,"/run/atlas.sock"); // adds a poller callback
+		server.setInterval(2000); // a reading from every port every 2 s
+		for (;;) {
+			poller.run(ATLAS_POLLER_TICK);
+			server.service();
+		}
+	
+	The socket is SOCK_SEQPACKET, so every message arrives whole. A message
+	is a type byte and its payload. Integers are little-endian, floats in
+	host order (the clients are on the same machine).
+	
+	Client to server:
+		ATLAS_MSG_LIST		-
+		ATLAS_MSG_SUBSCRIBE	port, channel mask (0: unsubscribe, port 0xFF: every port)
+		ATLAS_MSG_COMMAND	port, id u16, flags (ATLAS_CMD_*), command without "\r"
+	Server to client:
+		ATLAS_MSG_PORTS		count, then port, circuit, channel mask for each
+		ATLAS_MSG_READING	port, response, health, channel mask, reading ms u32, a float per channel in the mask
+		ATLAS_MSG_RESULT	port, id u16, response, result text
+		ATLAS_MSG_ERROR		id u16, error (atlas_server_error)
+	
+	A client that isn't reading is skipped rather than waited for. Its
+	messages are dropped whole while its socket buffer is full.
+	
+	Every job the server queues carries a tag, and completions are matched
+	to their asker by that tag, so jobs queued on the same poller by others
+	(or a callback alongside, like AtlasBoard::pollCallback) don't confuse it.
+============================================================================*/
+#ifndef _Atlas_Server_h
+#define _Atlas_Server_h
+
+#include <AtlasPoller.h>
+
+#define ATLAS_SERVER_MAX_CLIENTS	16
+#define ATLAS_SERVER_MESSAGE_LEN	128
+#define ATLAS_SERVER_PENDING		( 2 * ATLAS_POLLER_QUEUE ) // queued, in flight or finished but not yet sent, per port
+#define ATLAS_SERVER_COMPLETIONS	( ATLAS_POLLER_MAX_PORTS * ATLAS_SERVER_PENDING ) // room for every pending job
+#define ATLAS_SERVER_ALL_PORTS		0xFF
+#define ATLAS_SERVER_SCHEDULE		0xFF // pending job origin: the polling schedule, not a client
+
+#define ATLAS_CMD_HAS_RESULT		0x01
+#define ATLAS_CMD_HAS_RESPONSE		0x02
+
+enum atlas_message_type {
+	ATLAS_MSG_LIST = 0x01,
+	ATLAS_MSG_SUBSCRIBE = 0x02,
+	ATLAS_MSG_COMMAND = 0x03,
+	ATLAS_MSG_PORTS = 0x81,
+	ATLAS_MSG_READING = 0x82,
+	ATLAS_MSG_RESULT = 0x83,
+	ATLAS_MSG_ERROR = 0x84
+};
+
+enum atlas_server_error {
+	ATLAS_ERR_MALFORMED = 1,
+	ATLAS_ERR_BAD_PORT,
+	ATLAS_ERR_QUEUE_FULL,	// ATLAS_POLLER_QUEUE commands already waiting on the port
+	ATLAS_ERR_TOO_LONG,		// command doesn't fit ATLAS_POLLER_COMMAND_LEN
+	ATLAS_ERR_LOST			// the command ran but its result was dropped
+};
+
+struct atlas_server_client {
+	int			fd; // -1: free
+	uint16_t	generation; // bumped on connect, so replies never reach a later client in the same slot
+	uint8_t		channels[ATLAS_POLLER_MAX_PORTS]; // subscribed channel mask per port
+	uint32_t	dropped; // messages skipped while its buffer was full
+};
+
+struct atlas_server_origin { // who asked for a queued job
+	uint8_t		client; // or ATLAS_SERVER_SCHEDULE
+	uint16_t	generation;
+	uint16_t	id;
+	uint32_t	tag; // poller job tag
+};
+
+struct atlas_server_completion { // copied in the poller callback, sent from service()
+	uint32_t		tag;
+	uint8_t			port;
+	uint8_t			response;
+	uint8_t			health;
+	uint8_t			channel_mask;
+	uint32_t		reading_ms;
+	float			values[EZO_MAX_CHANNELS];
+	char			result[ATLAS_SERIAL_RESULT_LEN];
+};
+
+class AtlasServer {
+	public:
+		AtlasServer();
+		~AtlasServer() { end();}
+		bool			begin(AtlasPoller *poller, const char *path); // replaces a stale socket file
+		void			end();
+		void			setInterval(const uint32_t interval) { _interval = interval;} // ms, 0: only on request
+		void			service(const int timeout_ms = 0); // clients, finished jobs, schedule
+		uint8_t			getClientCount() const;
+	private:
+		static void		_onComplete(uint8_t port, EZO *sensor, ezo_response response, void *server);
+		void			_accept();
+		void			_receive(const uint8_t client);
+		void			_handle(const uint8_t client, const uint8_t *message, const ssize_t length);
+		bool			_queue(const uint8_t port, const uint8_t client, const uint16_t id, const char *command, const uint8_t flags);
+		void			_deliver(const atlas_server_completion &done);
+		void			_schedule();
+		void			_send(const uint8_t client, const uint8_t *message, const size_t length);
+		void			_sendError(const uint8_t client, const uint16_t id, const atlas_server_error error);
+		void			_close(const uint8_t client);
+		AtlasPoller *	_poller;
+		char			_path[108]; // sun_path
+		int				_listen_fd;
+		int				_epoll_fd;
+		atlas_server_client	_clients[ATLAS_SERVER_MAX_CLIENTS];
+		atlas_server_origin	_pending[ATLAS_POLLER_MAX_PORTS][ATLAS_SERVER_PENDING];
+		uint8_t			_pending_head[ATLAS_POLLER_MAX_PORTS];
+		uint8_t			_pending_count[ATLAS_POLLER_MAX_PORTS];
+		bool			_reading_pending[ATLAS_POLLER_MAX_PORTS]; // scheduled reading not back yet
+		uint32_t		_interval;
+		uint32_t		_last_sweep;
+		uint32_t		_next_tag;
+		pthread_mutex_t	_lock; // completions, filled from poller workers
+		atlas_server_completion	_done[ATLAS_SERVER_COMPLETIONS];
+		uint16_t		_done_head;
+		uint16_t		_done_count;
+		uint32_t		_done_lost;
+};
+
+// Client side
+class AtlasServerClient {
+	public:
+		AtlasServerClient() { _fd = -1;}
+		~AtlasServerClient() { close();}
+		bool			connect(const char *path);
+		void			close();
+		int				getFd() const { return _fd;} // for poll()/epoll
+		bool			list();
+		bool			subscribe(const uint8_t port, const uint8_t channels);
+		bool			command(const uint8_t port, const uint16_t id, const char *command, const uint8_t flags = ATLAS_CMD_HAS_RESULT | ATLAS_CMD_HAS_RESPONSE);
+		// Next message into buffer, waiting up to timeout_ms. Returns its length, 0 on timeout, -1 if the server is gone.
+		int				receive(uint8_t *buffer, const int timeout_ms);
+	private:
+		int				_fd;
+};
+#endif
@@ -0,0 +1,215 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#ifndef ARDUINO // Linux only
+
+#include <AtlasSimEZO.h>
+#include <Atlas.h> // ATLAS_TIME_DIFF
+#include <ctype.h>
+
+// Per type: reading time (datasheet), a typical reading, and the outputs "O,?" lists
+struct sim_type {
+	const char *	name;
+	uint16_t		read_time;
+	const char *	reading;
+	const char *	outputs;
+};
+static const sim_type SIM_TYPES[] = {
+	{ "DO",		600,	"8.26",						"?O,MG" },
+	{ "EC",		600,	"50000,25000,32.85,1.021",	"?O,EC,TDS,S,SG" },
+	{ "PH",		900,	"7.00",						NULL },
+	{ "ORP",	900,	"225.0",					NULL },
+	{ "RGB",	400,	"255,255,255",				"?O,RGB" },
+	{ NULL,		1000,	"0.00",						NULL } // anything else
+};
+
+static const sim_type *_simType(const char *name) {
+	const sim_type *t = SIM_TYPES;
+	while ( t->name && strcmp(t->name,name) ) t++;
+	return t;
+}
+
+AtlasSimEZO::AtlasSimEZO(AtlasVirtualClock *clock, const char *type, const char *firmware) {
+	_clock = clock;
+	_type = type;
+	_firmware = firmware;
+	const sim_type *t = _simType(type);
+	setReading(t->reading);
+	_read_time = t->read_time;
+	_wake_time = ATLAS_SIM_WAKE_TIME;
+	_powered = true;
+	_asleep = false;
+	_response = true;
+	_cal_points = 0;
+	_discard = false;
+	_in_len = 0;
+	_head = 0;
+	_count = 0;
+	_pos = 0;
+	_busy_until = clock->millis();
+	_baud = 9600;
+	_busy = 0;
+	_commands = 0;
+	_readings = 0;
+	clock->addSource(this);
+}
+
+AtlasSimEZO::~AtlasSimEZO() {
+	_clock->removeSource(this);
+}
+
+void AtlasSimEZO::setReading(const char *reading) {
+	strncpy(_reading,reading,ATLAS_SIM_LINE_LEN - 2);
+	_reading[ATLAS_SIM_LINE_LEN - 2] = 0;
+}
+
+void AtlasSimEZO::powerOff() {
+	_powered = false;
+	_count = 0; // whatever it was saying is lost
+	_pos = 0;
+	_in_len = 0;
+}
+
+void AtlasSimEZO::powerOn() {
+	if ( _powered ) return;
+	_powered = true;
+	_asleep = false;
+	_response = true; // power on defaults
+	_discard = false;
+	_busy_until = _clock->millis();
+	_reply("*RS",0);
+	_reply("*RE",ATLAS_SIM_BOOT_TIME);
+}
+
+int AtlasSimEZO::available() {
+	if ( ! _due() ) return 0;
+	return strlen(_lines[_head].text) - _pos;
+}
+
+int AtlasSimEZO::peek() {
+	return _due() ? _lines[_head].text[_pos] : -1;
+}
+
+int AtlasSimEZO::read() {
+	if ( ! _due() ) return -1;
+	line &l = _lines[_head];
+	char c = l.text[_pos++];
+	if ( ! l.text[_pos] ) {
+		_head = ( _head + 1 ) % ATLAS_SIM_LINES;
+		_count--;
+		_pos = 0;
+	}
+	return c;
+}
+
+size_t AtlasSimEZO::write(uint8_t byte) {
+	if ( ! _powered ) return 1;
+	if ( _asleep ) { // any byte wakes it, and is otherwise ignored
+		_asleep = false;
+		_discard = byte != '\r';
+		_busy_until = _clock->millis() + _wire(1);
+		_reply("*WA",_wake_time);
+		_busy += _busy_until - _clock->millis();
+		return 1;
+	}
+	if ( byte == '\r' ) {
+		_in[_in_len] = 0;
+		_in_len = 0;
+		if ( _discard ) _discard = false;
+		else _command(_in);
+	}
+	else if ( byte != '\n' && _in_len < ATLAS_SIM_LINE_LEN - 1 ) _in[_in_len++] = byte;
+	return 1;
+}
+
+bool AtlasSimEZO::nextEvent(uint32_t &when) {
+	if ( ! _count ) return false;
+	when = _lines[_head].due;
+	return true;
+}
+
+/*              PRIVATE METHODS                      */
+
+void AtlasSimEZO::_command(char *command) {
+	_commands++;
+	// A circuit answers one command at a time. One sent while it's reading waits its turn.
+	uint32_t from = _busy_until;
+	if ( ATLAS_TIME_DIFF(_busy_until,_clock->millis()) < 0 ) from = _busy_until = _clock->millis();
+	_busy_until += _wire(strlen(command) + 1);
+	_answer(command);
+	_busy += _busy_until - from;
+}
+
+void AtlasSimEZO::_answer(char *command) {
+	char answer[ATLAS_SIM_LINE_LEN];
+	uint16_t after = ATLAS_SIM_COMMAND_TIME;
+	answer[0] = 0;
+	for ( char *c = command ; *c ; c++ ) *c = toupper(*c);
+	if ( ! *command ) { _reply("*ER",after); return;}
+	if ( ! strcmp(command,"SLEEP") ) {
+		_reply("*SL",after);
+		_asleep = true;
+		return;
+	}
+	if ( ! strcmp(command,"R") || ! strncmp(command,"RT,",3) ) {
+		strcpy(answer,_reading);
+		after = _read_time;
+		_readings++;
+	}
+	else if ( ! strcmp(command,"I") ) snprintf(answer,sizeof(answer),"?I,%s,%s",_type,_firmware);
+	else if ( ! strcmp(command,"STATUS") ) strcpy(answer,"?STATUS,P,5.038");
+	else if ( ! strcmp(command,"RESPONSE,?") ) strcpy(answer,_response ? "?RESPONSE,1" : "?RESPONSE,0");
+	else if ( ! strcmp(command,"RESPONSE,0") ) _response = false;
+	else if ( ! strcmp(command,"RESPONSE,1") ) _response = true;
+	else if ( ! strcmp(command,"C,?") ) strcpy(answer,"?C,0");
+	else if ( ! strcmp(command,"L,?") ) strcpy(answer,"?L,1");
+	else if ( ! strcmp(command,"T,?") ) strcpy(answer,"?T,25.0");
+	else if ( ! strcmp(command,"CAL,?") ) snprintf(answer,sizeof(answer),"?CAL,%u",_cal_points);
+	else if ( ! strcmp(command,"CAL,CLEAR") ) _cal_points = 0;
+	else if ( ! strcmp(command,"CAL,DRY") ) {} // EC, not a point
+	else if ( ! strncmp(command,"CAL,MID,",8) ) _cal_points = 1; // pH, clears the others
+	else if ( ! strncmp(command,"CAL",3) && _cal_points < 3 ) _cal_points++;
+	else if ( ! strcmp(command,"NAME,?") ) strcpy(answer,"?NAME,");
+	else if ( ! strcmp(command,"O,?") ) {
+		const char *outputs = _simType(_type)->outputs;
+		if ( ! outputs ) { _reply("*ER",after); return;}
+		strcpy(answer,outputs);
+	}
+	// Anything else is a setting, taken as given
+	if ( answer[0] ) _reply(answer,after);
+	if ( _response ) _reply("*OK",answer[0] ? 0 : after);
+}
+
+void AtlasSimEZO::_reply(const char *text, const uint32_t after) {
+	if ( _count >= ATLAS_SIM_LINES ) return; // nobody is reading
+	line &l = _lines[( _head + _count ) % ATLAS_SIM_LINES];
+	snprintf(l.text,ATLAS_SIM_LINE_LEN,"%s\r",text);
+	_busy_until += after + _wire(strlen(l.text));
+	l.due = _busy_until;
+	_count++;
+}
+
+uint32_t AtlasSimEZO::_wire(const uint8_t bytes) const {
+	return ( (uint32_t)bytes * 10000 + _baud - 1 ) / _baud; // start and stop bits, rounded up
+}
+
+bool AtlasSimEZO::_due() const {
+	return _count && ATLAS_TIME_DIFF(_clock->millis(),_lines[_head].due) >= 0;
+}
+
+#endif
@@ -0,0 +1,103 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	A pretend EZO circuit on the end of a serial line, for running drivers
+	and the scheduler against an AtlasVirtualClock. It answers the commands
+	the library sends with what a real circuit of that type would, after
+	the time a real circuit would take: a reading in 400-900 ms, other
+	commands in ATLAS_SIM_COMMAND_TIME. It sleeps on "SLEEP" and wakes with
+	"*WA" on the next byte, counts calibration points for "Cal,?", and it
+	can be powered off and on to try out timeouts, the circuit breaker and
+	recovery:
+	
+		AtlasSimEZO ec(&sim,"EC");
+		ec.setReading("53000,26500,35.01,1.024");
+		ec.powerOff(); // says nothing until powerOn(), then "*RS" and "*RE"
+	
+	Replies arrive a whole line at a time, in order, once the line would
+	have crossed the wire at the baud rate given to begin().
+============================================================================*/
+#ifndef _Atlas_Sim_EZO_h
+#define _Atlas_Sim_EZO_h
+
+#include <Arduino.h>
+#include <AtlasTransport.h>
+#include <AtlasVirtualClock.h>
+
+#define ATLAS_SIM_LINE_LEN		48
+#define ATLAS_SIM_LINES			4	// replies waiting to be read
+#define ATLAS_SIM_COMMAND_TIME	20	// ms for anything but a reading
+#define ATLAS_SIM_WAKE_TIME		80	// ms from the waking byte to "*WA"
+#define ATLAS_SIM_BOOT_TIME		1000 // ms from "*RS" to "*RE"
+
+class AtlasSimEZO: public AtlasTransport, public AtlasEventSource {
+	public:
+		AtlasSimEZO(AtlasVirtualClock *clock, const char *type, const char *firmware = "2.10"); // "PH", "DO", "EC", "ORP", "RGB"
+		~AtlasSimEZO();
+		void			setReading(const char *reading); // what "R" answers
+		void			setReadTime(const uint16_t ms) { _read_time = ms;}
+		void			setWakeTime(const uint16_t ms) { _wake_time = ms;}
+		void			powerOff();
+		void			powerOn();
+		bool			isAsleep() const { return _asleep;}
+		bool			isPowered() const { return _powered;}
+		uint32_t		getCommands() const { return _commands;}
+		uint32_t		getReadings() const { return _readings;}
+		uint32_t		getBusyMillis() const { return _busy;} // receiving, working and replying
+		// AtlasTransport, the driver's end of the line
+		void			begin(const uint32_t baud_rate) { _baud = baud_rate ? baud_rate : 9600;}
+		int				available();
+		int				read();
+		int				peek();
+		size_t			write(uint8_t byte);
+		using Print::write;
+		// AtlasEventSource
+		bool			nextEvent(uint32_t &when);
+	private:
+		struct line {
+			uint32_t	due;
+			char		text[ATLAS_SIM_LINE_LEN]; // ends in '\r'
+		};
+		void			_command(char *command);
+		void			_answer(char *command); // queues the reply
+		void			_reply(const char *text, const uint32_t after); // queued behind anything before it
+		bool			_due() const; // first line can be read
+		uint32_t		_wire(const uint8_t bytes) const; // ms to send them, 8N1
+		AtlasVirtualClock *	_clock;
+		const char *	_type;
+		const char *	_firmware;
+		char			_reading[ATLAS_SIM_LINE_LEN];
+		uint16_t		_read_time;
+		uint16_t		_wake_time;
+		bool			_powered;
+		bool			_asleep;
+		bool			_response; // "*OK" after each command
+		uint8_t			_cal_points; // what "Cal,?" answers, kept through power cycles like the real EEPROM
+		bool			_discard; // rest of the line that woke it
+		char			_in[ATLAS_SIM_LINE_LEN];
+		uint8_t			_in_len;
+		line			_lines[ATLAS_SIM_LINES];
+		uint8_t			_head;
+		uint8_t			_count;
+		uint8_t			_pos; // in the first line
+		uint32_t		_busy_until; // replies come in order
+		uint32_t		_baud;
+		uint32_t		_busy;
+		uint32_t		_commands;
+		uint32_t		_readings;
+};
+#endif
@@ -0,0 +1,298 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#ifndef ARDUINO // Linux only
+
+#include <AtlasStore.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define ATLAS_STORE_MAX_ROW_BYTES	15 // 10 byte varint time, 5 byte value
+
+static uint8_t * putVarint(uint8_t *out, uint64_t value) {
+	while ( value >= 0x80 ) { *out++ = value | 0x80; value >>= 7;}
+	*out++ = value;
+	return out;
+}
+
+static const uint8_t * getVarint(const uint8_t *in, const uint8_t *end, uint64_t &value) {
+	value = 0;
+	for ( uint8_t shift = 0 ; in < end && shift < 64 ; shift += 7 ) {
+		uint8_t byte = *in++;
+		value |= (uint64_t)( byte & 0x7F ) << shift;
+		if ( !( byte & 0x80 ) ) return in;
+	}
+	return NULL; // ran off the end
+}
+
+static uint32_t floatBits(const float value) {
+	uint32_t bits;
+	memcpy(&bits,&value,4);
+	return bits;
+}
+
+// Segment: delta-of-delta times (the first time is in the index), then values.
+// The first value is 4 raw bytes. After that each is XORed with the one before:
+// a control byte of 0x80 | leading zero bytes << 4 | trailing zero bytes, then the bytes between.
+// 0 means unchanged.
+static size_t encodeSegment(const atlas_store_series *series, uint8_t *out) {
+	uint8_t *p = out;
+	int64_t delta = 0;
+	for ( uint16_t row = 1 ; row < series->count ; row++ ) {
+		int64_t next = series->times[row] - series->times[row - 1];
+		int64_t dod = next - delta;
+		delta = next;
+		p = putVarint(p,( (uint64_t)dod << 1 ) ^ (uint64_t)( dod >> 63 )); // zigzag
+	}
+	uint32_t previous = floatBits(series->values[0]);
+	memcpy(p,&previous,4); p += 4;
+	for ( uint16_t row = 1 ; row < series->count ; row++ ) {
+		uint32_t bits = floatBits(series->values[row]);
+		uint32_t x = bits ^ previous;
+		previous = bits;
+		if ( !x ) { *p++ = 0; continue;}
+		uint8_t lead = 0, trail = 0;
+		while ( !( x & ( 0xFF000000u >> ( lead * 8 ) ) ) ) lead++;
+		while ( !( x & ( 0xFFu << ( trail * 8 ) ) ) ) trail++;
+		*p++ = 0x80 | lead << 4 | trail;
+		for ( int8_t byte = 3 - lead ; byte >= trail ; byte-- ) *p++ = x >> ( byte * 8 );
+	}
+	return p - out;
+}
+
+static uint32_t decodeSegment(const atlas_store_index &entry, const uint8_t *in, const int64_t from_ms, const int64_t to_ms,
+		atlas_store_callback callback, void *context) {
+	const uint8_t *end = in + entry.bytes;
+	int64_t times[ATLAS_STORE_SEGMENT_ROWS];
+	if ( entry.rows == 0 || entry.rows > ATLAS_STORE_SEGMENT_ROWS ) return 0;
+	times[0] = entry.first_time;
+	int64_t delta = 0;
+	for ( uint32_t row = 1 ; row < entry.rows ; row++ ) {
+		uint64_t zigzag;
+		if ( !( in = getVarint(in,end,zigzag) ) ) return 0;
+		delta += (int64_t)( zigzag >> 1 ) ^ -(int64_t)( zigzag & 1 );
+		times[row] = times[row - 1] + delta;
+	}
+	if ( end - in < 4 ) return 0;
+	uint32_t bits;
+	memcpy(&bits,in,4); in += 4;
+	uint32_t found = 0;
+	for ( uint32_t row = 0 ; row < entry.rows ; row++ ) {
+		if ( row ) {
+			if ( in >= end ) return found;
+			uint8_t control = *in++;
+			if ( control ) {
+				uint8_t lead = ( control >> 4 ) & 0x07, trail = control & 0x0F;
+				if ( lead + trail > 3 || end - in < 4 - lead - trail ) return found;
+				uint32_t x = 0;
+				for ( int8_t byte = 3 - lead ; byte >= trail ; byte-- ) x |= (uint32_t)*in++ << ( byte * 8 );
+				bits ^= x;
+			}
+		}
+		if ( times[row] < from_ms || times[row] > to_ms ) continue;
+		float value;
+		memcpy(&value,&bits,4);
+		if ( callback ) callback(times[row],value,context);
+		found++;
+	}
+	return found;
+}
+
+AtlasStore::AtlasStore() {
+	_directory[0] = '\0';
+	_series_count = 0;
+}
+
+bool AtlasStore::open(const char *directory) {
+	close();
+	struct stat info;
+	if ( stat(directory,&info) < 0 || !S_ISDIR(info.st_mode) ) return false;
+	if ( strlen(directory) >= ATLAS_STORE_PATH_LENGTH - ATLAS_STORE_NAME_LENGTH - 8 ) return false;
+	strcpy(_directory,directory);
+	return true;
+}
+
+void AtlasStore::close() {
+	flush();
+	for ( uint8_t i = 0 ; i < _series_count ; i++ ) {
+		::close(_series[i]->col_fd);
+		::close(_series[i]->idx_fd);
+		free(_series[i]);
+	}
+	_series_count = 0;
+}
+
+bool AtlasStore::append(const char *series, const uint8_t channel, const int64_t time_ms, const float value) {
+	atlas_store_series *s = _find(series,channel,true);
+	if ( !s || time_ms < s->last_time ) return false;
+	// Still full if the last segment couldn't be written: try again, and refuse the row while it fails
+	if ( s->count >= ATLAS_STORE_SEGMENT_ROWS && !_writeSegment(s) ) return false;
+	s->times[s->count] = time_ms;
+	s->values[s->count] = value;
+	s->count++;
+	s->last_time = time_ms;
+	if ( s->count == ATLAS_STORE_SEGMENT_ROWS ) _writeSegment(s); // kept buffered if it fails
+	return true;
+}
+
+uint8_t AtlasStore::appendReading(const char *series, const EZO *sensor, const int64_t time_ms) {
+	uint8_t stored = 0;
+	uint8_t mask = sensor->getChannelMask();
+	for ( uint8_t channel = 0 ; channel < EZO_MAX_CHANNELS ; channel++ ) {
+		if ( ( mask & ( 1 << channel ) ) && append(series,channel,time_ms,sensor->getValue(channel)) ) stored++;
+	}
+	return stored;
+}
+
+uint8_t AtlasStore::appendReading(const char *series, RGB *sensor, const int64_t time_ms) {
+	uint8_t first = RGB_CH_RED, last = RGB_CH_LUX_BEYOND;
+	if ( sensor->getMode() == RGB_DEFAULT ) last = RGB_CH_BLUE;
+	else if ( sensor->getMode() == RGB_LUX ) first = RGB_CH_LUX_RED;
+	uint8_t stored = 0;
+	for ( uint8_t channel = first ; channel <= last ; channel++ ) {
+		if ( append(series,channel,time_ms,sensor->getValue(channel)) ) stored++;
+	}
+	return stored;
+}
+
+bool AtlasStore::flush() {
+	bool ok = true;
+	for ( uint8_t i = 0 ; i < _series_count ; i++ ) {
+		if ( _series[i]->count && !_writeSegment(_series[i]) ) ok = false;
+	}
+	return ok;
+}
+
+uint32_t AtlasStore::query(const char *series, const uint8_t channel, const int64_t from_ms, const int64_t to_ms,
+		atlas_store_callback callback, void *context) {
+	uint32_t found = 0;
+	char path[ATLAS_STORE_PATH_LENGTH];
+	int idx_fd = -1, col_fd = -1;
+	struct stat idx_info, col_info;
+	if ( _path(path,series,channel,"idx") ) idx_fd = ::open(path,O_RDONLY);
+	if ( _path(path,series,channel,"col") ) col_fd = ::open(path,O_RDONLY);
+	if ( idx_fd >= 0 && col_fd >= 0 && fstat(idx_fd,&idx_info) == 0 && fstat(col_fd,&col_info) == 0
+			&& idx_info.st_size >= (off_t)sizeof(atlas_store_index) && col_info.st_size > 0 ) {
+		size_t entries = idx_info.st_size / sizeof(atlas_store_index);
+		void *index_map = mmap(NULL,idx_info.st_size,PROT_READ,MAP_SHARED,idx_fd,0);
+		void *col_map = mmap(NULL,col_info.st_size,PROT_READ,MAP_SHARED,col_fd,0);
+		if ( index_map != MAP_FAILED && col_map != MAP_FAILED ) {
+			const atlas_store_index *index = (const atlas_store_index *)index_map;
+			const uint8_t *columns = (const uint8_t *)col_map;
+			// first segment that ends at or after from_ms
+			size_t low = 0, high = entries;
+			while ( low < high ) {
+				size_t middle = ( low + high ) / 2;
+				if ( index[middle].last_time < from_ms ) low = middle + 1;
+				else high = middle;
+			}
+			for ( size_t i = low ; i < entries && index[i].first_time <= to_ms ; i++ ) {
+				if ( index[i].offset + index[i].bytes > (uint64_t)col_info.st_size ) break; // torn write
+				found += decodeSegment(index[i],columns + index[i].offset,from_ms,to_ms,callback,context);
+			}
+		}
+		if ( index_map != MAP_FAILED ) munmap(index_map,idx_info.st_size);
+		if ( col_map != MAP_FAILED ) munmap(col_map,col_info.st_size);
+	}
+	if ( idx_fd >= 0 ) ::close(idx_fd);
+	if ( col_fd >= 0 ) ::close(col_fd);
+	// then what's still buffered here
+	atlas_store_series *s = _find(series,channel,false);
+	for ( uint16_t row = 0 ; s && row < s->count ; row++ ) {
+		if ( s->times[row] < from_ms || s->times[row] > to_ms ) continue;
+		if ( callback ) callback(s->times[row],s->values[row],context);
+		found++;
+	}
+	return found;
+}
+
+int64_t AtlasStore::now() {
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/*              PRIVATE METHODS                      */
+atlas_store_series * AtlasStore::_find(const char *series, const uint8_t channel, const bool create) {
+	for ( uint8_t i = 0 ; i < _series_count ; i++ ) {
+		if ( _series[i]->channel == channel && !strcmp(_series[i]->name,series) ) return _series[i];
+	}
+	if ( !create || !_directory[0] || _series_count >= ATLAS_STORE_MAX_SERIES ) return NULL;
+	char col_path[ATLAS_STORE_PATH_LENGTH], idx_path[ATLAS_STORE_PATH_LENGTH];
+	if ( !_path(col_path,series,channel,"col") || !_path(idx_path,series,channel,"idx") ) return NULL;
+	atlas_store_series *s = (atlas_store_series *)malloc(sizeof(atlas_store_series));
+	if ( !s ) return NULL;
+	strcpy(s->name,series);
+	s->channel = channel;
+	s->count = 0;
+	s->last_time = INT64_MIN;
+	s->col_fd = ::open(col_path,O_WRONLY | O_CREAT | O_APPEND,0644);
+	s->idx_fd = ::open(idx_path,O_RDWR | O_CREAT | O_APPEND,0644);
+	// Carry on after what's already there, dropping a partly written entry at the end
+	off_t size = s->idx_fd < 0 ? -1 : lseek(s->idx_fd,0,SEEK_END);
+	size_t entries = size < 0 ? 0 : size / sizeof(atlas_store_index);
+	bool torn = size > 0 && size % sizeof(atlas_store_index);
+	if ( s->col_fd < 0 || size < 0 || ( torn && ftruncate(s->idx_fd,entries * sizeof(atlas_store_index)) < 0 ) ) {
+		if ( s->col_fd >= 0 ) ::close(s->col_fd);
+		if ( s->idx_fd >= 0 ) ::close(s->idx_fd);
+		free(s);
+		return NULL;
+	}
+	if ( entries ) {
+		atlas_store_index last;
+		if ( pread(s->idx_fd,&last,sizeof(last),( entries - 1 ) * sizeof(atlas_store_index)) == sizeof(last) ) s->last_time = last.last_time;
+	}
+	_series[_series_count++] = s;
+	return s;
+}
+
+bool AtlasStore::_path(char *path, const char *series, const uint8_t channel, const char *extension) const {
+	if ( !series[0] || strlen(series) >= ATLAS_STORE_NAME_LENGTH || strchr(series,'/') ) return false;
+	int length = snprintf(path,ATLAS_STORE_PATH_LENGTH,"%s/%s.%u.%s",_directory,series,channel,extension);
+	return length > 0 && length < ATLAS_STORE_PATH_LENGTH; // a cut short path would be some other file
+}
+
+bool AtlasStore::_writeSegment(atlas_store_series *series) {
+	uint8_t buffer[ATLAS_STORE_SEGMENT_ROWS * ATLAS_STORE_MAX_ROW_BYTES];
+	atlas_store_index entry;
+	entry.first_time = series->times[0];
+	entry.last_time = series->times[series->count - 1];
+	entry.rows = series->count;
+	entry.bytes = encodeSegment(series,buffer);
+	// Data first, then the index entry that points at it. On failure the rows stay buffered
+	// and nothing half written is left where the next segment goes.
+	off_t offset = lseek(series->col_fd,0,SEEK_END);
+	off_t index_size = lseek(series->idx_fd,0,SEEK_END);
+	if ( offset < 0 || index_size < 0 ) return false;
+	if ( write(series->col_fd,buffer,entry.bytes) != (ssize_t)entry.bytes ) {
+		if ( ftruncate(series->col_fd,offset) < 0 ) {} // the index doesn't point at it either way
+		return false;
+	}
+	entry.offset = offset;
+	if ( write(series->idx_fd,&entry,sizeof(entry)) != (ssize_t)sizeof(entry) ) {
+		if ( ftruncate(series->idx_fd,index_size) < 0 ) {} // else _find() drops the torn entry on the next open
+		return false;
+	}
+	series->count = 0;
+	return true;
+}
+
+#endif
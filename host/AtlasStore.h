@@ -0,0 +1,92 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Linux only. Keeps readings on disk as columns: one pair of files per
+	series and channel, e.g. "station7-do.0.col" and "station7-do.0.idx".
+	
+	Rows are buffered until ATLAS_STORE_SEGMENT_ROWS of them make a segment,
+	which is compressed and appended to the .col file. Timestamps are stored
+	as zigzag varint delta-of-deltas, values XORed with the previous value,
+	keeping only the bytes that changed. Each segment gets a fixed size entry
+	in the .idx file with its time range, so query() finds the first segment
+	by binary search over the memory-mapped index and decodes only the
+	segments in range.
+	
+		AtlasStore store;
+		store.open("/var/lib/atlas");
+		DO_sensor.querySingleReading();
+		store.appendReading("station7-do",&DO_sensor,AtlasStore::now());
+		...
+		int64_t now = AtlasStore::now();
+		store.query("station7-do",EZO_DO_CH_MGL,now - 86400000LL,now,onRow,NULL);
+	
+	Times are ms and must not go backwards within a series.
+============================================================================*/
+#ifndef _Atlas_Store_h
+#define _Atlas_Store_h
+
+#include <Atlas_EZO.h>
+#include <AtlasRGB.h>
+
+#define ATLAS_STORE_MAX_SERIES		32	// series and channel pairs open for writing
+#define ATLAS_STORE_SEGMENT_ROWS	1024
+#define ATLAS_STORE_NAME_LENGTH		32
+#define ATLAS_STORE_PATH_LENGTH		256
+
+typedef void (*atlas_store_callback)(const int64_t time_ms, const float value, void *context);
+
+struct atlas_store_index { // one per segment in the .idx file
+	int64_t		first_time;
+	int64_t		last_time;
+	uint64_t	offset; // in the .col file
+	uint32_t	bytes;
+	uint32_t	rows;
+};
+
+struct atlas_store_series {
+	char		name[ATLAS_STORE_NAME_LENGTH];
+	uint8_t		channel;
+	int			col_fd;
+	int			idx_fd;
+	int64_t		last_time; // newest row, written or buffered
+	uint16_t	count; // buffered rows
+	int64_t		times[ATLAS_STORE_SEGMENT_ROWS];
+	float		values[ATLAS_STORE_SEGMENT_ROWS];
+};
+
+class AtlasStore {
+	public:
+		AtlasStore();
+		~AtlasStore() { close();}
+		bool			open(const char *directory); // must exist
+		void			close(); // flushes
+		bool			append(const char *series, const uint8_t channel, const int64_t time_ms, const float value);
+		uint8_t			appendReading(const char *series, const EZO *sensor, const int64_t time_ms); // each channel in getChannelMask()
+		uint8_t			appendReading(const char *series, RGB *sensor, const int64_t time_ms); // values the mode gives
+		bool			flush(); // writes partly filled segments too
+		// Rows with from_ms <= time <= to_ms, oldest first, including rows not yet flushed. Returns how many.
+		uint32_t		query(const char *series, const uint8_t channel, const int64_t from_ms, const int64_t to_ms, atlas_store_callback callback, void *context);
+		static int64_t	now(); // ms since the epoch
+	private:
+		atlas_store_series *	_find(const char *series, const uint8_t channel, const bool create);
+		bool			_path(char *path, const char *series, const uint8_t channel, const char *extension) const;
+		bool			_writeSegment(atlas_store_series *series);
+		char			_directory[ATLAS_STORE_PATH_LENGTH];
+		atlas_store_series *	_series[ATLAS_STORE_MAX_SERIES];
+		uint8_t			_series_count;
+};
+#endif
@@ -0,0 +1,60 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+============================================================================*/
+#ifndef ARDUINO // Linux only
+
+#include <AtlasVirtualClock.h>
+#include <Atlas.h> // ATLAS_TIME_DIFF
+
+AtlasVirtualClock::AtlasVirtualClock(const uint32_t start) {
+	_now = start;
+	_source_count = 0;
+}
+
+bool AtlasVirtualClock::addSource(AtlasEventSource *source) {
+	if ( _source_count >= ATLAS_VCLOCK_MAX_SOURCES ) return false;
+	_sources[_source_count++] = source;
+	return true;
+}
+
+void AtlasVirtualClock::removeSource(AtlasEventSource *source) {
+	for ( uint8_t i = 0 ; i < _source_count ; i++ ) {
+		if ( _sources[i] != source ) continue;
+		_sources[i] = _sources[--_source_count];
+		return;
+	}
+}
+
+bool AtlasVirtualClock::nextEvent(uint32_t &when) {
+	bool found = false;
+	for ( uint8_t i = 0 ; i < _source_count ; i++ ) {
+		uint32_t due;
+		if ( ! _sources[i]->nextEvent(due) || ATLAS_TIME_DIFF(due,_now) <= 0 ) continue; // already there to be read
+		if ( ! found || ATLAS_TIME_DIFF(due,when) < 0 ) when = due;
+		found = true;
+	}
+	return found;
+}
+
+void AtlasVirtualClock::advanceTo(const uint32_t when) {
+	if ( ATLAS_TIME_DIFF(when,_now) <= 0 ) return;
+	uint32_t due;
+	_now = ( nextEvent(due) && ATLAS_TIME_DIFF(due,when) < 0 ) ? due : when;
+}
+
+#endif
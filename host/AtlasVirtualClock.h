@@ -0,0 +1,67 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	A clock that only moves when told to, for running the library faster
+	than real time. delay() returns at once with the time moved on, and
+	idle() moves it on by a millisecond, so timeouts in blocking calls
+	still run their course. Between calls to a non-blocking driver, skip
+	straight to the next thing that will happen:
+	
+		AtlasVirtualClock sim;
+		AtlasSimEZO ph_circuit(&sim,"PH"); // also adds itself as an event source
+		PH_sensor.setClock(&sim);
+		PH_sensor.begin(&ph_circuit,9600);
+		sched.setClock(&sim);
+		while ( sim.millis() < 86400000UL ) { // a day
+			sched.service();
+			sim.advanceTo(sched.getNextEvent()); // or sooner, if a circuit answers first
+		}
+	
+	Event sources (simulated circuits and the like) say when their next
+	output is due. Nothing happens in between, so nothing is missed.
+============================================================================*/
+#ifndef _Atlas_Virtual_Clock_h
+#define _Atlas_Virtual_Clock_h
+
+#include <Arduino.h>
+#include <AtlasClock.h>
+
+#define ATLAS_VCLOCK_MAX_SOURCES	16
+
+class AtlasEventSource {
+	public:
+		virtual			~AtlasEventSource() {}
+		virtual bool	nextEvent(uint32_t &when) = 0; // false if nothing is coming
+};
+
+class AtlasVirtualClock: public AtlasClock {
+	public:
+		AtlasVirtualClock(const uint32_t start = 0);
+		uint32_t		millis() { return _now;}
+		void			delay(const uint32_t ms) { _now += ms;}
+		void			idle() { _now++;}
+		void			advance(const uint32_t ms) { _now += ms;} // whatever is due meanwhile
+		void			advanceTo(const uint32_t when); // or to the first event before it
+		bool			addSource(AtlasEventSource *source);
+		void			removeSource(AtlasEventSource *source);
+		bool			nextEvent(uint32_t &when); // earliest from any source, still to come
+	private:
+		uint32_t		_now;
+		AtlasEventSource *	_sources[ATLAS_VCLOCK_MAX_SOURCES];
+		uint8_t			_source_count;
+};
+#endif
@@ -0,0 +1,39 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	On Linux "Serial" is the console (stdout). Circuits are reached through
+	AtlasPosixSerial, which is an AtlasTransport rather than a HardwareSerial.
+============================================================================*/
+#ifndef _Atlas_Host_HardwareSerial_h
+#define _Atlas_Host_HardwareSerial_h
+
+#include <Arduino.h>
+
+class HardwareSerial: public Stream {
+	public:
+		virtual void	begin(unsigned long) {}
+		int				available() { return 0;}
+		int				read() { return -1;}
+		int				peek() { return -1;}
+		size_t			write(uint8_t byte) { return fputc(byte,stdout) == EOF ? 0 : 1;}
+		void			flush() { fflush(stdout);}
+		using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,2 @@
+// Pre-1.0 Arduino header name, for Atlas_EZO.h
+#include <Arduino.h>
@@ -0,0 +1,43 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Checks for the host tests. Each test is a plain program, built like the
+	tools in host/tools (see README.md). It prints every CHECK() that fails
+	and exits non-zero if there were any.
+============================================================================*/
+#ifndef _Atlas_Test_h
+#define _Atlas_Test_h
+
+#include <stdio.h>
+
+static int atlas_test_checks = 0;
+static int atlas_test_failures = 0;
+
+#define CHECK(condition) do { \
+	atlas_test_checks++; \
+	if ( !( condition ) ) { \
+		atlas_test_failures++; \
+		printf("%s:%d: CHECK(%s) failed\n",__FILE__,__LINE__,#condition); \
+	} \
+} while ( 0 )
+
+// Last line of main()
+static inline int atlasTestResult(const char *name) {
+	printf("%s: %d checks, %d failed\n",name,atlas_test_checks,atlas_test_failures);
+	return atlas_test_failures ? 1 : 0;
+}
+#endif
@@ -0,0 +1,153 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	The circuit breaker on a simulated EC circuit that stops answering and
+	comes back: closed to open after ATLAS_BREAKER_THRESHOLD timeouts, no
+	bytes sent while open, probes from service() with the wait doubling
+	after each failed one, and initialize() again once it answers. A probe
+	falling due part way through a command never cuts the command short.
+============================================================================*/
+#include <Atlas_EZO_EC.h>
+#include <AtlasSimEZO.h>
+#include "atlas_test.h"
+
+// Keeps what the driver wrote, to see that commands go out whole
+class RecordingSim : public AtlasSimEZO {
+	public:
+		RecordingSim(AtlasVirtualClock *clock) : AtlasSimEZO(clock,"EC") { _clock = clock; clear();}
+		void			clear() { _length = 0; _sent[0] = 0;}
+		const char *	sent() const { return _sent;}
+		uint32_t		sentAt() const { return _sent_at;} // first byte since clear()
+		size_t			write(uint8_t byte) {
+			if ( ! _length ) _sent_at = _clock->millis();
+			if ( _length < sizeof(_sent) - 1 ) { _sent[_length++] = byte; _sent[_length] = 0;}
+			return AtlasSimEZO::write(byte);
+		}
+		using Print::write;
+	private:
+		AtlasVirtualClock *	_clock;
+		char			_sent[256];
+		uint8_t			_length;
+		uint32_t		_sent_at;
+};
+
+// Moves on a millisecond every time it's asked, while ticking
+class TickingClock : public AtlasVirtualClock {
+	public:
+		TickingClock() { ticking = false;}
+		uint32_t		millis() { if ( ticking ) advance(1); return AtlasVirtualClock::millis();}
+		bool			ticking;
+};
+
+static TickingClock sim;
+static RecordingSim circuit(&sim);
+static EZO_EC ec;
+
+// Fails commands until the breaker opens
+static void trip() {
+	for ( uint8_t i = 0 ; i < ATLAS_BREAKER_THRESHOLD ; i++ ) {
+		CHECK(ec.getHealth() == ATLAS_HEALTH_CLOSED);
+		ec.querySingleReading();
+	}
+}
+
+static void testOpen() {
+	CHECK(ec.getHealth() == ATLAS_HEALTH_CLOSED);
+	CHECK(ec.connected());
+	uint32_t timeouts = ec.getTimeouts();
+	circuit.powerOff();
+	trip();
+	CHECK(ec.getHealth() == ATLAS_HEALTH_OPEN);
+	CHECK(ec.getTimeouts() == timeouts + ATLAS_BREAKER_THRESHOLD);
+	// Open: nothing is sent, and the command says why
+	circuit.clear();
+	CHECK(ec.querySingleReading() == EZO_RESPONSE_BR);
+	CHECK(! ec.startReading());
+	CHECK(ec.getLastResponse() == EZO_RESPONSE_BR);
+	CHECK(circuit.sent()[0] == 0);
+	CHECK(ec.getTimeouts() == timeouts + ATLAS_BREAKER_THRESHOLD);
+}
+
+// service() until something is sent or limit ms have gone by. Returns the ms until it was sent.
+static uint32_t waitForProbe(const uint32_t limit) {
+	uint32_t start = sim.millis();
+	circuit.clear();
+	while ( ! circuit.sent()[0] && sim.millis() - start < limit ) {
+		ec.service();
+		if ( ! circuit.sent()[0] ) sim.advance(1);
+	}
+	return circuit.sent()[0] ? circuit.sentAt() - start : limit;
+}
+
+static void testBackoff() {
+	// The first probe comes ATLAS_BACKOFF_MIN after opening, then each wait doubles
+	uint32_t expected = ATLAS_BACKOFF_MIN;
+	for ( uint8_t probe = 0 ; probe < 4 ; probe++ ) {
+		CHECK(waitForProbe(2 * expected) == expected); // from the failure of the one before
+		CHECK(ec.getHealth() == ATLAS_HEALTH_OPEN); // failed probe
+		expected *= 2;
+	}
+}
+
+static void testWholeCommands() {
+	// A probe falling due while a command is being written: all of it or none of it goes out
+	ec.resetHealth();
+	trip();
+	CHECK(ec.getHealth() == ATLAS_HEALTH_OPEN);
+	for ( uint8_t early = 1 ; early < 12 ; early++ ) {
+		ec.resetHealth();
+		trip();
+		// The probe is due ATLAS_BACKOFF_MIN after opening. Get to just short of it.
+		sim.advance(ATLAS_BACKOFF_MIN - early);
+		circuit.clear();
+		sim.ticking = true;
+		ezo_response response = ec.setTempComp(21.5);
+		sim.ticking = false;
+		CHECK(circuit.sent()[0] == 0 || ! strcmp(circuit.sent(),"T,21.5\r"));
+		CHECK(( circuit.sent()[0] == 0 ) == ( response == EZO_RESPONSE_BR ));
+	}
+}
+
+static void testRecovery() {
+	ec.resetHealth();
+	trip();
+	circuit.powerOn();
+	sim.advance(ATLAS_BACKOFF_MIN); // past "*RE" and the probe time
+	uint32_t commands = circuit.getCommands();
+	CHECK(waitForProbe(10) == 0);
+	CHECK(ec.getHealth() == ATLAS_HEALTH_CLOSED);
+	// The same service() runs initialize() after the probe, which asks the circuit a lot more
+	CHECK(circuit.getCommands() > commands + 4);
+	CHECK(ec.querySingleReading() == EZO_RESPONSE_OK);
+	// Back to the shortest wait
+	circuit.powerOff();
+	trip();
+	CHECK(ec.getHealth() == ATLAS_HEALTH_OPEN);
+	CHECK(waitForProbe(2 * ATLAS_BACKOFF_MIN) == ATLAS_BACKOFF_MIN);
+}
+
+int main() {
+	ec.setClock(&sim);
+	circuit.setReading("1413,765,0.70,1.000");
+	ec.begin(&circuit,9600);
+	ec.initialize();
+	testOpen();
+	testBackoff();
+	testWholeCommands();
+	testRecovery();
+	return atlasTestResult("breaker_test");
+}
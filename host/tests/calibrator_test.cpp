@@ -0,0 +1,129 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	AtlasCalibrator on simulated circuits: a two point pH calibration
+	through to DONE with the circuit reporting both points, a probe that
+	keeps drifting until the point times out, an EC dry point that settles
+	on readings around zero, and the getters before and after a run.
+============================================================================*/
+#include <AtlasCalibrator.h>
+#include <AtlasSimEZO.h>
+#include "atlas_test.h"
+#include <math.h>
+
+static AtlasVirtualClock sim;
+
+// Feeds readings of base + drift per reading +/- noise until the point is over. Returns the state it ended in.
+static atlas_cal_state settle(AtlasCalibrator &cal, AtlasSimEZO &circuit, const float base, const float drift, const float noise) {
+	char reading[ATLAS_SIM_LINE_LEN];
+	atlas_cal_state state;
+	while ( ( state = cal.update() ) == ATLAS_CAL_SETTLING ) {
+		uint32_t n = circuit.getReadings();
+		snprintf(reading,sizeof(reading),"%.2f",base + drift * n + ( n % 2 ? noise : -noise ));
+		circuit.setReading(reading);
+		sim.advance(10);
+	}
+	return state;
+}
+
+static void testDone() {
+	AtlasSimEZO circuit(&sim,"PH");
+	EZO_PH ph;
+	ph.setClock(&sim);
+	ph.begin(&circuit,9600);
+	ph.initialize();
+	AtlasCalibrator cal;
+	cal.begin(&ph);
+	CHECK(cal.getPoint() == ATLAS_CAL_NO_POINT);
+	CHECK(isnan(cal.getLastValue()));
+	cal.addPoint(ATLAS_CAL_PH_MID,7.00);
+	cal.addPoint(ATLAS_CAL_PH_LOW,4.00);
+	cal.start();
+	CHECK(cal.getState() == ATLAS_CAL_WAIT_PROBE);
+	CHECK(cal.getPoint() == ATLAS_CAL_PH_MID);
+	cal.proceed();
+	uint32_t start = sim.millis();
+	CHECK(isnan(cal.getLastValue())); // nothing read for this point yet
+	CHECK(settle(cal,circuit,7.00,0.0,0.002) == ATLAS_CAL_WAIT_PROBE);
+	// A full window at the reading interval, then the Cal command
+	CHECK(sim.millis() - start >= ( ATLAS_CAL_WINDOW - 1 ) * ATLAS_CAL_INTERVAL);
+	CHECK(sim.millis() - start < ( ATLAS_CAL_WINDOW + 1 ) * ATLAS_CAL_INTERVAL);
+	CHECK(cal.getPointIndex() == 1);
+	CHECK(cal.getPoint() == ATLAS_CAL_PH_LOW);
+	cal.proceed();
+	CHECK(settle(cal,circuit,4.00,0.0,0.002) == ATLAS_CAL_DONE);
+	CHECK(cal.getError() == ATLAS_CAL_OK);
+	CHECK(ph.getCalibration() == EZO_CAL_DOUBLE);
+	CHECK(cal.getPoint() == ATLAS_CAL_NO_POINT); // past the last one
+	CHECK(fabs(cal.getLastValue() - 4.00) < 0.01);
+	CHECK(cal.getReadings() == ATLAS_CAL_WINDOW);
+}
+
+static void testTimeout() {
+	AtlasSimEZO circuit(&sim,"PH");
+	EZO_PH ph;
+	ph.setClock(&sim);
+	ph.begin(&circuit,9600);
+	ph.initialize();
+	AtlasCalibrator cal;
+	cal.begin(&ph);
+	cal.setTimeout(60000);
+	cal.addPoint(ATLAS_CAL_PH_MID,7.00);
+	cal.start();
+	cal.proceed();
+	uint32_t start = sim.millis();
+	// 0.01 pH a reading is 0.6 pH a minute, well over the 0.02 allowed
+	CHECK(settle(cal,circuit,7.00,0.01,0.0) == ATLAS_CAL_FAILED);
+	CHECK(cal.getError() == ATLAS_CAL_ERR_TIMEOUT);
+	CHECK(sim.millis() - start > 60000);
+	CHECK(sim.millis() - start < 60000 + 2 * ATLAS_CAL_INTERVAL);
+	CHECK(fabs(cal.getSlope()) > 0.5);
+	CHECK(cal.getPoint() == ATLAS_CAL_PH_MID); // the one that failed
+	// Nothing was sent for it
+	ph.queryCalibration();
+	CHECK(ph.getCalibration() == EZO_CAL_NOT_CALIBRATED);
+}
+
+static void testDry() {
+	AtlasSimEZO circuit(&sim,"EC");
+	EZO_EC ec;
+	ec.setClock(&sim);
+	ec.begin(&circuit,9600);
+	ec.initialize();
+	ec.setWantedOutputs(EZO_EC_OUT_EC);
+	ec.applyOutputs();
+	AtlasCalibrator cal;
+	cal.begin(&ec);
+	cal.setTimeout(60000);
+	cal.addPoint(ATLAS_CAL_EC_DRY);
+	cal.addPoint(ATLAS_CAL_EC_ONE,12880);
+	cal.start();
+	cal.proceed();
+	// A dry probe reads 0.00 or a little more. Relative to that mean nothing would ever be stable.
+	CHECK(settle(cal,circuit,0.05,0.0,0.05) == ATLAS_CAL_WAIT_PROBE);
+	CHECK(cal.getPoint() == ATLAS_CAL_EC_ONE);
+	cal.proceed();
+	CHECK(settle(cal,circuit,12880,0.0,5.0) == ATLAS_CAL_DONE); // 0.04 %, within the relative limit
+	CHECK(ec.getCalibration() == EZO_CAL_SINGLE);
+}
+
+int main() {
+	testDone();
+	testTimeout();
+	testDry();
+	return atlasTestResult("calibrator_test");
+}
@@ -0,0 +1,185 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	AtlasFrameEncoder to AtlasFrameDecoder: key and difference frames, the
+	zigzag varint limits, absent and failed fields, lost frames, truncated
+	frames and a mismatched field list.
+============================================================================*/
+#include <AtlasFrame.h>
+#include "atlas_test.h"
+#include <math.h>
+
+// A circuit whose reading is set directly
+class TestSensor : public EZO {
+	public:
+		TestSensor() { _value = 0; _mask = 1; _time = 0;}
+		void	setReading(const float value) {
+			_value = value;
+			_first_byte_millis = ++_time;
+			_reply_seen = true;
+			_stampReading();
+		}
+		void	setMask(const uint8_t mask) { _mask = mask;}
+		void	fail() { for ( uint8_t i = 0 ; i < ATLAS_BREAKER_THRESHOLD ; i++ ) _commandFailed();}
+		float	getValue(const uint8_t) const { return _value;}
+		uint8_t	getChannelMask() const { return _mask;}
+	private:
+		float	_value;
+		uint8_t	_mask;
+		uint32_t	_time;
+};
+
+// Encodes the sensors' readings and decodes them again
+static atlas_frame_result roundTrip(AtlasFrameEncoder &encoder, AtlasFrameDecoder &decoder, uint8_t *length = NULL) {
+	uint8_t frame[ATLAS_FRAME_MAX_BYTES];
+	uint8_t bytes = encoder.encode(frame,sizeof(frame));
+	if ( length ) *length = bytes;
+	return decoder.decode(frame,bytes);
+}
+
+static void testValues() {
+	TestSensor a, b, c;
+	AtlasFrameEncoder encoder;
+	AtlasFrameDecoder decoder;
+	CHECK(encoder.addField(&a,0,0));
+	CHECK(encoder.addField(&b,0,2));
+	CHECK(encoder.addField(&c,0,6));
+	decoder.addField(0); decoder.addField(2); decoder.addField(6);
+	CHECK(encoder.getSchemaId() == decoder.getSchemaId());
+	// Each step's difference from the last crosses a varint length, up to the largest
+	const float steps[][3] = {
+		{ 0,			0,			0},
+		{ 63,			0.63,		0.000063},
+		{ -64,			-0.64,		-0.000064},
+		{ 8191,			81.91,		0.008191},
+		{ -8192,		-81.92,		-0.008192},
+		{ 1073741696,	10737416.0,	1073.741696},	// exactly representable, near ATLAS_FRAME_MAX_VALUE
+		{ -1073741696,	-10737416.0,	-1073.741696},	// the biggest difference
+		{ 1413,			7.01,		-0.5}
+	};
+	for ( uint8_t i = 0 ; i < sizeof(steps) / sizeof(steps[0]) ; i++ ) {
+		a.setReading(steps[i][0]); b.setReading(steps[i][1]); c.setReading(steps[i][2]);
+		CHECK(roundTrip(encoder,decoder) == ATLAS_FRAME_OK);
+		CHECK(decoder.isKey() == ( i == 0 ));
+		for ( uint8_t field = 0 ; field < 3 ; field++ ) {
+			CHECK(decoder.getStatus(field) == ATLAS_FIELD_OK);
+			float expected = lround(steps[i][field] * ( field == 0 ? 1 : field == 1 ? 100 : 1000000 ));
+			CHECK(decoder.getValue(field) == expected / ( field == 0 ? 1 : field == 1 ? 100 : 1000000 ));
+		}
+	}
+	// Out of range is failed, not wrapped
+	a.setReading(2e9); b.setReading(NAN); c.setReading(0);
+	CHECK(roundTrip(encoder,decoder) == ATLAS_FRAME_OK);
+	CHECK(decoder.getStatus(0) == ATLAS_FIELD_FAILED);
+	CHECK(decoder.getStatus(1) == ATLAS_FIELD_FAILED);
+	CHECK(decoder.getValue(0) != decoder.getValue(0)); // NaN
+	CHECK(decoder.getValue(2) == 0);
+}
+
+static void testStatus() {
+	TestSensor a, b;
+	AtlasFrameEncoder encoder;
+	AtlasFrameDecoder decoder;
+	encoder.addField(&a,0,1);
+	encoder.addField(&b,1,1);
+	decoder.addField(1); decoder.addField(1);
+	a.setReading(1.5); b.setReading(2.5);
+	b.setMask(1); // channel 1 is off
+	CHECK(roundTrip(encoder,decoder) == ATLAS_FRAME_OK);
+	CHECK(decoder.getStatus(0) == ATLAS_FIELD_OK);
+	CHECK(decoder.getStatus(1) == ATLAS_FIELD_MISSING);
+	// No new reading since the last frame
+	CHECK(roundTrip(encoder,decoder) == ATLAS_FRAME_OK);
+	CHECK(decoder.getStatus(0) == ATLAS_FIELD_FAILED);
+	// Back again: sent whole, since there's nothing to take a difference from
+	b.setMask(3);
+	a.setReading(-1.5); b.setReading(2.5);
+	CHECK(roundTrip(encoder,decoder) == ATLAS_FRAME_OK);
+	CHECK(decoder.getValue(0) == -1.5f && decoder.getValue(1) == 2.5f);
+	a.fail(); b.setReading(3.5);
+	CHECK(roundTrip(encoder,decoder) == ATLAS_FRAME_OK);
+	CHECK(decoder.getStatus(0) == ATLAS_FIELD_FAILED);
+	CHECK(decoder.getValue(1) == 3.5f);
+}
+
+static void testLoss() {
+	TestSensor a;
+	AtlasFrameEncoder encoder;
+	AtlasFrameDecoder decoder;
+	encoder.addField(&a,0,2);
+	encoder.setKeyInterval(0);
+	decoder.addField(2);
+	uint8_t frame[ATLAS_FRAME_MAX_BYTES];
+	// 100 frames wraps the 6 bit sequence
+	for ( uint8_t i = 0 ; i < 100 ; i++ ) {
+		a.setReading(i * 0.25 - 10);
+		CHECK(roundTrip(encoder,decoder) == ATLAS_FRAME_OK);
+		CHECK(decoder.getValue(0) == i * 0.25f - 10);
+	}
+	CHECK(!decoder.isKey());
+	// Lose one: differences can't be used until a key frame
+	a.setReading(1); encoder.encode(frame,sizeof(frame));
+	a.setReading(2);
+	CHECK(roundTrip(encoder,decoder) == ATLAS_FRAME_GAP);
+	a.setReading(3);
+	CHECK(roundTrip(encoder,decoder) == ATLAS_FRAME_GAP);
+	encoder.requestKey();
+	a.setReading(4);
+	CHECK(roundTrip(encoder,decoder) == ATLAS_FRAME_OK);
+	CHECK(decoder.isKey() && decoder.getValue(0) == 4);
+	// Too small a buffer writes nothing and changes nothing
+	a.setReading(5);
+	CHECK(encoder.encode(frame,2) == 0);
+	CHECK(roundTrip(encoder,decoder) == ATLAS_FRAME_OK);
+	CHECK(decoder.getValue(0) == 5);
+}
+
+static void testCorrupt() {
+	TestSensor a, b;
+	AtlasFrameEncoder encoder;
+	AtlasFrameDecoder decoder;
+	encoder.addField(&a,0,3);
+	encoder.addField(&b,0,3);
+	decoder.addField(3); decoder.addField(3);
+	a.setReading(1000); b.setReading(-1000);
+	CHECK(roundTrip(encoder,decoder) == ATLAS_FRAME_OK);
+	uint8_t frame[ATLAS_FRAME_MAX_BYTES];
+	a.setReading(2000); b.setReading(-2000);
+	uint8_t length = encoder.encode(frame,sizeof(frame));
+	// Every shorter frame is refused and the last good values stay
+	for ( uint8_t cut = 0 ; cut < length ; cut++ ) CHECK(decoder.decode(frame,cut) == ATLAS_FRAME_SHORT);
+	CHECK(decoder.getValue(0) == 1000 && decoder.getValue(1) == -1000);
+	// A varint that never ends
+	uint8_t endless[] = { frame[0], frame[1], 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+	CHECK(decoder.decode(endless,sizeof(endless)) == ATLAS_FRAME_SHORT);
+	CHECK(decoder.decode(frame,length) == ATLAS_FRAME_OK);
+	CHECK(decoder.getValue(0) == 2000 && decoder.getValue(1) == -2000);
+	// Different decimals, different schema
+	AtlasFrameDecoder other;
+	other.addField(3); other.addField(2);
+	CHECK(other.getSchemaId() != decoder.getSchemaId());
+	CHECK(other.decode(frame,length) == ATLAS_FRAME_SCHEMA);
+	CHECK(!other.addField(ATLAS_FRAME_MAX_DECIMALS + 1));
+}
+
+int main() {
+	testValues();
+	testStatus();
+	testLoss();
+	testCorrupt();
+	return atlasTestResult("frame_test");
+}
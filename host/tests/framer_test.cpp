@@ -0,0 +1,106 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	AtlasFramer: how each kind of line is classified, and what happens to
+	lines that don't fit.
+============================================================================*/
+#include <AtlasFramer.h>
+#include "atlas_test.h"
+
+// Feeds a string, returns what the last byte finished
+static atlas_frame_type pushAll(AtlasFramer &framer, const char *bytes) {
+	atlas_frame_type type = ATLAS_FRAME_NONE;
+	for ( ; *bytes ; bytes++ ) type = framer.push(*bytes);
+	return type;
+}
+
+static void testClassification() {
+	char buffer[16];
+	AtlasFramer framer;
+	framer.setDataBuffer(buffer,sizeof(buffer));
+	CHECK(pushAll(framer,"1413.2,0.64") == ATLAS_FRAME_NONE);
+	CHECK(framer.inLine());
+	CHECK(framer.push('\r') == ATLAS_FRAME_DATA);
+	CHECK(!framer.inLine());
+	CHECK(!strcmp(framer.data(),"1413.2,0.64"));
+	CHECK(framer.dataLength() == 11);
+	CHECK(!framer.truncated());
+	CHECK(pushAll(framer,"*OK\r") == ATLAS_FRAME_RESPONSE);
+	CHECK(!strcmp(framer.code(),"*OK"));
+	CHECK(pushAll(framer,"*ER\r") == ATLAS_FRAME_RESPONSE);
+	const char *events[] = { "*RS", "*RE", "*SL", "*WA", "*OV", "*UV", "*", "*O", "*E"};
+	for ( uint8_t i = 0 ; i < sizeof(events) / sizeof(events[0]) ; i++ ) {
+		CHECK(pushAll(framer,events[i]) == ATLAS_FRAME_NONE);
+		CHECK(framer.push('\r') == ATLAS_FRAME_EVENT);
+		CHECK(!strcmp(framer.code(),events[i]));
+	}
+	// A response or event doesn't touch the data line before it
+	CHECK(!strcmp(framer.data(),"1413.2,0.64"));
+	CHECK(framer.dataLength() == 11);
+}
+
+static void testLineEnds() {
+	char buffer[16];
+	AtlasFramer framer;
+	framer.setDataBuffer(buffer,sizeof(buffer));
+	CHECK(framer.push('\r') == ATLAS_FRAME_NONE); // empty line
+	CHECK(framer.push('\n') == ATLAS_FRAME_NONE);
+	CHECK(pushAll(framer,"7.00\r\n") == ATLAS_FRAME_NONE); // '\n' ends nothing
+	CHECK(!strcmp(framer.data(),"7.00"));
+	CHECK(pushAll(framer,"\n7.01\r") == ATLAS_FRAME_DATA);
+	CHECK(!strcmp(framer.data(),"7.01"));
+	// A '*' inside a data line is data
+	CHECK(pushAll(framer,"?L,1*\r") == ATLAS_FRAME_DATA);
+	CHECK(!strcmp(framer.data(),"?L,1*"));
+	// reset() drops a partial line
+	pushAll(framer,"*O");
+	framer.reset();
+	CHECK(!framer.inLine());
+	CHECK(pushAll(framer,"12\r") == ATLAS_FRAME_DATA);
+	CHECK(!strcmp(framer.data(),"12"));
+}
+
+static void testOverflow() {
+	char buffer[8];
+	AtlasFramer framer;
+	framer.setDataBuffer(buffer,sizeof(buffer));
+	CHECK(pushAll(framer,"1234567\r") == ATLAS_FRAME_DATA); // just fits with its NUL
+	CHECK(!framer.truncated());
+	CHECK(!strcmp(framer.data(),"1234567"));
+	CHECK(pushAll(framer,"123456789ABC\r") == ATLAS_FRAME_DATA);
+	CHECK(framer.truncated());
+	CHECK(framer.dataLength() == 7);
+	CHECK(!strcmp(framer.data(),"1234567"));
+	CHECK(pushAll(framer,"1\r") == ATLAS_FRAME_DATA); // the next line starts clean
+	CHECK(!framer.truncated());
+	// Codes longer than ATLAS_FRAME_CODE_LEN are cut, but still classified
+	CHECK(pushAll(framer,"*OKAY_AND_MORE\r") == ATLAS_FRAME_RESPONSE);
+	CHECK(strlen(framer.code()) == ATLAS_FRAME_CODE_LEN - 1);
+	CHECK(pushAll(framer,"*RESTARTED\r") == ATLAS_FRAME_EVENT);
+	// No buffer: data lines are framed and thrown away
+	framer.setDataBuffer(NULL,0);
+	CHECK(pushAll(framer,"1413.2\r") == ATLAS_FRAME_DATA);
+	CHECK(framer.dataLength() == 0);
+	CHECK(pushAll(framer,"*OK\r") == ATLAS_FRAME_RESPONSE);
+}
+
+int main() {
+	testClassification();
+	testLineEnds();
+	testOverflow();
+	return atlasTestResult("framer_test");
+}
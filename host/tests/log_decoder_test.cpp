@@ -0,0 +1,114 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	AtlasLogDecoder against a plain strtod() parse of the same log. Lines
+	are of every length, so line ends fall everywhere in the 16 byte blocks.
+	Build it once as it is and once with -U__SSE2__ to check the SSE2 line
+	scan against the plain one.
+============================================================================*/
+#include <AtlasLogDecoder.h>
+#include <Atlas_EZO_EC.h>
+#include "atlas_test.h"
+#include <math.h>
+#include <unistd.h>
+
+#define ROWS 5000
+
+static float expected_ec[ROWS];
+static float expected_sal[ROWS];
+static uint32_t bad_lines;
+static uint32_t single_lines;
+static uint32_t event_lines;
+
+// Writes a log of ROWS good "EC,SAL" lines with junk between them. Returns the path.
+static const char * writeLog(char *path) {
+	strcpy(path,"/tmp/atlas_log_XXXXXX");
+	int fd = mkstemp(path);
+	FILE *log = fdopen(fd,"w");
+	srand(1);
+	for ( uint32_t row = 0 ; row < ROWS ; row++ ) {
+		// Lengths wander from 3 to about 30 bytes
+		uint8_t decimals = rand() % 4;
+		float ec = (float)( rand() % 200000 ) / ( decimals ? 10 * decimals : 1 );
+		float sal = (float)( rand() % 4200 ) / 100;
+		if ( row % 97 == 0 ) ec = 0;
+		if ( row % 101 == 0 ) sal = -sal;
+		char line[64];
+		snprintf(line,sizeof(line),"%.*f,%.2f",decimals,ec,sal);
+		expected_ec[row] = strtod(line,NULL);
+		expected_sal[row] = strtod(strchr(line,',') + 1,NULL);
+		fputs(line,log);
+		fputs(( row % 3 ) ? "\r" : "\r\n",log);
+		switch ( row % 13 ) {
+			case 0:	fputs("*OK\r",log); event_lines++; break;
+			case 5:	fputs("\r\n\r",log); break;
+			case 7:	fputs("12.5\r",log); bad_lines++; single_lines++; break; // too few fields
+			case 9:	fputs("12.5,1.0,3\r",log); bad_lines++; break; // too many
+			case 11: fputs("1.2.3,4\r",log); bad_lines++; break; // not a number
+			case 12: fputs("*RS\r*RE\r",log); event_lines += 2; break;
+		}
+	}
+	fputs("99,1.5",log); // last line with no '\r'
+	fclose(log);
+	return path;
+}
+
+static void testDecode(const char *path) {
+	AtlasLogDecoder decoder;
+	CHECK(decoder.open(path));
+	CHECK(decoder.setLayout(EZO_EC_CIRCUIT,EZO_EC_OUT_EC | EZO_EC_OUT_S));
+	uint32_t rows = decoder.decode();
+	CHECK(rows == ROWS + 1);
+	CHECK(decoder.getRejected() == bad_lines);
+	CHECK(decoder.getEvents() == event_lines);
+	const float *ec = decoder.getColumn(EZO_EC_CH_EC);
+	const float *sal = decoder.getColumn(EZO_EC_CH_SAL);
+	CHECK(ec && sal);
+	CHECK(decoder.getColumn(EZO_EC_CH_TDS) == NULL);
+	if ( !ec || !sal || rows != ROWS + 1 ) return;
+	uint32_t wrong = 0;
+	for ( uint32_t row = 0 ; row < ROWS ; row++ ) {
+		// Both are correctly rounded from the same digits
+		if ( ec[row] != expected_ec[row] || sal[row] != expected_sal[row] ) {
+			if ( !wrong++ ) printf("row %u: %g,%g expected %g,%g\n",row,ec[row],sal[row],expected_ec[row],expected_sal[row]);
+		}
+	}
+	CHECK(wrong == 0);
+	CHECK(ec[ROWS] == 99 && sal[ROWS] == 1.5);
+}
+
+static void testLayouts(const char *path) {
+	AtlasLogDecoder decoder;
+	CHECK(decoder.open(path));
+	// One field per line: every two field line is rejected
+	CHECK(decoder.setLayout(EZO_EC_CIRCUIT,EZO_EC_OUT_EC));
+	CHECK(decoder.decode() == single_lines);
+	CHECK(decoder.getRejected() == ROWS + 1 + bad_lines - single_lines);
+	CHECK(!decoder.setLayout(EZO_UNKNOWN_CIRCUIT,0));
+	decoder.close();
+	CHECK(decoder.decode() == 0);
+	CHECK(!decoder.open("/nonexistent/atlas.log"));
+}
+
+int main() {
+	char path[32];
+	writeLog(path);
+	testDecode(path);
+	testLayouts(path);
+	unlink(path);
+	return atlasTestResult("log_decoder_test");
+}
@@ -0,0 +1,222 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	The scheduler on a virtual clock against simulated pH, EC and DO
+	circuits: the reading with the earliest deadline goes first, misses are
+	counted when a bus is overloaded or a circuit stops answering, a
+	sleeping circuit is woken early enough to read on time, and the charge
+	tally matches the time each circuit spent awake and asleep.
+============================================================================*/
+#include <Atlas_EZO_PH.h>
+#include <Atlas_EZO_EC.h>
+#include <Atlas_EZO_DO.h>
+#include <AtlasScheduler.h>
+#include <AtlasSimEZO.h>
+#include "atlas_test.h"
+#include <math.h>
+
+// Notes when it was woken and when each reading was asked for
+class WatchedSim : public AtlasSimEZO {
+	public:
+		WatchedSim(AtlasVirtualClock *clock, const char *type) : AtlasSimEZO(clock,type) {
+			_clock = clock; woke_at = 0; read_at = 0; _line_start = true;
+		}
+		size_t			write(uint8_t byte) {
+			bool was_asleep = isAsleep();
+			size_t written = AtlasSimEZO::write(byte);
+			if ( was_asleep && ! isAsleep() ) woke_at = _clock->millis();
+			else if ( _line_start && byte == 'R' ) read_at = _clock->millis();
+			_line_start = byte == '\r';
+			return written;
+		}
+		using Print::write;
+		uint32_t		woke_at;
+		uint32_t		read_at; // last "R"
+	private:
+		AtlasVirtualClock *	_clock;
+		bool			_line_start;
+};
+
+static AtlasVirtualClock sim;
+static WatchedSim ph_circuit(&sim,"pH");
+static WatchedSim ec_circuit(&sim,"EC");
+static WatchedSim do_circuit(&sim,"DO");
+static EZO_PH ph;
+static EZO_EC ec;
+static EZO_DO dox;
+
+static uint8_t order[16]; // tasks in the order they finished
+static uint8_t finished;
+
+static void onReading(const uint8_t task, EZO *, const ezo_response, void *) {
+	if ( finished < sizeof(order) ) order[finished] = task;
+	finished++;
+}
+
+// service() and skip to the next event until the clock reaches until
+static void run(AtlasScheduler &sched, const uint32_t until) {
+	while ( ATLAS_TIME_DIFF(sim.millis(),until) < 0 ) {
+		sched.service();
+		uint32_t next = sched.getNextEvent();
+		sim.advanceTo(ATLAS_TIME_DIFF(next,until) < 0 ? next : until);
+	}
+}
+
+// Lets a reading the scheduler left in flight finish, and wakes the circuit, for the next test
+static void release(EZO &sensor, WatchedSim &circuit) {
+	while ( sensor.busy() ) {
+		if ( sensor.pollCommand() ) sensor.finishCommand();
+		else sim.advance(10);
+	}
+	if ( circuit.isAsleep() ) sensor.wake();
+}
+
+static void releaseAll() {
+	release(ph,ph_circuit);
+	release(ec,ec_circuit);
+	release(dox,do_circuit);
+}
+
+static void testEarliestDeadline() {
+	// All three released together on one bus: the shortest period has the earliest deadline
+	AtlasScheduler sched;
+	sched.setClock(&sim);
+	uint8_t slow = sched.addTask(&ec,30000,0);
+	uint8_t fast = sched.addTask(&ph,5000,0);
+	uint8_t middle = sched.addTask(&dox,10000,0);
+	sched.setCallback(onReading,NULL);
+	finished = 0;
+	uint32_t start = sim.millis();
+	run(sched,start + 60000);
+	CHECK(finished >= 3);
+	CHECK(order[0] == fast);
+	CHECK(order[1] == middle);
+	CHECK(order[2] == slow);
+	// The bus has time for all of them, so nothing is missed
+	CHECK(sched.getUtilization(0) < 50);
+	CHECK(sched.getMissed(fast) == 0 && sched.getMissed(middle) == 0 && sched.getMissed(slow) == 0);
+	CHECK(sched.getRuns(fast) >= 11 && sched.getRuns(fast) <= 13);
+	CHECK(sched.getRuns(middle) >= 5 && sched.getRuns(middle) <= 7);
+	CHECK(sched.getRuns(slow) == 2);
+	releaseAll();
+}
+
+static void testMissed() {
+	// pH readings take 900 ms. Two every second on one bus can't all be done.
+	AtlasScheduler sched;
+	sched.setClock(&sim);
+	uint8_t first = sched.addTask(&ph,1000,0);
+	uint8_t second = sched.addTask(&ec,1000,0);
+	sched.setDuration(second,900);
+	ec_circuit.setReadTime(900);
+	run(sched,sim.millis() + 20000);
+	CHECK(sched.getUtilization(0) > 100);
+	CHECK(sched.getMissed(first) + sched.getMissed(second) >= 15);
+	CHECK(sched.getRuns(first) + sched.getRuns(second) <= 25);
+	releaseAll();
+	ec_circuit.setReadTime(600);
+	// A circuit that stops answering misses every reading, run or skipped by the breaker
+	AtlasScheduler quiet;
+	quiet.setClock(&sim);
+	uint8_t task = quiet.addTask(&dox,5000,1);
+	do_circuit.powerOff();
+	run(quiet,sim.millis() + 60000);
+	CHECK(quiet.getRuns(task) >= 11); // the last may still be waiting for its reply
+	CHECK(quiet.getMissed(task) == quiet.getRuns(task));
+	do_circuit.powerOn();
+	run(quiet,sim.millis() + 2 * ATLAS_BACKOFF_MAX);
+	uint32_t missed = quiet.getMissed(task);
+	run(quiet,sim.millis() + 30000);
+	CHECK(quiet.getMissed(task) == missed); // back and on time
+	releaseAll();
+}
+
+static void testPreWake() {
+	AtlasScheduler sched;
+	sched.setClock(&sim);
+	uint8_t task = sched.addTask(&ph,30000,0);
+	sched.setAutoSleep(true);
+	uint32_t start = sim.millis();
+	run(sched,start + 10000);
+	CHECK(sched.getRuns(task) == 1);
+	CHECK(sched.isAsleep(task));
+	CHECK(ph_circuit.isAsleep());
+	for ( uint8_t cycle = 1 ; cycle <= 3 ; cycle++ ) {
+		uint32_t release = start + cycle * 30000;
+		run(sched,release + 5000);
+		CHECK(sched.getRuns(task) == (uint32_t)cycle + 1);
+		// Woken ahead of the release, with time to settle, and read right on it
+		CHECK(ATLAS_TIME_DIFF(ph_circuit.woke_at,release - ATLAS_SCHED_WAKE_SETTLE) <= 0);
+		CHECK(ATLAS_TIME_DIFF(ph_circuit.woke_at,release - ATLAS_SCHED_WAKE_SETTLE - 500) > 0);
+		CHECK(ph_circuit.read_at == release);
+		CHECK(sched.getLateness(task) == 0);
+		CHECK(sched.isAsleep(task)); // and back to sleep
+	}
+	CHECK(sched.getMissed(task) == 0);
+	releaseAll();
+}
+
+static void testCharge() {
+	// Add up the time each circuit spent awake and asleep, as the scheduler saw it
+	AtlasScheduler sched;
+	sched.setClock(&sim);
+	uint8_t sleeper = sched.addTask(&ph,20000,0);
+	uint8_t waker = sched.addTask(&ec,20000,1);
+	sched.setSleep(sleeper,true);
+	sched.setSleep(waker,false);
+	sched.setCurrent(sleeper,10000,100);
+	sched.setCurrent(waker,10000,100);
+	uint64_t asleep_ms = 0, awake_ms = 0;
+	uint32_t start = sim.millis();
+	while ( ATLAS_TIME_DIFF(sim.millis(),start + 600000) < 0 ) {
+		sched.service();
+		bool asleep = sched.isAsleep(sleeper);
+		uint32_t before = sim.millis();
+		sim.advanceTo(sched.getNextEvent());
+		( asleep ? asleep_ms : awake_ms ) += sim.millis() - before;
+	}
+	sched.service(); // accounts up to now
+	double elapsed = sim.millis() - start;
+	CHECK(asleep_ms > awake_ms); // it slept most of the time
+	double expected = ( awake_ms * 10000.0 + asleep_ms * 100.0 ) / 1000.0 / 3600000.0; // mAh
+	CHECK(fabs(sched.getCharge(sleeper) - expected) < 1e-6);
+	CHECK(fabs(sched.getAverageCurrent(sleeper) - expected * 3600000.0 / elapsed) < 1e-3);
+	CHECK(fabs(sched.getCharge(waker) - 10.0 * elapsed / 3600000.0) < 1e-6);
+	CHECK(fabs(sched.getAverageCurrent(waker) - 10.0) < 1e-3);
+	sched.resetStats();
+	CHECK(sched.getCharge(sleeper) == 0.0 && sched.getAverageCurrent(sleeper) == 0.0);
+}
+
+int main() {
+	ph.setClock(&sim);
+	ec.setClock(&sim);
+	dox.setClock(&sim);
+	ph_circuit.setReading("7.01");
+	ec_circuit.setReading("1413,765,0.70,1.000");
+	do_circuit.setReading("8.2,92.5");
+	ph.begin(&ph_circuit,9600);
+	ec.begin(&ec_circuit,9600);
+	dox.begin(&do_circuit,9600);
+	ph.initialize();
+	ec.initialize();
+	dox.initialize();
+	testEarliestDeadline();
+	testMissed();
+	testPreWake();
+	testCharge();
+	return atlasTestResult("scheduler_test");
+}
@@ -0,0 +1,137 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	AtlasStore: rows go in and come back bit for bit, through the
+	delta-of-delta times and XORed values, across segments, from disk
+	after a reopen, and for ranges that start and end anywhere.
+============================================================================*/
+#include <AtlasStore.h>
+#include "atlas_test.h"
+#include <math.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#define ROWS ( 3 * ATLAS_STORE_SEGMENT_ROWS + 100 ) // the last 100 stay buffered until close()
+
+static int64_t times[ROWS];
+static float values[ROWS];
+
+struct collected {
+	uint32_t	rows;
+	uint32_t	first; // row of times[] expected next
+	uint32_t	wrong;
+};
+
+static void onRow(const int64_t time_ms, const float value, void *context) {
+	collected *c = (collected *)context;
+	uint32_t row = c->first + c->rows++;
+	if ( row >= ROWS || time_ms != times[row] || memcmp(&value,&values[row],sizeof(value)) ) {
+		if ( !c->wrong++ ) printf("row %u: %lld %g\n",row,(long long)time_ms,value);
+	}
+}
+
+static void makeRows() {
+	srand(2);
+	int64_t time = 1460000000000LL;
+	for ( uint32_t row = 0 ; row < ROWS ; row++ ) {
+		switch ( row % 7 ) {
+			case 0:		time += 1000; break;						// steady, delta-of-delta 0
+			case 1:		time += 1000 + rand() % 50 - 25; break;		// jitter
+			case 2:		break;										// same time twice
+			case 3:		time += ( row % 500 == 3 ) ? 86400000LL * 365 : 1; break; // a year's gap
+			default:	time += rand() % 5000; break;
+		}
+		times[row] = time;
+		uint32_t bits = rand() ^ ( (uint32_t)rand() << 16 );
+		switch ( row % 11 ) {
+			case 0:		values[row] = 7.0; break;
+			case 1:		values[row] = 7.0; break;						// unchanged, one byte
+			case 2:		values[row] = 7.001; break;						// low bytes change
+			case 3:		values[row] = -7.001; break;					// only the sign
+			case 4:		values[row] = 0.0; break;
+			case 5:		values[row] = -0.0; break;
+			case 6:		values[row] = INFINITY; break;
+			case 7:		bits = ( bits & 0x807FFFFF ) | 0x7F800001; memcpy(&values[row],&bits,4); break; // a NaN with payload
+			case 8:		bits &= 0x807FFFFF; memcpy(&values[row],&bits,4); break; // subnormal
+			default:	memcpy(&values[row],&bits,4); break;
+		}
+	}
+}
+
+static void checkRange(AtlasStore &store, const uint32_t first, const uint32_t last) {
+	collected c = { 0, first, 0};
+	// Rows sharing a time with the range ends are in the range too
+	uint32_t from = first, to = last;
+	while ( from > 0 && times[from - 1] == times[first] ) from--;
+	while ( to + 1 < ROWS && times[to + 1] == times[last] ) to++;
+	c.first = from;
+	uint32_t found = store.query("tank",3,times[first],times[last],onRow,&c);
+	CHECK(found == to - from + 1);
+	CHECK(c.rows == found);
+	CHECK(c.wrong == 0);
+}
+
+static void removeStore(const char *directory) {
+	DIR *dir = opendir(directory);
+	struct dirent *entry;
+	char path[ATLAS_STORE_PATH_LENGTH + 64];
+	while ( dir && ( entry = readdir(dir) ) ) {
+		if ( entry->d_name[0] == '.' ) continue;
+		snprintf(path,sizeof(path),"%s/%s",directory,entry->d_name);
+		unlink(path);
+	}
+	if ( dir ) closedir(dir);
+	rmdir(directory);
+}
+
+int main() {
+	char directory[] = "/tmp/atlas_store_XXXXXX";
+	CHECK(mkdtemp(directory) != NULL);
+	makeRows();
+	AtlasStore store;
+	CHECK(!store.open("/nonexistent/atlas"));
+	CHECK(store.open(directory));
+	uint32_t appended = 0;
+	for ( uint32_t row = 0 ; row < ROWS ; row++ ) {
+		if ( store.append("tank",3,times[row],values[row]) ) appended++;
+		if ( row % 5 == 0 ) store.append("tank",4,times[row],1.0); // another channel in between
+	}
+	CHECK(appended == ROWS);
+	CHECK(!store.append("tank",3,times[ROWS - 1] - 1,0.0)); // time went backwards
+	CHECK(!store.append("a/b",3,times[ROWS - 1],0.0));
+	// Segments on disk plus the buffered rows
+	checkRange(store,0,ROWS - 1);
+	checkRange(store,ATLAS_STORE_SEGMENT_ROWS - 1,ATLAS_STORE_SEGMENT_ROWS); // across a segment end
+	checkRange(store,ROWS - 150,ROWS - 50); // into the buffered rows
+	checkRange(store,1500,1500);
+	CHECK(store.query("tank",3,times[0] - 10,times[0] - 1,NULL,NULL) == 0);
+	CHECK(store.query("tank",3,times[ROWS - 1] + 1,times[ROWS - 1] + 10,NULL,NULL) == 0);
+	CHECK(store.query("tank",5,times[0],times[ROWS - 1],NULL,NULL) == 0);
+	CHECK(store.query("tank",4,times[0],times[ROWS - 1],NULL,NULL) == ( ROWS + 4 ) / 5);
+	// close() flushes, a new store reads it all from disk and carries on after it
+	store.close();
+	AtlasStore reopened;
+	CHECK(reopened.open(directory));
+	checkRange(reopened,0,ROWS - 1);
+	for ( uint32_t row = 0 ; row < 200 ; row += 37 ) checkRange(reopened,row,ROWS - 1 - row * 5);
+	CHECK(!reopened.append("tank",3,times[ROWS - 1] - 1,0.0));
+	CHECK(reopened.append("tank",3,times[ROWS - 1],values[ROWS - 1]));
+	CHECK(reopened.query("tank",3,times[ROWS - 1],times[ROWS - 1],NULL,NULL) >= 2);
+	reopened.close();
+	removeStore(directory);
+	return atlasTestResult("store_test");
+}
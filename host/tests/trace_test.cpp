@@ -0,0 +1,123 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+		A session with a simulated pH circuit recorded through AtlasTeeTransport
+		and played back through AtlasReplayTransport: the same readings come
+		out, every byte the driver writes matches the trace and nothing the
+		circuit said is left unread. A driver that says something else is
+		caught, and a file that isn't a trace is refused.
+============================================================================*/
+#include <Atlas_EZO_PH.h>
+#include <AtlasSimEZO.h>
+#include <AtlasTrace.h>
+#include <AtlasFileStream.h>
+#include "atlas_test.h"
+#include <unistd.h>
+
+#define READINGS 5
+
+static const char *values[READINGS] = { "7.012", "6.998", "7.105", "14.000", "0.003" };
+static float recorded[READINGS];
+
+static void record(const char *path) {
+	AtlasVirtualClock sim;
+	AtlasSimEZO circuit(&sim,"PH");
+	AtlasFileStream trace;
+	CHECK(trace.open(path,"wb"));
+	AtlasTeeTransport tee(&circuit,&trace);
+	tee.setClock(&sim);
+	EZO_PH ph;
+	ph.setClock(&sim);
+	ph.begin(&tee,9600);
+	ph.initialize();
+	CHECK(ph.connected());
+	for ( uint8_t i = 0 ; i < READINGS ; i++ ) {
+		circuit.setReading(values[i]);
+		CHECK(ph.querySingleReading() == EZO_RESPONSE_OK);
+		recorded[i] = ph.getPH();
+		sim.advance(1000);
+	}
+	tee.flushTrace();
+	trace.close();
+}
+
+static void testRoundTrip(const char *path, const float speed) {
+	AtlasVirtualClock sim;
+	AtlasFileStream trace;
+	CHECK(trace.open(path,"rb"));
+	AtlasReplayTransport replay(&trace);
+	replay.setClock(&sim);
+	replay.setSpeed(speed);
+	CHECK(replay.open());
+	EZO_PH ph;
+	ph.setClock(&sim);
+	ph.begin(&replay,9600);
+	ph.initialize();
+	CHECK(ph.connected());
+	for ( uint8_t i = 0 ; i < READINGS ; i++ ) {
+		CHECK(ph.querySingleReading() == EZO_RESPONSE_OK);
+		CHECK(ph.getPH() == recorded[i]);
+		sim.advance(1000);
+	}
+	CHECK(replay.done());
+	CHECK(replay.getMismatches() == 0);
+	CHECK(replay.getDropped() == 0);
+}
+
+static void testDifferentDriver(const char *path) {
+	// Calibrating where the recording read: the bytes don't match
+	AtlasVirtualClock sim;
+	AtlasFileStream trace;
+	CHECK(trace.open(path,"rb"));
+	AtlasReplayTransport replay(&trace);
+	replay.setClock(&sim);
+	replay.setSpeed(0);
+	CHECK(replay.open());
+	EZO_PH ph;
+	ph.setClock(&sim);
+	ph.begin(&replay,9600);
+	ph.initialize();
+	CHECK(replay.getMismatches() == 0);
+	ph.calibrate(EZO_PH_CAL_MID,7.00);
+	CHECK(replay.getMismatches() > 0);
+}
+
+static void testNotATrace(const char *path) {
+	AtlasFileStream file;
+	CHECK(file.open(path,"wb"));
+	file.write((const uint8_t *)"ATR0",4); // an older or different format
+	file.close();
+	CHECK(file.open(path,"rb"));
+	AtlasReplayTransport replay(&file);
+	CHECK(! replay.open());
+	CHECK(replay.done());
+}
+
+int main() {
+	char path[] = "/tmp/atlas_trace_XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+	if ( fd < 0 ) return atlasTestResult("trace_test");
+	close(fd);
+	record(path);
+	testRoundTrip(path,1.0);
+	testRoundTrip(path,0); // as fast as the driver asks
+	testDifferentDriver(path);
+	testNotATrace(path);
+	unlink(path);
+	return atlasTestResult("trace_test");
+}
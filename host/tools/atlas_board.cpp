@@ -0,0 +1,57 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Print what a polling process has published on a shared memory board.
+	
+	atlas_board <name> [interval ms]
+	
+	With an interval, keeps printing every sensor that has a new reading.
+============================================================================*/
+#include <AtlasBoard.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static const char * HEALTH_NAMES[] = { "ok", "open", "probing" };
+
+static void print(const atlas_board_reading &reading) {
+	printf("%-24s %lld.%03lld %-7s",reading.name,(long long)( reading.wall_ms / 1000 ),(long long)( reading.wall_ms % 1000 ),
+		reading.health <= ATLAS_HEALTH_HALF_OPEN ? HEALTH_NAMES[reading.health] : "?");
+	for ( uint8_t channel = 0 ; channel < EZO_MAX_CHANNELS ; channel++ ) {
+		if ( reading.channel_mask & ( 1 << channel ) ) printf(" %g",reading.values[channel]);
+	}
+	printf("  (%u readings, %u commands, %u timeouts)\n",reading.readings,reading.commands,reading.timeouts);
+}
+
+int main(int argc, char **argv) {
+	if ( argc < 2 ) { fprintf(stderr,"atlas_board <name> [interval ms]\n"); return 2;}
+	AtlasBoardReader board;
+	if ( ! board.attach(argv[1]) ) { fprintf(stderr,"%s: no board\n",argv[1]); return 1;}
+	int interval = argc > 2 ? atoi(argv[2]) : 0;
+	uint32_t seen[ATLAS_BOARD_SLOTS] = { 0 };
+	do {
+		atlas_board_reading reading;
+		for ( uint8_t slot = 0 ; slot < board.getSlotCount() ; slot++ ) {
+			if ( ! board.read(slot,reading) ) continue;
+			if ( interval && reading.readings == seen[slot] ) continue; // commands that weren't readings
+			seen[slot] = reading.readings;
+			print(reading);
+		}
+		fflush(stdout);
+		if ( interval ) usleep(interval * 1000);
+	} while ( interval );
+	return 0;
+}
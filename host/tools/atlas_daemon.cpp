@@ -0,0 +1,121 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Own the circuits and serve them to local clients, see AtlasServer.h.
+	
+	atlas_daemon serve <socket> <interval ms> <ec|do|ph|orp|rgb>:<tty>:<baud> ...
+	atlas_daemon watch <socket> [port] [command]
+	
+	watch prints the readings the daemon pushes, from every port or one.
+	With a command it sends that to the port instead and prints the result.
+============================================================================*/
+#include <AtlasServer.h>
+#include <Atlas_EZO_DO.h>
+#include <Atlas_EZO_EC.h>
+#include <Atlas_EZO_ORP.h>
+#include <Atlas_EZO_PH.h>
+#include <Atlas_EZO_RGB.h>
+#include <signal.h>
+#include <stdlib.h>
+
+static volatile bool stopping = false;
+
+static void onSignal(int) {
+	stopping = true;
+}
+
+static EZO * sensorFor(const char *type) {
+	if ( ! strcmp(type,"do") )	return new EZO_DO;
+	if ( ! strcmp(type,"ec") )	return new EZO_EC;
+	if ( ! strcmp(type,"orp") )	return new EZO_ORP;
+	if ( ! strcmp(type,"ph") )	return new EZO_PH;
+	if ( ! strcmp(type,"rgb") )	return new EZO_RGB;
+	return NULL;
+}
+
+static int usage() {
+	fprintf(stderr,"atlas_daemon serve <socket> <interval ms> <ec|do|ph|orp|rgb>:<tty>:<baud> ...\n");
+	fprintf(stderr,"atlas_daemon watch <socket> [port] [command]\n");
+	return 2;
+}
+
+static int serve(const char *path, const uint32_t interval, int count, char **ports) {
+	AtlasPoller poller;
+	if ( ! poller.begin(0) ) return 1;
+	for ( int i = 0 ; i < count ; i++ ) {
+		char *type = strtok(ports[i],":");
+		char *device = strtok(NULL,":");
+		char *baud = strtok(NULL,":");
+		EZO *sensor = type ? sensorFor(type) : NULL;
+		if ( ! sensor || ! device ) return usage();
+		AtlasPosixSerial *serial = new AtlasPosixSerial(device);
+		sensor->begin(serial,baud ? atol(baud) : 9600);
+		if ( ! serial->isOpen() ) { perror(device); return 1;}
+		sensor->initialize();
+		int port = poller.addPort(sensor,serial);
+		if ( port < 0 ) { fprintf(stderr,"%s: too many ports\n",device); return 1;}
+		printf("port %d: %s on %s\n",port,type,device);
+	}
+	AtlasServer server;
+	if ( ! server.begin(&poller,path) ) { perror(path); return 1;}
+	server.setInterval(interval);
+	signal(SIGINT,onSignal);
+	signal(SIGTERM,onSignal);
+	while ( ! stopping ) {
+		poller.run(ATLAS_POLLER_TICK);
+		server.service();
+	}
+	server.end(); // removes the socket file
+	return 0;
+}
+
+static int watch(const char *path, const int port, const char *command) {
+	AtlasServerClient client;
+	if ( ! client.connect(path) ) { perror(path); return 1;}
+	if ( command ) client.command(port,1,command);
+	else client.subscribe(port < 0 ? ATLAS_SERVER_ALL_PORTS : port,0xFF);
+	uint8_t message[ATLAS_SERVER_MESSAGE_LEN];
+	for (;;) {
+		int length = client.receive(message,-1);
+		if ( length < 0 ) return 1;
+		if ( message[0] == ATLAS_MSG_READING && length >= 9 ) {
+			uint32_t reading_ms = message[5] | ( message[6] << 8 ) | ( message[7] << 16 ) | ( (uint32_t)message[8] << 24 );
+			printf("port %u at %u ms:",message[1],reading_ms);
+			for ( int offset = 9 ; offset + 4 <= length ; offset += 4 ) {
+				float value;
+				memcpy(&value,message + offset,4);
+				printf(" %g",value);
+			}
+			printf("\n");
+		}
+		else if ( message[0] == ATLAS_MSG_RESULT && length >= 5 ) {
+			printf("%.*s (response %u)\n",length - 5,(const char *)message + 5,message[4]);
+			return 0;
+		}
+		else if ( message[0] == ATLAS_MSG_ERROR && length >= 4 ) {
+			fprintf(stderr,"error %u\n",message[3]);
+			return 1;
+		}
+		fflush(stdout);
+	}
+}
+
+int main(int argc, char **argv) {
+	if ( argc >= 5 && ! strcmp(argv[1],"serve") ) return serve(argv[2],atol(argv[3]),argc - 4,argv + 4);
+	if ( argc >= 3 && ! strcmp(argv[1],"watch") ) return watch(argv[2],argc > 3 ? atoi(argv[3]) : -1,argc > 4 ? argv[4] : NULL);
+	return usage();
+}
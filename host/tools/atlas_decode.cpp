@@ -0,0 +1,126 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Decode a recorded continuous-mode log into columns and print a summary,
+	or every row as CSV.
+	
+	atlas_decode <ec|do|ph|orp|rgb> <log> [outputs] [csv]
+	
+	outputs is what the circuit had on while logging, e.g. EC,S or RGB,LUX.
+	Default: all of them.
+============================================================================*/
+#include <Atlas_EZO_DO.h>
+#include <Atlas_EZO_EC.h>
+#include <Atlas_EZO_RGB.h>
+#include <AtlasLogDecoder.h>
+#include <time.h>
+
+struct output_name {
+	ezo_circuit_type	circuit;
+	const char *		name;
+	uint8_t				output;
+};
+
+static const output_name OUTPUT_NAMES[] = {
+	{ EZO_EC_CIRCUIT,	"EC",	EZO_EC_OUT_EC},
+	{ EZO_EC_CIRCUIT,	"TDS",	EZO_EC_OUT_TDS},
+	{ EZO_EC_CIRCUIT,	"S",	EZO_EC_OUT_S},
+	{ EZO_EC_CIRCUIT,	"SG",	EZO_EC_OUT_SG},
+	{ EZO_DO_CIRCUIT,	"DO",	EZO_DO_OUT_MGL},
+	{ EZO_DO_CIRCUIT,	"%",	EZO_DO_OUT_SAT},
+	{ EZO_RGB_CIRCUIT,	"RGB",	EZO_RGB_OUT_RGB},
+	{ EZO_RGB_CIRCUIT,	"PROX",	EZO_RGB_OUT_PROX},
+	{ EZO_RGB_CIRCUIT,	"LUX",	EZO_RGB_OUT_LUX},
+	{ EZO_RGB_CIRCUIT,	"CIE",	EZO_RGB_OUT_CIE}
+};
+
+static ezo_circuit_type circuitFor(const char *type) {
+	if ( ! strcmp(type,"do") )	return EZO_DO_CIRCUIT;
+	if ( ! strcmp(type,"ec") )	return EZO_EC_CIRCUIT;
+	if ( ! strcmp(type,"orp") )	return EZO_ORP_CIRCUIT;
+	if ( ! strcmp(type,"ph") )	return EZO_PH_CIRCUIT;
+	if ( ! strcmp(type,"rgb") )	return EZO_RGB_CIRCUIT;
+	return EZO_UNKNOWN_CIRCUIT;
+}
+
+static int outputsFor(const ezo_circuit_type circuit, char *list) {
+	int outputs = 0;
+	for ( char *name = strtok(list,",") ; name ; name = strtok(NULL,",") ) {
+		bool found = false;
+		for ( size_t i = 0 ; i < sizeof(OUTPUT_NAMES) / sizeof(OUTPUT_NAMES[0]) ; i++ ) {
+			if ( OUTPUT_NAMES[i].circuit != circuit || strcasecmp(OUTPUT_NAMES[i].name,name) ) continue;
+			outputs |= OUTPUT_NAMES[i].output;
+			found = true;
+		}
+		if ( ! found ) { fprintf(stderr,"unknown output %s\n",name); return -1;}
+	}
+	return outputs;
+}
+
+static int usage() {
+	fprintf(stderr,"atlas_decode <ec|do|ph|orp|rgb> <log> [outputs] [csv]\n");
+	return 2;
+}
+
+int main(int argc, char **argv) {
+	if ( argc < 3 ) return usage();
+	ezo_circuit_type circuit = circuitFor(argv[1]);
+	if ( circuit == EZO_UNKNOWN_CIRCUIT ) return usage();
+	bool csv = false;
+	int outputs = 0xFF;
+	for ( int i = 3 ; i < argc ; i++ ) {
+		if ( ! strcmp(argv[i],"csv") ) csv = true;
+		else if ( ( outputs = outputsFor(circuit,argv[i]) ) < 0 ) return usage();
+	}
+	AtlasLogDecoder log;
+	if ( ! log.open(argv[2]) ) { perror(argv[2]); return 1;}
+	if ( ! log.setLayout(circuit,outputs) ) return usage();
+	struct timespec start, stop;
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	uint32_t rows = log.decode();
+	clock_gettime(CLOCK_MONOTONIC,&stop);
+	double seconds = ( stop.tv_sec - start.tv_sec ) + ( stop.tv_nsec - start.tv_nsec ) / 1e9;
+	const float *columns[EZO_MAX_CHANNELS];
+	for ( uint8_t channel = 0 ; channel < EZO_MAX_CHANNELS ; channel++ ) columns[channel] = log.getColumn(channel);
+	if ( csv ) {
+		for ( uint32_t row = 0 ; row < rows ; row++ ) {
+			const char *separator = "";
+			for ( uint8_t channel = 0 ; channel < EZO_MAX_CHANNELS ; channel++ ) {
+				if ( ! columns[channel] ) continue;
+				printf("%s%g",separator,columns[channel][row]);
+				separator = ",";
+			}
+			printf("\n");
+		}
+		return 0;
+	}
+	printf("%u rows, %u rejected, %u events, %.1f MB in %.3f s (%.0f MB/s)\n",rows,log.getRejected(),log.getEvents(),
+		log.getSize() / 1e6,seconds,seconds > 0 ? log.getSize() / 1e6 / seconds : 0.0);
+	for ( uint8_t channel = 0 ; channel < EZO_MAX_CHANNELS && rows ; channel++ ) {
+		if ( ! columns[channel] ) continue;
+		double sum = 0.0;
+		float low = columns[channel][0], high = columns[channel][0];
+		for ( uint32_t row = 0 ; row < rows ; row++ ) {
+			float value = columns[channel][row];
+			sum += value;
+			if ( value < low ) low = value;
+			if ( value > high ) high = value;
+		}
+		printf("channel %u: min %g mean %g max %g\n",channel,low,sum / rows,high);
+	}
+	return 0;
+}
@@ -0,0 +1,309 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	
+	Find how often a layout of circuits can be read, before building it.
+	Each port runs on a virtual clock against simulated circuits, through
+	the real drivers and AtlasScheduler. Reply times, wire time at each
+	baud rate, the wait for "*OK" and mux switches all count.
+	
+	atlas_plan [-t minutes] [-m mux ms] [-l miss %] [-s] <port> ...
+	
+	port	[<baud>:]<circuit>[,<circuit>...]	more than one circuit is a mux
+	circuit	<ec|do|ph|orp|rgb>[@<baud>][/<period ms>]
+	
+	-t	virtual time each trial is measured over, default 60 minutes
+	-m	time to switch the mux channel, default 5 ms
+	-l	misses allowed, % of the readings due, default 0
+	-s	circuits sleep between readings where it pays (setAutoSleep())
+	
+	For each port it finds the shortest period all its circuits can be
+	read at without more misses than allowed. Circuits given a period keep
+	their ratios, the rest run with the fastest. It prints that period and,
+	for each circuit at it, readings, misses, worst start delay and reading
+	time, and how busy the port was. With periods given it does the same
+	at exactly those periods.
+	
+	The ports are independent, so each is planned on its own. I2C buses
+	can't be planned yet, as the drivers only talk serial.
+============================================================================*/
+#include <AtlasScheduler.h>
+#include <AtlasVirtualClock.h>
+#include <AtlasSimEZO.h>
+#include <Atlas_EZO_DO.h>
+#include <Atlas_EZO_EC.h>
+#include <Atlas_EZO_ORP.h>
+#include <Atlas_EZO_PH.h>
+#include <Atlas_EZO_RGB.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <ctype.h>
+
+#define ATLAS_PLAN_MAX_PORTS	16
+#define ATLAS_PLAN_WARM_UP		60000 // ms before measuring, while reading times are learned
+#define ATLAS_PLAN_MAX_PERIOD	3600000 // ms, give up beyond this
+
+struct plan_circuit {
+	char			type[4];
+	uint32_t		baud;
+	uint32_t		period; // asked for, 0: as fast as it goes
+	AtlasSimEZO *	sim;
+	EZO *			sensor;
+};
+
+struct plan_port {
+	AtlasVirtualClock	clock;
+	plan_circuit	circuits[ATLAS_SCHED_MAX_TASKS];
+	uint8_t			count;
+	uint32_t		mux_ms;
+	uint32_t		switches;
+};
+
+struct plan_result {
+	uint32_t		period[ATLAS_SCHED_MAX_TASKS];
+	uint32_t		runs[ATLAS_SCHED_MAX_TASKS];
+	uint32_t		missed[ATLAS_SCHED_MAX_TASKS];
+	float			miss_rate[ATLAS_SCHED_MAX_TASKS]; // % of the readings due
+	uint16_t		max_lateness[ATLAS_SCHED_MAX_TASKS];
+	uint16_t		duration[ATLAS_SCHED_MAX_TASKS];
+	float			current[ATLAS_SCHED_MAX_TASKS]; // mA
+	float			worst; // miss %, worst circuit
+	float			busy; // % of the time the port was in use
+	uint8_t			estimate; // % AtlasScheduler expected
+	uint32_t		switches;
+};
+
+static uint32_t measure_ms = 3600000;
+static float miss_limit = 0.0;
+static bool auto_sleep = false;
+
+static EZO * sensorFor(const char *type) {
+	if ( ! strcmp(type,"do") )	return new EZO_DO;
+	if ( ! strcmp(type,"ec") )	return new EZO_EC;
+	if ( ! strcmp(type,"orp") )	return new EZO_ORP;
+	if ( ! strcmp(type,"ph") )	return new EZO_PH;
+	if ( ! strcmp(type,"rgb") )	return new EZO_RGB;
+	return NULL;
+}
+
+static int usage() {
+	fprintf(stderr,"atlas_plan [-t minutes] [-m mux ms] [-l miss %%] [-s] [<baud>:]<ec|do|ph|orp|rgb>[@<baud>][/<period ms>][,...] ...\n");
+	return 2;
+}
+
+static void onMux(const uint8_t, const uint8_t, void *context) {
+	plan_port *port = (plan_port *)context;
+	port->clock.delay(port->mux_ms);
+	port->switches++;
+}
+
+static bool addPort(plan_port *port, char *spec) {
+	uint32_t baud = 9600;
+	char *colon = strchr(spec,':');
+	if ( colon ) {
+		baud = atol(spec);
+		spec = colon + 1;
+	}
+	char *rest;
+	for ( char *item = strtok_r(spec,",",&rest) ; item ; item = strtok_r(NULL,",",&rest) ) { // the drivers use strtok()
+		if ( port->count >= ATLAS_SCHED_MAX_TASKS ) return false;
+		plan_circuit &c = port->circuits[port->count];
+		char *slash = strchr(item,'/');
+		c.period = slash ? atol(slash + 1) : 0;
+		if ( slash ) *slash = 0;
+		char *at = strchr(item,'@');
+		c.baud = at ? atol(at + 1) : baud;
+		if ( at ) *at = 0;
+		c.sensor = sensorFor(item);
+		if ( ! c.sensor || strlen(item) >= sizeof(c.type) ) return false;
+		for ( uint8_t i = 0 ; i <= strlen(item) ; i++ ) c.type[i] = toupper(item[i]);
+		c.sim = new AtlasSimEZO(&port->clock,c.type);
+		c.sensor->setClock(&port->clock);
+		c.sensor->begin(c.sim,c.baud);
+		c.sensor->initialize(); // on its own channel, so no mux yet
+		if ( ! c.sensor->connected() ) return false;
+		port->count++;
+	}
+	return port->count > 0;
+}
+
+static uint32_t periodOf(const plan_port *port, const uint8_t circuit, const uint32_t fastest) {
+	// Circuits given a period keep their ratios, with the shortest given one at fastest
+	uint32_t shortest = 0;
+	for ( uint8_t i = 0 ; i < port->count ; i++ ) {
+		uint32_t p = port->circuits[i].period;
+		if ( p && ( ! shortest || p < shortest ) ) shortest = p;
+	}
+	const plan_circuit &c = port->circuits[circuit];
+	if ( ! c.period ) return fastest;
+	return (uint32_t)( (uint64_t)c.period * fastest / shortest );
+}
+
+static void runFor(plan_port *port, AtlasScheduler &sched, const uint32_t ms) {
+	uint32_t end = port->clock.millis() + ms;
+	while ( ATLAS_TIME_DIFF(port->clock.millis(),end) < 0 ) {
+		sched.service();
+		port->clock.advanceTo(sched.getNextEvent());
+	}
+}
+
+static void settle(plan_port *port) {
+	// Leave every circuit awake and quiet for the next trial
+	for ( uint8_t i = 0 ; i < port->count ; i++ ) {
+		EZO *sensor = port->circuits[i].sensor;
+		sensor->setOnline();
+		while ( sensor->busy() && ! sensor->pollCommand() ) port->clock.advanceTo(sensor->getCommandDeadline());
+		if ( sensor->busy() ) sensor->finishCommand();
+	}
+	port->clock.advance(ATLAS_SIM_BOOT_TIME);
+	for ( uint8_t i = 0 ; i < port->count ; i++ ) {
+		port->circuits[i].sensor->flushSerial();
+		if ( port->circuits[i].sim->isAsleep() ) port->circuits[i].sensor->wake();
+	}
+}
+
+static void trial(plan_port *port, const uint32_t fastest, plan_result &result) {
+	AtlasScheduler sched;
+	sched.setClock(&port->clock);
+	sched.setMuxCallback(onMux,port);
+	sched.setAutoSleep(auto_sleep);
+	uint32_t longest = 0;
+	for ( uint8_t i = 0 ; i < port->count ; i++ ) {
+		result.period[i] = periodOf(port,i,fastest);
+		if ( result.period[i] > longest ) longest = result.period[i];
+		sched.addTask(port->circuits[i].sensor,result.period[i],0,port->count > 1 ? i : ATLAS_SCHED_NO_MUX);
+	}
+	runFor(port,sched,longest * 3 > ATLAS_PLAN_WARM_UP ? longest * 3 : ATLAS_PLAN_WARM_UP);
+	sched.resetStats();
+	uint32_t busy = 0;
+	for ( uint8_t i = 0 ; i < port->count ; i++ ) busy -= port->circuits[i].sim->getBusyMillis();
+	uint32_t switches = port->switches;
+	runFor(port,sched,measure_ms);
+	for ( uint8_t i = 0 ; i < port->count ; i++ ) busy += port->circuits[i].sim->getBusyMillis();
+	result.switches = port->switches - switches;
+	busy += result.switches * port->mux_ms;
+	result.busy = 100.0 * busy / measure_ms;
+	result.estimate = sched.getUtilization(0);
+	result.worst = 0.0;
+	for ( uint8_t i = 0 ; i < port->count ; i++ ) {
+		result.runs[i] = sched.getRuns(i);
+		result.missed[i] = sched.getMissed(i);
+		result.max_lateness[i] = sched.getMaxLateness(i);
+		result.duration[i] = sched.getDuration(i);
+		result.current[i] = sched.getAverageCurrent(i);
+		float due = (float)measure_ms / result.period[i];
+		result.miss_rate[i] = 100.0 * result.missed[i] / ( due > 1.0 ? due : 1.0 );
+		if ( result.miss_rate[i] > result.worst ) result.worst = result.miss_rate[i];
+	}
+	settle(port);
+}
+
+static bool fastest(plan_port *port, uint32_t &period, plan_result &result) {
+	// Double until it keeps up, then halve the gap to the last period that didn't
+	uint32_t expected = 0;
+	for ( uint8_t i = 0 ; i < port->count ; i++ ) expected += port->circuits[i].sensor->getCircuitType() == EZO_PH_CIRCUIT ? 900 : 600;
+	uint32_t fail = 0;
+	uint32_t pass = expected / 2;
+	for (;;) {
+		trial(port,pass,result);
+		if ( result.worst <= miss_limit ) break;
+		fail = pass;
+		pass *= 2;
+		if ( pass > ATLAS_PLAN_MAX_PERIOD ) return false;
+	}
+	if ( ! fail ) fail = pass / 2; // kept up at the first guess, look below it
+	while ( pass - fail > 1 && pass - fail > pass / 200 ) { // to 0.5 %
+		uint32_t middle = fail + ( pass - fail ) / 2;
+		trial(port,middle,result);
+		if ( result.worst <= miss_limit ) pass = middle;
+		else fail = middle;
+	}
+	period = pass;
+	trial(port,pass,result);
+	return true;
+}
+
+static void print(const plan_port *port, const plan_result &result) {
+	printf("  circuit baud    period ms readings missed      %% max late ms reading ms");
+	printf(auto_sleep ? " mA\n" : "\n");
+	float per_second = 0.0;
+	for ( uint8_t i = 0 ; i < port->count ; i++ ) {
+		const plan_circuit &c = port->circuits[i];
+		printf("  %-7s %-7u %9u %8u %6u %6.2f %11u %10u",c.type,c.baud,result.period[i],result.runs[i],result.missed[i],result.miss_rate[i],result.max_lateness[i],result.duration[i]);
+		if ( auto_sleep ) printf(" %.2f",result.current[i]);
+		printf("\n");
+		per_second += 1000.0 / result.period[i];
+	}
+	printf("  %.2f readings/s, port busy %.0f%% (scheduler expects %u%%)",per_second,result.busy,result.estimate);
+	if ( port->count > 1 ) printf(", %u mux switches",result.switches);
+	printf("\n");
+}
+
+int main(int argc, char **argv) {
+	uint32_t mux_ms = 5;
+	int opt;
+	while ( ( opt = getopt(argc,argv,"t:m:l:s") ) != -1 ) {
+		switch ( opt ) {
+			case 't':	measure_ms = atol(optarg) * 60000; break;
+			case 'm':	mux_ms = atol(optarg); break;
+			case 'l':	miss_limit = atof(optarg); break;
+			case 's':	auto_sleep = true; break;
+			default:	return usage();
+		}
+	}
+	if ( optind >= argc || argc - optind > ATLAS_PLAN_MAX_PORTS || ! measure_ms ) return usage();
+	for ( int arg = optind ; arg < argc ; arg++ ) {
+		int number = arg - optind;
+		if ( ! strncmp(argv[arg],"i2c",3) ) {
+			printf("port %d: I2C isn't supported by the drivers yet, skipped\n",number);
+			continue;
+		}
+		plan_port *port = new plan_port;
+		port->count = 0;
+		port->mux_ms = mux_ms;
+		port->switches = 0;
+		char spec[128];
+		strncpy(spec,argv[arg],sizeof(spec) - 1);
+		spec[sizeof(spec) - 1] = 0;
+		if ( ! addPort(port,spec) ) {
+			fprintf(stderr,"port %d: can't make sense of %s\n",number,argv[arg]);
+			return usage();
+		}
+		printf("port %d: %u circuit%s%s\n",number,port->count,port->count > 1 ? "s on a mux" : "",auto_sleep ? ", sleeping" : "");
+		bool given = false;
+		for ( uint8_t i = 0 ; i < port->count ; i++ ) given |= port->circuits[i].period != 0;
+		plan_result result;
+		uint32_t period;
+		if ( ! fastest(port,period,result) ) printf("  can't keep up at any period up to %u ms\n",ATLAS_PLAN_MAX_PERIOD);
+		else {
+			printf(" fastest, %.1f%% misses allowed:\n",miss_limit);
+			print(port,result);
+		}
+		if ( given ) {
+			uint32_t shortest = 0;
+			for ( uint8_t i = 0 ; i < port->count ; i++ ) {
+				uint32_t p = port->circuits[i].period;
+				if ( p && ( ! shortest || p < shortest ) ) shortest = p;
+			}
+			trial(port,shortest,result);
+			printf(" at the periods given:\n");
+			print(port,result);
+		}
+		fflush(stdout);
+	}
+	return 0;
+}
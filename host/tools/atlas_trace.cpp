@@ -0,0 +1,112 @@
+/*============================================================================
+Atlas Scientific sensor library code is placed under the GNU license
+Copyright (c) 2016 Ryan Neve <Ryan@PlanktosInstruments.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+	
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+	
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+	
+	Record a circuit's byte stream to a trace, or replay a trace through the
+	drivers without hardware.
+	
+	atlas_trace record <tty> <baud> <ec|do|ph|orp|rgb> <trace> [readings]
+	atlas_trace replay <trace> <ec|do|ph|orp|rgb> [speed] [readings]
+============================================================================*/
+#include <Atlas_EZO_DO.h>
+#include <Atlas_EZO_EC.h>
+#include <Atlas_EZO_ORP.h>
+#include <Atlas_EZO_PH.h>
+#include <Atlas_EZO_RGB.h>
+#include <AtlasTrace.h>
+#include <AtlasPosixSerial.h>
+#include <AtlasFileStream.h>
+
+static EZO_DO	DO_sensor;
+static EZO_EC	EC_sensor;
+static EZO_ORP	ORP_sensor;
+static EZO_PH	PH_sensor;
+static EZO_RGB	RGB_sensor;
+
+static EZO * sensorFor(const char *type) {
+	if ( ! strcmp(type,"do") )	return &DO_sensor;
+	if ( ! strcmp(type,"ec") )	return &EC_sensor;
+	if ( ! strcmp(type,"orp") )	return &ORP_sensor;
+	if ( ! strcmp(type,"ph") )	return &PH_sensor;
+	if ( ! strcmp(type,"rgb") )	return &RGB_sensor;
+	return NULL;
+}
+
+static void readOnce(EZO *sensor) {
+	if ( sensor == &DO_sensor ) {
+		DO_sensor.querySingleReading();
+		printf("DO %.2f mg/l  %.1f %%\n",DO_sensor.getDOx(),DO_sensor.getSat());
+	}
+	else if ( sensor == &EC_sensor ) {
+		EC_sensor.querySingleReading();
+		printf("EC %.2f  TDS %.1f  S %.2f  SG %.3f\n",EC_sensor.getEC(),EC_sensor.getTDS(),EC_sensor.getSAL(),EC_sensor.getSG());
+	}
+	else if ( sensor == &ORP_sensor ) {
+		ORP_sensor.querySingleReading();
+		printf("ORP %.1f\n",ORP_sensor.getORP());
+	}
+	else if ( sensor == &PH_sensor ) {
+		PH_sensor.querySingleReading();
+		printf("pH %.3f\n",PH_sensor.getPH());
+	}
+	else {
+		RGB_sensor.querySingleReading();
+		printf("RGB %d,%d,%d  lux %d\n",RGB_sensor.getRed(),RGB_sensor.getGreen(),RGB_sensor.getBlue(),RGB_sensor.getLux());
+	}
+}
+
+static int usage() {
+	fprintf(stderr,"atlas_trace record <tty> <baud> <ec|do|ph|orp|rgb> <trace> [readings]\n");
+	fprintf(stderr,"atlas_trace replay <trace> <ec|do|ph|orp|rgb> [speed] [readings]\n");
+	return 2;
+}
+
+int main(int argc, char **argv) {
+	if ( argc < 4 ) return usage();
+	unsigned long start = millis();
+	if ( ! strcmp(argv[1],"record") && argc >= 6 ) {
+		EZO * sensor = sensorFor(argv[4]);
+		if ( ! sensor ) return usage();
+		int readings = argc > 6 ? atoi(argv[6]) : 10;
+		AtlasPosixSerial port(argv[2]);
+		AtlasFileStream trace;
+		if ( ! trace.open(argv[5],"wb") ) { perror(argv[5]); return 1;}
+		AtlasTeeTransport tee(&port,&trace);
+		sensor->begin(&tee,atol(argv[3]));
+		if ( ! port.isOpen() ) return 1;
+		sensor->initialize();
+		for ( int i = 0 ; i < readings ; i++ ) readOnce(sensor);
+		tee.flushTrace();
+		trace.close();
+	}
+	else if ( ! strcmp(argv[1],"replay") ) {
+		EZO * sensor = sensorFor(argv[3]);
+		if ( ! sensor ) return usage();
+		AtlasFileStream trace;
+		if ( ! trace.open(argv[2],"rb") ) { perror(argv[2]); return 1;}
+		AtlasReplayTransport replay(&trace);
+		if ( ! replay.open() ) { fprintf(stderr,"%s is not a trace\n",argv[2]); return 1;}
+		replay.setSpeed(argc > 4 ? atof(argv[4]) : 1.0);
+		int readings = argc > 5 ? atoi(argv[5]) : -1; // default: until the trace runs out
+		sensor->begin(&replay,9600);
+		sensor->initialize();
+		for ( int i = 0 ; ( readings < 0 || i < readings ) && ! replay.done() ; i++ ) readOnce(sensor);
+		printf("mismatched TX bytes %u, unread RX bytes %u\n",replay.getMismatches(),replay.getDropped());
+	}
+	else return usage();
+	printf("elapsed %lu ms\n",millis() - start);
+	return 0;
+}